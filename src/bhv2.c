@@ -9,6 +9,7 @@
 
 #include "bhv2.h"
 #include "skip.h"
+#include "kernels.h"
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>    /* isdigit */
@@ -17,12 +18,12 @@
 #include <sys/stat.h> /* fstat */
 
 /************************************************************/
-/* Global error state
+/* Error state (per thread)
  */
 /************************************************************/
 
-bhv2_error_t bhv2_last_error = BHV2_OK;
-char bhv2_error_detail[256] = {0};
+_Thread_local bhv2_error_t bhv2_last_error = BHV2_OK;
+_Thread_local char bhv2_error_detail[256] = {0};
 
 const char* bhv2_strerror(bhv2_error_t err) {
     switch (err) {
@@ -238,28 +239,36 @@ void bhv2_file_free(bhv2_file_t *file) {
  */
 /************************************************************/
 
-static bhv2_value_t* read_numeric_array_posix(int file_descriptor, matlab_dtype_t dtype, uint64_t ndims, uint64_t *dims);
+/* Internal decode flag: the value sits below an AnalogData field */
+#define DECODE_IN_ANALOG  0x80000000u
+
+static bhv2_value_t* read_numeric_array_posix(int file_descriptor, matlab_dtype_t dtype, uint64_t ndims, uint64_t *dims, unsigned flags);
 static bhv2_value_t* read_char_array_posix(int file_descriptor, uint64_t ndims, uint64_t *dims);
-static bhv2_value_t* read_struct_array_posix(int file_descriptor, uint64_t ndims, uint64_t *dims);
-static bhv2_value_t* read_cell_array_posix(int file_descriptor, uint64_t ndims, uint64_t *dims);
-static bhv2_value_t* read_array_data_posix(int file_descriptor, matlab_dtype_t dtype, uint64_t ndims, uint64_t *dims);
+static bhv2_value_t* read_struct_array_posix(int file_descriptor, uint64_t ndims, uint64_t *dims, unsigned flags);
+static bhv2_value_t* read_struct_selective_posix(int file_descriptor, uint64_t ndims, uint64_t *dims,
+                                                  const char **wanted_fields, unsigned flags);
+static bhv2_value_t* read_cell_array_posix(int file_descriptor, uint64_t ndims, uint64_t *dims, unsigned flags);
+static bhv2_value_t* read_array_data_posix(int file_descriptor, matlab_dtype_t dtype, uint64_t ndims, uint64_t *dims, unsigned flags);
 static int skip_array_data_posix(int file_descriptor, matlab_dtype_t dtype, uint64_t ndims, uint64_t *dims);
 
-bhv2_value_t* bhv2_read_value_posix(int file_descriptor) {
+/* Read a value header: [dtype_len][dtype][ndims][dims]
+ * On success *dims_out is allocated (caller frees) */
+static int read_value_header_posix(int file_descriptor, matlab_dtype_t *dtype_out,
+                                   uint64_t *ndims_out, uint64_t **dims_out) {
     /* Read dtype */
     uint64_t dtype_len;
     if (read_uint64_posix(file_descriptor, &dtype_len) < 0) {
-        return NULL;
+        return -1;
     }
 
     if (dtype_len > BHV2_MAX_TYPE_LENGTH) {
         set_error(BHV2_ERR_FORMAT, "Type name too long");
-        return NULL;
+        return -1;
     }
 
     char *dtype_string = read_string_posix(file_descriptor, dtype_len);
     if (!dtype_string) {
-        return NULL;
+        return -1;
     }
 
     matlab_dtype_t dtype = matlab_dtype_from_string(dtype_string);
@@ -267,34 +276,48 @@ bhv2_value_t* bhv2_read_value_posix(int file_descriptor) {
 
     if (dtype == MATLAB_UNKNOWN) {
         set_error(BHV2_ERR_FORMAT, "Unknown dtype");
-        return NULL;
+        return -1;
     }
 
     /* Read dimensions */
     uint64_t ndims;
     if (read_uint64_posix(file_descriptor, &ndims) < 0) {
-        return NULL;
+        return -1;
     }
 
     if (ndims > BHV2_MAX_NDIMS) {
         set_error(BHV2_ERR_FORMAT, "Too many dimensions");
-        return NULL;
+        return -1;
     }
 
     uint64_t *dims = malloc(ndims * sizeof(uint64_t));
     if (!dims) {
         set_error(BHV2_ERR_MEMORY, "Failed to allocate dims");
-        return NULL;
+        return -1;
     }
 
     if (read(file_descriptor, dims, ndims * sizeof(uint64_t)) != (ssize_t)(ndims * sizeof(uint64_t))) {
         free(dims);
         set_error(BHV2_ERR_IO, "Failed to read dims");
+        return -1;
+    }
+
+    *dtype_out = dtype;
+    *ndims_out = ndims;
+    *dims_out = dims;
+    return 0;
+}
+
+bhv2_value_t* bhv2_read_value_posix(int file_descriptor, unsigned flags) {
+    matlab_dtype_t dtype;
+    uint64_t ndims;
+    uint64_t *dims;
+    if (read_value_header_posix(file_descriptor, &dtype, &ndims, &dims) < 0) {
         return NULL;
     }
 
     /* Read array data */
-    bhv2_value_t *value = read_array_data_posix(file_descriptor, dtype, ndims, dims);
+    bhv2_value_t *value = read_array_data_posix(file_descriptor, dtype, ndims, dims, flags);
     free(dims);
 
     return value;
@@ -402,7 +425,95 @@ static int skip_array_data_posix(int file_descriptor, matlab_dtype_t dtype, uint
     return 0;
 }
 
-static bhv2_value_t* read_numeric_array_posix(int file_descriptor, matlab_dtype_t dtype, uint64_t ndims, uint64_t *dims) {
+/* Read a logical array as packed bits: bit i of word i/64 is element i.
+ * MATLAB stores one 0/1 byte per element; eight bytes become one output
+ * byte via a multiply that gathers each byte's low bit. */
+static bhv2_value_t* read_logical_packed_posix(int file_descriptor, uint64_t ndims, uint64_t *dims) {
+    bhv2_value_t *value = bhv2_value_new(MATLAB_LOGICAL, ndims, dims);
+    if (!value) return NULL;
+
+    uint64_t n_words = BHV2_BIT_WORDS(value->total);
+    uint64_t *bits = calloc(n_words ? n_words : 1, sizeof(uint64_t));
+    if (!bits) {
+        bhv2_value_free(value);
+        set_error(BHV2_ERR_MEMORY, "Failed to allocate bit array");
+        return NULL;
+    }
+    value->packed = true;
+    value->data.bits = bits;
+
+    /* Chunks are a multiple of 64 elements so each fills whole words */
+    uint8_t chunk[4096];
+    uint64_t done = 0;
+    while (done < value->total) {
+        uint64_t remaining = value->total - done;
+        size_t want = remaining < sizeof(chunk) ? (size_t)remaining : sizeof(chunk);
+        if (read(file_descriptor, chunk, want) != (ssize_t)want) {
+            bhv2_value_free(value);
+            set_error(BHV2_ERR_IO, "Failed to read logical array");
+            return NULL;
+        }
+        /* Zero the tail so the last partial group packs as zeros */
+        size_t padded = (want + 7) & ~(size_t)7;
+        memset(chunk + want, 0, padded - want);
+
+        uint8_t *out = (uint8_t*)bits + done / 8;
+        for (size_t i = 0; i < padded; i += 8) {
+            uint64_t group;
+            memcpy(&group, chunk + i, 8);
+            group = (group | (group >> 1) | (group >> 2) | (group >> 3) |
+                     (group >> 4) | (group >> 5) | (group >> 6) | (group >> 7)) & 0x0101010101010101ULL;
+            out[i / 8] = (uint8_t)((group * 0x0102040810204080ULL) >> 56);
+        }
+        done += want;
+    }
+
+    return value;
+}
+
+/* Read a double array as single. The doubles pass through a small chunk
+ * buffer, so only the floats are ever held whole; the conversion is a
+ * dispatched kernel (kernel_double_to_single()). */
+static bhv2_value_t* read_double_as_single_posix(int file_descriptor, uint64_t ndims, uint64_t *dims) {
+    bhv2_value_t *value = bhv2_value_new(MATLAB_SINGLE, ndims, dims);
+    if (!value) return NULL;
+
+    float *out = malloc(value->total * sizeof(float));
+    if (!out) {
+        bhv2_value_free(value);
+        set_error(BHV2_ERR_MEMORY, "Failed to allocate array data");
+        return NULL;
+    }
+    value->data.f = out;
+
+    double chunk[1024];
+    uint64_t done = 0;
+    while (done < value->total) {
+        uint64_t remaining = value->total - done;
+        size_t want = remaining < 1024 ? (size_t)remaining : 1024;
+        if (read(file_descriptor, chunk, want * sizeof(double)) != (ssize_t)(want * sizeof(double))) {
+            bhv2_value_free(value);
+            set_error(BHV2_ERR_IO, "Failed to read array data");
+            return NULL;
+        }
+        kernel_double_to_single(chunk, want, out + done);
+        done += want;
+    }
+
+    return value;
+}
+
+static bhv2_value_t* read_numeric_array_posix(int file_descriptor, matlab_dtype_t dtype, uint64_t ndims, uint64_t *dims, unsigned flags) {
+    if (dtype == MATLAB_LOGICAL && (flags & BHV2_DECODE_PACK_LOGICAL)) {
+        return read_logical_packed_posix(file_descriptor, ndims, dims);
+    }
+    if (dtype == MATLAB_DOUBLE && (flags & BHV2_DECODE_SINGLE) && (flags & DECODE_IN_ANALOG)) {
+        /* Scalars stay double: trial metadata and timestamps need it and save nothing */
+        uint64_t total = 1;
+        for (uint64_t i = 0; i < ndims; i++) total *= dims[i];
+        if (total > 1) return read_double_as_single_posix(file_descriptor, ndims, dims);
+    }
+
     bhv2_value_t *value = bhv2_value_new(dtype, ndims, dims);
     if (!value) return NULL;
 
@@ -471,7 +582,14 @@ static bhv2_value_t* read_char_array_posix(int file_descriptor, uint64_t ndims,
     return value;
 }
 
-static bhv2_value_t* read_struct_array_posix(int file_descriptor, uint64_t ndims, uint64_t *dims) {
+/* Decode flags for a struct field's value: BHV2_DECODE_SINGLE only takes
+ * effect below an AnalogData field */
+static unsigned field_flags(const char *field_name, unsigned flags) {
+    if (strcmp(field_name, "AnalogData") == 0) flags |= DECODE_IN_ANALOG;
+    return flags;
+}
+
+static bhv2_value_t* read_struct_array_posix(int file_descriptor, uint64_t ndims, uint64_t *dims, unsigned flags) {
     bhv2_value_t *value = bhv2_value_new(MATLAB_STRUCT, ndims, dims);
     if (!value) return NULL;
     
@@ -518,7 +636,8 @@ static bhv2_value_t* read_struct_array_posix(int file_descriptor, uint64_t ndims
             }
             
             /* Read field value (recursive) - call bhv2_read_value_posix */
-            value->data.struct_array.fields[idx].value = bhv2_read_value_posix(file_descriptor);
+            value->data.struct_array.fields[idx].value =
+                bhv2_read_value_posix(file_descriptor, field_flags(value->data.struct_array.fields[idx].name, flags));
             if (!value->data.struct_array.fields[idx].value) {
                 bhv2_value_free(value);
                 return NULL;
@@ -529,14 +648,49 @@ static bhv2_value_t* read_struct_array_posix(int file_descriptor, uint64_t ndims
     return value;
 }
 
+/************************************************************/
+/* Match a field name against a selective-read field list.
+ * Returns 1 if the whole field is wanted, 0 if not wanted, and
+ * -1 if only nested paths are wanted ("AnalogData.Eye" for field
+ * "AnalogData"); *subpaths then receives the NULL-terminated list of
+ * remainders ("Eye"), which the caller frees (the strings are not copied).
+ */
+/************************************************************/
+static int match_wanted_field(const char *field_name, const char **wanted_fields, const char ***subpaths) {
+    *subpaths = NULL;
+    if (!wanted_fields) return 0;
+    
+    size_t name_len = strlen(field_name);
+    size_t n_nested = 0;
+    for (const char **w = wanted_fields; *w; w++) {
+        if (strcmp(*w, field_name) == 0) return 1;
+        if (strncmp(*w, field_name, name_len) == 0 && (*w)[name_len] == '.') n_nested++;
+    }
+    if (n_nested == 0) return 0;
+    
+    const char **list = malloc((n_nested + 1) * sizeof(char*));
+    if (!list) return 1;  /* Fall back to reading the whole field */
+    
+    size_t k = 0;
+    for (const char **w = wanted_fields; *w; w++) {
+        if (strncmp(*w, field_name, name_len) == 0 && (*w)[name_len] == '.') {
+            list[k++] = *w + name_len + 1;
+        }
+    }
+    list[k] = NULL;
+    *subpaths = list;
+    return -1;
+}
+
 /************************************************************/
 /* Read struct array selectively - only read specified fields, skip the rest.
- * wanted_fields is a NULL-terminated array of field names to read.
+ * wanted_fields is a NULL-terminated array of field names to read; a
+ * dotted path ("AnalogData.Eye") reads only that part of a nested struct.
  * Other fields are skipped (not allocated).
  */
 /************************************************************/
 static bhv2_value_t* read_struct_selective_posix(int file_descriptor, uint64_t ndims, uint64_t *dims,
-                                                  const char **wanted_fields) {
+                                                  const char **wanted_fields, unsigned flags) {
     bhv2_value_t *value = bhv2_value_new(MATLAB_STRUCT, ndims, dims);
     if (!value) return NULL;
     
@@ -583,24 +737,39 @@ static bhv2_value_t* read_struct_selective_posix(int file_descriptor, uint64_t n
             }
             
             /* Check if this field is wanted */
-            bool wanted = false;
-            if (wanted_fields) {
-                for (const char **w = wanted_fields; *w; w++) {
-                    if (strcmp(field_name, *w) == 0) {
-                        wanted = true;
-                        break;
-                    }
-                }
-            }
+            const char **subpaths;
+            int wanted = match_wanted_field(field_name, wanted_fields, &subpaths);
             
-            if (wanted) {
+            if (wanted > 0) {
                 /* Store name and read value */
                 value->data.struct_array.fields[idx].name = field_name;
-                value->data.struct_array.fields[idx].value = bhv2_read_value_posix(file_descriptor);
+                value->data.struct_array.fields[idx].value = bhv2_read_value_posix(file_descriptor, field_flags(field_name, flags));
                 if (!value->data.struct_array.fields[idx].value) {
                     bhv2_value_free(value);
                     return NULL;
                 }
+            } else if (wanted < 0) {
+                /* Only nested paths wanted - recurse into structs, read anything else whole */
+                value->data.struct_array.fields[idx].name = field_name;
+                matlab_dtype_t sub_dtype;
+                uint64_t sub_ndims;
+                uint64_t *sub_dims;
+                if (read_value_header_posix(file_descriptor, &sub_dtype, &sub_ndims, &sub_dims) < 0) {
+                    free(subpaths);
+                    bhv2_value_free(value);
+                    return NULL;
+                }
+                unsigned sub_flags = field_flags(field_name, flags);
+                bhv2_value_t *sub = (sub_dtype == MATLAB_STRUCT)
+                    ? read_struct_selective_posix(file_descriptor, sub_ndims, sub_dims, subpaths, sub_flags)
+                    : read_array_data_posix(file_descriptor, sub_dtype, sub_ndims, sub_dims, sub_flags);
+                free(sub_dims);
+                free(subpaths);
+                value->data.struct_array.fields[idx].value = sub;
+                if (!sub) {
+                    bhv2_value_free(value);
+                    return NULL;
+                }
             } else {
                 /* Skip this field - don't store name or value */
                 free(field_name);
@@ -617,7 +786,7 @@ static bhv2_value_t* read_struct_selective_posix(int file_descriptor, uint64_t n
     return value;
 }
 
-static bhv2_value_t* read_cell_array_posix(int file_descriptor, uint64_t ndims, uint64_t *dims) {
+static bhv2_value_t* read_cell_array_posix(int file_descriptor, uint64_t ndims, uint64_t *dims, unsigned flags) {
     bhv2_value_t *value = bhv2_value_new(MATLAB_CELL, ndims, dims);
     if (!value) return NULL;
     
@@ -703,7 +872,7 @@ static bhv2_value_t* read_cell_array_posix(int file_descriptor, uint64_t ndims,
         }
         
         /* Read cell data */
-        value->data.cell_array[i] = read_array_data_posix(file_descriptor, cell_dtype, cell_ndims, cell_dims);
+        value->data.cell_array[i] = read_array_data_posix(file_descriptor, cell_dtype, cell_ndims, cell_dims, flags);
         free(cell_dims);
         
         if (!value->data.cell_array[i]) {
@@ -715,7 +884,7 @@ static bhv2_value_t* read_cell_array_posix(int file_descriptor, uint64_t ndims,
     return value;
 }
 
-static bhv2_value_t* read_array_data_posix(int file_descriptor, matlab_dtype_t dtype, uint64_t ndims, uint64_t *dims) {
+static bhv2_value_t* read_array_data_posix(int file_descriptor, matlab_dtype_t dtype, uint64_t ndims, uint64_t *dims, unsigned flags) {
     switch (dtype) {
         case MATLAB_DOUBLE:
         case MATLAB_SINGLE:
@@ -728,16 +897,16 @@ static bhv2_value_t* read_array_data_posix(int file_descriptor, matlab_dtype_t d
         case MATLAB_INT32:
         case MATLAB_INT64:
         case MATLAB_LOGICAL:
-            return read_numeric_array_posix(file_descriptor, dtype, ndims, dims);
+            return read_numeric_array_posix(file_descriptor, dtype, ndims, dims, flags);
             
         case MATLAB_CHAR:
             return read_char_array_posix(file_descriptor, ndims, dims);
             
         case MATLAB_STRUCT:
-            return read_struct_array_posix(file_descriptor, ndims, dims);
+            return read_struct_array_posix(file_descriptor, ndims, dims, flags);
             
         case MATLAB_CELL:
-            return read_cell_array_posix(file_descriptor, ndims, dims);
+            return read_cell_array_posix(file_descriptor, ndims, dims, flags);
             
         default:
             set_error(BHV2_ERR_FORMAT, "Unknown dtype");
@@ -795,6 +964,23 @@ bhv2_file_t* bhv2_open_stream(const char *path) {
     return file;
 }
 
+void bhv2_set_decode_flags(bhv2_file_t *file, unsigned flags) {
+    if (file) {
+        file->decode_flags = flags;
+    }
+}
+
+int bhv2_seek(bhv2_file_t *file, off_t pos) {
+    if (!file || pos < 0 || pos > file->file_size) return -1;
+    if (lseek(file->file_descriptor, pos, SEEK_SET) != pos) {
+        set_error(BHV2_ERR_IO, "Seek failed");
+        return -1;
+    }
+    file->current_pos = pos;
+    file->at_variable_data = false;
+    return 0;
+}
+
 int bhv2_read_next_variable_name(bhv2_file_t *file, char **name_out) {
     if (!file) return -1;
     
@@ -833,7 +1019,7 @@ bhv2_value_t* bhv2_read_variable_data(bhv2_file_t *file) {
         return NULL;
     }
     
-    bhv2_value_t *value = bhv2_read_value_posix(file->file_descriptor);
+    bhv2_value_t *value = bhv2_read_value_posix(file->file_descriptor, file->decode_flags);
     
     file->at_variable_data = false;
     file->current_pos = lseek(file->file_descriptor, 0, SEEK_CUR);
@@ -855,60 +1041,20 @@ bhv2_value_t* bhv2_read_variable_data_selective(bhv2_file_t *file, const char **
     
     int fd = file->file_descriptor;
     
-    /* Read dtype */
-    uint64_t dtype_len;
-    if (read_uint64_posix(fd, &dtype_len) < 0) {
-        return NULL;
-    }
-    
-    if (dtype_len > BHV2_MAX_TYPE_LENGTH) {
-        set_error(BHV2_ERR_FORMAT, "Type name too long");
-        return NULL;
-    }
-    
-    char *dtype_string = read_string_posix(fd, dtype_len);
-    if (!dtype_string) {
-        return NULL;
-    }
-    
-    matlab_dtype_t dtype = matlab_dtype_from_string(dtype_string);
-    free(dtype_string);
-    
-    if (dtype == MATLAB_UNKNOWN) {
-        set_error(BHV2_ERR_FORMAT, "Unknown dtype");
-        return NULL;
-    }
-    
-    /* Read dimensions */
+    matlab_dtype_t dtype;
     uint64_t ndims;
-    if (read_uint64_posix(fd, &ndims) < 0) {
-        return NULL;
-    }
-    
-    if (ndims > BHV2_MAX_NDIMS) {
-        set_error(BHV2_ERR_FORMAT, "Too many dimensions");
-        return NULL;
-    }
-    
-    uint64_t *dims = malloc(ndims * sizeof(uint64_t));
-    if (!dims) {
-        set_error(BHV2_ERR_MEMORY, "Failed to allocate dims");
-        return NULL;
-    }
-    
-    if (read(fd, dims, ndims * sizeof(uint64_t)) != (ssize_t)(ndims * sizeof(uint64_t))) {
-        free(dims);
-        set_error(BHV2_ERR_IO, "Failed to read dims");
+    uint64_t *dims;
+    if (read_value_header_posix(fd, &dtype, &ndims, &dims) < 0) {
         return NULL;
     }
     
     /* For structs, use selective reader; otherwise fall back to full read */
     bhv2_value_t *value;
     if (dtype == MATLAB_STRUCT) {
-        value = read_struct_selective_posix(fd, ndims, dims, wanted_fields);
+        value = read_struct_selective_posix(fd, ndims, dims, wanted_fields, file->decode_flags);
     } else {
         /* Non-struct: read fully (shouldn't happen for trials) */
-        value = read_array_data_posix(fd, dtype, ndims, dims);
+        value = read_array_data_posix(fd, dtype, ndims, dims, file->decode_flags);
     }
     
     free(dims);
@@ -1025,7 +1171,9 @@ double bhv2_get_double(bhv2_value_t *value, uint64_t index) {
         case MATLAB_INT16:   return (double)value->data.i16[index];
         case MATLAB_INT32:   return (double)value->data.i32[index];
         case MATLAB_INT64:   return (double)value->data.i64[index];
-        case MATLAB_LOGICAL: return value->data.logical[index] ? 1.0 : 0.0;
+        case MATLAB_LOGICAL:
+            if (value->packed) return (double)((value->data.bits[index / 64] >> (index % 64)) & 1);
+            return value->data.logical[index] ? 1.0 : 0.0;
         default: return 0.0;
     }
 }
@@ -23,6 +23,13 @@
 #define BHV2_MAX_NDIMS         100
 #define BHV2_MAX_FIELDS        1000
 
+/* Decode options (bhv2_set_decode_flags) */
+#define BHV2_DECODE_PACK_LOGICAL  0x1   /* Logical arrays as packed bits */
+#define BHV2_DECODE_SINGLE        0x2   /* AnalogData double arrays (not scalars) as single */
+
+/* 64-bit words needed for n packed bits */
+#define BHV2_BIT_WORDS(n)      (((n) + 63) / 64)
+
 /************************************************************/
 /* Data types
  */
@@ -64,6 +71,7 @@ struct bhv2_value {
     uint64_t ndims;
     uint64_t *dims;         /* Array of dimension sizes */
     uint64_t total;         /* Total number of elements */
+    bool packed;            /* Logical stored as bits (data.bits) */
     
     union {
         double *d;          /* double array */
@@ -77,6 +85,7 @@ struct bhv2_value {
         int32_t *i32;
         int64_t *i64;
         bool *logical;
+        uint64_t *bits;     /* packed logical: element i is bit i%64 of word i/64 */
         char *string;       /* char array (null-terminated string) */
         
         /* Struct array: array of field arrays */
@@ -112,6 +121,7 @@ typedef struct {
     off_t file_size;         /* Total file size */
     off_t current_pos;       /* Current read position */
     bool at_variable_data;   /* Are we positioned at variable data? */
+    unsigned decode_flags;   /* BHV2_DECODE_* options for value reads */
 } bhv2_file_t;
 
 /************************************************************/
@@ -130,9 +140,9 @@ typedef enum {
 /* Get human-readable error message */
 const char* bhv2_strerror(bhv2_error_t err);
 
-/* Last error (thread-local in future) */
-extern bhv2_error_t bhv2_last_error;
-extern char bhv2_error_detail[256];
+/* Last error of the calling thread */
+extern _Thread_local bhv2_error_t bhv2_last_error;
+extern _Thread_local char bhv2_error_detail[256];
 
 /************************************************************/
 /* Type utilities
@@ -173,6 +183,15 @@ void bhv2_file_free(bhv2_file_t *file);
 /* Open BHV2 file for streaming */
 bhv2_file_t* bhv2_open_stream(const char *path);
 
+/* Set BHV2_DECODE_* options used by subsequent reads */
+void bhv2_set_decode_flags(bhv2_file_t *file, unsigned flags);
+
+/* Move to pos, which must be the start of a variable (an offset from
+ * bhv2_file_t.current_pos before a bhv2_read_next_variable_name() call).
+ * Returns 0 on success, -1 on error.
+ */
+int bhv2_seek(bhv2_file_t *file, off_t pos);
+
 /* Read next variable name (returns 0 on success, -1 on EOF/error)
  * Caller must free returned name with free()
  */
@@ -184,7 +203,8 @@ int bhv2_read_next_variable_name(bhv2_file_t *file, char **name_out);
 bhv2_value_t* bhv2_read_variable_data(bhv2_file_t *file);
 
 /* Read variable data selectively (only specified struct fields)
- * wanted_fields: NULL-terminated array of field names to read
+ * wanted_fields: NULL-terminated array of field names to read; dotted
+ *                paths ("AnalogData.Eye") read part of a nested struct
  * Caller must free returned value with bhv2_value_free()
  */
 bhv2_value_t* bhv2_read_variable_data_selective(bhv2_file_t *file, const char **wanted_fields);
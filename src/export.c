@@ -0,0 +1,252 @@
+/*
+ * export.c - Export trial fields to other formats (-e)
+ */
+
+#define _POSIX_C_SOURCE 200809L  /* For strdup */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "export.h"
+#include "matfile.h"
+#include "json.h"
+#include "macros/plot.h"
+
+/************************************************************/
+/* Helpers
+ */
+/************************************************************/
+
+/* Value at a dotted path in a trial struct (NULL if absent) */
+static bhv2_value_t* field_value(bhv2_value_t *trial, const char *path) {
+    bhv2_value_t *value = trial;
+    const char *part = path;
+    char name[BHV2_MAX_NAME_LENGTH + 1];
+    while (value && *part) {
+        const char *dot = strchr(part, '.');
+        size_t len = dot ? (size_t)(dot - part) : strlen(part);
+        if (len > BHV2_MAX_NAME_LENGTH) return NULL;
+        memcpy(name, part, len);
+        name[len] = '\0';
+        value = bhv2_struct_get(value, name, 0);
+        part = dot ? dot + 1 : part + len;
+    }
+    return value;
+}
+
+static size_t count_fields(const char **fields) {
+    size_t n = 0;
+    while (fields && fields[n]) n++;
+    return n;
+}
+
+/* "<dir>/<stem><suffix>" (caller frees) */
+static char* output_path(const char *input_path, const char *output_dir, const char *suffix) {
+    char stem[256];
+    plot_output_stem(input_path, stem, sizeof(stem));
+    const char *dir = output_dir ? output_dir : ".";
+    size_t len = strlen(dir) + 1 + strlen(stem) + strlen(suffix) + 1;
+    char *path = malloc(len);
+    if (path) snprintf(path, len, "%s/%s%s", dir, stem, suffix);
+    return path;
+}
+
+/* Trial metadata, one entry per kept trial */
+typedef struct {
+    double *trial, *condition, *error, *block;
+    size_t count;
+    size_t capacity;
+} export_meta_t;
+
+static int meta_append(export_meta_t *meta, ml_trial_file_t *file) {
+    if (meta->count >= meta->capacity) {
+        size_t cap = meta->capacity == 0 ? 256 : meta->capacity * 2;
+        double **cols[4] = { &meta->trial, &meta->condition, &meta->error, &meta->block };
+        for (int c = 0; c < 4; c++) {
+            double *grown = realloc(*cols[c], cap * sizeof(double));
+            if (!grown) return -1;
+            *cols[c] = grown;
+        }
+        meta->capacity = cap;
+    }
+    meta->trial[meta->count] = trial_number(file);
+    meta->condition[meta->count] = trial_condition(file);
+    meta->error[meta->count] = trial_error(file);
+    meta->block[meta->count] = trial_block(file);
+    meta->count++;
+    return 0;
+}
+
+static void meta_free(export_meta_t *meta) {
+    free(meta->trial);
+    free(meta->condition);
+    free(meta->error);
+    free(meta->block);
+}
+
+/************************************************************/
+/* MAT v5
+ */
+/************************************************************/
+
+static int export_mat(ml_trial_file_t *file, const char *path, const char **fields) {
+    size_t n_fields = count_fields(fields);
+
+    /* Struct field names: dots become underscores */
+    char **names = calloc(n_fields ? n_fields : 1, sizeof(char*));
+    if (!names) return -1;
+    for (size_t f = 0; f < n_fields; f++) {
+        names[f] = strdup(fields[f]);
+        if (!names[f]) break;
+        for (char *p = names[f]; *p; p++) {
+            if (*p == '.') *p = '_';
+        }
+    }
+
+    int status = -1;
+    export_meta_t meta = {0};
+    mat_file_t *mat = NULL;
+    for (size_t f = 0; f < n_fields; f++) {
+        if (!names[f]) goto done;
+    }
+
+    mat = mat_create(path);
+    if (!mat) {
+        fprintf(stderr, "Error: Cannot write %s\n", path);
+        goto done;
+    }
+
+    if (n_fields > 0 && mat_begin_struct_array(mat, "data", (const char**)names, n_fields) != 0) goto done;
+
+    int read;
+    while ((read = read_next_trial(file, SELECT_DATA)) > 0) {
+        if (meta_append(&meta, file) != 0) goto done;
+        for (size_t f = 0; f < n_fields; f++) {
+            if (mat_write_field(mat, field_value(trial_data(file), fields[f])) != 0) goto done;
+        }
+    }
+    if (read < 0) goto done;
+
+    if (n_fields > 0 && mat_end_struct_array(mat) != 0) goto done;
+    if (mat_write_doubles(mat, "Trial", meta.trial, meta.count) != 0
+        || mat_write_doubles(mat, "Condition", meta.condition, meta.count) != 0
+        || mat_write_doubles(mat, "TrialError", meta.error, meta.count) != 0
+        || mat_write_doubles(mat, "Block", meta.block, meta.count) != 0) {
+        goto done;
+    }
+    status = 0;
+
+done:
+    if (mat && mat_close(mat) != 0) status = -1;
+    if (status != 0 && mat) remove(path);
+    meta_free(&meta);
+    for (size_t f = 0; f < n_fields; f++) free(names[f]);
+    free(names);
+    return status;
+}
+
+/************************************************************/
+/* JSON Lines
+ */
+/************************************************************/
+
+static int is_meta_name(const char *name) {
+    return strcmp(name, "Trial") == 0 || strcmp(name, "Condition") == 0
+        || strcmp(name, "TrialError") == 0 || strcmp(name, "Block") == 0;
+}
+
+/* One object per trial: metadata, then the projected fields as a tree */
+static int export_jsonl(ml_trial_file_t *file, FILE *fp) {
+    json_writer_t *json = json_writer_new(fp);
+    if (!json) return -1;
+
+    int read;
+    while ((read = read_next_trial(file, SELECT_DATA)) > 0) {
+        json_raw(json, "{\"Trial\":", 9);
+        json_int(json, trial_number(file));
+        json_raw(json, ",\"Condition\":", 13);
+        json_int(json, trial_condition(file));
+        json_raw(json, ",\"TrialError\":", 14);
+        json_int(json, trial_error(file));
+        json_raw(json, ",\"Block\":", 9);
+        json_int(json, trial_block(file));
+
+        bhv2_value_t *data = trial_data(file);
+        if (data && data->dtype == MATLAB_STRUCT && data->total == 1) {
+            for (uint64_t f = 0; f < data->data.struct_array.n_fields; f++) {
+                bhv2_struct_field_t *field = &data->data.struct_array.fields[f];
+                if (!field->name || is_meta_name(field->name)) continue;
+                json_raw(json, ",", 1);
+                json_key(json, field->name);
+                json_write_value(json, field->value);
+            }
+        }
+        json_raw(json, "}\n", 2);
+        if (json->failed) break;
+    }
+
+    int status = json_writer_free(json);
+    return read < 0 ? -1 : status;
+}
+
+/************************************************************/
+/* Public API
+ */
+/************************************************************/
+
+int export_format_known(const char *format) {
+    return format && (strcmp(format, "mat") == 0 || strcmp(format, "jsonl") == 0);
+}
+
+int run_export(const char *format, ml_trial_file_t *file, const char *input_path,
+               const char *output_dir, const char **fields) {
+    if (!export_format_known(format)) {
+        fprintf(stderr, "Error: Unknown export format: %s\n", format ? format : "(none)");
+        return -1;
+    }
+    int is_mat = strcmp(format, "mat") == 0;
+    int to_stdout = output_dir && strcmp(output_dir, "-") == 0;
+    if (to_stdout && is_mat) {
+        fprintf(stderr, "Error: -e mat cannot write to stdout\n");
+        return -1;
+    }
+    if (set_data_fields(file, fields) != 0) return -1;
+
+    if (to_stdout) return export_jsonl(file, stdout);
+
+    char *path = output_path(input_path, output_dir, is_mat ? ".mat" : ".jsonl");
+    char *tmp = output_path(input_path, output_dir, is_mat ? ".mat.tmp" : ".jsonl.tmp");
+    if (!path || !tmp) {
+        free(path);
+        free(tmp);
+        return -1;
+    }
+
+    /* Written aside and renamed into place, so the file is whole or absent */
+    int status;
+    if (is_mat) {
+        status = export_mat(file, tmp, fields);
+    } else {
+        FILE *fp = fopen(tmp, "w");
+        if (!fp) {
+            fprintf(stderr, "Error: Cannot write %s\n", tmp);
+            status = -1;
+        } else {
+            status = export_jsonl(file, fp);
+            if (fclose(fp) != 0) status = -1;
+            if (status != 0) remove(tmp);
+        }
+    }
+    if (status == 0 && rename(tmp, path) != 0) {
+        remove(tmp);
+        status = -1;
+    }
+    free(tmp);
+    if (status == 0) {
+        printf("Saved: %s\n", path);
+    } else {
+        fprintf(stderr, "Error: Export to %s failed\n", path);
+    }
+    free(path);
+    return status;
+}
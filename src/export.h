@@ -0,0 +1,36 @@
+/*
+ * export.h - Export trial fields to other formats (-e)
+ *
+ * Exports write one file per input with the trial metadata of every kept
+ * trial plus the fields chosen with --fields (dotted paths, e.g.
+ * "AnalogData.Eye,UserVars"), decoded with a SELECT_DATA projection so
+ * nothing else is read. Analog filters and resampling apply as usual.
+ *
+ *   mat     <stem>.mat, MATLAB v5: Trial, Condition, TrialError, Block
+ *           (N x 1 double) and, if fields were chosen, "data", an N x 1
+ *           struct array with one field per path ("AnalogData_Eye")
+ *   jsonl   <stem>.jsonl (or stdout with -O -), JSON Lines: one object
+ *           per trial with Trial, Condition, TrialError, Block and the
+ *           chosen fields as nested objects ({"AnalogData":{"Eye":...}});
+ *           see json.h for how values map to JSON
+ */
+
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include "ml_trial.h"
+
+/* True if format names a known export */
+int export_format_known(const char *format);
+
+/* Run an export
+ * format: "mat" or "jsonl"
+ * fields: NULL-terminated dotted paths, or NULL for metadata only
+ * output_dir: Directory for the output file (NULL for current dir, "-"
+ *             for stdout, jsonl only)
+ * Returns 0 on success, -1 on error.
+ */
+int run_export(const char *format, ml_trial_file_t *file, const char *input_path,
+               const char *output_dir, const char **fields);
+
+#endif /* EXPORT_H */
@@ -0,0 +1,431 @@
+/*
+ * filter.c - Signal conditioning for AnalogData channels
+ */
+
+#define _POSIX_C_SOURCE 200809L  /* For strdup, strcasecmp */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include "filter.h"
+#include "kernels.h"
+
+#define FILTER_MAX_HALF 1000    /* FIR windows are capped at 2001 samples */
+#define FILTER_RESAMPLE_ZEROS 8       /* Sinc zero crossings each side of the centre */
+#define FILTER_RESAMPLE_MAX_RATIO 64  /* Largest up or down factor after reduction */
+#define FILTER_PI    3.14159265358979323846
+#define FILTER_SQRT2 1.41421356237309504880
+
+/************************************************************/
+/* Chain setup
+ */
+/************************************************************/
+
+filter_chain_t* filter_chain_new(void) {
+    return calloc(1, sizeof(filter_chain_t));
+}
+
+void filter_chain_free(filter_chain_t *chain) {
+    if (!chain) return;
+    for (size_t i = 0; i < chain->n_rules; i++) {
+        free(chain->rules[i].channel);
+        free(chain->rules[i].ops);
+    }
+    free(chain->rules);
+    ml_analog_schema_free(chain->schema);
+    free(chain->scratch);
+    free(chain->resample_taps);
+    free(chain);
+}
+
+static int parse_op(const char *text, size_t len, filter_op_t *op) {
+    static const struct { const char *name; filter_op_kind_t kind; } names[] = {
+        {"lp", FILTER_LOWPASS},
+        {"sg", FILTER_SGOLAY},
+        {"sgd", FILTER_SGOLAY_DERIV},
+        {"med", FILTER_MEDIAN}
+    };
+
+    const char *eq = memchr(text, '=', len);
+    if (!eq) return -1;
+    size_t name_len = (size_t)(eq - text);
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strlen(names[i].name) == name_len && strncmp(text, names[i].name, name_len) == 0) {
+            char value[32];
+            size_t value_len = len - name_len - 1;
+            if (value_len == 0 || value_len >= sizeof(value)) return -1;
+            memcpy(value, eq + 1, value_len);
+            value[value_len] = '\0';
+
+            char *end;
+            op->kind = names[i].kind;
+            op->param = strtod(value, &end);
+            return (*end == '\0' && op->param > 0.0) ? 0 : -1;
+        }
+    }
+    return -1;
+}
+
+int filter_chain_parse(filter_chain_t *chain, const char *spec) {
+    const char *colon = strchr(spec, ':');
+    if (!colon || colon == spec || colon[1] == '\0') return -1;
+
+    filter_rule_t rule = {0};
+    rule.channel = strndup(spec, (size_t)(colon - spec));
+    if (!rule.channel) return -1;
+
+    /* Operations: comma-separated name=value */
+    size_t n_ops = 1;
+    for (const char *c = colon + 1; *c; c++) n_ops += (*c == ',');
+    rule.ops = calloc(n_ops, sizeof(filter_op_t));
+    if (!rule.ops) goto fail;
+
+    const char *start = colon + 1;
+    while (rule.n_ops < n_ops) {
+        const char *comma = strchr(start, ',');
+        size_t len = comma ? (size_t)(comma - start) : strlen(start);
+        if (parse_op(start, len, &rule.ops[rule.n_ops]) != 0) goto fail;
+        rule.n_ops++;
+        start += len + 1;
+    }
+
+    filter_rule_t *grown = realloc(chain->rules, (chain->n_rules + 1) * sizeof(filter_rule_t));
+    if (!grown) goto fail;
+    chain->rules = grown;
+    chain->rules[chain->n_rules++] = rule;
+    return 0;
+
+fail:
+    free(rule.channel);
+    free(rule.ops);
+    return -1;
+}
+
+filter_chain_t* filter_chain_copy(filter_chain_t *chain) {
+    if (!chain) return NULL;
+
+    filter_chain_t *copy = filter_chain_new();
+    if (!copy) return NULL;
+    copy->resample_hz = chain->resample_hz;
+    copy->origin = chain->origin ? chain->origin : chain;
+    copy->rules = calloc(chain->n_rules ? chain->n_rules : 1, sizeof(filter_rule_t));
+    if (!copy->rules) {
+        filter_chain_free(copy);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < chain->n_rules; i++) {
+        const filter_rule_t *rule = &chain->rules[i];
+        filter_rule_t *dst = &copy->rules[copy->n_rules++];
+        dst->channel = strdup(rule->channel);
+        dst->ops = malloc(rule->n_ops * sizeof(filter_op_t));
+        if (!dst->channel || !dst->ops) {
+            filter_chain_free(copy);
+            return NULL;
+        }
+        memcpy(dst->ops, rule->ops, rule->n_ops * sizeof(filter_op_t));
+        dst->n_ops = rule->n_ops;
+    }
+    return copy;
+}
+
+int filter_chain_set_resample(filter_chain_t *chain, double rate_hz) {
+    if (!chain || !(rate_hz > 0.0)) return -1;
+    chain->resample_hz = rate_hz;
+    chain->resample_from_hz = 0.0;  /* Design on next trial */
+    return 0;
+}
+
+/* True the first time a warning flag of chain (or of the chain it was
+ * copied from, or any other copy) is raised */
+static bool first_warning(filter_chain_t *chain, bool nyquist) {
+    filter_chain_t *root = chain->origin ? chain->origin : chain;
+    return !atomic_exchange(nyquist ? &root->warned_nyquist : &root->warned_resample, true);
+}
+
+/************************************************************/
+/* Operations on one column
+ */
+/************************************************************/
+
+/* Window of ms milliseconds as a half-width in samples (at least min_half) */
+static size_t window_half(double ms, double interval_ms, size_t min_half) {
+    double half = floor(ms / interval_ms / 2.0 + 0.5);
+    if (half > FILTER_MAX_HALF) half = FILTER_MAX_HALF;
+    return half < (double)min_half ? min_half : (size_t)half;
+}
+
+/* 2nd-order Butterworth low-pass run forward and backward over each
+ * finite stretch of x */
+static void apply_lowpass(double *x, size_t n, double cutoff_hz, double fs) {
+    double k = tan(FILTER_PI * cutoff_hz / fs);
+    double norm = 1.0 / (1.0 + FILTER_SQRT2 * k + k * k);
+    double b[3] = { k * k * norm, 2.0 * k * k * norm, k * k * norm };
+    double a[2] = { 2.0 * (k * k - 1.0) * norm, (1.0 - FILTER_SQRT2 * k + k * k) * norm };
+
+    size_t i = 0;
+    while (i < n) {
+        /* Skip non-finite samples, then take the finite run after them */
+        while (i < n && !isfinite(x[i])) i++;
+        size_t start = i;
+        while (i < n && isfinite(x[i])) i++;
+        size_t len = i - start;
+        if (len == 0) continue;
+
+        kernel_biquad(x + start, len, b, a);
+        kernel_reverse(x + start, len);
+        kernel_biquad(x + start, len, b, a);
+        kernel_reverse(x + start, len);
+    }
+}
+
+/* Savitzky-Golay coefficients for a quadratic fit over 2 * half + 1 samples:
+ * smoothing (deriv = 0) or first derivative per unit of dt (deriv = 1) */
+static void sgolay_coeffs(size_t half, int deriv, double dt, double *h) {
+    double m = (double)half;
+    if (deriv) {
+        double norm = 3.0 / (m * (m + 1.0) * (2.0 * m + 1.0) * dt);
+        for (size_t i = 0; i <= 2 * half; i++) {
+            h[i] = ((double)i - m) * norm;
+        }
+    } else {
+        double norm = 1.0 / ((2.0 * m - 1.0) * (2.0 * m + 1.0) * (2.0 * m + 3.0));
+        for (size_t i = 0; i <= 2 * half; i++) {
+            double k = (double)i - m;
+            h[i] = (3.0 * (3.0 * m * m + 3.0 * m - 1.0) - 15.0 * k * k) * norm;
+        }
+    }
+}
+
+static int ensure_scratch(filter_chain_t *chain, size_t len) {
+    if (chain->scratch_len >= len) return 0;
+    double *grown = realloc(chain->scratch, len * sizeof(double));
+    if (!grown) return -1;
+    chain->scratch = grown;
+    chain->scratch_len = len;
+    return 0;
+}
+
+static int apply_op(filter_chain_t *chain, const filter_op_t *op, double *x, size_t n,
+                    double interval_ms) {
+    double fs = 1000.0 / interval_ms;
+
+    if (op->kind == FILTER_LOWPASS) {
+        if (op->param < fs / 2.0) {
+            apply_lowpass(x, n, op->param, fs);
+        } else if (first_warning(chain, true)) {
+            fprintf(stderr, "Warning: Low-pass cutoff %g Hz is not below Nyquist (%g Hz); skipped\n",
+                    op->param, fs / 2.0);
+        }
+        return 0;
+    }
+
+    /* FIR and median filters: x -> scratch -> x; taps (or the median's
+     * sorted window) follow the samples */
+    size_t half = window_half(op->param, interval_ms, op->kind == FILTER_MEDIAN ? 1 : 2);
+    if (ensure_scratch(chain, n + 2 * half + 1) != 0) return -1;
+    double *out = chain->scratch;
+    double *taps = chain->scratch + n;
+
+    if (op->kind == FILTER_MEDIAN) {
+        kernel_median_filter(x, n, half, taps, out);
+    } else {
+        sgolay_coeffs(half, op->kind == FILTER_SGOLAY_DERIV, interval_ms / 1000.0, taps);
+        kernel_fir_centered(x, n, taps, half, out);
+    }
+    memcpy(x, out, n * sizeof(double));
+    return 0;
+}
+
+/************************************************************/
+/* Channel helpers
+ */
+/************************************************************/
+
+static bool rule_matches(const filter_rule_t *rule, const ml_analog_schema_t *schema,
+                         const ml_analog_channel_t *ch) {
+    return strcasecmp(rule->channel, ch->label) == 0 ||
+           strcasecmp(rule->channel, schema->field_names[ch->field]) == 0;
+}
+
+/* Convert a numeric channel to double in place */
+static int channel_to_double(bhv2_value_t *value) {
+    if (value->dtype == MATLAB_DOUBLE) return 0;
+
+    double *d = malloc(value->total * sizeof(double));
+    if (!d) return -1;
+    for (uint64_t i = 0; i < value->total; i++) {
+        d[i] = bhv2_get_double(value, i);
+    }
+    free(value->data.u8);  /* Any member: they share the one buffer */
+    value->data.d = d;
+    value->dtype = MATLAB_DOUBLE;
+    value->packed = false;
+    return 0;
+}
+
+/************************************************************/
+/* Resampling
+ */
+/************************************************************/
+
+static long gcd_long(long a, long b) {
+    while (b) {
+        long t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/* Windowed-sinc (Blackman) anti-aliasing filter for fs_in -> resample_hz.
+ * Returns 0 on success, 1 if the rates have no small integer ratio,
+ * -1 on allocation failure. */
+static int design_resampler(filter_chain_t *chain, double fs_in) {
+    if (chain->resample_from_hz == fs_in) return 0;
+
+    long in = lround(fs_in), out = lround(chain->resample_hz);
+    if (in <= 0 || out <= 0 || fabs(fs_in - in) > 1e-6 * fs_in ||
+        fabs(chain->resample_hz - out) > 1e-6 * chain->resample_hz) {
+        return 1;
+    }
+    long g = gcd_long(in, out);
+    size_t up = (size_t)(out / g), down = (size_t)(in / g);
+    if (up > FILTER_RESAMPLE_MAX_RATIO || down > FILTER_RESAMPLE_MAX_RATIO) return 1;
+
+    size_t widest = up > down ? up : down;
+    size_t half = FILTER_RESAMPLE_ZEROS * widest;
+    double *h = realloc(chain->resample_taps, (2 * half + 1) * sizeof(double));
+    if (!h) return -1;
+    chain->resample_taps = h;
+
+    /* Cutoff at the lower of the two Nyquist rates, in upsampled samples */
+    double fc = 1.0 / (double)widest;
+    double sum = 0.0;
+    for (size_t k = 0; k <= 2 * half; k++) {
+        double t = (double)k - (double)half;
+        double sinc = t == 0.0 ? 1.0 : sin(FILTER_PI * fc * t) / (FILTER_PI * fc * t);
+        double w = 0.42 - 0.5 * cos(FILTER_PI * k / half) + 0.08 * cos(2.0 * FILTER_PI * k / half);
+        h[k] = sinc * w;
+        sum += h[k];
+    }
+    for (size_t k = 0; k <= 2 * half; k++) {
+        h[k] *= (double)up / sum;  /* Gain up makes up for the inserted zeros */
+    }
+
+    chain->resample_half = half;
+    chain->resample_up = up;
+    chain->resample_down = down;
+    chain->resample_from_hz = fs_in;
+    return 0;
+}
+
+/* Resample every channel to resample_hz and rewrite SampleInterval */
+static int resample_trial(filter_chain_t *chain, const ml_analog_schema_t *schema,
+                          bhv2_value_t *analog, double *interval_ms) {
+    double fs_in = 1000.0 / *interval_ms;
+    if (schema->interval_field < 0) {
+        if (first_warning(chain, false)) {
+            fprintf(stderr, "Warning: AnalogData has no SampleInterval; not resampled\n");
+        }
+        return 0;
+    }
+
+    int designed = design_resampler(chain, fs_in);
+    if (designed < 0) return -1;
+    if (designed > 0) {
+        if (first_warning(chain, false)) {
+            fprintf(stderr, "Warning: Cannot resample %g Hz to %g Hz (no small integer ratio); not resampled\n",
+                    fs_in, chain->resample_hz);
+        }
+        return 0;
+    }
+    size_t up = chain->resample_up, down = chain->resample_down;
+    if (up == down) return 0;
+
+    for (size_t c = 0; c < schema->n_channels; c++) {
+        bhv2_value_t *value = ml_analog_channel(schema, analog, c);
+        if (!value) continue;
+        if (channel_to_double(value) != 0) return -1;
+
+        size_t n = ml_analog_samples(value);
+        size_t n_cols = ml_analog_columns(value);
+        size_t n_out = kernel_resample_length(n, up, down);
+        double *out = malloc(n_out * n_cols * sizeof(double));
+        if (!out) return -1;
+
+        for (size_t j = 0; j < n_cols; j++) {
+            if (schema->channels[c].kind == ML_CH_BUTTON) {
+                kernel_resample_hold(value->data.d + j * n, n, up, down, out + j * n_out);
+            } else {
+                kernel_resample_poly(value->data.d + j * n, n, chain->resample_taps,
+                                     chain->resample_half, up, down, out + j * n_out);
+            }
+        }
+
+        free(value->data.d);
+        value->data.d = out;
+        value->dims[0] = n_out;
+        value->total = n_out * n_cols;
+    }
+
+    /* Keep the stored unit: seconds if the file used seconds */
+    bhv2_value_t *interval = analog->data.struct_array.fields[schema->interval_field].value;
+    if (interval && interval->total > 0 && channel_to_double(interval) == 0) {
+        bool seconds = interval->data.d[0] < 0.05;
+        interval->data.d[0] = (seconds ? 1.0 : 1000.0) / chain->resample_hz;
+    }
+    *interval_ms = 1000.0 / chain->resample_hz;
+    return 0;
+}
+
+/************************************************************/
+/* Trial application
+ */
+/************************************************************/
+
+int filter_chain_apply(filter_chain_t *chain, bhv2_value_t *trial) {
+    if (!chain || (chain->n_rules == 0 && chain->resample_hz <= 0.0) || !trial) return 0;
+
+    bhv2_value_t *analog = bhv2_struct_get(trial, "AnalogData", 0);
+    if (!analog || ml_analog_schema_update(&chain->schema, analog) != 0) return 0;
+    const ml_analog_schema_t *schema = chain->schema;
+    double interval_ms = ml_analog_interval_ms(schema, analog);
+
+    /* Resample first so the filters run at the output rate */
+    if (chain->resample_hz > 0.0 && resample_trial(chain, schema, analog, &interval_ms) != 0) {
+        return -1;
+    }
+
+    for (size_t c = 0; c < schema->n_channels; c++) {
+        const ml_analog_channel_t *ch = &schema->channels[c];
+        if (ch->kind == ML_CH_BUTTON) continue;  /* Digital */
+
+        bhv2_value_t *value = NULL;
+        for (size_t r = 0; r < chain->n_rules; r++) {
+            const filter_rule_t *rule = &chain->rules[r];
+            if (!rule_matches(rule, schema, ch)) continue;
+
+            if (!value) {
+                value = ml_analog_channel(schema, analog, c);
+                if (!value) break;  /* Empty in this trial */
+                if (channel_to_double(value) != 0) return -1;
+            }
+
+            size_t n = ml_analog_samples(value);
+            size_t n_cols = ml_analog_columns(value);
+            for (size_t op = 0; op < rule->n_ops; op++) {
+                for (size_t j = 0; j < n_cols; j++) {
+                    if (apply_op(chain, &rule->ops[op], value->data.d + j * n, n, interval_ms) != 0) {
+                        return -1;
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * filter.h - Signal conditioning for AnalogData channels
+ *
+ * A filter chain is a list of rules, each naming a channel and the
+ * operations to run on it in order:
+ *
+ *   eye:lp=30           Zero-phase Butterworth low-pass at 30 Hz
+ *   mouse:sg=25         Savitzky-Golay smoothing over a 25 ms window
+ *   eye:sgd=25          Savitzky-Golay first derivative (units per second)
+ *   general:med=5       Median filter over a 5 ms window (despiking)
+ *   eye:med=5,lp=30     Several operations, applied left to right
+ *
+ * Channels are matched case-insensitively by label ("Eye", "Gen1") or by
+ * AnalogData field ("General" selects every General.Gen<N>). Matching
+ * channels are converted to double and filtered in place, one column at
+ * a time, right after a trial is decoded (see set_filters()).
+ *
+ * NaN/Inf samples (blinks, touch released) are left as they are: the
+ * low-pass runs separately over each finite stretch, the FIR and median
+ * filters only spoil samples whose window contains one.
+ *
+ * The chain can also resample every channel to a common rate
+ * (filter_chain_set_resample()); that happens before the filters run.
+ */
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdatomic.h>
+#include "bhv2.h"
+#include "ml_analog.h"
+
+typedef enum {
+    FILTER_LOWPASS,         /* param: cutoff (Hz) */
+    FILTER_SGOLAY,          /* param: window (ms) */
+    FILTER_SGOLAY_DERIV,    /* param: window (ms) */
+    FILTER_MEDIAN           /* param: window (ms) */
+} filter_op_kind_t;
+
+typedef struct {
+    filter_op_kind_t kind;
+    double param;
+} filter_op_t;
+
+typedef struct {
+    char *channel;              /* As given on the command line */
+    filter_op_t *ops;
+    size_t n_ops;
+} filter_rule_t;
+
+typedef struct filter_chain {
+    filter_rule_t *rules;
+    size_t n_rules;
+
+    /* Working state, reused across trials */
+    ml_analog_schema_t *schema;
+    double *scratch;
+    size_t scratch_len;
+    atomic_bool warned_nyquist; /* Low-pass cutoff above fs/2 reported */
+
+    /* Resampling (resample_hz 0 for none); filter designed per input rate */
+    double resample_hz;
+    double resample_from_hz;    /* Input rate the taps were designed for */
+    double *resample_taps;
+    size_t resample_half;
+    size_t resample_up, resample_down;
+    atomic_bool warned_resample;
+
+    /* Chain this one was copied from; warnings are reported once for all copies */
+    struct filter_chain *origin;
+} filter_chain_t;
+
+/* Empty chain (NULL on allocation failure) */
+filter_chain_t* filter_chain_new(void);
+
+/* Free a chain and its rules */
+void filter_chain_free(filter_chain_t *chain);
+
+/* Same rules and resampling with fresh working state, for a chain used
+ * by another thread (NULL on allocation failure or if chain is NULL).
+ * chain must outlive the copy. */
+filter_chain_t* filter_chain_copy(filter_chain_t *chain);
+
+/* Add a rule from "<channel>:<op>=<value>[,<op>=<value>...]".
+ * Returns 0 on success, -1 on a malformed spec or allocation failure.
+ */
+int filter_chain_parse(filter_chain_t *chain, const char *spec);
+
+/* Resample every AnalogData channel to rate_hz before filtering. The ratio
+ * to the recorded rate must reduce to integers up to 64 (500 Hz, 1 kHz,
+ * 2 kHz, ... all do). Analog channels go through a polyphase windowed-sinc
+ * FIR, button channels are sample-and-hold; SampleInterval is rewritten.
+ * Returns 0 on success, -1 if rate_hz is not positive.
+ */
+int filter_chain_set_resample(filter_chain_t *chain, double rate_hz);
+
+/* Resample and filter the AnalogData channels of a decoded trial struct in place.
+ * Returns 0 on success (including trials without AnalogData), -1 on
+ * allocation failure.
+ */
+int filter_chain_apply(filter_chain_t *chain, bhv2_value_t *trial);
+
+#endif /* FILTER_H */
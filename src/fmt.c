@@ -0,0 +1,393 @@
+/*
+ * fmt.c - Number formatting without printf
+ *
+ * fmt_double() is Grisu2 (Loitsch, "Printing Floating-Point Numbers
+ * Quickly and Accurately with Integers", PLDI 2010): the value and its
+ * rounding boundaries are scaled by a cached power of ten into 64-bit
+ * fixed point, and digits are generated until the result is inside the
+ * boundaries, narrowed by one unit for the error of the scaling.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "fmt.h"
+
+/************************************************************/
+/* Integers
+ */
+/************************************************************/
+
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+size_t fmt_uint(char *buf, uint64_t value) {
+    char tmp[FMT_INT_MAX];
+    char *p = tmp + sizeof(tmp);
+    while (value >= 100) {
+        unsigned pair = (unsigned)(value % 100) * 2;
+        value /= 100;
+        *--p = digit_pairs[pair + 1];
+        *--p = digit_pairs[pair];
+    }
+    if (value >= 10) {
+        unsigned pair = (unsigned)value * 2;
+        *--p = digit_pairs[pair + 1];
+        *--p = digit_pairs[pair];
+    } else {
+        *--p = (char)('0' + value);
+    }
+    size_t len = (size_t)(tmp + sizeof(tmp) - p);
+    memcpy(buf, p, len);
+    return len;
+}
+
+size_t fmt_int(char *buf, int64_t value) {
+    if (value < 0) {
+        buf[0] = '-';
+        return 1 + fmt_uint(buf + 1, (uint64_t)0 - (uint64_t)value);
+    }
+    return fmt_uint(buf, (uint64_t)value);
+}
+
+/************************************************************/
+/* Grisu2
+ */
+/************************************************************/
+
+/* f * 2^e */
+typedef struct {
+    uint64_t f;
+    int e;
+} diy_fp_t;
+
+
+/* 10^k for k = -348, -340, ..., 340, normalized (top bit set) and
+ * rounded to nearest */
+static const struct {
+    uint64_t f;
+    int e;
+} cached_powers[87] = {
+    { UINT64_C(0xfa8fd5a0081c0288), -1220 }, { UINT64_C(0xbaaee17fa23ebf76), -1193 },
+    { UINT64_C(0x8b16fb203055ac76), -1166 }, { UINT64_C(0xcf42894a5dce35ea), -1140 },
+    { UINT64_C(0x9a6bb0aa55653b2d), -1113 }, { UINT64_C(0xe61acf033d1a45df), -1087 },
+    { UINT64_C(0xab70fe17c79ac6ca), -1060 }, { UINT64_C(0xff77b1fcbebcdc4f), -1034 },
+    { UINT64_C(0xbe5691ef416bd60c), -1007 }, { UINT64_C(0x8dd01fad907ffc3c),  -980 },
+    { UINT64_C(0xd3515c2831559a83),  -954 }, { UINT64_C(0x9d71ac8fada6c9b5),  -927 },
+    { UINT64_C(0xea9c227723ee8bcb),  -901 }, { UINT64_C(0xaecc49914078536d),  -874 },
+    { UINT64_C(0x823c12795db6ce57),  -847 }, { UINT64_C(0xc21094364dfb5637),  -821 },
+    { UINT64_C(0x9096ea6f3848984f),  -794 }, { UINT64_C(0xd77485cb25823ac7),  -768 },
+    { UINT64_C(0xa086cfcd97bf97f4),  -741 }, { UINT64_C(0xef340a98172aace5),  -715 },
+    { UINT64_C(0xb23867fb2a35b28e),  -688 }, { UINT64_C(0x84c8d4dfd2c63f3b),  -661 },
+    { UINT64_C(0xc5dd44271ad3cdba),  -635 }, { UINT64_C(0x936b9fcebb25c996),  -608 },
+    { UINT64_C(0xdbac6c247d62a584),  -582 }, { UINT64_C(0xa3ab66580d5fdaf6),  -555 },
+    { UINT64_C(0xf3e2f893dec3f126),  -529 }, { UINT64_C(0xb5b5ada8aaff80b8),  -502 },
+    { UINT64_C(0x87625f056c7c4a8b),  -475 }, { UINT64_C(0xc9bcff6034c13053),  -449 },
+    { UINT64_C(0x964e858c91ba2655),  -422 }, { UINT64_C(0xdff9772470297ebd),  -396 },
+    { UINT64_C(0xa6dfbd9fb8e5b88f),  -369 }, { UINT64_C(0xf8a95fcf88747d94),  -343 },
+    { UINT64_C(0xb94470938fa89bcf),  -316 }, { UINT64_C(0x8a08f0f8bf0f156b),  -289 },
+    { UINT64_C(0xcdb02555653131b6),  -263 }, { UINT64_C(0x993fe2c6d07b7fac),  -236 },
+    { UINT64_C(0xe45c10c42a2b3b06),  -210 }, { UINT64_C(0xaa242499697392d3),  -183 },
+    { UINT64_C(0xfd87b5f28300ca0e),  -157 }, { UINT64_C(0xbce5086492111aeb),  -130 },
+    { UINT64_C(0x8cbccc096f5088cc),  -103 }, { UINT64_C(0xd1b71758e219652c),   -77 },
+    { UINT64_C(0x9c40000000000000),   -50 }, { UINT64_C(0xe8d4a51000000000),   -24 },
+    { UINT64_C(0xad78ebc5ac620000),     3 }, { UINT64_C(0x813f3978f8940984),    30 },
+    { UINT64_C(0xc097ce7bc90715b3),    56 }, { UINT64_C(0x8f7e32ce7bea5c70),    83 },
+    { UINT64_C(0xd5d238a4abe98068),   109 }, { UINT64_C(0x9f4f2726179a2245),   136 },
+    { UINT64_C(0xed63a231d4c4fb27),   162 }, { UINT64_C(0xb0de65388cc8ada8),   189 },
+    { UINT64_C(0x83c7088e1aab65db),   216 }, { UINT64_C(0xc45d1df942711d9a),   242 },
+    { UINT64_C(0x924d692ca61be758),   269 }, { UINT64_C(0xda01ee641a708dea),   295 },
+    { UINT64_C(0xa26da3999aef774a),   322 }, { UINT64_C(0xf209787bb47d6b85),   348 },
+    { UINT64_C(0xb454e4a179dd1877),   375 }, { UINT64_C(0x865b86925b9bc5c2),   402 },
+    { UINT64_C(0xc83553c5c8965d3d),   428 }, { UINT64_C(0x952ab45cfa97a0b3),   455 },
+    { UINT64_C(0xde469fbd99a05fe3),   481 }, { UINT64_C(0xa59bc234db398c25),   508 },
+    { UINT64_C(0xf6c69a72a3989f5c),   534 }, { UINT64_C(0xb7dcbf5354e9bece),   561 },
+    { UINT64_C(0x88fcf317f22241e2),   588 }, { UINT64_C(0xcc20ce9bd35c78a5),   614 },
+    { UINT64_C(0x98165af37b2153df),   641 }, { UINT64_C(0xe2a0b5dc971f303a),   667 },
+    { UINT64_C(0xa8d9d1535ce3b396),   694 }, { UINT64_C(0xfb9b7cd9a4a7443c),   720 },
+    { UINT64_C(0xbb764c4ca7a44410),   747 }, { UINT64_C(0x8bab8eefb6409c1a),   774 },
+    { UINT64_C(0xd01fef10a657842c),   800 }, { UINT64_C(0x9b10a4e5e9913129),   827 },
+    { UINT64_C(0xe7109bfba19c0c9d),   853 }, { UINT64_C(0xac2820d9623bf429),   880 },
+    { UINT64_C(0x80444b5e7aa7cf85),   907 }, { UINT64_C(0xbf21e44003acdd2d),   933 },
+    { UINT64_C(0x8e679c2f5e44ff8f),   960 }, { UINT64_C(0xd433179d9c8cb841),   986 },
+    { UINT64_C(0x9e19db92b4e31ba9),  1013 }, { UINT64_C(0xeb96bf6ebadf77d9),  1039 },
+    { UINT64_C(0xaf87023b9bf0ee6b),  1066 }
+};
+
+static diy_fp_t diy_fp_multiply(diy_fp_t x, diy_fp_t y) {
+    const uint64_t M32 = 0xFFFFFFFFu;
+    uint64_t a = x.f >> 32, b = x.f & M32;
+    uint64_t c = y.f >> 32, d = y.f & M32;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+    tmp += 1u << 31;    /* Round */
+    diy_fp_t r = { ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64 };
+    return r;
+}
+
+static diy_fp_t diy_fp_normalize(diy_fp_t x) {
+    while (!(x.f & (UINT64_C(1) << 63))) {
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+/* Boundaries halfway to the neighbouring values, with a common exponent.
+ * The lower one is closer when v is a power of two (lower_closer). */
+static void normalized_boundaries(diy_fp_t v, int lower_closer, diy_fp_t *minus, diy_fp_t *plus) {
+    diy_fp_t p = { (v.f << 1) + 1, v.e - 1 };
+    p = diy_fp_normalize(p);
+
+    diy_fp_t m;
+    if (lower_closer) {
+        m.f = (v.f << 2) - 1;
+        m.e = v.e - 2;
+    } else {
+        m.f = (v.f << 1) - 1;
+        m.e = v.e - 1;
+    }
+    m.f <<= m.e - p.e;
+    m.e = p.e;
+    *plus = p;
+    *minus = m;
+}
+
+/* Cached power c with e + c.e in [-60, -32]; *k is its negated exponent */
+static diy_fp_t cached_power(int e, int *k) {
+    double dk = (-61 - e) * 0.30102999566398114 + 347;  /* log10(2) */
+    int ik = (int)dk;
+    if (dk - ik > 0.0) ik++;
+    unsigned index = (unsigned)((ik >> 3) + 1);
+    *k = -(-348 + (int)(index << 3));
+    diy_fp_t r = { cached_powers[index].f, cached_powers[index].e };
+    return r;
+}
+
+static const uint32_t pow10_32[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+static int count_digits(uint32_t n) {
+    int d = 1;
+    while (d < 10 && n >= pow10_32[d]) d++;
+    return d;
+}
+
+/* Move the last digit toward w while it stays inside the interval */
+static void grisu_round(char *digits, int len, uint64_t delta, uint64_t rest,
+                        uint64_t ten_kappa, uint64_t wp_w) {
+    while (rest < wp_w && delta - rest >= ten_kappa
+           && (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        digits[len - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+static void digit_gen(diy_fp_t w, diy_fp_t mp, uint64_t delta, char *digits, int *len, int *k) {
+    diy_fp_t one = { UINT64_C(1) << -mp.e, mp.e };
+    uint64_t wp_w = mp.f - w.f;
+    uint32_t p1 = (uint32_t)(mp.f >> -one.e);
+    uint64_t p2 = mp.f & (one.f - 1);
+    int kappa = count_digits(p1);
+    *len = 0;
+
+    /* Integer part */
+    while (kappa > 0) {
+        uint32_t div = pow10_32[kappa - 1];
+        uint32_t d = p1 / div;
+        p1 %= div;
+        if (d || *len) digits[(*len)++] = (char)('0' + d);
+        kappa--;
+        uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+        if (rest <= delta) {
+            *k += kappa;
+            grisu_round(digits, *len, delta, rest, (uint64_t)pow10_32[kappa] << -one.e, wp_w);
+            return;
+        }
+    }
+
+    /* Fraction */
+    for (;;) {
+        p2 *= 10;
+        delta *= 10;
+        char d = (char)(p2 >> -one.e);
+        if (d || *len) digits[(*len)++] = (char)('0' + d);
+        p2 &= one.f - 1;
+        kappa--;
+        if (p2 < delta) {
+            *k += kappa;
+            int index = -kappa;
+            grisu_round(digits, *len, delta, p2, one.f, wp_w * (index < 10 ? pow10_32[index] : 0));
+            return;
+        }
+    }
+}
+
+/* Digits of a positive finite value v: v = digits * 10^k */
+static int grisu2(diy_fp_t v, int lower_closer, char *digits, int *k) {
+    diy_fp_t w_m, w_p;
+    normalized_boundaries(v, lower_closer, &w_m, &w_p);
+    diy_fp_t c_mk = cached_power(w_p.e, k);
+    diy_fp_t w = diy_fp_multiply(diy_fp_normalize(v), c_mk);
+    diy_fp_t wp = diy_fp_multiply(w_p, c_mk);
+    diy_fp_t wm = diy_fp_multiply(w_m, c_mk);
+    wm.f++;
+    wp.f--;
+    int len;
+    digit_gen(w, wp, wp.f - wm.f, digits, &len, k);
+    return len;
+}
+
+/************************************************************/
+/* Doubles
+ */
+/************************************************************/
+
+static size_t write_exponent(char *buf, int exp) {
+    size_t n = 0;
+    buf[n++] = 'e';
+    if (exp < 0) {
+        buf[n++] = '-';
+        exp = -exp;
+    } else {
+        buf[n++] = '+';
+    }
+    if (exp < 10) buf[n++] = '0';
+    return n + fmt_uint(buf + n, (uint64_t)exp);
+}
+
+/* Sign, then the digits of a positive value in the shortest layout */
+static size_t write_decimal(char *buf, int negative, diy_fp_t v, int lower_closer) {
+    size_t n = 0;
+    if (negative) buf[n++] = '-';
+    if (v.f == 0) {
+        buf[n++] = '0';
+        return n;
+    }
+
+    char digits[18];
+    int k;
+    int len = grisu2(v, lower_closer, digits, &k);
+    int point = len + k;    /* value = 0.digits * 10^point */
+
+    if (len <= point && point <= 21) {
+        /* Integer: 1234000 */
+        memcpy(buf + n, digits, (size_t)len);
+        n += (size_t)len;
+        memset(buf + n, '0', (size_t)(point - len));
+        n += (size_t)(point - len);
+    } else if (0 < point && point <= 21) {
+        /* 12.34 */
+        memcpy(buf + n, digits, (size_t)point);
+        n += (size_t)point;
+        buf[n++] = '.';
+        memcpy(buf + n, digits + point, (size_t)(len - point));
+        n += (size_t)(len - point);
+    } else if (-6 < point && point <= 0) {
+        /* 0.001234 */
+        buf[n++] = '0';
+        buf[n++] = '.';
+        memset(buf + n, '0', (size_t)-point);
+        n += (size_t)-point;
+        memcpy(buf + n, digits, (size_t)len);
+        n += (size_t)len;
+    } else {
+        /* 1.234e+30 */
+        buf[n++] = digits[0];
+        if (len > 1) {
+            buf[n++] = '.';
+            memcpy(buf + n, digits + 1, (size_t)(len - 1));
+            n += (size_t)(len - 1);
+        }
+        n += write_exponent(buf + n, point - 1);
+    }
+    return n;
+}
+
+size_t fmt_double(char *buf, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int biased_e = (int)((bits >> 52) & 0x7FF);
+    uint64_t significand = bits & UINT64_C(0x000FFFFFFFFFFFFF);
+    diy_fp_t v;
+    if (biased_e != 0) {
+        v.f = significand | (UINT64_C(1) << 52);
+        v.e = biased_e - 1075;  /* 1023 + 52 */
+    } else {
+        v.f = significand;
+        v.e = -1074;
+    }
+    return write_decimal(buf, (int)(bits >> 63), v, significand == 0 && biased_e > 1);
+}
+
+size_t fmt_float(char *buf, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int biased_e = (int)((bits >> 23) & 0xFF);
+    uint32_t significand = bits & 0x007FFFFFu;
+    diy_fp_t v;
+    if (biased_e != 0) {
+        v.f = significand | (UINT32_C(1) << 23);
+        v.e = biased_e - 150;   /* 127 + 23 */
+    } else {
+        v.f = significand;
+        v.e = -149;
+    }
+    return write_decimal(buf, (int)(bits >> 31), v, significand == 0 && biased_e > 1);
+}
+
+/************************************************************/
+/* Fixed point
+ */
+/************************************************************/
+
+size_t fmt_fixed(char *buf, double value, int decimals) {
+    size_t n = 0;
+    if (isnan(value)) {
+        if (signbit(value)) buf[n++] = '-';
+        memcpy(buf + n, "nan", 3);
+        return n + 3;
+    }
+    if (isinf(value)) {
+        if (value < 0) buf[n++] = '-';
+        memcpy(buf + n, "inf", 3);
+        return n + 3;
+    }
+    if (decimals < 0 || decimals > 9 || fabs(value) >= 1e17) return fmt_double(buf, value);
+
+    int negative = signbit(value) != 0;
+    double scaled = fabs(value) * pow10_32[decimals];
+    double whole = floor(scaled);
+    double frac = scaled - whole;   /* Exact below 2^52 */
+
+    /* The product is rounded; within its error of a tie, the digits
+     * depend on the exact binary value and printf decides */
+    if (scaled >= 0x1p52 || fabs(frac - 0.5) <= scaled * 0x1p-51) {
+        int len = snprintf(buf, FMT_FIXED_MAX, "%.*f", decimals, value);
+        return len > 0 ? (size_t)len : 0;
+    }
+
+    uint64_t units = (uint64_t)whole + (frac > 0.5);
+    if (negative) buf[n++] = '-';
+    n += fmt_uint(buf + n, units / pow10_32[decimals]);
+    if (decimals > 0) {
+        uint32_t rest = (uint32_t)(units % pow10_32[decimals]);
+        buf[n++] = '.';
+        for (int d = decimals - 1; d >= 0; d--) {
+            buf[n + (size_t)d] = (char)('0' + rest % 10);
+            rest /= 10;
+        }
+        n += (size_t)decimals;
+    }
+    return n;
+}
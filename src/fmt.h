@@ -0,0 +1,42 @@
+/*
+ * fmt.h - Number formatting without printf
+ *
+ * Writers that emit many numbers (exports, data files) format them here:
+ * no format-string parsing, no locale, no varargs. Output is ASCII and
+ * not NUL-terminated; each function returns the number of bytes written.
+ *
+ * fmt_double() prints the shortest decimal that reads back to the same
+ * double (Grisu2: always round-trips, and is the shortest such string in
+ * all but a tiny fraction of cases, where it is one digit longer).
+ * Integral values print without a fraction ("3", not "3.0"), large and
+ * small magnitudes with an exponent ("1e+21", "1.5e-07"). The caller
+ * handles NaN and infinities, which have no common spelling.
+ *
+ * fmt_fixed() is "%.*f" for text tables and plot data: same digits and
+ * rounding as printf for 0-9 decimals and magnitudes below 1e17 (larger
+ * ones print as fmt_double() would), "nan" and "inf" as glibc spells them.
+ */
+
+#ifndef FMT_H
+#define FMT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Longest output of each function */
+#define FMT_DOUBLE_MAX 25
+#define FMT_INT_MAX 20
+#define FMT_FIXED_MAX 32
+
+/* Shortest round-trip decimal for a finite double or single */
+size_t fmt_double(char *buf, double value);
+size_t fmt_float(char *buf, float value);
+
+/* value with a fixed number of decimals (0-9), as printf "%.*f" */
+size_t fmt_fixed(char *buf, double value, int decimals);
+
+/* Signed and unsigned decimal integers */
+size_t fmt_int(char *buf, int64_t value);
+size_t fmt_uint(char *buf, uint64_t value);
+
+#endif /* FMT_H */
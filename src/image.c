@@ -0,0 +1,312 @@
+/*
+ * image.c - In-process raster images
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "image.h"
+
+/************************************************************/
+/* Images
+ */
+/************************************************************/
+
+image_t* image_new(size_t width, size_t height) {
+    if (width == 0 || height == 0) return NULL;
+
+    image_t *img = malloc(sizeof(image_t));
+    if (!img) return NULL;
+
+    img->width = width;
+    img->height = height;
+    img->rgb = calloc(width * height, 3);
+    if (!img->rgb) {
+        free(img);
+        return NULL;
+    }
+    return img;
+}
+
+void image_free(image_t *img) {
+    if (!img) return;
+    free(img->rgb);
+    free(img);
+}
+
+void image_set(image_t *img, size_t x, size_t y, const uint8_t rgb[3]) {
+    if (x >= img->width || y >= img->height) return;
+    uint8_t *p = img->rgb + (y * img->width + x) * 3;
+    p[0] = rgb[0];
+    p[1] = rgb[1];
+    p[2] = rgb[2];
+}
+
+void image_blend(image_t *img, size_t x, size_t y, const uint8_t rgb[3], double alpha) {
+    if (x >= img->width || y >= img->height || !(alpha > 0.0)) return;
+    if (alpha > 1.0) alpha = 1.0;
+    uint8_t *p = img->rgb + (y * img->width + x) * 3;
+    for (int c = 0; c < 3; c++) {
+        p[c] = (uint8_t)(p[c] + alpha * (rgb[c] - p[c]) + 0.5);
+    }
+}
+
+/************************************************************/
+/* Colormap
+ */
+/************************************************************/
+
+static const uint8_t heat_stops[][3] = {
+    {  0,   0,   0},
+    { 87,  16, 110},
+    {188,  55,  84},
+    {249, 142,   9},
+    {252, 255, 164}
+};
+#define N_HEAT_STOPS (sizeof(heat_stops) / sizeof(heat_stops[0]))
+
+void image_colormap(double t, uint8_t rgb[3]) {
+    if (!(t > 0.0)) t = 0.0;  /* Also catches NaN */
+    if (t > 1.0) t = 1.0;
+
+    double pos = t * (N_HEAT_STOPS - 1);
+    size_t i = (size_t)pos;
+    if (i >= N_HEAT_STOPS - 1) i = N_HEAT_STOPS - 2;
+    double f = pos - i;
+
+    for (int c = 0; c < 3; c++) {
+        double v = heat_stops[i][c] + f * (heat_stops[i + 1][c] - heat_stops[i][c]);
+        rgb[c] = (uint8_t)(v + 0.5);
+    }
+}
+
+/************************************************************/
+/* Output
+ */
+/************************************************************/
+
+int image_write_ppm(const image_t *img, const char *path) {
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        fprintf(stderr, "Error: Cannot write to %s: ", path);
+        perror(NULL);
+        return -1;
+    }
+
+    fprintf(fp, "P6\n%zu %zu\n255\n", img->width, img->height);
+    size_t n = img->width * img->height * 3;
+    int ret = fwrite(img->rgb, 1, n, fp) == n ? 0 : -1;
+
+    if (fclose(fp) != 0) ret = -1;
+    if (ret != 0) fprintf(stderr, "Error: Failed writing %s\n", path);
+    return ret;
+}
+
+/************************************************************/
+/* PNG
+ *
+ * Each row is filtered with Sub or Up, whichever leaves the smaller sum
+ * of absolute (signed) bytes, then the filtered rows are compressed as
+ * a single fixed-Huffman deflate block. The only matches looked for are
+ * runs of the previous byte (distance 1): on flat colors both filters
+ * turn into runs of zeros, which such matches take 258 bytes at a time.
+ */
+/************************************************************/
+
+#define PNG_FILTER_SUB 1
+#define PNG_FILTER_UP  2
+
+/* Deflate length codes 257..285: base length and extra bits */
+static const uint16_t length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+/* Deflate bit stream (least significant bit first) into a buffer sized
+ * for the worst case up front */
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+    uint32_t acc;
+    int n_bits;
+} bit_writer_t;
+
+static void put_bits(bit_writer_t *bw, uint32_t value, int n) {
+    bw->acc |= value << bw->n_bits;
+    bw->n_bits += n;
+    while (bw->n_bits >= 8) {
+        bw->buf[bw->len++] = (uint8_t)bw->acc;
+        bw->acc >>= 8;
+        bw->n_bits -= 8;
+    }
+}
+
+/* Huffman codes go most significant bit first */
+static void put_code(bit_writer_t *bw, uint32_t code, int n) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < n; i++) {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    put_bits(bw, reversed, n);
+}
+
+/* Literal/length symbol in the fixed Huffman code */
+static void put_symbol(bit_writer_t *bw, unsigned sym) {
+    if (sym < 144) put_code(bw, 0x30 + sym, 8);
+    else if (sym < 256) put_code(bw, 0x190 + (sym - 144), 9);
+    else if (sym < 280) put_code(bw, sym - 256, 7);
+    else put_code(bw, 0xc0 + (sym - 280), 8);
+}
+
+/* Match of len (3..258) bytes at distance 1 */
+static void put_run(bit_writer_t *bw, size_t len) {
+    int i = 28;
+    while (length_base[i] > len) i--;
+    put_symbol(bw, 257 + i);
+    if (length_extra[i] > 0) put_bits(bw, (uint32_t)(len - length_base[i]), length_extra[i]);
+    put_code(bw, 0, 5);  /* Distance code 0: distance 1 */
+}
+
+/* zlib stream of data into out (at least 9/8 of n plus 16 bytes);
+ * returns its length */
+static size_t zlib_compress(const uint8_t *data, size_t n, uint8_t *out) {
+    bit_writer_t bw = { out, 0, 0, 0 };
+    put_bits(&bw, 0x78, 8);         /* Deflate, 32K window */
+    put_bits(&bw, 0x01, 8);         /* No dictionary, fastest; header % 31 == 0 */
+    put_bits(&bw, 1, 1);            /* Final block */
+    put_bits(&bw, 1, 2);            /* Fixed Huffman codes */
+
+    size_t i = 0;
+    while (i < n) {
+        size_t run = 0;
+        if (i > 0) {
+            while (run < 258 && i + run < n && data[i + run] == data[i - 1]) run++;
+        }
+        if (run >= 3) {
+            put_run(&bw, run);
+            i += run;
+        } else {
+            put_symbol(&bw, data[i++]);
+        }
+    }
+    put_symbol(&bw, 256);           /* End of block */
+    if (bw.n_bits > 0) put_bits(&bw, 0, 8 - bw.n_bits);
+
+    uint32_t a = 1, b = 0;
+    for (size_t k = 0; k < n; k++) {
+        a = (a + data[k]) % 65521;
+        b = (b + a) % 65521;
+    }
+    uint32_t adler = (b << 16) | a;
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out[bw.len++] = (uint8_t)(adler >> shift);
+    }
+    return bw.len;
+}
+
+/* Filter type byte plus filtered row, into out (1 + stride bytes) */
+static void filter_row(const uint8_t *row, const uint8_t *prev, size_t stride, uint8_t *out) {
+    uint64_t cost_sub = 0, cost_up = 0;
+    for (size_t i = 0; i < stride; i++) {
+        int8_t sub = (int8_t)(row[i] - (i >= 3 ? row[i - 3] : 0));
+        int8_t up = (int8_t)(row[i] - (prev ? prev[i] : 0));
+        cost_sub += (uint64_t)(sub < 0 ? -sub : sub);
+        cost_up += (uint64_t)(up < 0 ? -up : up);
+    }
+
+    bool use_sub = cost_sub < cost_up;
+    out[0] = use_sub ? PNG_FILTER_SUB : PNG_FILTER_UP;
+    for (size_t i = 0; i < stride; i++) {
+        uint8_t left = i >= 3 ? row[i - 3] : 0;
+        uint8_t above = prev ? prev[i] : 0;
+        out[1 + i] = (uint8_t)(row[i] - (use_sub ? left : above));
+    }
+}
+
+static void put_be32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+/* Chunk: length, type, data, CRC-32 of type and data */
+static int write_chunk(FILE *fp, const uint32_t crc_table[256], const char *type,
+                       const uint8_t *data, size_t len) {
+    uint8_t word[4];
+    uint32_t crc = 0xffffffffu;
+    for (int i = 0; i < 4; i++) {
+        crc = crc_table[(crc ^ (uint8_t)type[i]) & 0xff] ^ (crc >> 8);
+    }
+    for (size_t i = 0; i < len; i++) {
+        crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+
+    put_be32(word, (uint32_t)len);
+    if (fwrite(word, 1, 4, fp) != 4 || fwrite(type, 1, 4, fp) != 4) return -1;
+    if (len > 0 && fwrite(data, 1, len, fp) != len) return -1;
+    put_be32(word, crc ^ 0xffffffffu);
+    return fwrite(word, 1, 4, fp) == 4 ? 0 : -1;
+}
+
+int image_write_png(const image_t *img, const char *path) {
+    size_t stride = img->width * 3;
+    size_t raw_len = img->height * (1 + stride);
+    uint8_t *raw = malloc(raw_len);
+    uint8_t *packed = malloc(raw_len + raw_len / 8 + 16);
+    if (!raw || !packed) {
+        free(raw);
+        free(packed);
+        fprintf(stderr, "Error: Out of memory\n");
+        return -1;
+    }
+
+    for (size_t y = 0; y < img->height; y++) {
+        const uint8_t *row = img->rgb + y * stride;
+        filter_row(row, y > 0 ? row - stride : NULL, stride, raw + y * (1 + stride));
+    }
+    size_t packed_len = zlib_compress(raw, raw_len, packed);
+    free(raw);
+
+    /* Built per call: images may be written from several threads */
+    uint32_t crc_table[256];
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        }
+        crc_table[n] = c;
+    }
+
+    uint8_t header[13];
+    put_be32(header, (uint32_t)img->width);
+    put_be32(header + 4, (uint32_t)img->height);
+    header[8] = 8;      /* Bits per channel */
+    header[9] = 2;      /* RGB */
+    header[10] = 0;     /* Deflate */
+    header[11] = 0;     /* Adaptive filtering */
+    header[12] = 0;     /* Not interlaced */
+
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        fprintf(stderr, "Error: Cannot write to %s: ", path);
+        perror(NULL);
+        free(packed);
+        return -1;
+    }
+
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    int ret = (fwrite(signature, 1, 8, fp) == 8
+               && write_chunk(fp, crc_table, "IHDR", header, sizeof(header)) == 0
+               && write_chunk(fp, crc_table, "IDAT", packed, packed_len) == 0
+               && write_chunk(fp, crc_table, "IEND", NULL, 0) == 0) ? 0 : -1;
+    free(packed);
+
+    if (fclose(fp) != 0) ret = -1;
+    if (ret != 0) fprintf(stderr, "Error: Failed writing %s\n", path);
+    return ret;
+}
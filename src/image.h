@@ -0,0 +1,46 @@
+/*
+ * image.h - In-process raster images
+ *
+ * Small 8-bit RGB images for graphical macros that do not need gnuplot
+ * (heatmaps, contact sheets). Written as binary PPM (P6), which needs no
+ * library and is opened by most image viewers and converters, or as PNG,
+ * compressed by presto itself (one fixed-Huffman deflate block with
+ * run-length matches, which suits flat backgrounds and repeated rows).
+ */
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    size_t width;
+    size_t height;
+    uint8_t *rgb;               /* width * height * 3 bytes, row 0 at the top */
+} image_t;
+
+/* New image filled with black (NULL on error) */
+image_t* image_new(size_t width, size_t height);
+
+/* Free an image */
+void image_free(image_t *img);
+
+/* Set one pixel (ignored if outside the image) */
+void image_set(image_t *img, size_t x, size_t y, const uint8_t rgb[3]);
+
+/* Mix rgb into one pixel with weight alpha in [0, 1] (ignored if outside
+ * the image) */
+void image_blend(image_t *img, size_t x, size_t y, const uint8_t rgb[3], double alpha);
+
+/* Heat colormap: t in [0, 1] runs black -> purple -> red -> yellow -> white
+ * (values outside the range are clamped) */
+void image_colormap(double t, uint8_t rgb[3]);
+
+/* Write as binary PPM. Returns 0 on success, -1 on error */
+int image_write_ppm(const image_t *img, const char *path);
+
+/* Write as PNG. Returns 0 on success, -1 on error */
+int image_write_png(const image_t *img, const char *path);
+
+#endif /* IMAGE_H */
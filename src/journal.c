@@ -0,0 +1,136 @@
+/*
+ * journal.c - Job journal for resumable batch runs (--journal)
+ */
+
+#define _XOPEN_SOURCE 700  /* For realpath, fsync, st_mtim */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "journal.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+
+struct journal {
+    char *path;
+    char *signature;
+    FILE *fp;               /* Open for appending */
+    uint64_t *done;         /* Keys listed when opened, sorted */
+    size_t n_done;
+};
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t len) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static int compare_key(const void *a, const void *b) {
+    uint64_t ka = *(const uint64_t*)a;
+    uint64_t kb = *(const uint64_t*)b;
+    return (ka > kb) - (ka < kb);
+}
+
+/* Collect the keys of "done" lines */
+static int read_done(journal_t *journal, FILE *fp) {
+    size_t capacity = 0;
+    char line[PATH_MAX + 64];
+    while (fgets(line, sizeof(line), fp)) {
+        uint64_t key;
+        if (sscanf(line, "done %" SCNx64, &key) != 1) continue;
+        if (journal->n_done == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            uint64_t *grown = realloc(journal->done, capacity * sizeof(uint64_t));
+            if (!grown) return -1;
+            journal->done = grown;
+        }
+        journal->done[journal->n_done++] = key;
+    }
+    if (journal->n_done > 0) qsort(journal->done, journal->n_done, sizeof(uint64_t), compare_key);
+    return 0;
+}
+
+journal_t* journal_open(const char *path, const char *signature) {
+    journal_t *journal = calloc(1, sizeof(journal_t));
+    if (!journal) return NULL;
+    journal->path = strdup(path);
+    journal->signature = strdup(signature ? signature : "");
+    if (!journal->path || !journal->signature) {
+        journal_close(journal);
+        return NULL;
+    }
+
+    FILE *existing = fopen(path, "r");
+    if (existing) {
+        int status = read_done(journal, existing);
+        fclose(existing);
+        if (status != 0) {
+            journal_close(journal);
+            return NULL;
+        }
+    }
+
+    journal->fp = fopen(path, "a");
+    if (!journal->fp) {
+        journal_close(journal);
+        return NULL;
+    }
+    return journal;
+}
+
+void journal_close(journal_t *journal) {
+    if (!journal) return;
+    if (journal->fp) fclose(journal->fp);
+    free(journal->done);
+    free(journal->signature);
+    free(journal->path);
+    free(journal);
+}
+
+int journal_key(const journal_t *journal, const char *input_path, uint64_t *key) {
+    struct stat st;
+    char real[PATH_MAX];
+    if (stat(input_path, &st) != 0 || !realpath(input_path, real)) return -1;
+
+    int64_t stamp[3] = { (int64_t)st.st_size, (int64_t)st.st_mtim.tv_sec, (int64_t)st.st_mtim.tv_nsec };
+    uint64_t hash = fnv1a(FNV_OFFSET, real, strlen(real) + 1);
+    hash = fnv1a(hash, stamp, sizeof(stamp));
+    *key = fnv1a(hash, journal->signature, strlen(journal->signature));
+    return 0;
+}
+
+bool journal_done(const journal_t *journal, uint64_t key) {
+    return journal->n_done > 0
+        && bsearch(&key, journal->done, journal->n_done, sizeof(uint64_t), compare_key) != NULL;
+}
+
+int journal_record(journal_t *journal, uint64_t key, const char *input_path) {
+    /* Synced before the checkpoint goes, so a crash never loses both */
+    if (fprintf(journal->fp, "done %016" PRIx64 " %s\n", key, input_path) < 0
+        || fflush(journal->fp) != 0 || fsync(fileno(journal->fp)) != 0) {
+        fprintf(stderr, "Error: Cannot write journal %s\n", journal->path);
+        return -1;
+    }
+
+    char *checkpoint = journal_checkpoint_path(journal, key);
+    if (checkpoint) {
+        remove(checkpoint);
+        free(checkpoint);
+    }
+    return 0;
+}
+
+char* journal_checkpoint_path(const journal_t *journal, uint64_t key) {
+    size_t len = strlen(journal->path) + 1 + 16 + sizeof(".ckpt");
+    char *path = malloc(len);
+    if (path) snprintf(path, len, "%s.%016" PRIx64 ".ckpt", journal->path, key);
+    return path;
+}
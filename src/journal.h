@@ -0,0 +1,52 @@
+/*
+ * journal.h - Job journal for resumable batch runs (--journal)
+ *
+ * The journal is a text file with one line per finished job:
+ *
+ *   done <key> <input path>
+ *
+ * The key is a 64-bit FNV-1a hash (16 hex digits) of the input file's
+ * identity - real path, size and modification time - and of the job
+ * signature, the options that shape the output. A rerun with the same
+ * journal skips the jobs it lists; a file that changed, or a run with
+ * other options, has a different key and is processed again. Lines are
+ * appended and synced as jobs finish, so an interrupted run loses only
+ * the jobs in progress.
+ *
+ * Those are not lost entirely when the macro's per-trial kernel can save
+ * its accumulator (see trial_kernel_t): the file then checkpoints to
+ * "<journal>.<key>.ckpt" as it goes, and the rerun carries on from the
+ * last checkpoint's trial. The checkpoint is removed once the job is
+ * recorded.
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct journal journal_t;
+
+/* Open (or create) the journal at path for jobs with this signature,
+ * reading the jobs it already lists. Returns NULL on failure. */
+journal_t* journal_open(const char *path, const char *signature);
+
+/* Close the journal */
+void journal_close(journal_t *journal);
+
+/* Key of the job on input_path. Returns 0 on success, -1 if the file
+ * cannot be found. */
+int journal_key(const journal_t *journal, const char *input_path, uint64_t *key);
+
+/* True if the journal lists key as done */
+bool journal_done(const journal_t *journal, uint64_t key);
+
+/* Append key as done and remove its checkpoint.
+ * Returns 0 on success, -1 on a write failure. */
+int journal_record(journal_t *journal, uint64_t key, const char *input_path);
+
+/* Checkpoint path for key (caller frees; NULL on allocation failure) */
+char* journal_checkpoint_path(const journal_t *journal, uint64_t key);
+
+#endif /* JOURNAL_H */
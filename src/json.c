@@ -0,0 +1,288 @@
+/*
+ * json.c - Streaming JSON writer
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "json.h"
+#include "fmt.h"
+
+#define JSON_BUFFER_SIZE (1 << 20)
+
+/************************************************************/
+/* Buffer
+ */
+/************************************************************/
+
+static void flush(json_writer_t *writer) {
+    if (writer->len > 0 && fwrite(writer->buffer, 1, writer->len, writer->fp) != writer->len) {
+        writer->failed = true;
+    }
+    writer->len = 0;
+}
+
+/* Room for n more bytes (n <= capacity) */
+static char* reserve(json_writer_t *writer, size_t n) {
+    if (writer->len + n > writer->capacity) flush(writer);
+    return writer->buffer + writer->len;
+}
+
+json_writer_t* json_writer_new(FILE *fp) {
+    json_writer_t *writer = calloc(1, sizeof(json_writer_t));
+    if (!writer) return NULL;
+    writer->buffer = malloc(JSON_BUFFER_SIZE);
+    if (!writer->buffer) {
+        free(writer);
+        return NULL;
+    }
+    writer->fp = fp;
+    writer->capacity = JSON_BUFFER_SIZE;
+    return writer;
+}
+
+int json_writer_free(json_writer_t *writer) {
+    if (!writer) return -1;
+    flush(writer);
+    if (fflush(writer->fp) != 0) writer->failed = true;
+    int status = writer->failed ? -1 : 0;
+    free(writer->buffer);
+    free(writer);
+    return status;
+}
+
+void json_raw(json_writer_t *writer, const char *text, size_t len) {
+    while (len > 0) {
+        size_t room = writer->capacity - writer->len;
+        if (room == 0) {
+            flush(writer);
+            room = writer->capacity;
+        }
+        size_t n = len < room ? len : room;
+        memcpy(writer->buffer + writer->len, text, n);
+        writer->len += n;
+        text += n;
+        len -= n;
+    }
+}
+
+/************************************************************/
+/* Scalars
+ */
+/************************************************************/
+
+/* Length of the well-formed UTF-8 sequence starting a multibyte character
+ * at s (at most n bytes), 0 if there is none: overlong forms, surrogates
+ * and code points past U+10FFFF are rejected */
+static size_t utf8_length(const unsigned char *s, size_t n) {
+    size_t len;
+    unsigned lo = 0x80, hi = 0xBF;     /* Allowed range of the second byte */
+    if (s[0] >= 0xC2 && s[0] <= 0xDF) {
+        len = 2;
+    } else if (s[0] >= 0xE0 && s[0] <= 0xEF) {
+        len = 3;
+        if (s[0] == 0xE0) lo = 0xA0;
+        if (s[0] == 0xED) hi = 0x9F;
+    } else if (s[0] >= 0xF0 && s[0] <= 0xF4) {
+        len = 4;
+        if (s[0] == 0xF0) lo = 0x90;
+        if (s[0] == 0xF4) hi = 0x8F;
+    } else {
+        return 0;
+    }
+    if (n < len || s[1] < lo || s[1] > hi) return 0;
+    for (size_t i = 2; i < len; i++) {
+        if (s[i] < 0x80 || s[i] > 0xBF) return 0;
+    }
+    return len;
+}
+
+/* UTF-8 text is copied as is; bytes that are not part of a valid sequence
+ * are taken as Latin-1 and escaped */
+void json_string(json_writer_t *writer, const char *text, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    char *p = reserve(writer, 1);
+    *p = '"';
+    writer->len++;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)text[i];
+        size_t seq = c >= 0x80 ? utf8_length((const unsigned char*)text + i, len - i) : 0;
+        if (seq > 0) {
+            json_raw(writer, text + i, seq);
+            i += seq - 1;
+            continue;
+        }
+        p = reserve(writer, 6);
+        size_t n = 0;
+        if (c == '"' || c == '\\') {
+            p[n++] = '\\';
+            p[n++] = (char)c;
+        } else if (c == '\n') {
+            p[n++] = '\\';
+            p[n++] = 'n';
+        } else if (c == '\t') {
+            p[n++] = '\\';
+            p[n++] = 't';
+        } else if (c < 0x20 || c >= 0x7F) {
+            p[n++] = '\\';
+            p[n++] = 'u';
+            p[n++] = '0';
+            p[n++] = '0';
+            p[n++] = hex[c >> 4];
+            p[n++] = hex[c & 0xF];
+        } else {
+            p[n++] = (char)c;
+        }
+        writer->len += n;
+    }
+    p = reserve(writer, 1);
+    *p = '"';
+    writer->len++;
+}
+
+void json_key(json_writer_t *writer, const char *name) {
+    json_string(writer, name, strlen(name));
+    json_raw(writer, ":", 1);
+}
+
+void json_number(json_writer_t *writer, double value) {
+    if (!isfinite(value)) {
+        json_raw(writer, "null", 4);
+        return;
+    }
+    char *p = reserve(writer, FMT_DOUBLE_MAX);
+    writer->len += fmt_double(p, value);
+}
+
+void json_int(json_writer_t *writer, int64_t value) {
+    char *p = reserve(writer, FMT_INT_MAX);
+    writer->len += fmt_int(p, value);
+}
+
+/************************************************************/
+/* Values
+ */
+/************************************************************/
+
+static void write_element(json_writer_t *writer, bhv2_value_t *value, uint64_t i) {
+    char *p;
+    switch (value->dtype) {
+        case MATLAB_DOUBLE: json_number(writer, value->data.d[i]); break;
+        case MATLAB_SINGLE:
+            if (!isfinite(value->data.f[i])) {
+                json_raw(writer, "null", 4);
+            } else {
+                p = reserve(writer, FMT_DOUBLE_MAX);
+                writer->len += fmt_float(p, value->data.f[i]);
+            }
+            break;
+        case MATLAB_UINT8:  json_int(writer, value->data.u8[i]); break;
+        case MATLAB_UINT16: json_int(writer, value->data.u16[i]); break;
+        case MATLAB_UINT32: json_int(writer, value->data.u32[i]); break;
+        case MATLAB_UINT64:
+            p = reserve(writer, FMT_INT_MAX);
+            writer->len += fmt_uint(p, value->data.u64[i]);
+            break;
+        case MATLAB_INT8:   json_int(writer, value->data.i8[i]); break;
+        case MATLAB_INT16:  json_int(writer, value->data.i16[i]); break;
+        case MATLAB_INT32:  json_int(writer, value->data.i32[i]); break;
+        case MATLAB_INT64:  json_int(writer, value->data.i64[i]); break;
+        case MATLAB_LOGICAL:
+            if (bhv2_get_double(value, i) != 0.0) {
+                json_raw(writer, "true", 4);
+            } else {
+                json_raw(writer, "false", 5);
+            }
+            break;
+        default: json_raw(writer, "null", 4); break;
+    }
+}
+
+static void write_array(json_writer_t *writer, bhv2_value_t *value) {
+    if (value->total == 1) {
+        write_element(writer, value, 0);
+        return;
+    }
+
+    /* M x N matrix: rows */
+    if (value->ndims == 2 && value->dims[0] > 1 && value->dims[1] > 1) {
+        uint64_t rows = value->dims[0], cols = value->dims[1];
+        json_raw(writer, "[", 1);
+        for (uint64_t r = 0; r < rows; r++) {
+            json_raw(writer, r ? ",[" : "[", r ? 2 : 1);
+            for (uint64_t c = 0; c < cols; c++) {
+                if (c) json_raw(writer, ",", 1);
+                write_element(writer, value, r + c * rows);
+            }
+            json_raw(writer, "]", 1);
+        }
+        json_raw(writer, "]", 1);
+        return;
+    }
+
+    json_raw(writer, "[", 1);
+    for (uint64_t i = 0; i < value->total; i++) {
+        if (i) json_raw(writer, ",", 1);
+        write_element(writer, value, i);
+    }
+    json_raw(writer, "]", 1);
+}
+
+static void write_struct_element(json_writer_t *writer, bhv2_value_t *value, uint64_t index) {
+    uint64_t n_fields = value->data.struct_array.n_fields;
+    bhv2_struct_field_t *fields = value->data.struct_array.fields + index * n_fields;
+    bool first = true;
+    json_raw(writer, "{", 1);
+    for (uint64_t f = 0; f < n_fields; f++) {
+        if (!fields[f].name) continue;  /* Not decoded by a projection */
+        if (!first) json_raw(writer, ",", 1);
+        first = false;
+        json_key(writer, fields[f].name);
+        json_write_value(writer, fields[f].value);
+    }
+    json_raw(writer, "}", 1);
+}
+
+void json_write_value(json_writer_t *writer, bhv2_value_t *value) {
+    if (!value) {
+        json_raw(writer, "null", 4);
+        return;
+    }
+
+    switch (value->dtype) {
+        case MATLAB_CHAR:
+            json_string(writer, value->data.string ? value->data.string : "",
+                        value->data.string ? value->total : 0);
+            break;
+
+        case MATLAB_STRUCT:
+            if (value->total == 1) {
+                write_struct_element(writer, value, 0);
+                break;
+            }
+            json_raw(writer, "[", 1);
+            for (uint64_t i = 0; i < value->total; i++) {
+                if (i) json_raw(writer, ",", 1);
+                write_struct_element(writer, value, i);
+            }
+            json_raw(writer, "]", 1);
+            break;
+
+        case MATLAB_CELL:
+            json_raw(writer, "[", 1);
+            for (uint64_t i = 0; i < value->total; i++) {
+                if (i) json_raw(writer, ",", 1);
+                json_write_value(writer, value->data.cell_array[i]);
+            }
+            json_raw(writer, "]", 1);
+            break;
+
+        case MATLAB_UNKNOWN:
+            json_raw(writer, "null", 4);
+            break;
+
+        default:
+            write_array(writer, value);
+            break;
+    }
+}
@@ -0,0 +1,58 @@
+/*
+ * json.h - Streaming JSON writer
+ *
+ * Text is assembled in a large buffer and written with fwrite() when it
+ * fills, numbers go through fmt.h, so no printf runs per value. The caller
+ * lays out objects and arrays with json_raw(); json_write_value() writes
+ * any bhv2_value_t:
+ *
+ *   numeric, logical   1 element: number or true/false; vectors and N-D
+ *                      arrays: flat array (column-major); M x N matrices:
+ *                      array of M rows. NaN and Inf are null.
+ *   char               string (UTF-8 copied as is, other bytes above 0x7F
+ *                      read as Latin-1)
+ *   struct             1 x 1: object; otherwise array of objects
+ *   cell               array
+ *   NULL               null
+ */
+
+#ifndef JSON_H
+#define JSON_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "bhv2.h"
+
+typedef struct {
+    FILE *fp;
+    char *buffer;
+    size_t len;
+    size_t capacity;
+    bool failed;                /* A write failed */
+} json_writer_t;
+
+/* Writer on an open stream (NULL if out of memory) */
+json_writer_t* json_writer_new(FILE *fp);
+
+/* Flush and free (the stream stays open). Returns 0 if everything was
+ * written, -1 otherwise. */
+int json_writer_free(json_writer_t *writer);
+
+/* Write bytes as they are */
+void json_raw(json_writer_t *writer, const char *text, size_t len);
+
+/* Write a quoted, escaped string of len bytes */
+void json_string(json_writer_t *writer, const char *text, size_t len);
+
+/* Write "name": */
+void json_key(json_writer_t *writer, const char *name);
+
+/* Write a number (null if not finite) */
+void json_number(json_writer_t *writer, double value);
+void json_int(json_writer_t *writer, int64_t value);
+
+/* Write a value as described above */
+void json_write_value(json_writer_t *writer, bhv2_value_t *value);
+
+#endif /* JSON_H */
@@ -0,0 +1,649 @@
+/*
+ * kernels.c - Numeric kernels over contiguous sample buffers
+ *
+ * NaN/Inf detection uses (v - v) != (v - v): finite values give 0 == 0,
+ * NaN and +/-Inf give NaN, which compares unequal to itself. This keeps
+ * the loops free of library calls and branches.
+ *
+ * The kernels in kernel_table_t also have SIMD variants (kernels_x86.c);
+ * the public functions call whichever kernel_isa() selected. The filters
+ * dispatch only their interiors, where no index needs clamping.
+ */
+
+#define _POSIX_C_SOURCE 200809L  /* For pthread_once */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "kernels.h"
+#include "kernels_isa.h"
+
+/************************************************************/
+/* CPU dispatch
+ */
+/************************************************************/
+
+static const char *isa_names[] = { "scalar", "sse2", "avx2", "avx512" };
+
+static pthread_once_t dispatch_once = PTHREAD_ONCE_INIT;
+static kernel_isa_t detected_isa = KERNEL_ISA_SCALAR;
+static kernel_isa_t active_isa = KERNEL_ISA_SCALAR;
+static const kernel_table_t *active = &kernel_table_scalar;
+
+#ifdef KERNELS_X86
+#include <cpuid.h>
+
+/* OS-enabled register state (XCR0); the CPU flags alone do not say the
+ * kernel saves the wider registers */
+static uint64_t read_xcr0(void) {
+    uint32_t eax, edx;
+    __asm__ volatile (".byte 0x0f, 0x01, 0xd0" : "=a"(eax), "=d"(edx) : "c"(0));  /* xgetbv */
+    return ((uint64_t)edx << 32) | eax;
+}
+
+static kernel_isa_t detect_isa(void) {
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(edx & bit_SSE2)) return KERNEL_ISA_SCALAR;
+
+    bool os_avx = false, os_avx512 = false;
+    if ((ecx & bit_OSXSAVE) && (ecx & bit_AVX)) {
+        uint64_t xcr0 = read_xcr0();
+        os_avx = (xcr0 & 0x06) == 0x06;         /* XMM, YMM */
+        os_avx512 = (xcr0 & 0xe6) == 0xe6;      /* Plus opmask, ZMM */
+    }
+
+    unsigned max_leaf = __get_cpuid_max(0, NULL);
+    if (max_leaf >= 7 && os_avx) {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        if (os_avx512 && (ebx & bit_AVX512F)) return KERNEL_ISA_AVX512;
+        if (ebx & bit_AVX2) return KERNEL_ISA_AVX2;
+    }
+    return KERNEL_ISA_SSE2;
+}
+
+static const kernel_table_t* isa_table(kernel_isa_t isa) {
+    switch (isa) {
+        case KERNEL_ISA_AVX512: return &kernel_table_avx512;
+        case KERNEL_ISA_AVX2: return &kernel_table_avx2;
+        case KERNEL_ISA_SSE2: return &kernel_table_sse2;
+        default: return &kernel_table_scalar;
+    }
+}
+#else
+static kernel_isa_t detect_isa(void) {
+    return KERNEL_ISA_SCALAR;
+}
+
+static const kernel_table_t* isa_table(kernel_isa_t isa) {
+    (void)isa;
+    return &kernel_table_scalar;
+}
+#endif
+
+/* Best supported variant, capped by $PRESTO_KERNELS */
+static void dispatch_init(void) {
+    detected_isa = detect_isa();
+    active_isa = detected_isa;
+
+    const char *cap = getenv("PRESTO_KERNELS");
+    for (int i = 0; cap && i <= KERNEL_ISA_AVX512; i++) {
+        if (strcmp(cap, isa_names[i]) == 0 && (kernel_isa_t)i < active_isa) active_isa = (kernel_isa_t)i;
+    }
+    active = isa_table(active_isa);
+}
+
+static const kernel_table_t* table(void) {
+    pthread_once(&dispatch_once, dispatch_init);
+    return active;
+}
+
+kernel_isa_t kernel_isa(void) {
+    pthread_once(&dispatch_once, dispatch_init);
+    return active_isa;
+}
+
+kernel_isa_t kernel_isa_supported(void) {
+    pthread_once(&dispatch_once, dispatch_init);
+    return detected_isa;
+}
+
+int kernel_set_isa(kernel_isa_t isa) {
+    pthread_once(&dispatch_once, dispatch_init);
+    if (isa < KERNEL_ISA_SCALAR || isa > detected_isa) return -1;
+    active_isa = isa;
+    active = isa_table(isa);
+    return 0;
+}
+
+const char* kernel_isa_name(kernel_isa_t isa) {
+    return isa >= KERNEL_ISA_SCALAR && isa <= KERNEL_ISA_AVX512 ? isa_names[isa] : "unknown";
+}
+
+/************************************************************/
+/* Precision
+ */
+/************************************************************/
+
+static void to_single_scalar(const double *x, size_t n, float *out) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = (float)x[i];
+    }
+}
+
+void kernel_double_to_single(const double *x, size_t n, float *out) {
+    table()->to_single(x, n, out);
+}
+
+/************************************************************/
+/* Finite-value scans
+ */
+/************************************************************/
+
+static size_t count_nonfinite_scalar(const double *x, size_t n) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        double d = x[i] - x[i];
+        count += (d != d);
+    }
+    return count;
+}
+
+size_t kernel_count_nonfinite(const double *x, size_t n) {
+    return table()->count_nonfinite(x, n);
+}
+
+size_t kernel_longest_nonfinite_run(const double *x, size_t n) {
+    size_t run = 0, best = 0;
+    for (size_t i = 0; i < n; i++) {
+        double d = x[i] - x[i];
+        run = (d != d) ? run + 1 : 0;
+        best = run > best ? run : best;
+    }
+    return best;
+}
+
+static void minmax_scalar(const double *x, size_t n, double *min_out, double *max_out) {
+    double lo = INFINITY, hi = -INFINITY;
+    size_t finite = 0;
+    for (size_t i = 0; i < n; i++) {
+        double v = x[i];
+        double d = v - v;
+        int ok = (d == d);
+        finite += ok;
+        lo = (ok && v < lo) ? v : lo;
+        hi = (ok && v > hi) ? v : hi;
+    }
+    *min_out = finite ? lo : NAN;
+    *max_out = finite ? hi : NAN;
+}
+
+void kernel_minmax(const double *x, size_t n, double *min_out, double *max_out) {
+    table()->minmax(x, n, min_out, max_out);
+}
+
+void kernel_minmax_bins(const double *x, size_t n, size_t n_bins, double *mins, double *maxs) {
+    for (size_t b = 0; b < n_bins; b++) {
+        size_t start = b * n / n_bins;
+        size_t end = (b + 1) * n / n_bins;
+        kernel_minmax(x + start, end - start, &mins[b], &maxs[b]);
+    }
+}
+
+void kernel_mean_bins(const double *x, size_t n, double first, double width,
+                      size_t n_bins, double *means) {
+    for (size_t b = 0; b < n_bins; b++) {
+        double lo = ceil(first + b * width);
+        double hi = ceil(first + (b + 1) * width);
+        size_t start = lo < 0.0 ? 0 : lo > (double)n ? n : (size_t)lo;
+        size_t end = hi < 0.0 ? 0 : hi > (double)n ? n : (size_t)hi;
+
+        double sum = 0.0;
+        size_t finite = 0;
+        for (size_t i = start; i < end; i++) {
+            double v = x[i];
+            double d = v - v;
+            int ok = (d == d);
+            finite += ok;
+            sum += ok ? v : 0.0;
+        }
+        means[b] = finite ? sum / finite : NAN;
+    }
+}
+
+/************************************************************/
+/* Signal shape scans
+ */
+/************************************************************/
+
+static size_t count_equal_scalar(const double *x, size_t n, double value) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        count += (x[i] == value);
+    }
+    return count;
+}
+
+size_t kernel_count_equal(const double *x, size_t n, double value) {
+    return table()->count_equal(x, n, value);
+}
+
+size_t kernel_longest_flat_run(const double *x, size_t n, double tol) {
+    if (n == 0) return 0;
+
+    size_t run = 0, best = 0;
+    double anchor = x[0];
+    for (size_t i = 0; i < n; i++) {
+        double v = x[i];
+        if (fabs(v - anchor) <= tol) {
+            run++;
+        } else {
+            /* NaN fails the comparison above and restarts the run */
+            anchor = v;
+            double d = v - v;
+            run = (d == d) ? 1 : 0;
+        }
+        if (run > best) best = run;
+    }
+    return best;
+}
+
+/************************************************************/
+/* Packed bit signals
+ */
+/************************************************************/
+
+void kernel_pack_threshold(const double *x, size_t n, double threshold, uint64_t *bits) {
+    size_t n_full = n / 64;
+    for (size_t w = 0; w < n_full; w++) {
+        const double *chunk = x + w * 64;
+        uint64_t word = 0;
+        for (int b = 0; b < 64; b++) {
+            word |= (uint64_t)(chunk[b] > threshold) << b;
+        }
+        bits[w] = word;
+    }
+    if (n % 64) {
+        uint64_t word = 0;
+        for (size_t i = n_full * 64; i < n; i++) {
+            word |= (uint64_t)(x[i] > threshold) << (i % 64);
+        }
+        bits[n_full] = word;
+    }
+}
+
+size_t kernel_bit_edges(const uint64_t *bits, size_t n, size_t *edges, size_t cap) {
+    size_t count = 0;
+    uint64_t carry = 0;  /* Previous sample's state, shifted into bit 0 */
+    size_t n_words = (n + 63) / 64;
+
+    for (size_t w = 0; w < n_words; w++) {
+        uint64_t word = bits[w];
+        if (w == n_words - 1 && n % 64) {
+            word &= (UINT64_C(1) << (n % 64)) - 1;  /* Ignore bits past the end */
+        }
+
+        /* Bit i set where sample i differs from sample i-1 */
+        uint64_t changes = word ^ ((word << 1) | carry);
+        carry = word >> 63;
+
+        while (changes) {
+            if (count < cap) {
+                edges[count] = w * 64 + (size_t)__builtin_ctzll(changes);
+            }
+            count++;
+            changes &= changes - 1;  /* Clear lowest set bit */
+        }
+    }
+
+    return count;
+}
+
+/************************************************************/
+/* Motion (x/y position traces)
+ */
+/************************************************************/
+
+static void moving_average_scalar(const double *x, size_t n_out, size_t width, double scale, double *out) {
+    for (size_t i = 0; i < n_out; i++) {
+        const double *w = x + i;
+        double sum = 0.0;
+        for (size_t k = 0; k < width; k++) {
+            sum += w[k];
+        }
+        out[i] = sum * scale;
+    }
+}
+
+void kernel_moving_average(const double *x, size_t n, size_t half, double *out) {
+    if (n == 0) return;
+    if (half > (n - 1) / 2) half = (n - 1) / 2;
+
+    /* Ends: shrink the window to the samples available */
+    for (size_t i = 0; i < half && i < n; i++) {
+        double sum_lo = 0.0, sum_hi = 0.0;
+        for (size_t k = 0; k <= i + half; k++) sum_lo += x[k];
+        for (size_t k = n - 1 - i - half; k < n; k++) sum_hi += x[k];
+        out[i] = sum_lo / (double)(i + half + 1);
+        out[n - 1 - i] = sum_hi / (double)(i + half + 1);
+    }
+
+    /* Interior: full window. Summed directly rather than as a running sum
+     * so a NaN only spoils its own neighbourhood. */
+    double scale = 1.0 / (double)(2 * half + 1);
+    table()->moving_average(x, n - 2 * half, 2 * half + 1, scale, out + half);
+}
+
+static void speed_scalar(const double *x, const double *y, size_t n_out, double inv2, double *out) {
+    for (size_t i = 0; i < n_out; i++) {
+        double cx = x[i + 2] - x[i];
+        double cy = y[i + 2] - y[i];
+        out[i] = sqrt(cx * cx + cy * cy) * inv2;
+    }
+}
+
+void kernel_speed(const double *x, const double *y, size_t n, double dt, double *out) {
+    if (n < 2) {
+        if (n == 1) out[0] = 0.0;
+        return;
+    }
+
+    double inv = 1.0 / dt;
+    double dx = x[1] - x[0], dy = y[1] - y[0];
+    out[0] = sqrt(dx * dx + dy * dy) * inv;
+
+    table()->speed(x, y, n - 2, 0.5 * inv, out + 1);
+
+    dx = x[n - 1] - x[n - 2];
+    dy = y[n - 1] - y[n - 2];
+    out[n - 1] = sqrt(dx * dx + dy * dy) * inv;
+}
+
+static void segments_scalar(const double *x, const double *y, size_t n_seg, double *out) {
+    for (size_t i = 0; i < n_seg; i++) {
+        double dx = x[i + 1] - x[i];
+        double dy = y[i + 1] - y[i];
+        double d = sqrt(dx * dx + dy * dy);
+        double z = d - d;
+        out[i] = (z == z) ? d : 0.0;
+    }
+}
+
+/* Segment lengths are computed a block at a time, then added up in order
+ * so the total does not depend on the variant */
+#define PATH_BLOCK 256
+
+double kernel_path_length(const double *x, const double *y, size_t n) {
+    double seg[PATH_BLOCK];
+    double total = 0.0;
+    const kernel_table_t *impl = table();
+
+    for (size_t start = 0; start + 1 < n; start += PATH_BLOCK) {
+        size_t len = n - 1 - start < PATH_BLOCK ? n - 1 - start : PATH_BLOCK;
+        impl->segments(x + start, y + start, len, seg);
+        for (size_t i = 0; i < len; i++) {
+            total += seg[i];
+        }
+    }
+    return total;
+}
+
+static size_t argmax_scalar(const double *x, size_t n) {
+    size_t best = n;
+    double hi = -INFINITY;
+    for (size_t i = 0; i < n; i++) {
+        double v = x[i];
+        double d = v - v;
+        int take = (d == d) & (v > hi);
+        hi = take ? v : hi;
+        best = take ? i : best;
+    }
+    return best;
+}
+
+size_t kernel_argmax(const double *x, size_t n) {
+    return table()->argmax(x, n);
+}
+
+/************************************************************/
+/* Filters (one channel column at a time)
+ */
+/************************************************************/
+
+void kernel_biquad(double *x, size_t n, const double b[3], const double a[2]) {
+    if (n == 0) return;
+
+    /* Transposed direct form II, state at steady state for input x[0] */
+    double dc = (b[0] + b[1] + b[2]) / (1.0 + a[0] + a[1]);
+    double z1 = (dc - b[0]) * x[0];
+    double z2 = (b[2] - a[1] * dc) * x[0];
+
+    for (size_t i = 0; i < n; i++) {
+        double in = x[i];
+        double y = b[0] * in + z1;
+        z1 = b[1] * in - a[0] * y + z2;
+        z2 = b[2] * in - a[1] * y;
+        x[i] = y;
+    }
+}
+
+void kernel_reverse(double *x, size_t n) {
+    for (size_t i = 0, j = n; i + 1 < j; i++) {
+        j--;
+        double t = x[i];
+        x[i] = x[j];
+        x[j] = t;
+    }
+}
+
+static double fir_clamped(const double *x, size_t n, const double *h, size_t half, size_t i) {
+    double sum = 0.0;
+    for (size_t k = 0; k <= 2 * half; k++) {
+        size_t j = (i + k < half) ? 0 : i + k - half;
+        if (j >= n) j = n - 1;
+        sum += h[k] * x[j];
+    }
+    return sum;
+}
+
+static void fir_scalar(const double *x, size_t n_out, const double *h, size_t taps, double *out) {
+    for (size_t i = 0; i < n_out; i++) {
+        const double *w = x + i;
+        double sum = 0.0;
+        for (size_t k = 0; k < taps; k++) {
+            sum += h[k] * w[k];
+        }
+        out[i] = sum;
+    }
+}
+
+void kernel_fir_centered(const double *x, size_t n, const double *h, size_t half, double *out) {
+    if (n == 0) return;
+
+    /* Interior: every tap inside the buffer */
+    if (n > 2 * half) table()->fir(x, n - 2 * half, h, 2 * half + 1, out + half);
+
+    /* Ends: clamp indices to the buffer */
+    size_t head = half < n ? half : n;
+    size_t tail = n > half ? n - half : 0;
+    if (tail < head) tail = head;
+    for (size_t i = 0; i < head; i++) out[i] = fir_clamped(x, n, h, half, i);
+    for (size_t i = tail; i < n; i++) out[i] = fir_clamped(x, n, h, half, i);
+}
+
+/* Position of the first element of sorted[0..m) not less than v */
+static size_t lower_bound(const double *sorted, size_t m, double v) {
+    size_t lo = 0, hi = m;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (sorted[mid] < v) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+void kernel_median_filter(const double *x, size_t n, size_t half, double *window, double *out) {
+    /* window holds the finite samples of x[lo..hi) in order; both ends
+     * only move forward, so each step removes and inserts a few */
+    size_t m = 0, lo = 0, hi = 0;   /* Covered: [lo, hi) */
+
+    for (size_t i = 0; i < n; i++) {
+        size_t want_lo = i > half ? i - half : 0;
+        size_t want_hi = i + half < n ? i + half + 1 : n;
+        for (; lo < want_lo; lo++) {
+            double v = x[lo];
+            double dv = v - v;
+            if (dv != dv) continue;
+            size_t k = lower_bound(window, m, v);
+            memmove(window + k, window + k + 1, (m - k - 1) * sizeof(double));
+            m--;
+        }
+        for (; hi < want_hi; hi++) {
+            double v = x[hi];
+            double dv = v - v;
+            if (dv != dv) continue;
+            size_t k = lower_bound(window, m, v);
+            memmove(window + k + 1, window + k, (m - k) * sizeof(double));
+            window[k] = v;
+            m++;
+        }
+
+        double d = x[i] - x[i];
+        if (d != d) {
+            out[i] = x[i];
+            continue;
+        }
+        out[i] = (m % 2) ? window[m / 2] : 0.5 * (window[m / 2 - 1] + window[m / 2]);
+    }
+}
+
+/************************************************************/
+/* Resampling
+ */
+/************************************************************/
+
+size_t kernel_resample_length(size_t n, size_t up, size_t down) {
+    return (n * up + down - 1) / down;
+}
+
+/* Output m of kernel_resample_poly(), clamping inputs to the buffer */
+static double resample_clamped(const double *x, size_t n, const double *h, size_t half,
+                               size_t up, size_t down, size_t m) {
+    ptrdiff_t last = (ptrdiff_t)n - 1;
+    ptrdiff_t step = (ptrdiff_t)up;
+
+    /* Input samples j with |m * down - j * up| <= half */
+    ptrdiff_t t = (ptrdiff_t)(m * down);
+    ptrdiff_t lo = t - (ptrdiff_t)half;
+    ptrdiff_t j_lo = lo >= 0 ? (lo + step - 1) / step : -((-lo) / step);
+    ptrdiff_t j_hi = (t + (ptrdiff_t)half) / step;
+
+    double sum = 0.0;
+    for (ptrdiff_t j = j_lo; j <= j_hi; j++) {
+        ptrdiff_t idx = j < 0 ? 0 : (j > last ? last : j);
+        sum += h[j * step + (ptrdiff_t)half - t] * x[idx];
+    }
+    return sum;
+}
+
+/* The same sum for outputs whose inputs all lie in the buffer */
+static void resample_poly_scalar(const double *x, const double *h, size_t half, size_t up, size_t down,
+                                 size_t m_lo, size_t m_hi, double *out) {
+    for (size_t m = m_lo; m < m_hi; m++) {
+        size_t t = m * down;
+        size_t j_lo = (t - half + up - 1) / up;
+        size_t j_hi = (t + half) / up;
+
+        double sum = 0.0;
+        for (size_t j = j_lo; j <= j_hi; j++) {
+            sum += h[j * up + half - t] * x[j];
+        }
+        out[m] = sum;
+    }
+}
+
+void kernel_resample_poly(const double *x, size_t n, const double *h, size_t half,
+                          size_t up, size_t down, double *out) {
+    if (n == 0) return;
+    size_t n_out = kernel_resample_length(n, up, down);
+
+    /* Interior: m * down >= half and (m * down + half) / up <= n - 1 */
+    size_t m_lo = (half + down - 1) / down;
+    size_t m_hi = n * up > half ? (n * up - 1 - half) / down + 1 : 0;
+    if (m_hi > n_out) m_hi = n_out;
+    if (m_lo > m_hi) m_lo = m_hi = n_out;
+
+    for (size_t m = 0; m < m_lo; m++) out[m] = resample_clamped(x, n, h, half, up, down, m);
+    table()->resample_poly(x, h, half, up, down, m_lo, m_hi, out);
+    for (size_t m = m_hi; m < n_out; m++) out[m] = resample_clamped(x, n, h, half, up, down, m);
+}
+
+void kernel_resample_hold(const double *x, size_t n, size_t up, size_t down, double *out) {
+    size_t n_out = kernel_resample_length(n, up, down);
+    for (size_t m = 0; m < n_out; m++) {
+        size_t j = m * down / up;
+        out[m] = x[j < n ? j : n - 1];
+    }
+}
+
+/************************************************************/
+/* Histograms
+ */
+/************************************************************/
+
+/* Points are binned in blocks: bin indices are computed branch-free into
+ * a small buffer (vectorizable), then scattered into the grid. Dropped
+ * points go to bin 0 with a weight of 0. */
+#define HIST_BLOCK 256
+
+static void hist_index_scalar(const double *x, const double *y, size_t n,
+                              double x0, double y0, double inv_bin, size_t nx, size_t ny,
+                              size_t *idx, uint32_t *keep) {
+    double fnx = (double)nx, fny = (double)ny;
+    for (size_t i = 0; i < n; i++) {
+        double fx = (x[i] - x0) * inv_bin;
+        double fy = (y[i] - y0) * inv_bin;
+        /* NaN fails every comparison */
+        int ok = (fx >= 0.0) & (fx < fnx) & (fy >= 0.0) & (fy < fny);
+        size_t ix = (size_t)(ok ? fx : 0.0);
+        size_t iy = (size_t)(ok ? fy : 0.0);
+        idx[i] = iy * nx + ix;
+        keep[i] = (uint32_t)ok;
+    }
+}
+
+size_t kernel_hist2d(const double *x, const double *y, size_t n,
+                     double x0, double y0, double inv_bin,
+                     size_t nx, size_t ny, uint32_t *counts) {
+    size_t idx[HIST_BLOCK];
+    uint32_t keep[HIST_BLOCK];
+    size_t added = 0;
+    const kernel_table_t *impl = table();
+
+    for (size_t start = 0; start < n; start += HIST_BLOCK) {
+        size_t len = n - start < HIST_BLOCK ? n - start : HIST_BLOCK;
+        impl->hist_index(x + start, y + start, len, x0, y0, inv_bin, nx, ny, idx, keep);
+
+        for (size_t i = 0; i < len; i++) {
+            counts[idx[i]] += keep[i];
+            added += keep[i];
+        }
+    }
+
+    return added;
+}
+
+const kernel_table_t kernel_table_scalar = {
+    .to_single = to_single_scalar,
+    .count_nonfinite = count_nonfinite_scalar,
+    .count_equal = count_equal_scalar,
+    .minmax = minmax_scalar,
+    .moving_average = moving_average_scalar,
+    .speed = speed_scalar,
+    .segments = segments_scalar,
+    .argmax = argmax_scalar,
+    .hist_index = hist_index_scalar,
+    .fir = fir_scalar,
+    .resample_poly = resample_poly_scalar
+};
@@ -0,0 +1,185 @@
+/*
+ * kernels.h - Numeric kernels over contiguous sample buffers
+ *
+ * Analog channels are decoded straight into contiguous arrays (MATLAB
+ * column-major, so each column of an N x K matrix is N adjacent samples).
+ * These kernels scan such columns in place, with branch-free loops. The
+ * hottest scans, the filter interiors and the motion kernels also have
+ * hand-written SIMD variants chosen at run time (see kernel_isa()).
+ */
+
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/************************************************************/
+/* CPU dispatch
+ */
+/************************************************************/
+
+typedef enum {
+    KERNEL_ISA_SCALAR,
+    KERNEL_ISA_SSE2,
+    KERNEL_ISA_AVX2,
+    KERNEL_ISA_AVX512
+} kernel_isa_t;
+
+/* Variant in use: the best the CPU supports, capped by $PRESTO_KERNELS
+ * ("scalar", "sse2", "avx2" or "avx512") */
+kernel_isa_t kernel_isa(void);
+
+/* Best variant the CPU (and OS) supports */
+kernel_isa_t kernel_isa_supported(void);
+
+/* Switch variant (for tests; not thread-safe against running kernels).
+ * Returns -1 if isa is not supported. */
+int kernel_set_isa(kernel_isa_t isa);
+
+const char* kernel_isa_name(kernel_isa_t isa);
+
+/************************************************************/
+/* Precision
+ */
+/************************************************************/
+
+/* out[i] = (float)x[i], rounded to nearest as a C cast is */
+void kernel_double_to_single(const double *x, size_t n, float *out);
+
+/************************************************************/
+/* Finite-value scans
+ */
+/************************************************************/
+
+/* Count NaN/Inf samples */
+size_t kernel_count_nonfinite(const double *x, size_t n);
+
+/* Length of the longest run of consecutive NaN/Inf samples */
+size_t kernel_longest_nonfinite_run(const double *x, size_t n);
+
+/* Min and max over finite samples (both NaN if there are none) */
+void kernel_minmax(const double *x, size_t n, double *min_out, double *max_out);
+
+/* Min/max decimation: split x into n_bins runs of (nearly) equal length
+ * and take the min and max over finite samples of each (NaN for a run
+ * that is empty or has none) */
+void kernel_minmax_bins(const double *x, size_t n, size_t n_bins, double *mins, double *maxs);
+
+/* Mean over finite samples of n_bins bins of width samples each, bin b
+ * covering sample positions [first + b * width, first + (b + 1) * width)
+ * (first may be negative or fractional; positions outside 0..n-1 hold no
+ * samples). NaN for a bin with no finite sample. */
+void kernel_mean_bins(const double *x, size_t n, double first, double width,
+                      size_t n_bins, double *means);
+
+/************************************************************/
+/* Signal shape scans
+ */
+/************************************************************/
+
+/* Count samples exactly equal to value */
+size_t kernel_count_equal(const double *x, size_t n, double value);
+
+/* Length of the longest run of samples that stay within tol of the
+ * run's first sample (NaN/Inf samples break a run) */
+size_t kernel_longest_flat_run(const double *x, size_t n, double tol);
+
+/************************************************************/
+/* Packed bit signals (bit i of word i/64 is sample i)
+ */
+/************************************************************/
+
+/* Pack x[i] > threshold into bits; bits must hold (n + 63) / 64 words */
+void kernel_pack_threshold(const double *x, size_t n, double threshold, uint64_t *bits);
+
+/* Sample indices where a packed signal changes state, taking the state
+ * before sample 0 as 0. Edges therefore alternate rise (0->1), fall
+ * (1->0), starting with a rise. Writes at most cap indices to edges and
+ * returns the total number of edges (call again with more room if larger).
+ */
+size_t kernel_bit_edges(const uint64_t *bits, size_t n, size_t *edges, size_t cap);
+
+/************************************************************/
+/* Motion (x/y position traces)
+ */
+/************************************************************/
+
+/* Centered moving average over 2 * half + 1 samples (fewer at the ends).
+ * A NaN/Inf sample makes only the outputs whose window contains it NaN.
+ * out must not alias x.
+ */
+void kernel_moving_average(const double *x, size_t n, size_t half, double *out);
+
+/* Speed from central differences (one-sided at the ends), in position
+ * units per unit of dt. NaN where a neighbouring sample is NaN/Inf. */
+void kernel_speed(const double *x, const double *y, size_t n, double dt, double *out);
+
+/* Summed length of the segments between consecutive samples, skipping
+ * segments with a NaN/Inf end */
+double kernel_path_length(const double *x, const double *y, size_t n);
+
+/* Index of the largest finite value, or n if there is none */
+size_t kernel_argmax(const double *x, size_t n);
+
+/************************************************************/
+/* Filters (one channel column at a time)
+ */
+/************************************************************/
+
+/* Second-order IIR section run forward over x in place:
+ *   y[i] = b0 x[i] + b1 x[i-1] + b2 x[i-2] - a1 y[i-1] - a2 y[i-2]
+ * The state starts as if x[0] had been the input forever, so a filter with
+ * unit DC gain has no start-up transient. x must be NaN/Inf free.
+ */
+void kernel_biquad(double *x, size_t n, const double b[3], const double a[2]);
+
+/* Reverse x in place */
+void kernel_reverse(double *x, size_t n);
+
+/* out[i] = sum over k = -half..half of h[k + half] * x[i + k], with indices
+ * outside the buffer clamped to the first/last sample. out must not alias x.
+ */
+void kernel_fir_centered(const double *x, size_t n, const double *h, size_t half, double *out);
+
+/* Median of the finite samples within half of i (window shrinks at the
+ * ends). NaN/Inf samples are left as they are. window is scratch for
+ * 2 * half + 1 samples; out must not alias x.
+ */
+void kernel_median_filter(const double *x, size_t n, size_t half, double *window, double *out);
+
+/************************************************************/
+/* Resampling
+ */
+/************************************************************/
+
+/* Output length when resampling n samples by up / down */
+size_t kernel_resample_length(size_t n, size_t up, size_t down);
+
+/* Polyphase FIR resampling by up / down. h is a symmetric low-pass of
+ * 2 * half + 1 taps at the upsampled rate (gain up). Output sample m is
+ * upsampled sample m * down; each one only touches the taps that land on
+ * input samples. Inputs past the ends are clamped to the first/last
+ * sample. out must hold kernel_resample_length(n, up, down) samples.
+ */
+void kernel_resample_poly(const double *x, size_t n, const double *h, size_t half,
+                          size_t up, size_t down, double *out);
+
+/* Sample-and-hold resampling by up / down (for digital channels) */
+void kernel_resample_hold(const double *x, size_t n, size_t up, size_t down, double *out);
+
+/************************************************************/
+/* Histograms
+ */
+/************************************************************/
+
+/* Add (x[i], y[i]) points to an nx by ny grid of bins starting at (x0, y0)
+ * with 1 / inv_bin samples per bin. counts is row-major, row 0 at y0.
+ * Points outside the grid or with a NaN/Inf coordinate are dropped.
+ * Returns the number of points added.
+ */
+size_t kernel_hist2d(const double *x, const double *y, size_t n,
+                     double x0, double y0, double inv_bin,
+                     size_t nx, size_t ny, uint32_t *counts);
+
+#endif /* KERNELS_H */
@@ -0,0 +1,66 @@
+/*
+ * kernels_isa.h - Instruction-set variants of the dispatched kernels
+ *
+ * Internal to kernels.c and kernels_x86.c. Each variant fills in the same
+ * table; kernels.c picks one at first use (see kernel_isa()). Variants
+ * must return exactly what the scalar code returns for every input, bit
+ * for bit: NaN/Inf included, and the same sign when the result is a zero.
+ */
+
+#ifndef KERNELS_ISA_H
+#define KERNELS_ISA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    void (*to_single)(const double *x, size_t n, float *out);
+    size_t (*count_nonfinite)(const double *x, size_t n);
+    size_t (*count_equal)(const double *x, size_t n, double value);
+    void (*minmax)(const double *x, size_t n, double *min_out, double *max_out);
+
+    /* Interior of kernel_moving_average(): out[i] = (sum over k < width
+     * of x[i + k], summed in k order) * scale, for i < n_out */
+    void (*moving_average)(const double *x, size_t n_out, size_t width, double scale, double *out);
+
+    /* Interior of kernel_speed(): out[i] = sqrt(cx * cx + cy * cy) * inv2
+     * with cx = x[i + 2] - x[i], cy likewise, for i < n_out */
+    void (*speed)(const double *x, const double *y, size_t n_out, double inv2, double *out);
+
+    /* Segment pass of kernel_path_length() over one block: out[i] is the
+     * length from point i to point i + 1, or 0 where it is not finite,
+     * for i < n_seg */
+    void (*segments)(const double *x, const double *y, size_t n_seg, double *out);
+
+    /* kernel_argmax(): first index of the largest finite value, or n */
+    size_t (*argmax)(const double *x, size_t n);
+
+    /* Index pass of kernel_hist2d() over one block: idx[i] = iy * nx + ix
+     * and keep[i] = 1 for points inside the grid, idx[i] = 0 and
+     * keep[i] = 0 for the rest */
+    void (*hist_index)(const double *x, const double *y, size_t n,
+                       double x0, double y0, double inv_bin, size_t nx, size_t ny,
+                       size_t *idx, uint32_t *keep);
+
+    /* Interior of kernel_fir_centered(): out[i] = sum over k < taps of
+     * h[k] * x[i + k], summed in k order, for i < n_out */
+    void (*fir)(const double *x, size_t n_out, const double *h, size_t taps, double *out);
+
+    /* Outputs m_lo..m_hi-1 of kernel_resample_poly(), whose inputs all
+     * lie in x (no clamping) */
+    void (*resample_poly)(const double *x, const double *h, size_t half, size_t up, size_t down,
+                          size_t m_lo, size_t m_hi, double *out);
+} kernel_table_t;
+
+/* Portable C (kernels.c); variants use it for tails and unusual inputs */
+extern const kernel_table_t kernel_table_scalar;
+
+/* x86-64 variants (kernels_x86.c); only defined where KERNELS_X86 is */
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define KERNELS_X86 1
+extern const kernel_table_t kernel_table_sse2;
+extern const kernel_table_t kernel_table_avx2;
+extern const kernel_table_t kernel_table_avx512;
+#endif
+
+#endif /* KERNELS_ISA_H */
@@ -0,0 +1,688 @@
+/*
+ * kernels_x86.c - SSE2, AVX2 and AVX-512 variants of the dispatched kernels
+ *
+ * Each function is compiled for its instruction set with a target
+ * attribute, so the file builds with the default flags and the binary
+ * runs anywhere; kernels.c only calls a variant the CPU supports. The
+ * loops do the scalar code's arithmetic lane by lane (no reassociation,
+ * no fused multiply-add), so results match it bit for bit: the filters
+ * and the moving average run one output per lane, each summed in the
+ * scalar order, and SIMD square roots are correctly rounded like sqrt().
+ * Remainders
+ * are left to the scalar code, or masked off with AVX-512.
+ */
+
+#include "kernels_isa.h"
+
+#ifdef KERNELS_X86
+
+#include <math.h>
+#include <stdint.h>
+#include <immintrin.h>
+
+#define SSE2 __attribute__((target("sse2")))
+#define AVX2 __attribute__((target("avx2")))
+#define AVX512 __attribute__((target("avx512f")))
+
+/* Fold the scalar result for a remainder into lane results (NaN: none) */
+static void merge_minmax(double *lo, double *hi, double tail_lo, double tail_hi) {
+    if (tail_lo < *lo) *lo = tail_lo;
+    if (tail_hi > *hi) *hi = tail_hi;
+}
+
+/* First zero in x, with its sign */
+static double first_zero(const double *x, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (x[i] == 0.0) return x[i];
+    }
+    return 0.0;
+}
+
+static void finish_minmax(const double *x, size_t n, double lo, double hi, double *min_out, double *max_out) {
+    /* Lanes that saw no finite sample stay at +/-Inf, never a finite value */
+    *min_out = lo == INFINITY ? NAN : lo;
+    *max_out = hi == -INFINITY ? NAN : hi;
+
+    /* The scalar code keeps the first of equal values, which only shows
+     * for zeros: a zero result has the sign of the first zero in x. The
+     * lanes and their reduction lose that order, so look it up. */
+    if (lo == 0.0) *min_out = first_zero(x, n);
+    if (hi == 0.0) *max_out = first_zero(x, n);
+}
+
+/* Fold per-lane argmax results (value, and index as a double, exact below 2^53; lanes that
+ * took nothing hold -Inf and n) and the scalar result for x[i..n) into
+ * the scalar answer: the largest value, at its first index */
+static size_t finish_argmax(const double *x, size_t n, size_t i, const double *hi, const double *at, int lanes) {
+    double best_hi = -INFINITY;
+    size_t best = n;
+    for (int k = 0; k < lanes; k++) {
+        size_t idx = (size_t)at[k];
+        if (hi[k] > best_hi || (hi[k] == best_hi && idx < best)) {
+            best_hi = hi[k];
+            best = idx;
+        }
+    }
+    size_t tail = kernel_table_scalar.argmax(x + i, n - i);
+    if (tail < n - i && x[i + tail] > best_hi) best = i + tail;
+    return best;
+}
+
+/* Vector variants only handle grids whose indices fit in 32 bits */
+static int grid_fits(size_t nx, size_t ny) {
+    return nx <= INT32_MAX && ny <= INT32_MAX;
+}
+
+static size_t gcd(size_t a, size_t b) {
+    while (b) {
+        size_t r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+/* Inputs j_lo..j_hi of interior resampling output m, and the tap for j_lo
+ * (the tap steps by up with j). Outputs up / gcd(up, down) apart use the
+ * same taps on inputs down / gcd(up, down) apart, so the variants run
+ * such outputs side by side. */
+static void resample_range(size_t m, size_t half, size_t up, size_t down,
+                           size_t *j_lo, size_t *j_hi, size_t *tap) {
+    size_t t = m * down;
+    *j_lo = (t - half + up - 1) / up;
+    *j_hi = (t + half) / up;
+    *tap = *j_lo * up + half - t;
+}
+
+/************************************************************/
+/* SSE2 (2 lanes)
+ */
+/************************************************************/
+
+SSE2 static void to_single_sse2(const double *x, size_t n, float *out) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(x + i));
+        __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(x + i + 2));
+        _mm_storeu_ps(out + i, _mm_movelh_ps(lo, hi));
+    }
+    kernel_table_scalar.to_single(x + i, n - i, out + i);
+}
+
+SSE2 static size_t count_nonfinite_sse2(const double *x, size_t n) {
+    __m128i acc = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d v = _mm_loadu_pd(x + i);
+        __m128d d = _mm_sub_pd(v, v);
+        /* All-ones lanes are -1: subtracting adds one */
+        acc = _mm_sub_epi64(acc, _mm_castpd_si128(_mm_cmpunord_pd(d, d)));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, acc);
+    return lanes[0] + lanes[1] + kernel_table_scalar.count_nonfinite(x + i, n - i);
+}
+
+SSE2 static size_t count_equal_sse2(const double *x, size_t n, double value) {
+    __m128d target = _mm_set1_pd(value);
+    __m128i acc = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d eq = _mm_cmpeq_pd(_mm_loadu_pd(x + i), target);
+        acc = _mm_sub_epi64(acc, _mm_castpd_si128(eq));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, acc);
+    return lanes[0] + lanes[1] + kernel_table_scalar.count_equal(x + i, n - i, value);
+}
+
+SSE2 static void minmax_sse2(const double *x, size_t n, double *min_out, double *max_out) {
+    __m128d pos_inf = _mm_set1_pd(INFINITY), neg_inf = _mm_set1_pd(-INFINITY);
+    __m128d lo = pos_inf, hi = neg_inf;
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d v = _mm_loadu_pd(x + i);
+        __m128d d = _mm_sub_pd(v, v);
+        __m128d ok = _mm_cmpord_pd(d, d);
+        /* Non-finite samples become the identity of min / max */
+        lo = _mm_min_pd(lo, _mm_or_pd(_mm_and_pd(ok, v), _mm_andnot_pd(ok, pos_inf)));
+        hi = _mm_max_pd(hi, _mm_or_pd(_mm_and_pd(ok, v), _mm_andnot_pd(ok, neg_inf)));
+    }
+    double l[2], h[2];
+    _mm_storeu_pd(l, lo);
+    _mm_storeu_pd(h, hi);
+    double rlo = l[1] < l[0] ? l[1] : l[0];
+    double rhi = h[1] > h[0] ? h[1] : h[0];
+
+    double tail_lo, tail_hi;
+    kernel_table_scalar.minmax(x + i, n - i, &tail_lo, &tail_hi);
+    merge_minmax(&rlo, &rhi, tail_lo, tail_hi);
+    finish_minmax(x, n, rlo, rhi, min_out, max_out);
+}
+
+SSE2 static void moving_average_sse2(const double *x, size_t n_out, size_t width, double scale, double *out) {
+    __m128d vscale = _mm_set1_pd(scale);
+    size_t i = 0;
+    for (; i + 2 <= n_out; i += 2) {
+        __m128d sum = _mm_setzero_pd();
+        for (size_t k = 0; k < width; k++) {
+            sum = _mm_add_pd(sum, _mm_loadu_pd(x + i + k));
+        }
+        _mm_storeu_pd(out + i, _mm_mul_pd(sum, vscale));
+    }
+    kernel_table_scalar.moving_average(x + i, n_out - i, width, scale, out + i);
+}
+
+SSE2 static void speed_sse2(const double *x, const double *y, size_t n_out, double inv2, double *out) {
+    __m128d vinv2 = _mm_set1_pd(inv2);
+    size_t i = 0;
+    for (; i + 2 <= n_out; i += 2) {
+        __m128d cx = _mm_sub_pd(_mm_loadu_pd(x + i + 2), _mm_loadu_pd(x + i));
+        __m128d cy = _mm_sub_pd(_mm_loadu_pd(y + i + 2), _mm_loadu_pd(y + i));
+        __m128d d = _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(cx, cx), _mm_mul_pd(cy, cy)));
+        _mm_storeu_pd(out + i, _mm_mul_pd(d, vinv2));
+    }
+    kernel_table_scalar.speed(x + i, y + i, n_out - i, inv2, out + i);
+}
+
+SSE2 static void segments_sse2(const double *x, const double *y, size_t n_seg, double *out) {
+    size_t i = 0;
+    for (; i + 2 <= n_seg; i += 2) {
+        __m128d dx = _mm_sub_pd(_mm_loadu_pd(x + i + 1), _mm_loadu_pd(x + i));
+        __m128d dy = _mm_sub_pd(_mm_loadu_pd(y + i + 1), _mm_loadu_pd(y + i));
+        __m128d d = _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)));
+        __m128d z = _mm_sub_pd(d, d);
+        _mm_storeu_pd(out + i, _mm_and_pd(_mm_cmpord_pd(z, z), d));
+    }
+    kernel_table_scalar.segments(x + i, y + i, n_seg - i, out + i);
+}
+
+SSE2 static size_t argmax_sse2(const double *x, size_t n) {
+    __m128d hi = _mm_set1_pd(-INFINITY), at = _mm_set1_pd((double)n);
+    __m128d idx = _mm_set_pd(1.0, 0.0), step = _mm_set1_pd(2.0);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d v = _mm_loadu_pd(x + i);
+        __m128d d = _mm_sub_pd(v, v);
+        /* Strictly greater, so each lane keeps its first of equal values */
+        __m128d take = _mm_and_pd(_mm_cmpord_pd(d, d), _mm_cmpgt_pd(v, hi));
+        hi = _mm_or_pd(_mm_and_pd(take, v), _mm_andnot_pd(take, hi));
+        at = _mm_or_pd(_mm_and_pd(take, idx), _mm_andnot_pd(take, at));
+        idx = _mm_add_pd(idx, step);
+    }
+    double h[2], a[2];
+    _mm_storeu_pd(h, hi);
+    _mm_storeu_pd(a, at);
+    return finish_argmax(x, n, i, h, a, 2);
+}
+
+SSE2 static void hist_index_sse2(const double *x, const double *y, size_t n,
+                                 double x0, double y0, double inv_bin, size_t nx, size_t ny,
+                                 size_t *idx, uint32_t *keep) {
+    size_t i = 0;
+    if (grid_fits(nx, ny)) {
+        __m128d vx0 = _mm_set1_pd(x0), vy0 = _mm_set1_pd(y0), inv = _mm_set1_pd(inv_bin);
+        __m128d fnx = _mm_set1_pd((double)nx), fny = _mm_set1_pd((double)ny);
+        __m128d zero = _mm_setzero_pd();
+        __m128i vnx = _mm_set1_epi64x((long long)nx), izero = _mm_setzero_si128();
+        for (; i + 2 <= n; i += 2) {
+            __m128d fx = _mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(x + i), vx0), inv);
+            __m128d fy = _mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(y + i), vy0), inv);
+            /* NaN fails every comparison */
+            __m128d ok = _mm_and_pd(_mm_and_pd(_mm_cmpge_pd(fx, zero), _mm_cmplt_pd(fx, fnx)),
+                                    _mm_and_pd(_mm_cmpge_pd(fy, zero), _mm_cmplt_pd(fy, fny)));
+            __m128i ix = _mm_unpacklo_epi32(_mm_cvttpd_epi32(_mm_and_pd(ok, fx)), izero);
+            __m128i iy = _mm_unpacklo_epi32(_mm_cvttpd_epi32(_mm_and_pd(ok, fy)), izero);
+            _mm_storeu_si128((__m128i*)(idx + i), _mm_add_epi64(_mm_mul_epu32(iy, vnx), ix));
+            int mask = _mm_movemask_pd(ok);
+            keep[i] = (uint32_t)(mask & 1);
+            keep[i + 1] = (uint32_t)(mask >> 1 & 1);
+        }
+    }
+    kernel_table_scalar.hist_index(x + i, y + i, n - i, x0, y0, inv_bin, nx, ny, idx + i, keep + i);
+}
+
+SSE2 static void fir_sse2(const double *x, size_t n_out, const double *h, size_t taps, double *out) {
+    size_t i = 0;
+    for (; i + 2 <= n_out; i += 2) {
+        __m128d sum = _mm_setzero_pd();
+        for (size_t k = 0; k < taps; k++) {
+            sum = _mm_add_pd(sum, _mm_mul_pd(_mm_set1_pd(h[k]), _mm_loadu_pd(x + i + k)));
+        }
+        _mm_storeu_pd(out + i, sum);
+    }
+    kernel_table_scalar.fir(x + i, n_out - i, h, taps, out + i);
+}
+
+SSE2 static void resample_poly_sse2(const double *x, const double *h, size_t half, size_t up, size_t down,
+                                    size_t m_lo, size_t m_hi, double *out) {
+    size_t g = gcd(up, down), period = up / g, stride = down / g;
+    for (size_t m0 = m_lo; m0 < m_lo + period && m0 < m_hi; m0++) {
+        size_t m = m0;
+        for (; m + period < m_hi; m += 2 * period) {
+            size_t j_lo, j_hi, tap;
+            resample_range(m, half, up, down, &j_lo, &j_hi, &tap);
+            __m128d sum = _mm_setzero_pd();
+            for (size_t j = j_lo; j <= j_hi; j++, tap += up) {
+                __m128d v = _mm_set_pd(x[j + stride], x[j]);
+                sum = _mm_add_pd(sum, _mm_mul_pd(_mm_set1_pd(h[tap]), v));
+            }
+            double s[2];
+            _mm_storeu_pd(s, sum);
+            out[m] = s[0];
+            out[m + period] = s[1];
+        }
+        for (; m < m_hi; m += period) {
+            kernel_table_scalar.resample_poly(x, h, half, up, down, m, m + 1, out);
+        }
+    }
+}
+
+const kernel_table_t kernel_table_sse2 = {
+    .to_single = to_single_sse2,
+    .count_nonfinite = count_nonfinite_sse2,
+    .count_equal = count_equal_sse2,
+    .minmax = minmax_sse2,
+    .moving_average = moving_average_sse2,
+    .speed = speed_sse2,
+    .segments = segments_sse2,
+    .argmax = argmax_sse2,
+    .hist_index = hist_index_sse2,
+    .fir = fir_sse2,
+    .resample_poly = resample_poly_sse2
+};
+
+/************************************************************/
+/* AVX2 (4 lanes)
+ */
+/************************************************************/
+
+AVX2 static void to_single_avx2(const double *x, size_t n, float *out) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(out + i, _mm256_cvtpd_ps(_mm256_loadu_pd(x + i)));
+    }
+    kernel_table_scalar.to_single(x + i, n - i, out + i);
+}
+
+AVX2 static size_t count_nonfinite_avx2(const double *x, size_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d v = _mm256_loadu_pd(x + i);
+        __m256d d = _mm256_sub_pd(v, v);
+        acc = _mm256_sub_epi64(acc, _mm256_castpd_si256(_mm256_cmp_pd(d, d, _CMP_UNORD_Q)));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3]
+         + kernel_table_scalar.count_nonfinite(x + i, n - i);
+}
+
+AVX2 static size_t count_equal_avx2(const double *x, size_t n, double value) {
+    __m256d target = _mm256_set1_pd(value);
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d eq = _mm256_cmp_pd(_mm256_loadu_pd(x + i), target, _CMP_EQ_OQ);
+        acc = _mm256_sub_epi64(acc, _mm256_castpd_si256(eq));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3]
+         + kernel_table_scalar.count_equal(x + i, n - i, value);
+}
+
+AVX2 static void minmax_avx2(const double *x, size_t n, double *min_out, double *max_out) {
+    __m256d pos_inf = _mm256_set1_pd(INFINITY), neg_inf = _mm256_set1_pd(-INFINITY);
+    __m256d lo = pos_inf, hi = neg_inf;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d v = _mm256_loadu_pd(x + i);
+        __m256d d = _mm256_sub_pd(v, v);
+        __m256d ok = _mm256_cmp_pd(d, d, _CMP_ORD_Q);
+        lo = _mm256_min_pd(lo, _mm256_blendv_pd(pos_inf, v, ok));
+        hi = _mm256_max_pd(hi, _mm256_blendv_pd(neg_inf, v, ok));
+    }
+    double l[4], h[4];
+    _mm256_storeu_pd(l, lo);
+    _mm256_storeu_pd(h, hi);
+    double rlo = l[0], rhi = h[0];
+    for (int k = 1; k < 4; k++) {
+        if (l[k] < rlo) rlo = l[k];
+        if (h[k] > rhi) rhi = h[k];
+    }
+
+    double tail_lo, tail_hi;
+    kernel_table_scalar.minmax(x + i, n - i, &tail_lo, &tail_hi);
+    merge_minmax(&rlo, &rhi, tail_lo, tail_hi);
+    finish_minmax(x, n, rlo, rhi, min_out, max_out);
+}
+
+AVX2 static void moving_average_avx2(const double *x, size_t n_out, size_t width, double scale, double *out) {
+    __m256d vscale = _mm256_set1_pd(scale);
+    size_t i = 0;
+    for (; i + 4 <= n_out; i += 4) {
+        __m256d sum = _mm256_setzero_pd();
+        for (size_t k = 0; k < width; k++) {
+            sum = _mm256_add_pd(sum, _mm256_loadu_pd(x + i + k));
+        }
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(sum, vscale));
+    }
+    kernel_table_scalar.moving_average(x + i, n_out - i, width, scale, out + i);
+}
+
+AVX2 static void speed_avx2(const double *x, const double *y, size_t n_out, double inv2, double *out) {
+    __m256d vinv2 = _mm256_set1_pd(inv2);
+    size_t i = 0;
+    for (; i + 4 <= n_out; i += 4) {
+        __m256d cx = _mm256_sub_pd(_mm256_loadu_pd(x + i + 2), _mm256_loadu_pd(x + i));
+        __m256d cy = _mm256_sub_pd(_mm256_loadu_pd(y + i + 2), _mm256_loadu_pd(y + i));
+        __m256d d = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(cx, cx), _mm256_mul_pd(cy, cy)));
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(d, vinv2));
+    }
+    kernel_table_scalar.speed(x + i, y + i, n_out - i, inv2, out + i);
+}
+
+AVX2 static void segments_avx2(const double *x, const double *y, size_t n_seg, double *out) {
+    size_t i = 0;
+    for (; i + 4 <= n_seg; i += 4) {
+        __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(x + i + 1), _mm256_loadu_pd(x + i));
+        __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(y + i + 1), _mm256_loadu_pd(y + i));
+        __m256d d = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)));
+        __m256d z = _mm256_sub_pd(d, d);
+        _mm256_storeu_pd(out + i, _mm256_and_pd(_mm256_cmp_pd(z, z, _CMP_ORD_Q), d));
+    }
+    kernel_table_scalar.segments(x + i, y + i, n_seg - i, out + i);
+}
+
+AVX2 static size_t argmax_avx2(const double *x, size_t n) {
+    __m256d hi = _mm256_set1_pd(-INFINITY), at = _mm256_set1_pd((double)n);
+    __m256d idx = _mm256_set_pd(3.0, 2.0, 1.0, 0.0), step = _mm256_set1_pd(4.0);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d v = _mm256_loadu_pd(x + i);
+        __m256d d = _mm256_sub_pd(v, v);
+        __m256d take = _mm256_and_pd(_mm256_cmp_pd(d, d, _CMP_ORD_Q), _mm256_cmp_pd(v, hi, _CMP_GT_OQ));
+        hi = _mm256_blendv_pd(hi, v, take);
+        at = _mm256_blendv_pd(at, idx, take);
+        idx = _mm256_add_pd(idx, step);
+    }
+    double h[4], a[4];
+    _mm256_storeu_pd(h, hi);
+    _mm256_storeu_pd(a, at);
+    return finish_argmax(x, n, i, h, a, 4);
+}
+
+AVX2 static void hist_index_avx2(const double *x, const double *y, size_t n,
+                                 double x0, double y0, double inv_bin, size_t nx, size_t ny,
+                                 size_t *idx, uint32_t *keep) {
+    size_t i = 0;
+    if (grid_fits(nx, ny)) {
+        __m256d vx0 = _mm256_set1_pd(x0), vy0 = _mm256_set1_pd(y0), inv = _mm256_set1_pd(inv_bin);
+        __m256d fnx = _mm256_set1_pd((double)nx), fny = _mm256_set1_pd((double)ny);
+        __m256d zero = _mm256_setzero_pd();
+        __m256i vnx = _mm256_set1_epi64x((long long)nx);
+        for (; i + 4 <= n; i += 4) {
+            __m256d fx = _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(x + i), vx0), inv);
+            __m256d fy = _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(y + i), vy0), inv);
+            __m256d ok = _mm256_and_pd(
+                _mm256_and_pd(_mm256_cmp_pd(fx, zero, _CMP_GE_OQ), _mm256_cmp_pd(fx, fnx, _CMP_LT_OQ)),
+                _mm256_and_pd(_mm256_cmp_pd(fy, zero, _CMP_GE_OQ), _mm256_cmp_pd(fy, fny, _CMP_LT_OQ)));
+            __m256i ix = _mm256_cvtepu32_epi64(_mm256_cvttpd_epi32(_mm256_and_pd(ok, fx)));
+            __m256i iy = _mm256_cvtepu32_epi64(_mm256_cvttpd_epi32(_mm256_and_pd(ok, fy)));
+            _mm256_storeu_si256((__m256i*)(idx + i), _mm256_add_epi64(_mm256_mul_epu32(iy, vnx), ix));
+            int mask = _mm256_movemask_pd(ok);
+            for (int k = 0; k < 4; k++) {
+                keep[i + k] = (uint32_t)(mask >> k & 1);
+            }
+        }
+    }
+    kernel_table_scalar.hist_index(x + i, y + i, n - i, x0, y0, inv_bin, nx, ny, idx + i, keep + i);
+}
+
+AVX2 static void fir_avx2(const double *x, size_t n_out, const double *h, size_t taps, double *out) {
+    size_t i = 0;
+    for (; i + 4 <= n_out; i += 4) {
+        __m256d sum = _mm256_setzero_pd();
+        for (size_t k = 0; k < taps; k++) {
+            sum = _mm256_add_pd(sum, _mm256_mul_pd(_mm256_set1_pd(h[k]), _mm256_loadu_pd(x + i + k)));
+        }
+        _mm256_storeu_pd(out + i, sum);
+    }
+    kernel_table_scalar.fir(x + i, n_out - i, h, taps, out + i);
+}
+
+AVX2 static void resample_poly_avx2(const double *x, const double *h, size_t half, size_t up, size_t down,
+                                    size_t m_lo, size_t m_hi, double *out) {
+    size_t g = gcd(up, down), period = up / g, stride = down / g;
+    __m256i lanes = _mm256_set_epi64x((long long)(3 * stride), (long long)(2 * stride), (long long)stride, 0);
+    for (size_t m0 = m_lo; m0 < m_lo + period && m0 < m_hi; m0++) {
+        size_t m = m0;
+        for (; m + 3 * period < m_hi; m += 4 * period) {
+            size_t j_lo, j_hi, tap;
+            resample_range(m, half, up, down, &j_lo, &j_hi, &tap);
+            __m256d sum = _mm256_setzero_pd();
+            for (size_t j = j_lo; j <= j_hi; j++, tap += up) {
+                __m256d v = _mm256_i64gather_pd(x + j, lanes, 8);
+                sum = _mm256_add_pd(sum, _mm256_mul_pd(_mm256_set1_pd(h[tap]), v));
+            }
+            double s[4];
+            _mm256_storeu_pd(s, sum);
+            for (int k = 0; k < 4; k++) {
+                out[m + k * period] = s[k];
+            }
+        }
+        for (; m < m_hi; m += period) {
+            kernel_table_scalar.resample_poly(x, h, half, up, down, m, m + 1, out);
+        }
+    }
+}
+
+const kernel_table_t kernel_table_avx2 = {
+    .to_single = to_single_avx2,
+    .count_nonfinite = count_nonfinite_avx2,
+    .count_equal = count_equal_avx2,
+    .minmax = minmax_avx2,
+    .moving_average = moving_average_avx2,
+    .speed = speed_avx2,
+    .segments = segments_avx2,
+    .argmax = argmax_avx2,
+    .hist_index = hist_index_avx2,
+    .fir = fir_avx2,
+    .resample_poly = resample_poly_avx2
+};
+
+/************************************************************/
+/* AVX-512 (8 lanes, remainders masked)
+ */
+/************************************************************/
+
+/* Lanes of the block at i that lie before n */
+AVX512 static __mmask8 lanes_before(size_t i, size_t n) {
+    return n - i >= 8 ? (__mmask8)0xff : (__mmask8)((1u << (n - i)) - 1);
+}
+
+AVX512 static void to_single_avx512(const double *x, size_t n, float *out) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(out + i, _mm512_cvtpd_ps(_mm512_loadu_pd(x + i)));
+    }
+    kernel_table_scalar.to_single(x + i, n - i, out + i);
+}
+
+AVX512 static size_t count_nonfinite_avx512(const double *x, size_t n) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; i += 8) {
+        __mmask8 m = lanes_before(i, n);
+        __m512d v = _mm512_maskz_loadu_pd(m, x + i);
+        __m512d d = _mm512_sub_pd(v, v);
+        count += (size_t)__builtin_popcount(_mm512_mask_cmp_pd_mask(m, d, d, _CMP_UNORD_Q));
+    }
+    return count;
+}
+
+AVX512 static size_t count_equal_avx512(const double *x, size_t n, double value) {
+    __m512d target = _mm512_set1_pd(value);
+    size_t count = 0;
+    for (size_t i = 0; i < n; i += 8) {
+        __mmask8 m = lanes_before(i, n);
+        __m512d v = _mm512_maskz_loadu_pd(m, x + i);
+        count += (size_t)__builtin_popcount(_mm512_mask_cmp_pd_mask(m, v, target, _CMP_EQ_OQ));
+    }
+    return count;
+}
+
+AVX512 static void minmax_avx512(const double *x, size_t n, double *min_out, double *max_out) {
+    __m512d lo = _mm512_set1_pd(INFINITY), hi = _mm512_set1_pd(-INFINITY);
+    for (size_t i = 0; i < n; i += 8) {
+        __mmask8 m = lanes_before(i, n);
+        __m512d v = _mm512_maskz_loadu_pd(m, x + i);
+        __m512d d = _mm512_sub_pd(v, v);
+        __mmask8 ok = _mm512_mask_cmp_pd_mask(m, d, d, _CMP_ORD_Q);
+        lo = _mm512_mask_min_pd(lo, ok, lo, v);
+        hi = _mm512_mask_max_pd(hi, ok, hi, v);
+    }
+    double l[8], h[8];
+    _mm512_storeu_pd(l, lo);
+    _mm512_storeu_pd(h, hi);
+    double rlo = l[0], rhi = h[0];
+    for (int k = 1; k < 8; k++) {
+        if (l[k] < rlo) rlo = l[k];
+        if (h[k] > rhi) rhi = h[k];
+    }
+    finish_minmax(x, n, rlo, rhi, min_out, max_out);
+}
+
+AVX512 static void moving_average_avx512(const double *x, size_t n_out, size_t width, double scale, double *out) {
+    __m512d vscale = _mm512_set1_pd(scale);
+    for (size_t i = 0; i < n_out; i += 8) {
+        __mmask8 m = lanes_before(i, n_out);
+        __m512d sum = _mm512_setzero_pd();
+        for (size_t k = 0; k < width; k++) {
+            sum = _mm512_add_pd(sum, _mm512_maskz_loadu_pd(m, x + i + k));
+        }
+        _mm512_mask_storeu_pd(out + i, m, _mm512_mul_pd(sum, vscale));
+    }
+}
+
+AVX512 static void speed_avx512(const double *x, const double *y, size_t n_out, double inv2, double *out) {
+    __m512d vinv2 = _mm512_set1_pd(inv2);
+    for (size_t i = 0; i < n_out; i += 8) {
+        __mmask8 m = lanes_before(i, n_out);
+        __m512d cx = _mm512_sub_pd(_mm512_maskz_loadu_pd(m, x + i + 2), _mm512_maskz_loadu_pd(m, x + i));
+        __m512d cy = _mm512_sub_pd(_mm512_maskz_loadu_pd(m, y + i + 2), _mm512_maskz_loadu_pd(m, y + i));
+        __m512d d = _mm512_sqrt_pd(_mm512_add_pd(_mm512_mul_pd(cx, cx), _mm512_mul_pd(cy, cy)));
+        _mm512_mask_storeu_pd(out + i, m, _mm512_mul_pd(d, vinv2));
+    }
+}
+
+AVX512 static void segments_avx512(const double *x, const double *y, size_t n_seg, double *out) {
+    for (size_t i = 0; i < n_seg; i += 8) {
+        __mmask8 m = lanes_before(i, n_seg);
+        __m512d dx = _mm512_sub_pd(_mm512_maskz_loadu_pd(m, x + i + 1), _mm512_maskz_loadu_pd(m, x + i));
+        __m512d dy = _mm512_sub_pd(_mm512_maskz_loadu_pd(m, y + i + 1), _mm512_maskz_loadu_pd(m, y + i));
+        __m512d d = _mm512_sqrt_pd(_mm512_add_pd(_mm512_mul_pd(dx, dx), _mm512_mul_pd(dy, dy)));
+        __m512d z = _mm512_sub_pd(d, d);
+        _mm512_mask_storeu_pd(out + i, m, _mm512_maskz_mov_pd(_mm512_cmp_pd_mask(z, z, _CMP_ORD_Q), d));
+    }
+}
+
+AVX512 static size_t argmax_avx512(const double *x, size_t n) {
+    __m512d hi = _mm512_set1_pd(-INFINITY), at = _mm512_set1_pd((double)n);
+    __m512d idx = _mm512_set_pd(7.0, 6.0, 5.0, 4.0, 3.0, 2.0, 1.0, 0.0), step = _mm512_set1_pd(8.0);
+    for (size_t i = 0; i < n; i += 8) {
+        __mmask8 m = lanes_before(i, n);
+        __m512d v = _mm512_maskz_loadu_pd(m, x + i);
+        __m512d d = _mm512_sub_pd(v, v);
+        __mmask8 take = _mm512_mask_cmp_pd_mask(m, d, d, _CMP_ORD_Q) & _mm512_cmp_pd_mask(v, hi, _CMP_GT_OQ);
+        hi = _mm512_mask_mov_pd(hi, take, v);
+        at = _mm512_mask_mov_pd(at, take, idx);
+        idx = _mm512_add_pd(idx, step);
+    }
+    double h[8], a[8];
+    _mm512_storeu_pd(h, hi);
+    _mm512_storeu_pd(a, at);
+    return finish_argmax(x, n, n, h, a, 8);
+}
+
+AVX512 static void hist_index_avx512(const double *x, const double *y, size_t n,
+                                     double x0, double y0, double inv_bin, size_t nx, size_t ny,
+                                     size_t *idx, uint32_t *keep) {
+    if (!grid_fits(nx, ny)) {
+        kernel_table_scalar.hist_index(x, y, n, x0, y0, inv_bin, nx, ny, idx, keep);
+        return;
+    }
+    __m512d vx0 = _mm512_set1_pd(x0), vy0 = _mm512_set1_pd(y0), inv = _mm512_set1_pd(inv_bin);
+    __m512d fnx = _mm512_set1_pd((double)nx), fny = _mm512_set1_pd((double)ny);
+    __m512d zero = _mm512_setzero_pd();
+    __m512i vnx = _mm512_set1_epi64((long long)nx);
+    for (size_t i = 0; i < n; i += 8) {
+        __mmask8 m = lanes_before(i, n);
+        __m512d fx = _mm512_mul_pd(_mm512_sub_pd(_mm512_maskz_loadu_pd(m, x + i), vx0), inv);
+        __m512d fy = _mm512_mul_pd(_mm512_sub_pd(_mm512_maskz_loadu_pd(m, y + i), vy0), inv);
+        __mmask8 ok = m
+            & _mm512_cmp_pd_mask(fx, zero, _CMP_GE_OQ) & _mm512_cmp_pd_mask(fx, fnx, _CMP_LT_OQ)
+            & _mm512_cmp_pd_mask(fy, zero, _CMP_GE_OQ) & _mm512_cmp_pd_mask(fy, fny, _CMP_LT_OQ);
+        __m512i ix = _mm512_cvtepu32_epi64(_mm512_cvttpd_epi32(_mm512_maskz_mov_pd(ok, fx)));
+        __m512i iy = _mm512_cvtepu32_epi64(_mm512_cvttpd_epi32(_mm512_maskz_mov_pd(ok, fy)));
+        _mm512_mask_storeu_epi64(idx + i, m, _mm512_add_epi64(_mm512_mul_epu32(iy, vnx), ix));
+        for (size_t k = 0; k < 8 && i + k < n; k++) {
+            keep[i + k] = (uint32_t)(ok >> k & 1);
+        }
+    }
+}
+
+AVX512 static void fir_avx512(const double *x, size_t n_out, const double *h, size_t taps, double *out) {
+    for (size_t i = 0; i < n_out; i += 8) {
+        __mmask8 m = lanes_before(i, n_out);
+        __m512d sum = _mm512_setzero_pd();
+        for (size_t k = 0; k < taps; k++) {
+            sum = _mm512_add_pd(sum, _mm512_mul_pd(_mm512_set1_pd(h[k]), _mm512_maskz_loadu_pd(m, x + i + k)));
+        }
+        _mm512_mask_storeu_pd(out + i, m, sum);
+    }
+}
+
+AVX512 static void resample_poly_avx512(const double *x, const double *h, size_t half, size_t up, size_t down,
+                                        size_t m_lo, size_t m_hi, double *out) {
+    size_t g = gcd(up, down), period = up / g, stride = down / g;
+    long long step = (long long)stride;
+    __m512i lanes = _mm512_set_epi64(7 * step, 6 * step, 5 * step, 4 * step, 3 * step, 2 * step, step, 0);
+    for (size_t m0 = m_lo; m0 < m_lo + period && m0 < m_hi; m0++) {
+        size_t m = m0;
+        for (; m + 7 * period < m_hi; m += 8 * period) {
+            size_t j_lo, j_hi, tap;
+            resample_range(m, half, up, down, &j_lo, &j_hi, &tap);
+            __m512d sum = _mm512_setzero_pd();
+            for (size_t j = j_lo; j <= j_hi; j++, tap += up) {
+                __m512d v = _mm512_i64gather_pd(lanes, x + j, 8);
+                sum = _mm512_add_pd(sum, _mm512_mul_pd(_mm512_set1_pd(h[tap]), v));
+            }
+            double s[8];
+            _mm512_storeu_pd(s, sum);
+            for (int k = 0; k < 8; k++) {
+                out[m + k * period] = s[k];
+            }
+        }
+        for (; m < m_hi; m += period) {
+            kernel_table_scalar.resample_poly(x, h, half, up, down, m, m + 1, out);
+        }
+    }
+}
+
+const kernel_table_t kernel_table_avx512 = {
+    .to_single = to_single_avx512,
+    .count_nonfinite = count_nonfinite_avx512,
+    .count_equal = count_equal_avx512,
+    .minmax = minmax_avx512,
+    .moving_average = moving_average_avx512,
+    .speed = speed_avx512,
+    .segments = segments_avx512,
+    .argmax = argmax_avx512,
+    .hist_index = hist_index_avx512,
+    .fir = fir_avx512,
+    .resample_poly = resample_poly_avx512
+};
+
+#endif /* KERNELS_X86 */
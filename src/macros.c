@@ -9,6 +9,8 @@
 #include <string.h>
 #include <stdarg.h>
 #include "macros.h"
+#include "fmt.h"
+#include "plugin.h"
 
 /************************************************************/
 /* Result management
@@ -18,12 +20,14 @@
 void macro_result_init(macro_result_t *result) {
     result->text = NULL;
     result->length = 0;
+    result->capacity = 0;
 }
 
 void macro_result_free(macro_result_t *result) {
     free(result->text);
     result->text = NULL;
     result->length = 0;
+    result->capacity = 0;
 }
 
 void macro_result_set(macro_result_t *result, const char *text) {
@@ -31,28 +35,41 @@ void macro_result_set(macro_result_t *result, const char *text) {
     if (text) {
         result->length = strlen(text);
         result->text = strdup(text);
+        result->capacity = result->text ? result->length + 1 : 0;
+        if (!result->text) result->length = 0;
     } else {
         result->text = NULL;
         result->length = 0;
+        result->capacity = 0;
     }
 }
 
+/* Room for n more bytes plus the terminator; the buffer grows
+ * geometrically so appending a large table stays linear */
+static char* result_reserve(macro_result_t *result, size_t n) {
+    size_t need = result->length + n + 1;
+    if (need > result->capacity) {
+        size_t cap = result->capacity < 1024 ? 1024 : result->capacity;
+        while (cap < need) cap *= 2;
+        char *grown = realloc(result->text, cap);
+        if (!grown) return NULL;
+        result->text = grown;
+        result->capacity = cap;
+    }
+    return result->text + result->length;
+}
+
+static void result_append_n(macro_result_t *result, const char *text, size_t n) {
+    char *end = result_reserve(result, n);
+    if (!end) return;
+    memcpy(end, text, n);
+    result->length += n;
+    result->text[result->length] = '\0';
+}
+
 void macro_result_append(macro_result_t *result, const char *text) {
     if (!text) return;
-    
-    size_t add_len = strlen(text);
-    size_t new_len = result->length + add_len;
-    
-    char *new_text = realloc(result->text, new_len + 1);
-    if (!new_text) return;
-    
-    if (result->length == 0) {
-        new_text[0] = '\0';
-    }
-    
-    strcat(new_text, text);
-    result->text = new_text;
-    result->length = new_len;
+    result_append_n(result, text, strlen(text));
 }
 
 void macro_result_appendf(macro_result_t *result, const char *fmt, ...) {
@@ -60,10 +77,25 @@ void macro_result_appendf(macro_result_t *result, const char *fmt, ...) {
     va_list args;
     
     va_start(args, fmt);
-    vsnprintf(buf, sizeof(buf), fmt, args);
+    int n = vsnprintf(buf, sizeof(buf), fmt, args);
     va_end(args);
     
-    macro_result_append(result, buf);
+    if (n < 0) return;
+    result_append_n(result, buf, (size_t)n < sizeof(buf) ? (size_t)n : sizeof(buf) - 1);
+}
+
+void macro_result_append_fixed(macro_result_t *result, double value, int decimals) {
+    char *end = result_reserve(result, FMT_FIXED_MAX);
+    if (!end) return;
+    result->length += fmt_fixed(end, value, decimals);
+    result->text[result->length] = '\0';
+}
+
+void macro_result_append_int(macro_result_t *result, int64_t value) {
+    char *end = result_reserve(result, FMT_INT_MAX);
+    if (!end) return;
+    result->length += fmt_int(end, value);
+    result->text[result->length] = '\0';
 }
 
 /************************************************************/
@@ -81,7 +113,15 @@ int run_macro(int macro_id, ml_trial_file_t *file, macro_result_t *result) {
         case 3: return macro_scenes(file, result);
         case 4: return macro_analog(file, result);
         case 5: return macro_errorcounts(file, result);
+        case 6: return macro_analogqc(file, result);
+        case 7: return macro_buttons(file, result);
+        case 8: return macro_trajectory(file, result);
+        case 9: return macro_performance(file, result);
+        case 10: return macro_timing(file, result);
+        case 11: return macro_objects(file, result);
+        case 12: return macro_uservars(file, result);
         default:
+            if (run_plugin_macro(macro_id, file, result) == 0) return 0;
             macro_result_set(result, "Unknown macro");
             return -1;
     }
@@ -8,6 +8,7 @@
 #ifndef PRESTO_MACROS_H
 #define PRESTO_MACROS_H
 
+#include <stdint.h>
 #include "ml_trial.h"
 
 /************************************************************/
@@ -18,6 +19,7 @@
 typedef struct {
     char *text;         /* Allocated text output */
     size_t length;      /* Length of text */
+    size_t capacity;    /* Allocated bytes */
 } macro_result_t;
 
 /************************************************************/
@@ -41,6 +43,11 @@ void macro_result_set(macro_result_t *result, const char *text);
 void macro_result_append(macro_result_t *result, const char *text);
 void macro_result_appendf(macro_result_t *result, const char *fmt, ...);
 
+/* Numbers without printf, for per-trial rows (see fmt.h):
+ * append_fixed is "%.*f", append_int is "%d" */
+void macro_result_append_fixed(macro_result_t *result, double value, int decimals);
+void macro_result_append_int(macro_result_t *result, int64_t value);
+
 /************************************************************/
 /* Run a macro by ID
  * Returns 0 on success, -1 on error (unknown macro)
@@ -72,4 +79,25 @@ int macro_analog(ml_trial_file_t *file, macro_result_t *result);
 /* Macro 5: Error counts per condition */
 int macro_errorcounts(ml_trial_file_t *file, macro_result_t *result);
 
+/* Macro 6: Analog data quality (all trials) */
+int macro_analogqc(ml_trial_file_t *file, macro_result_t *result);
+
+/* Macro 7: Button press events (all trials) */
+int macro_buttons(ml_trial_file_t *file, macro_result_t *result);
+
+/* Macro 8: Mouse/touch trajectories (all trials) */
+int macro_trajectory(ml_trial_file_t *file, macro_result_t *result);
+
+/* Macro 9: Rolling performance / learning curve (all trials) */
+int macro_performance(ml_trial_file_t *file, macro_result_t *result);
+
+/* Macro 10: Trial timing and inter-trial intervals (all trials) */
+int macro_timing(ml_trial_file_t *file, macro_result_t *result);
+
+/* Macro 11: Object status per scene and condition (all trials) */
+int macro_objects(ml_trial_file_t *file, macro_result_t *result);
+
+/* Macro 12: UserVars as typed columns (all trials) */
+int macro_uservars(ml_trial_file_t *file, macro_result_t *result);
+
 #endif /* PRESTO_MACROS_H */
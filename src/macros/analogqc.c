@@ -0,0 +1,211 @@
+/************************************************************/
+/* analogqc.c - Macro 6: Analog data quality over the session
+ * Scans every trial's AnalogData for NaN/Inf runs, saturated or
+ * flatlined eye signal, sample-count mismatch against the trial
+ * duration, and dropped samples. Only AnalogData and BehavioralCodes
+ * are decoded; channels are scanned in place in their read buffers.
+ */
+/************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../macros.h"
+#include "../ml_analog.h"
+#include "../kernels.h"
+
+/* Thresholds */
+#define QC_FLAT_MIN_MS      200.0   /* Eye flat this long is a flatline */
+#define QC_FLAT_TOLERANCE   1e-9    /* Max change still considered flat */
+#define QC_SAT_FRACTION     0.02    /* Share of samples pinned at an extreme */
+#define QC_COUNT_FRACTION   0.01    /* Allowed sample-count error vs duration */
+#define QC_COUNT_MIN        2       /* ...but never less than this many samples */
+
+/* Per-trial flags */
+enum {
+    QC_NAN   = 1 << 0,  /* NaN/Inf samples present */
+    QC_SAT   = 1 << 1,  /* Eye pinned at its min or max */
+    QC_FLAT  = 1 << 2,  /* Eye constant for QC_FLAT_MIN_MS or longer */
+    QC_COUNT = 1 << 3,  /* Sample count disagrees with trial duration */
+    QC_DROP  = 1 << 4   /* Channels in the same trial differ in length */
+};
+
+#define QC_N_FLAGS 5
+static const char *qc_flag_names[QC_N_FLAGS] = {
+    "nan", "sat", "flat", "count", "drop"
+};
+
+static const char *qc_fields[] = { "AnalogData", "BehavioralCodes", NULL };
+
+/* Per-trial scan state */
+typedef struct {
+    int flags;
+    size_t samples;         /* Longest channel length */
+    size_t shortest;        /* Shortest non-empty channel length */
+    size_t nonfinite;       /* NaN/Inf samples over all channels */
+    size_t nonfinite_run;   /* Longest NaN/Inf run in any column */
+} qc_trial_t;
+
+/* Trial duration from the last behavioral code time (ms), 0 if unknown */
+static double trial_duration_ms(bhv2_value_t *trial_value) {
+    bhv2_value_t *codes = bhv2_struct_get(trial_value, "BehavioralCodes", 0);
+    bhv2_value_t *times = codes ? bhv2_struct_get(codes, "CodeTimes", 0) : NULL;
+    if (!times || times->total == 0) return 0.0;
+    return bhv2_get_double(times, times->total - 1);
+}
+
+/* View a numeric channel as doubles: the read buffer itself when the
+ * channel is double, otherwise a converted copy stored in *scratch. */
+static const double* channel_doubles(bhv2_value_t *ch, double **scratch) {
+    if (ch->dtype == MATLAB_DOUBLE) return ch->data.d;
+
+    double *buf = realloc(*scratch, ch->total * sizeof(double));
+    if (!buf) return NULL;
+    *scratch = buf;
+    for (uint64_t i = 0; i < ch->total; i++) {
+        buf[i] = bhv2_get_double(ch, i);
+    }
+    return buf;
+}
+
+static void scan_channel(ml_channel_kind_t kind, bhv2_value_t *ch, double interval_ms,
+                         qc_trial_t *qc, double **scratch) {
+    if (!ch) return;  /* Empty or non-numeric */
+
+    size_t n = ml_analog_samples(ch);
+    size_t n_cols = ml_analog_columns(ch);
+
+    if (n > qc->samples) qc->samples = n;
+    if (qc->shortest == 0 || n < qc->shortest) qc->shortest = n;
+
+    const double *x = channel_doubles(ch, scratch);
+    if (!x) return;
+
+    bool is_eye = (kind == ML_CH_EYE);
+    size_t flat_min = (size_t)ceil(QC_FLAT_MIN_MS / interval_ms);
+
+    for (size_t c = 0; c < n_cols; c++) {
+        const double *col = x + c * n;  /* Column-major */
+
+        size_t nf = kernel_count_nonfinite(col, n);
+        if (nf > 0) {
+            qc->nonfinite += nf;
+            size_t run = kernel_longest_nonfinite_run(col, n);
+            if (run > qc->nonfinite_run) qc->nonfinite_run = run;
+            qc->flags |= QC_NAN;
+        }
+
+        if (!is_eye) continue;
+
+        if (kernel_longest_flat_run(col, n, QC_FLAT_TOLERANCE) >= flat_min) {
+            qc->flags |= QC_FLAT;
+            continue;  /* A flat column is trivially "pinned" too */
+        }
+
+        double lo, hi;
+        kernel_minmax(col, n, &lo, &hi);
+        if (isnan(lo) || lo == hi) continue;
+        size_t pinned = kernel_count_equal(col, n, lo) + kernel_count_equal(col, n, hi);
+        if (pinned >= QC_SAT_FRACTION * n && pinned > 1) {
+            qc->flags |= QC_SAT;
+        }
+    }
+}
+
+static void format_flags(int flags, char *buf, size_t size) {
+    buf[0] = '\0';
+    if (flags == 0) {
+        snprintf(buf, size, "ok");
+        return;
+    }
+    size_t len = 0;
+    for (int f = 0; f < QC_N_FLAGS; f++) {
+        if (!(flags & (1 << f))) continue;
+        len += snprintf(buf + len, size - len, "%s%s", len ? "," : "", qc_flag_names[f]);
+        if (len >= size) break;
+    }
+}
+
+int macro_analogqc(ml_trial_file_t *file, macro_result_t *result) {
+    if (set_data_fields(file, qc_fields) != 0) {
+        macro_result_set(result, "Out of memory");
+        return 0;
+    }
+
+    int n_trials = 0, n_flagged = 0, n_no_analog = 0;
+    int flag_counts[QC_N_FLAGS] = {0};
+    size_t total_samples = 0, total_nonfinite = 0;
+    double *scratch = NULL;
+    ml_analog_schema_t *schema = NULL;  /* Channel map, built on first trial */
+
+    macro_result_append(result, "Trial\tCond\tError\tSamples\tExpected\tNaN\tNaNRun\tFlags\n");
+
+    while (read_next_trial(file, SELECT_DATA) > 0) {
+        bhv2_value_t *trial_value = trial_data(file);
+        bhv2_value_t *analog = bhv2_struct_get(trial_value, "AnalogData", 0);
+        n_trials++;
+
+        if (!analog || ml_analog_schema_update(&schema, analog) != 0) {
+            n_no_analog++;
+            macro_result_appendf(result, "%d\t%d\t%d\t-\t-\t-\t-\tno-analog\n",
+                                 trial_number(file), trial_condition(file), trial_error(file));
+            continue;
+        }
+
+        double interval_ms = ml_analog_interval_ms(schema, analog);
+        qc_trial_t qc = {0};
+
+        for (size_t c = 0; c < schema->n_channels; c++) {
+            scan_channel(schema->channels[c].kind, ml_analog_channel(schema, analog, c),
+                         interval_ms, &qc, &scratch);
+        }
+
+        /* Sample count vs duration */
+        double duration = trial_duration_ms(trial_value);
+        long expected = duration > 0.0 ? lround(duration / interval_ms) : -1;
+        if (expected >= 0) {
+            long tolerance = lround(QC_COUNT_FRACTION * expected);
+            if (tolerance < QC_COUNT_MIN) tolerance = QC_COUNT_MIN;
+            if (labs((long)qc.samples - expected) > tolerance) qc.flags |= QC_COUNT;
+        }
+        if (qc.shortest > 0 && qc.shortest < qc.samples) qc.flags |= QC_DROP;
+
+        char flag_text[64];
+        format_flags(qc.flags, flag_text, sizeof(flag_text));
+        if (expected >= 0) {
+            macro_result_appendf(result, "%d\t%d\t%d\t%zu\t%ld\t%zu\t%zu\t%s\n",
+                                 trial_number(file), trial_condition(file), trial_error(file),
+                                 qc.samples, expected, qc.nonfinite, qc.nonfinite_run, flag_text);
+        } else {
+            macro_result_appendf(result, "%d\t%d\t%d\t%zu\t-\t%zu\t%zu\t%s\n",
+                                 trial_number(file), trial_condition(file), trial_error(file),
+                                 qc.samples, qc.nonfinite, qc.nonfinite_run, flag_text);
+        }
+
+        total_samples += qc.samples;
+        total_nonfinite += qc.nonfinite;
+        if (qc.flags) n_flagged++;
+        for (int f = 0; f < QC_N_FLAGS; f++) {
+            if (qc.flags & (1 << f)) flag_counts[f]++;
+        }
+    }
+
+    free(scratch);
+    ml_analog_schema_free(schema);
+
+    /* Session summary */
+    macro_result_appendf(result, "\nTrials: %d\n", n_trials);
+    if (n_trials == 0) return 0;
+
+    macro_result_appendf(result, "Flagged: %d (%.1f%%)\n", n_flagged, 100.0 * n_flagged / n_trials);
+    for (int f = 0; f < QC_N_FLAGS; f++) {
+        macro_result_appendf(result, "  %s: %d\n", qc_flag_names[f], flag_counts[f]);
+    }
+    if (n_no_analog > 0) {
+        macro_result_appendf(result, "  no-analog: %d\n", n_no_analog);
+    }
+    macro_result_appendf(result, "Samples: %zu\n", total_samples);
+    macro_result_appendf(result, "NaN/Inf values: %zu\n", total_nonfinite);
+
+    return 0;
+}
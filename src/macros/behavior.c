@@ -1,37 +1,138 @@
 /************************************************************/
 /* behavior.c - Macro 1: Behavior summary
+ * Error code breakdown plus the reaction time distribution (mean, SD,
+ * median, percentiles) from streaming estimators (stats.h), so nothing
+ * per trial is kept. Reads only ReactionTime.
  */
 /************************************************************/
 
+#include <stdlib.h>
 #include "../macros.h"
+#include "../stats.h"
+
+#define N_ERROR_CODES 10    /* MonkeyLogic uses 0-9 */
+
+static const char *behavior_fields[] = { "ReactionTime", NULL };
+
+/* The per-trial kernel's accumulator */
+typedef struct {
+    stats_hist_t *errors;           /* One bin per error code */
+    stats_moments_t rt;
+    stats_quantiles_t *rt_quantiles;
+} behavior_t;
+
+static void behavior_destroy(void *acc) {
+    behavior_t *bs = acc;
+    if (!bs) return;
+    stats_hist_free(bs->errors);
+    stats_quantiles_free(bs->rt_quantiles);
+    free(bs);
+}
+
+static void* behavior_create(void *ctx) {
+    (void)ctx;
+    behavior_t *bs = calloc(1, sizeof(behavior_t));
+    if (!bs) return NULL;
+    bs->errors = stats_hist_new(0, N_ERROR_CODES, N_ERROR_CODES);
+    bs->rt_quantiles = stats_quantiles_new(0);
+    if (!bs->errors || !bs->rt_quantiles) {
+        behavior_destroy(bs);
+        return NULL;
+    }
+    return bs;
+}
+
+static int behavior_trial(void *acc, const trial_view_t *trial, void *ctx) {
+    (void)ctx;
+    behavior_t *bs = acc;
+    stats_hist_add(bs->errors, trial->error_code);
+
+    /* NaN (no response) is left out by the estimators */
+    bhv2_value_t *rt = bhv2_struct_get(trial->data, "ReactionTime", 0);
+    if (!rt || rt->total == 0) return 0;
+    double x = bhv2_get_double(rt, 0);
+    stats_moments_add(&bs->rt, x);
+    return stats_quantiles_add(bs->rt_quantiles, x);
+}
+
+static int behavior_merge(void *acc, void *later, void *ctx) {
+    (void)ctx;
+    behavior_t *bs = acc;
+    const behavior_t *more = later;
+    stats_moments_merge(&bs->rt, &more->rt);
+    if (stats_hist_merge(bs->errors, more->errors) != 0) return -1;
+    return stats_quantiles_merge(bs->rt_quantiles, more->rt_quantiles);
+}
+
+static int behavior_save(const void *acc, FILE *fp, void *ctx) {
+    (void)ctx;
+    const behavior_t *bs = acc;
+    if (stats_hist_save(bs->errors, fp) != 0 || stats_moments_save(&bs->rt, fp) != 0) return -1;
+    return stats_quantiles_save(bs->rt_quantiles, fp);
+}
+
+static void* behavior_load(FILE *fp, void *ctx) {
+    (void)ctx;
+    behavior_t *bs = calloc(1, sizeof(behavior_t));
+    if (!bs) return NULL;
+    if (!(bs->errors = stats_hist_load(fp)) || bs->errors->n_bins != N_ERROR_CODES
+        || stats_moments_load(&bs->rt, fp) != 0 || !(bs->rt_quantiles = stats_quantiles_load(fp))) {
+        behavior_destroy(bs);
+        return NULL;
+    }
+    return bs;
+}
+
+static const trial_kernel_t behavior_kernel = {
+    .read_flag = SELECT_DATA,
+    .create = behavior_create,
+    .trial = behavior_trial,
+    .merge = behavior_merge,
+    .destroy = behavior_destroy,
+    .save = behavior_save,
+    .load = behavior_load
+};
 
 int macro_behavior(ml_trial_file_t *file, macro_result_t *result) {
-    /* Count error codes (MonkeyLogic uses 0-9) */
-    int error_counts[10] = {0};
-    int total = 0;
-
-    while (read_next_trial(file, SKIP_DATA) > 0) {
-        int error = trial_error(file);
-        if (error >= 0 && error < 10) {
-            error_counts[error]++;
-        }
-        total++;
+    behavior_t *bs;
+    if (set_data_fields(file, behavior_fields) != 0) {
+        macro_result_set(result, "Out of memory");
+        return 0;
+    }
+    if (run_trial_kernel(file, &behavior_kernel, NULL, (void**)&bs) != 0) {
+        /* A read, allocation or kernel error; the cause may be on a worker */
+        macro_result_set(result, "Error reading or processing trials");
+        return 0;
     }
-    
+
     /* Format output */
-    macro_result_appendf(result, "Trials: %d\n", total);
-    
+    uint64_t total = stats_hist_total(bs->errors);
+    const uint64_t *error_counts = bs->errors->counts;
+    macro_result_appendf(result, "Trials: %d\n", (int)total);
+
     if (total > 0) {
-        int correct = error_counts[0];
+        int correct = (int)error_counts[0];
         double pct = 100.0 * correct / total;
         macro_result_appendf(result, "Correct: %d (%.1f%%)\n", correct, pct);
-        
+
         macro_result_append(result, "Errors:\n");
-        for (int e = 0; e < 10; e++) {
+        for (int e = 0; e < N_ERROR_CODES; e++) {
             double epct = 100.0 * error_counts[e] / total;
-            macro_result_appendf(result, "  E%d: %d (%.1f%%)\n", e, error_counts[e], epct);
+            macro_result_appendf(result, "  E%d: %d (%.1f%%)\n", e, (int)error_counts[e], epct);
         }
     }
-    
+
+    if (bs->rt.n > 0) {
+        const stats_quantiles_t *q = bs->rt_quantiles;
+        macro_result_appendf(result, "Reaction time (ms, %d trials):\n", (int)bs->rt.n);
+        macro_result_appendf(result, "  Mean: %.1f (SD %.1f)\n", bs->rt.mean, stats_moments_sd(&bs->rt));
+        macro_result_appendf(result, "  Median: %.1f\n", stats_quantiles_get(q, 0.5));
+        macro_result_appendf(result, "  P5/P25/P75/P95: %.1f / %.1f / %.1f / %.1f\n",
+                             stats_quantiles_get(q, 0.05), stats_quantiles_get(q, 0.25),
+                             stats_quantiles_get(q, 0.75), stats_quantiles_get(q, 0.95));
+        macro_result_appendf(result, "  Range: %.1f - %.1f\n", bs->rt.min, bs->rt.max);
+    }
+
+    behavior_destroy(bs);
     return 0;
 }
@@ -0,0 +1,178 @@
+/************************************************************/
+/* buttons.c - Macro 7: Button press events
+ * Reports per-trial press latency and duration for each button.
+ * Button channels are decoded as packed bits and presses are found
+ * with a word-at-a-time edge detector; no per-sample conversion.
+ */
+/************************************************************/
+
+#define _POSIX_C_SOURCE 200809L  /* For strdup */
+
+#include <stdlib.h>
+#include <string.h>
+#include "../macros.h"
+#include "../ml_analog.h"
+#include "../kernels.h"
+
+static const char *button_fields[] = {
+    "AnalogData.Button", "AnalogData.SampleInterval", NULL
+};
+
+/* Session totals for one button */
+typedef struct {
+    char *name;
+    int trials;             /* Trials where the button was recorded */
+    int pressed;            /* ...and pressed at least once */
+    int presses;
+    double latency_sum;     /* First-press latency (ms) */
+    double duration_sum;    /* First-press duration (ms) */
+} button_summary_t;
+
+typedef struct {
+    button_summary_t *items;
+    size_t count;
+    size_t capacity;
+} button_summaries_t;
+
+static button_summary_t* find_summary(button_summaries_t *list, const char *name) {
+    for (size_t i = 0; i < list->count; i++) {
+        if (strcmp(list->items[i].name, name) == 0) return &list->items[i];
+    }
+    if (list->count >= list->capacity) {
+        size_t new_cap = list->capacity == 0 ? 8 : list->capacity * 2;
+        button_summary_t *grown = realloc(list->items, new_cap * sizeof(button_summary_t));
+        if (!grown) return NULL;
+        list->items = grown;
+        list->capacity = new_cap;
+    }
+    button_summary_t *item = &list->items[list->count];
+    memset(item, 0, sizeof(*item));
+    item->name = strdup(name);
+    if (!item->name) return NULL;
+    list->count++;
+    return item;
+}
+
+/* Packed bits for a button channel: the decoded bits themselves when the
+ * channel is logical, otherwise thresholded at 0.5 into *scratch. */
+static const uint64_t* button_bits(bhv2_value_t *ch, uint64_t n, uint64_t **scratch, double **conv) {
+    if (ch->dtype == MATLAB_LOGICAL && ch->packed) return ch->data.bits;
+
+    uint64_t *bits = realloc(*scratch, BHV2_BIT_WORDS(n) * sizeof(uint64_t));
+    if (!bits) return NULL;
+    *scratch = bits;
+
+    const double *x = ch->data.d;
+    if (ch->dtype != MATLAB_DOUBLE) {
+        double *buf = realloc(*conv, n * sizeof(double));
+        if (!buf) return NULL;
+        *conv = buf;
+        for (uint64_t i = 0; i < n; i++) {
+            buf[i] = bhv2_get_double(ch, i);
+        }
+        x = buf;
+    }
+    kernel_pack_threshold(x, n, 0.5, bits);
+    return bits;
+}
+
+int macro_buttons(ml_trial_file_t *file, macro_result_t *result) {
+    if (set_data_fields(file, button_fields) != 0) {
+        macro_result_set(result, "Out of memory");
+        return 0;
+    }
+    set_decode_flags(file, file->bhv2_file->decode_flags | BHV2_DECODE_PACK_LOGICAL);
+
+    ml_analog_schema_t *schema = NULL;
+    button_summaries_t summaries = {0};
+    uint64_t *scratch = NULL;
+    double *conv = NULL;
+    size_t *edges = NULL;
+    size_t edge_cap = 0;
+    int n_trials = 0;
+
+    macro_result_append(result, "Trial\tCond\tError\tButton\tPresses\tLatency\tDuration\tHeld\n");
+
+    while (read_next_trial(file, SELECT_DATA) > 0) {
+        n_trials++;
+        bhv2_value_t *analog = bhv2_struct_get(trial_data(file), "AnalogData", 0);
+        if (!analog || ml_analog_schema_update(&schema, analog) != 0) continue;
+
+        double interval_ms = ml_analog_interval_ms(schema, analog);
+
+        for (size_t c = 0; c < schema->n_channels; c++) {
+            if (schema->channels[c].kind != ML_CH_BUTTON) continue;
+            bhv2_value_t *ch = ml_analog_channel(schema, analog, c);
+            if (!ch) continue;
+
+            uint64_t n = ml_analog_samples(ch);  /* First column only */
+            const uint64_t *bits = button_bits(ch, n, &scratch, &conv);
+            if (!bits) continue;
+
+            size_t n_edges = kernel_bit_edges(bits, n, edges, edge_cap);
+            if (n_edges > edge_cap) {
+                size_t *grown = realloc(edges, n_edges * sizeof(size_t));
+                if (!grown) continue;
+                edges = grown;
+                edge_cap = n_edges;
+                kernel_bit_edges(bits, n, edges, edge_cap);
+            }
+
+            /* Edges alternate press, release; a trailing press lasts to the end */
+            size_t presses = (n_edges + 1) / 2;
+            double held = 0.0;
+            for (size_t e = 0; e < n_edges; e += 2) {
+                size_t release = (e + 1 < n_edges) ? edges[e + 1] : n;
+                held += (release - edges[e]) * interval_ms;
+            }
+
+            const char *label = schema->channels[c].label;
+            button_summary_t *sum = find_summary(&summaries, label);
+            if (sum) sum->trials++;
+
+            if (presses == 0) {
+                macro_result_appendf(result, "%d\t%d\t%d\t%s\t0\t-\t-\t0.0\n",
+                                     trial_number(file), trial_condition(file), trial_error(file), label);
+                continue;
+            }
+
+            size_t first_release = n_edges > 1 ? edges[1] : n;
+            double latency = edges[0] * interval_ms;
+            double duration = (first_release - edges[0]) * interval_ms;
+            macro_result_appendf(result, "%d\t%d\t%d\t%s\t%zu\t%.1f\t%.1f\t%.1f\n",
+                                 trial_number(file), trial_condition(file), trial_error(file),
+                                 label, presses, latency, duration, held);
+
+            if (sum) {
+                sum->pressed++;
+                sum->presses += (int)presses;
+                sum->latency_sum += latency;
+                sum->duration_sum += duration;
+            }
+        }
+    }
+
+    /* Session summary */
+    macro_result_appendf(result, "\nTrials: %d\n", n_trials);
+    if (summaries.count > 0) {
+        macro_result_append(result, "Button\tTrials\tPressed\tPresses\tMeanLatency\tMeanDuration\n");
+    }
+    for (size_t i = 0; i < summaries.count; i++) {
+        button_summary_t *sum = &summaries.items[i];
+        if (sum->pressed > 0) {
+            macro_result_appendf(result, "%s\t%d\t%d\t%d\t%.1f\t%.1f\n", sum->name, sum->trials,
+                                 sum->pressed, sum->presses,
+                                 sum->latency_sum / sum->pressed, sum->duration_sum / sum->pressed);
+        } else {
+            macro_result_appendf(result, "%s\t%d\t0\t0\t-\t-\n", sum->name, sum->trials);
+        }
+        free(sum->name);
+    }
+
+    free(summaries.items);
+    free(edges);
+    free(scratch);
+    free(conv);
+    ml_analog_schema_free(schema);
+    return 0;
+}
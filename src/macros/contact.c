@@ -0,0 +1,421 @@
+/************************************************************/
+/* contact.c - Graphical macro 5: Trial contact sheet
+ *
+ * One small thumbnail per kept trial, tiled in file order into a single
+ * PNG rendered in-process (no gnuplot). A tile shows:
+ *   - a strip along the top colored by the trial's error code
+ *   - the eye X and Y traces, scaled to the heatmap extent (--extent)
+ *   - a strip along the bottom lit wherever any button is held
+ *
+ * Only AnalogData.Eye and AnalogData.Button are decoded. While trials
+ * stream past, each is reduced to one min/max pair per pixel column
+ * (kernel_minmax_bins()), so the sheet never holds whole traces. Tile
+ * rows are then drawn in parallel when the file has a scheduler.
+ */
+/************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "../ml_analog.h"
+#include "../kernels.h"
+#include "../image.h"
+#include "plot.h"
+
+#define CONTACT_TILE_W 64           /* Pixels; one min/max pair per column */
+#define CONTACT_TILE_H 40
+#define CONTACT_GUTTER 2            /* Background between tiles */
+#define CONTACT_COLUMNS 16          /* Tiles per row */
+#define CONTACT_STRIP 3             /* Height of the error and button strips */
+
+static const char *contact_fields[] = { "AnalogData.Eye", "AnalogData.Button", NULL };
+
+static const uint8_t color_background[3] = { 16, 18, 22 };
+static const uint8_t color_tile[3] = { 34, 38, 46 };
+static const uint8_t color_eye_x[3] = { 0x34, 0x98, 0xdb };    /* As in -g1 */
+static const uint8_t color_eye_y[3] = { 0x85, 0xc1, 0xe9 };
+static const uint8_t color_button[3] = { 0xf1, 0xc4, 0x0f };
+static const uint8_t color_correct[3] = { 0x2e, 0xcc, 0x71 };   /* As in -g2 */
+static const uint8_t color_error3[3] = { 0xe7, 0x4c, 0x3c };
+static const uint8_t color_error7[3] = { 0x34, 0x98, 0xdb };
+static const uint8_t color_other[3] = { 0x95, 0xa5, 0xa6 };
+
+/* One trial, decimated to the tile's columns */
+typedef struct {
+    int trial_num;
+    int error_code;
+    int has_eye;
+    float eye_min[2][CONTACT_TILE_W];   /* X, Y; NaN where there are no samples */
+    float eye_max[2][CONTACT_TILE_W];
+    uint64_t buttons;                   /* Bit c: a button held during column c */
+} thumb_t;
+
+/* Thumbnails of a run of trials (the per-trial kernel's accumulator) */
+typedef struct {
+    thumb_t *thumbs;
+    size_t count;
+    size_t capacity;
+
+    /* Working state */
+    ml_analog_schema_t *schema;
+    double *conv;           /* Channel samples converted to double */
+    size_t conv_len;
+} contact_t;
+
+/* Column col of a channel as doubles: 1 if present, 0 if not, -1 on error */
+static int channel_column(bhv2_value_t *channel, uint64_t col, const double **x, size_t *n,
+                          double **conv, size_t *conv_len) {
+    if (!channel || ml_analog_columns(channel) <= col) return 0;
+
+    *n = ml_analog_samples(channel);
+    if (channel->dtype == MATLAB_DOUBLE && !channel->packed) {
+        *x = channel->data.d + col * *n;
+        return 1;
+    }
+    if (*conv_len < *n) {
+        double *grown = realloc(*conv, *n * sizeof(double));
+        if (!grown) return -1;
+        *conv = grown;
+        *conv_len = *n;
+    }
+    for (size_t i = 0; i < *n; i++) {
+        (*conv)[i] = bhv2_get_double(channel, col * *n + i);
+    }
+    *x = *conv;
+    return 1;
+}
+
+/* Fill the traces and button columns of th from this trial's analog data */
+static int decimate_trial(contact_t *ct, bhv2_value_t *analog, thumb_t *th) {
+    double mins[CONTACT_TILE_W], maxs[CONTACT_TILE_W];
+    for (size_t ch = 0; ch < ct->schema->n_channels; ch++) {
+        const ml_analog_channel_t *info = &ct->schema->channels[ch];
+        bool is_eye = info->kind == ML_CH_EYE && strcmp(info->label, "Eye") == 0;
+        if (!is_eye && info->kind != ML_CH_BUTTON) continue;
+
+        bhv2_value_t *channel = ml_analog_channel(ct->schema, analog, ch);
+        for (int axis = 0; axis < (is_eye ? 2 : 1); axis++) {
+            const double *x;
+            size_t n;
+            int found = channel_column(channel, axis, &x, &n, &ct->conv, &ct->conv_len);
+            if (found < 0) return -1;
+            if (found == 0 || n == 0) continue;
+
+            kernel_minmax_bins(x, n, CONTACT_TILE_W, mins, maxs);
+            for (size_t c = 0; c < CONTACT_TILE_W; c++) {
+                if (is_eye) {
+                    th->eye_min[axis][c] = (float)mins[c];
+                    th->eye_max[axis][c] = (float)maxs[c];
+                } else if (maxs[c] > 0.5) {
+                    th->buttons |= UINT64_C(1) << c;
+                }
+            }
+            th->has_eye |= is_eye;
+        }
+    }
+    return 0;
+}
+
+/************************************************************/
+/* Per-trial kernel
+ */
+/************************************************************/
+
+static void* contact_create(void *ctx) {
+    (void)ctx;
+    return calloc(1, sizeof(contact_t));
+}
+
+static void contact_destroy(void *acc) {
+    contact_t *ct = acc;
+    free(ct->thumbs);
+    free(ct->conv);
+    ml_analog_schema_free(ct->schema);
+    free(ct);
+}
+
+static thumb_t* add_thumb(contact_t *ct) {
+    if (ct->count >= ct->capacity) {
+        size_t new_cap = ct->capacity == 0 ? 64 : ct->capacity * 2;
+        thumb_t *grown = realloc(ct->thumbs, new_cap * sizeof(thumb_t));
+        if (!grown) return NULL;
+        ct->thumbs = grown;
+        ct->capacity = new_cap;
+    }
+    thumb_t *th = &ct->thumbs[ct->count++];
+    memset(th, 0, sizeof(*th));
+    return th;
+}
+
+static int contact_trial(void *acc, const trial_view_t *trial, void *ctx) {
+    (void)ctx;
+    contact_t *ct = acc;
+    thumb_t *th = add_thumb(ct);
+    if (!th) return -1;
+    th->trial_num = trial->trial_num;
+    th->error_code = trial->error_code;
+
+    /* A trial without analog data still gets its tile (error strip only) */
+    for (int axis = 0; axis < 2; axis++) {
+        for (size_t c = 0; c < CONTACT_TILE_W; c++) {
+            th->eye_min[axis][c] = th->eye_max[axis][c] = NAN;
+        }
+    }
+    bhv2_value_t *analog = bhv2_struct_get(trial->data, "AnalogData", 0);
+    if (!analog || ml_analog_schema_update(&ct->schema, analog) != 0) return 0;
+    return decimate_trial(ct, analog, th);
+}
+
+/* Later trials go after earlier ones */
+static int contact_merge(void *acc, void *later, void *ctx) {
+    (void)ctx;
+    contact_t *ct = acc;
+    const contact_t *more = later;
+    for (size_t i = 0; i < more->count; i++) {
+        thumb_t *th = add_thumb(ct);
+        if (!th) return -1;
+        *th = more->thumbs[i];
+    }
+    return 0;
+}
+
+static const trial_kernel_t contact_kernel = {
+    .read_flag = SELECT_DATA,
+    .create = contact_create,
+    .trial = contact_trial,
+    .merge = contact_merge,
+    .destroy = contact_destroy
+};
+
+/************************************************************/
+/* Rendering
+ */
+/************************************************************/
+
+/* Sheet being drawn; tile rows are drawn independently (disjoint pixels) */
+typedef struct {
+    image_t *img;
+    const contact_t *ct;
+    const plot_options_t *opts;
+
+    /* Parallel rendering */
+    sched_t *sched;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    size_t pending;         /* Tile rows not yet drawn */
+} sheet_t;
+
+typedef struct {
+    sheet_t *sheet;
+    size_t row;
+} sheet_row_t;
+
+static const uint8_t* error_color(int error_code) {
+    if (error_code == 0) return color_correct;
+    if (error_code == 3) return color_error3;
+    if (error_code == 7) return color_error7;
+    return color_other;
+}
+
+static void fill_rect(image_t *img, size_t x0, size_t y0, size_t w, size_t h, const uint8_t rgb[3]) {
+    for (size_t y = y0; y < y0 + h; y++) {
+        for (size_t x = x0; x < x0 + w; x++) {
+            image_set(img, x, y, rgb);
+        }
+    }
+}
+
+/* Vertical span [top, bottom] (pixel rows, fractional) in column x,
+ * anti-aliased by each pixel's coverage; at least one pixel thick */
+static void draw_span(image_t *img, size_t x, double top, double bottom,
+                      double clip_top, double clip_bottom, const uint8_t rgb[3]) {
+    if (bottom - top < 1.0) {
+        double mid = 0.5 * (top + bottom);
+        top = mid - 0.5;
+        bottom = mid + 0.5;
+    }
+    if (top < clip_top) top = clip_top;
+    if (bottom > clip_bottom) bottom = clip_bottom;
+
+    for (size_t y = (size_t)floor(top); (double)y < bottom; y++) {
+        double lo = (double)y > top ? (double)y : top;
+        double hi = (double)(y + 1) < bottom ? (double)(y + 1) : bottom;
+        image_blend(img, x, y, rgb, hi - lo);
+    }
+}
+
+/* One trace: each column's min..max, widened to reach the previous
+ * column's range so the trace stays connected */
+static void draw_trace(image_t *img, size_t x0, double top, double height,
+                       const float *mins, const float *maxs, double v0, double v1,
+                       const uint8_t rgb[3]) {
+    double scale = height / (v1 - v0);
+    double prev_lo = NAN, prev_hi = NAN;
+    for (size_t c = 0; c < CONTACT_TILE_W; c++) {
+        double lo = mins[c], hi = maxs[c];
+        if (isnan(lo)) {
+            prev_lo = prev_hi = NAN;
+            continue;
+        }
+        double span_lo = lo, span_hi = hi;
+        if (!isnan(prev_lo)) {
+            if (prev_hi < span_lo) span_lo = prev_hi;
+            if (prev_lo > span_hi) span_hi = prev_lo;
+        }
+        prev_lo = lo;
+        prev_hi = hi;
+
+        /* Values run up, pixel rows down */
+        double y_top = top + (v1 - span_hi) * scale;
+        double y_bottom = top + (v1 - span_lo) * scale;
+        draw_span(img, x0 + c, y_top, y_bottom, top, top + height, rgb);
+    }
+}
+
+static void draw_tile(sheet_t *sheet, const thumb_t *th, size_t index) {
+    image_t *img = sheet->img;
+    size_t x0 = CONTACT_GUTTER + (index % CONTACT_COLUMNS) * (CONTACT_TILE_W + CONTACT_GUTTER);
+    size_t y0 = CONTACT_GUTTER + (index / CONTACT_COLUMNS) * (CONTACT_TILE_H + CONTACT_GUTTER);
+
+    fill_rect(img, x0, y0, CONTACT_TILE_W, CONTACT_TILE_H, color_tile);
+    fill_rect(img, x0, y0, CONTACT_TILE_W, CONTACT_STRIP, error_color(th->error_code));
+    for (size_t c = 0; c < CONTACT_TILE_W; c++) {
+        if (th->buttons >> c & 1) {
+            fill_rect(img, x0 + c, y0 + CONTACT_TILE_H - CONTACT_STRIP, 1, CONTACT_STRIP, color_button);
+        }
+    }
+
+    if (!th->has_eye) return;
+    double top = y0 + CONTACT_STRIP + 1;
+    double height = CONTACT_TILE_H - 2 * (CONTACT_STRIP + 1);
+    const double *extent = sheet->opts->extent;
+    draw_trace(img, x0, top, height, th->eye_min[1], th->eye_max[1], extent[2], extent[3], color_eye_y);
+    draw_trace(img, x0, top, height, th->eye_min[0], th->eye_max[0], extent[0], extent[1], color_eye_x);
+}
+
+static void draw_row(sheet_t *sheet, size_t row) {
+    size_t first = row * CONTACT_COLUMNS;
+    size_t end = first + CONTACT_COLUMNS < sheet->ct->count ? first + CONTACT_COLUMNS : sheet->ct->count;
+    for (size_t i = first; i < end; i++) {
+        draw_tile(sheet, &sheet->ct->thumbs[i], i);
+    }
+}
+
+static void draw_row_task(void *arg) {
+    sheet_row_t *task = arg;
+    sheet_t *sheet = task->sheet;
+    draw_row(sheet, task->row);
+
+    pthread_mutex_lock(&sheet->lock);
+    sheet->pending--;
+    pthread_cond_signal(&sheet->done);
+    pthread_mutex_unlock(&sheet->lock);
+}
+
+/* Every tile row as a leaf task; waits by drawing queued rows itself,
+ * as a file task must not block a worker idle (see sched_help()) */
+static int draw_rows_parallel(sheet_t *sheet, size_t n_rows) {
+    sheet_row_t *tasks = malloc(n_rows * sizeof(sheet_row_t));
+    if (!tasks) return -1;
+    pthread_mutex_init(&sheet->lock, NULL);
+    pthread_cond_init(&sheet->done, NULL);
+    sheet->pending = n_rows;
+
+    for (size_t r = 0; r < n_rows; r++) {
+        tasks[r].sheet = sheet;
+        tasks[r].row = r;
+        if (sched_submit(sheet->sched, draw_row_task, &tasks[r], CONTACT_COLUMNS, true) != 0) {
+            draw_row_task(&tasks[r]);  /* Out of memory for the queue: draw here */
+        }
+    }
+
+    pthread_mutex_lock(&sheet->lock);
+    while (sheet->pending > 0) {
+        pthread_mutex_unlock(&sheet->lock);
+        int helped = sched_help(sheet->sched);
+        pthread_mutex_lock(&sheet->lock);
+        if (!helped && sheet->pending > 0) {
+            /* Nothing queued anywhere: the rest is being drawn */
+            pthread_cond_wait(&sheet->done, &sheet->lock);
+        }
+    }
+    pthread_mutex_unlock(&sheet->lock);
+
+    pthread_cond_destroy(&sheet->done);
+    pthread_mutex_destroy(&sheet->lock);
+    free(tasks);
+    return 0;
+}
+
+static image_t* render_sheet(const contact_t *ct, const plot_options_t *opts, sched_t *sched) {
+    size_t n_rows = (ct->count + CONTACT_COLUMNS - 1) / CONTACT_COLUMNS;
+    size_t n_cols = ct->count < CONTACT_COLUMNS ? ct->count : CONTACT_COLUMNS;
+    image_t *img = image_new(CONTACT_GUTTER + n_cols * (CONTACT_TILE_W + CONTACT_GUTTER),
+                             CONTACT_GUTTER + n_rows * (CONTACT_TILE_H + CONTACT_GUTTER));
+    if (!img) return NULL;
+    fill_rect(img, 0, 0, img->width, img->height, color_background);
+
+    sheet_t sheet = { .img = img, .ct = ct, .opts = opts, .sched = sched };
+    if (sched && n_rows > 1) {
+        if (draw_rows_parallel(&sheet, n_rows) != 0) {
+            image_free(img);
+            return NULL;
+        }
+    } else {
+        for (size_t r = 0; r < n_rows; r++) {
+            draw_row(&sheet, r);
+        }
+    }
+    return img;
+}
+
+int run_contact_macro(ml_trial_file_t *file, const char *input_path,
+                      const char *output_dir, const plot_options_t *opts) {
+    const char *out_dir = output_dir ? output_dir : ".";
+    if (strcmp(out_dir, "-") == 0) {
+        fprintf(stderr, "Error: Stdout output (-O -) not supported for contact sheets\n");
+        return -1;
+    }
+    if (!(opts->extent[1] > opts->extent[0]) || !(opts->extent[3] > opts->extent[2])) {
+        fprintf(stderr, "Error: Invalid contact sheet extent\n");
+        return -1;
+    }
+
+    if (set_data_fields(file, contact_fields) != 0) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return -1;
+    }
+
+    contact_t *ct;
+    if (run_trial_kernel(file, &contact_kernel, NULL, (void**)&ct) != 0) return -1;
+    int ret = 0;
+
+    if (ct->count == 0) {
+        fprintf(stderr, "Warning: No trials to plot\n");
+        ret = -1;
+        goto cleanup;
+    }
+
+    image_t *img = render_sheet(ct, opts, file->sched);
+    if (!img) {
+        fprintf(stderr, "Error: Out of memory\n");
+        ret = -1;
+        goto cleanup;
+    }
+
+    char stem[256];
+    char path[1024];
+    plot_output_stem(input_path, stem, sizeof(stem));
+    snprintf(path, sizeof(path), "%s/ContactSheet_%s.png", out_dir, stem);
+    ret = image_write_png(img, path);
+    if (ret == 0) printf("Saved: %s\n", path);
+    image_free(img);
+
+cleanup:
+    contact_destroy(ct);
+    return ret;
+}
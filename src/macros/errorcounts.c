@@ -3,50 +3,112 @@
  */
 /************************************************************/
 
+#include <stdlib.h>
 #include "../macros.h"
 
-int macro_errorcounts(ml_trial_file_t *file, macro_result_t *result) {
-    /* Build a map of condition -> error code -> count */
-    /* For simplicity, use fixed arrays (assume max 100 conditions, 10 error codes) */
-    #define MAX_COND 100
-    int counts[MAX_COND][10] = {{0}};
-    int cond_totals[MAX_COND] = {0};
-    int max_cond = -1;
-    
-    while (read_next_trial(file, SKIP_DATA) > 0) {
-        int cond = trial_condition(file);
-        int error = trial_error(file);
-        
-        if (cond >= 0 && cond < MAX_COND && error >= 0 && error < 10) {
-            counts[cond][error]++;
-            cond_totals[cond]++;
-            if (cond > max_cond) max_cond = cond;
+/* For simplicity, use fixed arrays (assume max 100 conditions, 10 error codes) */
+#define MAX_COND 100
+#define MAX_ERROR 10
+
+/* Map of condition -> error code -> count (the per-trial kernel's accumulator) */
+typedef struct {
+    int counts[MAX_COND][MAX_ERROR];
+    int cond_totals[MAX_COND];
+    int max_cond;
+} errorcounts_t;
+
+static void* errorcounts_create(void *ctx) {
+    (void)ctx;
+    errorcounts_t *ec = calloc(1, sizeof(errorcounts_t));
+    if (ec) ec->max_cond = -1;
+    return ec;
+}
+
+static int errorcounts_trial(void *acc, const trial_view_t *trial, void *ctx) {
+    (void)ctx;
+    errorcounts_t *ec = acc;
+    int cond = trial->condition;
+    int error = trial->error_code;
+
+    if (cond >= 0 && cond < MAX_COND && error >= 0 && error < MAX_ERROR) {
+        ec->counts[cond][error]++;
+        ec->cond_totals[cond]++;
+        if (cond > ec->max_cond) ec->max_cond = cond;
+    }
+    return 0;
+}
+
+static int errorcounts_merge(void *acc, void *later, void *ctx) {
+    (void)ctx;
+    errorcounts_t *ec = acc;
+    const errorcounts_t *more = later;
+    for (int c = 0; c <= more->max_cond; c++) {
+        for (int e = 0; e < MAX_ERROR; e++) {
+            ec->counts[c][e] += more->counts[c][e];
         }
+        ec->cond_totals[c] += more->cond_totals[c];
     }
-    
-    if (max_cond < 0) {
+    if (more->max_cond > ec->max_cond) ec->max_cond = more->max_cond;
+    return 0;
+}
+
+/* Checkpoint: the counts as they are in memory */
+static int errorcounts_save(const void *acc, FILE *fp, void *ctx) {
+    (void)ctx;
+    return fwrite(acc, sizeof(errorcounts_t), 1, fp) == 1 ? 0 : -1;
+}
+
+static void* errorcounts_load(FILE *fp, void *ctx) {
+    errorcounts_t *ec = errorcounts_create(ctx);
+    if (ec && (fread(ec, sizeof(errorcounts_t), 1, fp) != 1 || ec->max_cond >= MAX_COND)) {
+        free(ec);
+        return NULL;
+    }
+    return ec;
+}
+
+static const trial_kernel_t errorcounts_kernel = {
+    .read_flag = SKIP_DATA,
+    .create = errorcounts_create,
+    .trial = errorcounts_trial,
+    .merge = errorcounts_merge,
+    .destroy = free,
+    .save = errorcounts_save,
+    .load = errorcounts_load
+};
+
+int macro_errorcounts(ml_trial_file_t *file, macro_result_t *result) {
+    errorcounts_t *ec;
+    if (run_trial_kernel(file, &errorcounts_kernel, NULL, (void**)&ec) != 0) {
+        /* A read, allocation or kernel error; the cause may be on a worker */
+        macro_result_set(result, "Error reading or processing trials");
+        return 0;
+    }
+
+    if (ec->max_cond < 0) {
         macro_result_set(result, "No data");
+        free(ec);
         return 0;
     }
-    
+
     /* Header: Cond, E0, E1, ..., E9, Total */
     macro_result_append(result, "Cond");
-    for (int e = 0; e < 10; e++) {
+    for (int e = 0; e < MAX_ERROR; e++) {
         macro_result_appendf(result, "\tE%d", e);
     }
     macro_result_append(result, "\tTotal\n");
-    
+
     /* Rows */
-    for (int c = 1; c <= max_cond; c++) {
-        if (cond_totals[c] == 0) continue;
-        
+    for (int c = 1; c <= ec->max_cond; c++) {
+        if (ec->cond_totals[c] == 0) continue;
+
         macro_result_appendf(result, "%d", c);
-        for (int e = 0; e < 10; e++) {
-            macro_result_appendf(result, "\t%d", counts[c][e]);
+        for (int e = 0; e < MAX_ERROR; e++) {
+            macro_result_appendf(result, "\t%d", ec->counts[c][e]);
         }
-        macro_result_appendf(result, "\t%d\n", cond_totals[c]);
+        macro_result_appendf(result, "\t%d\n", ec->cond_totals[c]);
     }
-    
-    #undef MAX_COND
+
+    free(ec);
     return 0;
 }
@@ -4,28 +4,32 @@
 /************************************************************/
 
 #include "../macros.h"
+#include "../stats.h"
+
+#define N_ERROR_CODES 10    /* MonkeyLogic uses 0-9 */
 
 int macro_errors(ml_trial_file_t *file, macro_result_t *result) {
-    /* Count error codes (MonkeyLogic uses 0-9) */
-    int error_counts[10] = {0};
-    int total = 0;
+    /* One bin per error code; other codes only count toward the total */
+    stats_hist_t *errors = stats_hist_new(0, N_ERROR_CODES, N_ERROR_CODES);
+    if (!errors) {
+        macro_result_set(result, "Out of memory");
+        return 0;
+    }
 
     while (read_next_trial(file, SKIP_DATA) > 0) {
-        int error = trial_error(file);
-        if (error >= 0 && error < 10) {
-            error_counts[error]++;
-        }
-        total++;
+        stats_hist_add(errors, trial_error(file));
     }
-    
+    uint64_t total = stats_hist_total(errors);
+
     /* Header */
     macro_result_append(result, "Error\tCount\tPercent\n");
-    
+
     /* Output all error codes 0-9 */
-    for (int e = 0; e < 10; e++) {
-        double pct = total > 0 ? 100.0 * error_counts[e] / total : 0.0;
-        macro_result_appendf(result, "%d\t%d\t%.1f%%\n", e, error_counts[e], pct);
+    for (int e = 0; e < N_ERROR_CODES; e++) {
+        double pct = total > 0 ? 100.0 * errors->counts[e] / total : 0.0;
+        macro_result_appendf(result, "%d\t%d\t%.1f%%\n", e, (int)errors->counts[e], pct);
     }
-    
+
+    stats_hist_free(errors);
     return 0;
 }
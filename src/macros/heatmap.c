@@ -0,0 +1,381 @@
+/************************************************************/
+/* heatmap.c - Graphical macro 3: Gaze density heatmap
+ *
+ * Bins AnalogData.Eye samples of every kept trial into one 2D histogram
+ * per condition. Only the Eye field is decoded. Output is a binary grid
+ * file with the raw counts plus one PPM image per condition, rendered
+ * in-process (no gnuplot).
+ *
+ * Grid file (native byte order):
+ *   char[4]  "PRHM"
+ *   uint32   version (1)
+ *   uint32   nx, ny, n_conditions
+ *   double   x_min, x_max, y_min, y_max, bin   (max = min + n * bin)
+ *   Then per condition (ascending):
+ *     int32    condition
+ *     uint32   trials
+ *     uint64   samples binned
+ *     uint32   counts[ny][nx]   (row 0 at y_min)
+ */
+/************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../ml_analog.h"
+#include "../kernels.h"
+#include "../image.h"
+#include "plot.h"
+
+#define HEATMAP_MAX_BINS 4096       /* Per axis */
+#define HEATMAP_IMAGE_SIZE 480      /* Bins are scaled up to about this many pixels */
+
+static const char *heatmap_fields[] = { "AnalogData.Eye", NULL };
+
+/* Counts for one condition */
+typedef struct {
+    int condition;
+    uint32_t trials;
+    uint64_t samples;
+    uint32_t *counts;
+} heatmap_hist_t;
+
+/* Grid and the histograms over a run of trials (the per-trial kernel's
+ * accumulator, see run_trial_kernel()) */
+typedef struct {
+    size_t nx, ny;
+    double x0, y0, inv_bin;
+    heatmap_hist_t *hists;
+    size_t count;
+    size_t capacity;
+
+    /* Working state */
+    ml_analog_schema_t *schema;
+    double *conv;           /* Eye samples converted to double */
+    size_t conv_len;
+} heatmap_t;
+
+static heatmap_hist_t* find_hist(heatmap_t *hm, int condition) {
+    for (size_t i = 0; i < hm->count; i++) {
+        if (hm->hists[i].condition == condition) return &hm->hists[i];
+    }
+    if (hm->count >= hm->capacity) {
+        size_t new_cap = hm->capacity == 0 ? 8 : hm->capacity * 2;
+        heatmap_hist_t *grown = realloc(hm->hists, new_cap * sizeof(heatmap_hist_t));
+        if (!grown) return NULL;
+        hm->hists = grown;
+        hm->capacity = new_cap;
+    }
+    heatmap_hist_t *h = &hm->hists[hm->count];
+    memset(h, 0, sizeof(*h));
+    h->condition = condition;
+    h->counts = calloc(hm->nx * hm->ny, sizeof(uint32_t));
+    if (!h->counts) return NULL;
+    hm->count++;
+    return h;
+}
+
+static int compare_hist(const void *a, const void *b) {
+    int ca = ((const heatmap_hist_t*)a)->condition;
+    int cb = ((const heatmap_hist_t*)b)->condition;
+    return (ca > cb) - (ca < cb);
+}
+
+/* Eye X and Y columns of this trial: 1 if found, 0 if absent, -1 on error */
+static int trial_eye(ml_analog_schema_t *schema, bhv2_value_t *analog,
+                     const double **x, const double **y, size_t *n,
+                     double **conv, size_t *conv_len) {
+    for (size_t c = 0; c < schema->n_channels; c++) {
+        const ml_analog_channel_t *ch = &schema->channels[c];
+        if (ch->kind != ML_CH_EYE || strcmp(ch->label, "Eye") != 0) continue;
+
+        bhv2_value_t *eye = ml_analog_channel(schema, analog, c);
+        if (!eye || ml_analog_columns(eye) < 2) return 0;
+
+        *n = ml_analog_samples(eye);
+        if (eye->dtype == MATLAB_DOUBLE) {
+            *x = eye->data.d;
+        } else {
+            if (*conv_len < 2 * *n) {
+                double *grown = realloc(*conv, 2 * *n * sizeof(double));
+                if (!grown) return -1;
+                *conv = grown;
+                *conv_len = 2 * *n;
+            }
+            for (size_t i = 0; i < 2 * *n; i++) {
+                (*conv)[i] = bhv2_get_double(eye, i);
+            }
+            *x = *conv;
+        }
+        *y = *x + *n;  /* Column-major: Y follows X */
+        return 1;
+    }
+    return 0;
+}
+
+/************************************************************/
+/* Per-trial kernel
+ */
+/************************************************************/
+
+/* ctx: a heatmap_t holding only the grid */
+static void* heatmap_create(void *ctx) {
+    const heatmap_t *grid = ctx;
+    heatmap_t *hm = calloc(1, sizeof(heatmap_t));
+    if (!hm) return NULL;
+    hm->nx = grid->nx;
+    hm->ny = grid->ny;
+    hm->x0 = grid->x0;
+    hm->y0 = grid->y0;
+    hm->inv_bin = grid->inv_bin;
+    return hm;
+}
+
+static void heatmap_destroy(void *acc) {
+    heatmap_t *hm = acc;
+    for (size_t i = 0; i < hm->count; i++) {
+        free(hm->hists[i].counts);
+    }
+    free(hm->hists);
+    free(hm->conv);
+    ml_analog_schema_free(hm->schema);
+    free(hm);
+}
+
+static int heatmap_trial(void *acc, const trial_view_t *trial, void *ctx) {
+    (void)ctx;
+    heatmap_t *hm = acc;
+    bhv2_value_t *analog = bhv2_struct_get(trial->data, "AnalogData", 0);
+    if (!analog || ml_analog_schema_update(&hm->schema, analog) != 0) return 0;
+
+    const double *x, *y;
+    size_t n;
+    int found = trial_eye(hm->schema, analog, &x, &y, &n, &hm->conv, &hm->conv_len);
+    if (found <= 0) return found;
+
+    heatmap_hist_t *h = find_hist(hm, trial->condition);
+    if (!h) return -1;
+    h->trials++;
+    h->samples += kernel_hist2d(x, y, n, hm->x0, hm->y0, hm->inv_bin, hm->nx, hm->ny, h->counts);
+    return 0;
+}
+
+/* Counts add up, so the merge order does not change the result */
+static int heatmap_merge(void *acc, void *later, void *ctx) {
+    (void)ctx;
+    heatmap_t *hm = acc;
+    const heatmap_t *more = later;
+    size_t n_bins = hm->nx * hm->ny;
+    for (size_t i = 0; i < more->count; i++) {
+        const heatmap_hist_t *src = &more->hists[i];
+        heatmap_hist_t *h = find_hist(hm, src->condition);
+        if (!h) return -1;
+        h->trials += src->trials;
+        h->samples += src->samples;
+        for (size_t b = 0; b < n_bins; b++) {
+            h->counts[b] += src->counts[b];
+        }
+    }
+    return 0;
+}
+
+/* Checkpoint: nx, ny, count, then each histogram as in the grid file */
+static int heatmap_save(const void *acc, FILE *fp, void *ctx) {
+    (void)ctx;
+    const heatmap_t *hm = acc;
+    uint64_t header[3] = { hm->nx, hm->ny, hm->count };
+    if (fwrite(header, sizeof(header), 1, fp) != 1) return -1;
+    for (size_t i = 0; i < hm->count; i++) {
+        const heatmap_hist_t *h = &hm->hists[i];
+        if (fwrite(&h->condition, sizeof(h->condition), 1, fp) != 1
+            || fwrite(&h->trials, sizeof(h->trials), 1, fp) != 1
+            || fwrite(&h->samples, sizeof(h->samples), 1, fp) != 1
+            || fwrite(h->counts, sizeof(uint32_t), hm->nx * hm->ny, fp) != hm->nx * hm->ny) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void* heatmap_load(FILE *fp, void *ctx) {
+    heatmap_t *hm = heatmap_create(ctx);
+    if (!hm) return NULL;
+    uint64_t header[3];
+    if (fread(header, sizeof(header), 1, fp) != 1 || header[0] != hm->nx || header[1] != hm->ny) {
+        heatmap_destroy(hm);
+        return NULL;
+    }
+    for (uint64_t i = 0; i < header[2]; i++) {
+        int condition;
+        uint32_t trials;
+        uint64_t samples;
+        heatmap_hist_t *h = NULL;
+        if (fread(&condition, sizeof(condition), 1, fp) != 1
+            || fread(&trials, sizeof(trials), 1, fp) != 1
+            || fread(&samples, sizeof(samples), 1, fp) != 1
+            || !(h = find_hist(hm, condition))
+            || fread(h->counts, sizeof(uint32_t), hm->nx * hm->ny, fp) != hm->nx * hm->ny) {
+            heatmap_destroy(hm);
+            return NULL;
+        }
+        h->trials = trials;
+        h->samples = samples;
+    }
+    return hm;
+}
+
+static const trial_kernel_t heatmap_kernel = {
+    .read_flag = SELECT_DATA,
+    .create = heatmap_create,
+    .trial = heatmap_trial,
+    .merge = heatmap_merge,
+    .destroy = heatmap_destroy,
+    .save = heatmap_save,
+    .load = heatmap_load
+};
+
+/************************************************************/
+/* Output
+ */
+/************************************************************/
+
+static int write_grid_file(const heatmap_t *hm, const plot_options_t *opts, const char *path) {
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        fprintf(stderr, "Error: Cannot write to %s: ", path);
+        perror(NULL);
+        return -1;
+    }
+
+    uint32_t version = 1;
+    uint32_t dims[3] = { (uint32_t)hm->nx, (uint32_t)hm->ny, (uint32_t)hm->count };
+    /* The last bin may reach past the requested max; store the real edges */
+    double grid[5] = { opts->extent[0], opts->extent[0] + hm->nx * opts->bin,
+                       opts->extent[2], opts->extent[2] + hm->ny * opts->bin, opts->bin };
+
+    int ok = fwrite("PRHM", 1, 4, fp) == 4
+          && fwrite(&version, sizeof(version), 1, fp) == 1
+          && fwrite(dims, sizeof(dims), 1, fp) == 1
+          && fwrite(grid, sizeof(grid), 1, fp) == 1;
+
+    size_t n_bins = hm->nx * hm->ny;
+    for (size_t i = 0; ok && i < hm->count; i++) {
+        const heatmap_hist_t *h = &hm->hists[i];
+        int32_t condition = h->condition;
+        ok = fwrite(&condition, sizeof(condition), 1, fp) == 1
+          && fwrite(&h->trials, sizeof(h->trials), 1, fp) == 1
+          && fwrite(&h->samples, sizeof(h->samples), 1, fp) == 1
+          && fwrite(h->counts, sizeof(uint32_t), n_bins, fp) == n_bins;
+    }
+
+    if (fclose(fp) != 0) ok = 0;
+    if (!ok) {
+        fprintf(stderr, "Error: Failed writing %s\n", path);
+        return -1;
+    }
+    printf("Saved: %s\n", path);
+    return 0;
+}
+
+/* Log-scaled counts through the heat colormap, y up, each bin scale x scale pixels */
+static int write_hist_image(const heatmap_t *hm, const heatmap_hist_t *h, const char *path) {
+    size_t larger = hm->nx > hm->ny ? hm->nx : hm->ny;
+    size_t scale = larger < HEATMAP_IMAGE_SIZE ? HEATMAP_IMAGE_SIZE / larger : 1;
+
+    image_t *img = image_new(hm->nx * scale, hm->ny * scale);
+    if (!img) return -1;
+
+    uint32_t max = 0;
+    for (size_t i = 0; i < hm->nx * hm->ny; i++) {
+        if (h->counts[i] > max) max = h->counts[i];
+    }
+    double norm = max > 0 ? 1.0 / log1p((double)max) : 0.0;
+
+    for (size_t by = 0; by < hm->ny; by++) {
+        size_t row = (hm->ny - 1 - by) * scale;  /* Image row 0 is the top */
+        for (size_t bx = 0; bx < hm->nx; bx++) {
+            uint8_t rgb[3];
+            image_colormap(log1p((double)h->counts[by * hm->nx + bx]) * norm, rgb);
+            for (size_t dy = 0; dy < scale; dy++) {
+                for (size_t dx = 0; dx < scale; dx++) {
+                    image_set(img, bx * scale + dx, row + dy, rgb);
+                }
+            }
+        }
+    }
+
+    int ret = image_write_ppm(img, path);
+    image_free(img);
+    if (ret == 0) printf("Saved: %s\n", path);
+    return ret;
+}
+
+int run_heatmap_macro(ml_trial_file_t *file, const char *input_path,
+                      const char *output_dir, const plot_options_t *opts) {
+    const char *out_dir = output_dir ? output_dir : ".";
+    if (strcmp(out_dir, "-") == 0) {
+        fprintf(stderr, "Error: Stdout output (-O -) not supported for heatmaps\n");
+        return -1;
+    }
+
+    double width = opts->extent[1] - opts->extent[0];
+    double height = opts->extent[3] - opts->extent[2];
+    if (!(opts->bin > 0.0) || !(width > 0.0) || !(height > 0.0)) {
+        fprintf(stderr, "Error: Invalid heatmap extent or bin size\n");
+        return -1;
+    }
+
+    heatmap_t grid = {0};
+    grid.nx = (size_t)ceil(width / opts->bin);
+    grid.ny = (size_t)ceil(height / opts->bin);
+    grid.x0 = opts->extent[0];
+    grid.y0 = opts->extent[2];
+    grid.inv_bin = 1.0 / opts->bin;
+    if (grid.nx > HEATMAP_MAX_BINS || grid.ny > HEATMAP_MAX_BINS) {
+        fprintf(stderr, "Error: Heatmap grid too large (%zux%zu bins, max %d per axis)\n",
+                grid.nx, grid.ny, HEATMAP_MAX_BINS);
+        return -1;
+    }
+
+    if (set_data_fields(file, heatmap_fields) != 0) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return -1;
+    }
+
+    /* Binning runs next to decoding when the file has a scheduler */
+    heatmap_t *hm;
+    if (run_trial_kernel(file, &heatmap_kernel, &grid, (void**)&hm) != 0) return -1;
+    int ret = 0;
+
+    if (hm->count == 0) {
+        fprintf(stderr, "Warning: No eye data to plot\n");
+        ret = -1;
+        goto cleanup;
+    }
+    qsort(hm->hists, hm->count, sizeof(heatmap_hist_t), compare_hist);
+
+    char stem[256];
+    char path[1024];
+    plot_output_stem(input_path, stem, sizeof(stem));
+
+    snprintf(path, sizeof(path), "%s/GazeHeatmap_%s.grid", out_dir, stem);
+    if (write_grid_file(hm, opts, path) != 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < hm->count; i++) {
+        snprintf(path, sizeof(path), "%s/GazeHeatmap_%s_c%d.ppm", out_dir, stem, hm->hists[i].condition);
+        if (write_hist_image(hm, &hm->hists[i], path) != 0) {
+            ret = -1;
+            goto cleanup;
+        }
+    }
+
+cleanup:
+    heatmap_destroy(hm);
+    return ret;
+}
@@ -0,0 +1,345 @@
+/************************************************************/
+/* objects.c - Macro 11: Object status over the session
+ * Streams ObjectStatusRecord from every trial and reports, per
+ * condition and scene, frame counts (status records), scene durations, object onsets
+ * and offsets, and how long each object was on screen.
+ *
+ * Only ObjectStatusRecord.Time, .Status and .SceneParam.{Time,
+ * AdapterList} are decoded. Each trial's record is flattened into
+ * typed arrays (record times, a records x objects status matrix, scene
+ * start times) that are reused from trial to trial.
+ *
+ * A record holds the status of every object from its time until the
+ * next record; the last record closes the trial. A record belongs to
+ * the last scene that started at or before it. Objects are taken to
+ * be off before the first record.
+ */
+/************************************************************/
+
+#define _POSIX_C_SOURCE 200809L  /* For strdup */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../macros.h"
+
+static const char *objects_fields[] = {
+    "ObjectStatusRecord.Time",
+    "ObjectStatusRecord.Status",
+    "ObjectStatusRecord.SceneParam.Time",
+    "ObjectStatusRecord.SceneParam.AdapterList",
+    NULL
+};
+
+/* One trial's ObjectStatusRecord, flattened */
+typedef struct {
+    size_t n_records;
+    size_t n_objects;
+    double *time;               /* [n_records] ms */
+    uint8_t *status;            /* [n_records * n_objects], record-major */
+    size_t n_scenes;
+    double *scene_time;         /* [n_scenes] ms */
+    const char **scene_label;   /* [n_scenes] first adapter, points into the trial */
+    size_t record_cap, status_cap, scene_time_cap, scene_label_cap;
+} osr_trial_t;
+
+/* Condition x scene sums */
+typedef struct {
+    int condition;
+    size_t scene;               /* 1-based */
+    char *label;
+    int trials;
+    double frames;
+    double duration;
+    double onsets;
+    double offsets;
+    size_t n_objects;
+    int *shown;                 /* [n_objects] trials with the object on */
+    double *on_time;            /* [n_objects] ms on screen, summed */
+} osr_group_t;
+
+typedef struct {
+    osr_group_t *items;
+    size_t count;
+    size_t capacity;
+} osr_groups_t;
+
+/************************************************************/
+/* Flattening
+ */
+/************************************************************/
+
+static int grow(void **buf, size_t *cap, size_t n, size_t size) {
+    if (n <= *cap) return 0;
+    size_t new_cap = *cap ? *cap : 16;
+    while (new_cap < n) new_cap *= 2;
+    void *grown = realloc(*buf, new_cap * size);
+    if (!grown) return -1;
+    *buf = grown;
+    *cap = new_cap;
+    return 0;
+}
+
+/* Status of record r: a cell of per-record vectors, or a records x objects matrix */
+static size_t record_objects(bhv2_value_t *status, size_t r, size_t n_records) {
+    if (status->dtype == MATLAB_CELL) {
+        bhv2_value_t *row = bhv2_cell_get(status, r);
+        return row ? row->total : 0;
+    }
+    return n_records ? status->total / n_records : 0;
+}
+
+static double record_status(bhv2_value_t *status, size_t r, size_t n_records, size_t o) {
+    if (status->dtype == MATLAB_CELL) {
+        return bhv2_get_double(bhv2_cell_get(status, r), o);
+    }
+    return bhv2_get_double(status, o * n_records + r);  /* Column-major */
+}
+
+/* Returns 0 on success (n_records 0 if the trial has no record), -1 on allocation failure */
+static int flatten(bhv2_value_t *osr, osr_trial_t *t) {
+    t->n_records = t->n_objects = t->n_scenes = 0;
+
+    bhv2_value_t *time = osr ? bhv2_struct_get(osr, "Time", 0) : NULL;
+    bhv2_value_t *status = osr ? bhv2_struct_get(osr, "Status", 0) : NULL;
+    if (!time || !status || time->total == 0) return 0;
+
+    size_t n = time->total;
+    if (status->dtype == MATLAB_CELL && status->total < n) n = status->total;
+
+    size_t n_objects = 0;
+    for (size_t r = 0; r < n; r++) {
+        size_t k = record_objects(status, r, n);
+        if (k > n_objects) n_objects = k;
+    }
+
+    if (grow((void**)&t->time, &t->record_cap, n, sizeof(double)) != 0) return -1;
+    if (grow((void**)&t->status, &t->status_cap, n * n_objects, sizeof(uint8_t)) != 0) return -1;
+
+    for (size_t r = 0; r < n; r++) {
+        t->time[r] = bhv2_get_double(time, r);
+        size_t k = record_objects(status, r, n);
+        uint8_t *row = t->status + r * n_objects;
+        for (size_t o = 0; o < n_objects; o++) {
+            row[o] = o < k && record_status(status, r, n, o) != 0.0;
+        }
+    }
+    t->n_records = n;
+    t->n_objects = n_objects;
+
+    /* Scenes; without start times the whole trial is one scene */
+    bhv2_value_t *scenes = bhv2_struct_get(osr, "SceneParam", 0);
+    size_t n_scenes = scenes && scenes->dtype == MATLAB_STRUCT ? scenes->total : 0;
+    size_t scene_slots = n_scenes ? n_scenes : 1;
+    if (grow((void**)&t->scene_time, &t->scene_time_cap, scene_slots, sizeof(double)) != 0) return -1;
+    if (grow((void**)&t->scene_label, &t->scene_label_cap, scene_slots, sizeof(char*)) != 0) return -1;
+
+    size_t kept = 0;
+    for (size_t s = 0; s < n_scenes; s++) {
+        bhv2_value_t *start = bhv2_struct_get(scenes, "Time", s);
+        if (!start || start->total == 0) continue;
+        bhv2_value_t *adapters = bhv2_struct_get(scenes, "AdapterList", s);
+        bhv2_value_t *first = adapters && adapters->dtype == MATLAB_CELL ? bhv2_cell_get(adapters, 0) : adapters;
+        const char *label = bhv2_get_string(first);
+        t->scene_time[kept] = bhv2_get_double(start, 0);
+        t->scene_label[kept] = label && *label ? label : "-";
+        kept++;
+    }
+    if (kept == 0) {
+        t->scene_time[0] = t->time[0];
+        t->scene_label[0] = "-";
+        kept = 1;
+    }
+    t->n_scenes = kept;
+    return 0;
+}
+
+static void osr_trial_free(osr_trial_t *t) {
+    free(t->time);
+    free(t->status);
+    free(t->scene_time);
+    free(t->scene_label);
+}
+
+/************************************************************/
+/* Grouping
+ */
+/************************************************************/
+
+static osr_group_t* find_group(osr_groups_t *list, int condition, size_t scene, const char *label) {
+    for (size_t i = 0; i < list->count; i++) {
+        osr_group_t *g = &list->items[i];
+        if (g->condition == condition && g->scene == scene && strcmp(g->label, label) == 0) return g;
+    }
+    if (list->count >= list->capacity) {
+        size_t new_cap = list->capacity == 0 ? 16 : list->capacity * 2;
+        osr_group_t *grown = realloc(list->items, new_cap * sizeof(osr_group_t));
+        if (!grown) return NULL;
+        list->items = grown;
+        list->capacity = new_cap;
+    }
+    osr_group_t *g = &list->items[list->count];
+    memset(g, 0, sizeof(*g));
+    g->condition = condition;
+    g->scene = scene;
+    g->label = strdup(label);
+    if (!g->label) return NULL;
+    list->count++;
+    return g;
+}
+
+static int group_objects(osr_group_t *g, size_t n_objects) {
+    if (n_objects <= g->n_objects) return 0;
+    int *shown = realloc(g->shown, n_objects * sizeof(int));
+    if (!shown) return -1;
+    g->shown = shown;
+    double *on_time = realloc(g->on_time, n_objects * sizeof(double));
+    if (!on_time) return -1;
+    g->on_time = on_time;
+    for (size_t o = g->n_objects; o < n_objects; o++) {
+        g->shown[o] = 0;
+        g->on_time[o] = 0.0;
+    }
+    g->n_objects = n_objects;
+    return 0;
+}
+
+static int compare_group(const void *a, const void *b) {
+    const osr_group_t *ga = a, *gb = b;
+    if (ga->condition != gb->condition) return (ga->condition > gb->condition) - (ga->condition < gb->condition);
+    if (ga->scene != gb->scene) return (ga->scene > gb->scene) - (ga->scene < gb->scene);
+    return strcmp(ga->label, gb->label);
+}
+
+/************************************************************/
+/* Macro
+ */
+/************************************************************/
+
+int macro_objects(ml_trial_file_t *file, macro_result_t *result) {
+    if (set_data_fields(file, objects_fields) != 0) {
+        macro_result_set(result, "Out of memory");
+        return 0;
+    }
+
+    osr_trial_t t = {0};
+    osr_groups_t groups = {0};
+    double *on_scratch = NULL;
+    size_t on_cap = 0;
+    int n_trials = 0, n_recorded = 0;
+    int failed = 0;
+
+    macro_result_append(result, "Trial\tCond\tError\tScenes\tFrames\tObjects\tOnsets\tOffsets\tDuration\n");
+
+    while (!failed && read_next_trial(file, SELECT_DATA) > 0) {
+        n_trials++;
+        bhv2_value_t *osr = bhv2_struct_get(trial_data(file), "ObjectStatusRecord", 0);
+        if (flatten(osr, &t) != 0) {
+            failed = 1;
+            break;
+        }
+        if (t.n_records == 0) continue;
+        n_recorded++;
+
+        if (grow((void**)&on_scratch, &on_cap, t.n_objects ? t.n_objects : 1, sizeof(double)) != 0) {
+            failed = 1;
+            break;
+        }
+
+        int trial_onsets = 0, trial_offsets = 0;
+        size_t r = 0;
+        for (size_t s = 0; s < t.n_scenes; s++) {
+            /* Records of this scene (the first scene also takes earlier records) */
+            size_t begin = r;
+            while (r < t.n_records && (s + 1 == t.n_scenes || t.time[r] < t.scene_time[s + 1])) r++;
+            size_t end = r;
+
+            double scene_start = s == 0 ? fmin(t.scene_time[0], t.time[0]) : t.scene_time[s];
+            double scene_end = s + 1 < t.n_scenes ? t.scene_time[s + 1] : t.time[t.n_records - 1];
+
+            int onsets = 0, offsets = 0;
+            for (size_t i = begin; i < end; i++) {
+                const uint8_t *row = t.status + i * t.n_objects;
+                const uint8_t *prev = i > 0 ? row - t.n_objects : NULL;
+                for (size_t o = 0; o < t.n_objects; o++) {
+                    int was = prev ? prev[o] : 0;
+                    onsets += row[o] && !was;
+                    offsets += !row[o] && was;
+                }
+            }
+
+            /* On-screen time: each record's hold, clipped to the scene; the
+             * previous scene's last record carries over until the first one here */
+            memset(on_scratch, 0, t.n_objects * sizeof(double));
+            for (size_t i = begin > 0 ? begin - 1 : 0; i < end; i++) {
+                double from = fmax(t.time[i], scene_start);
+                double until = fmin(i + 1 < t.n_records ? t.time[i + 1] : t.time[i], scene_end);
+                if (!(until > from)) continue;
+                const uint8_t *row = t.status + i * t.n_objects;
+                for (size_t o = 0; o < t.n_objects; o++) on_scratch[o] += row[o] * (until - from);
+            }
+            trial_onsets += onsets;
+            trial_offsets += offsets;
+
+            osr_group_t *g = find_group(&groups, trial_condition(file), s + 1, t.scene_label[s]);
+            if (!g || group_objects(g, t.n_objects) != 0) {
+                failed = 1;
+                break;
+            }
+            g->trials++;
+            g->frames += end - begin;
+            g->duration += scene_end - scene_start;
+            g->onsets += onsets;
+            g->offsets += offsets;
+            for (size_t o = 0; o < t.n_objects; o++) {
+                g->shown[o] += on_scratch[o] > 0.0;
+                g->on_time[o] += on_scratch[o];
+            }
+        }
+
+        macro_result_appendf(result, "%d\t%d\t%d\t%zu\t%zu\t%zu\t%d\t%d\t%.1f\n",
+                             trial_number(file), trial_condition(file), trial_error(file),
+                             t.n_scenes, t.n_records, t.n_objects, trial_onsets, trial_offsets,
+                             t.time[t.n_records - 1] - fmin(t.scene_time[0], t.time[0]));
+    }
+
+    if (failed) {
+        macro_result_set(result, "Out of memory");
+    } else {
+        /* Means per condition and scene */
+        macro_result_appendf(result, "\nTrials: %d (%d with ObjectStatusRecord)\n", n_trials, n_recorded);
+        if (groups.count > 0) {
+            qsort(groups.items, groups.count, sizeof(osr_group_t), compare_group);
+            macro_result_append(result, "Cond\tScene\tAdapter\tTrials\tFrames\tDuration\tOnsets\tOffsets\n");
+        }
+        for (size_t i = 0; i < groups.count; i++) {
+            osr_group_t *g = &groups.items[i];
+            macro_result_appendf(result, "%d\t%zu\t%s\t%d\t%.1f\t%.1f\t%.2f\t%.2f\n",
+                                 g->condition, g->scene, g->label, g->trials, g->frames / g->trials,
+                                 g->duration / g->trials, g->onsets / g->trials, g->offsets / g->trials);
+        }
+
+        /* On-screen time per object, over the trials that showed it */
+        if (groups.count > 0) {
+            macro_result_append(result, "\nCond\tScene\tObject\tShown\tOnTime\n");
+        }
+        for (size_t i = 0; i < groups.count; i++) {
+            osr_group_t *g = &groups.items[i];
+            for (size_t o = 0; o < g->n_objects; o++) {
+                if (g->shown[o] == 0) continue;
+                macro_result_appendf(result, "%d\t%zu\t%zu\t%d\t%.1f\n", g->condition, g->scene,
+                                     o + 1, g->shown[o], g->on_time[o] / g->shown[o]);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < groups.count; i++) {
+        free(groups.items[i].label);
+        free(groups.items[i].shown);
+        free(groups.items[i].on_time);
+    }
+    free(groups.items);
+    free(on_scratch);
+    osr_trial_free(&t);
+    return 0;
+}
@@ -0,0 +1,195 @@
+/************************************************************/
+/* performance.c - Macro 9: Rolling performance / learning curve
+ * Sliding-window and exponentially weighted accuracy, running rate per
+ * condition and accuracy changepoints, trial by trial. Reads only trial
+ * metadata and AbsoluteTrialStartTime.
+ */
+/************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "../macros.h"
+#include "performance.h"
+
+static const char *performance_fields[] = { "AbsoluteTrialStartTime", NULL };
+
+/************************************************************/
+/* Rolling state
+ */
+/************************************************************/
+
+void perf_init(perf_state_t *perf) {
+    memset(perf, 0, sizeof(*perf));
+}
+
+void perf_free(perf_state_t *perf) {
+    free(perf->conds);
+    perf->conds = NULL;
+    perf->n_conds = 0;
+    perf->cond_capacity = 0;
+}
+
+static perf_cond_t* find_cond(perf_state_t *perf, int condition) {
+    for (size_t i = 0; i < perf->n_conds; i++) {
+        if (perf->conds[i].condition == condition) return &perf->conds[i];
+    }
+    if (perf->n_conds >= perf->cond_capacity) {
+        size_t new_cap = perf->cond_capacity == 0 ? 16 : perf->cond_capacity * 2;
+        perf_cond_t *grown = realloc(perf->conds, new_cap * sizeof(perf_cond_t));
+        if (!grown) return NULL;
+        perf->conds = grown;
+        perf->cond_capacity = new_cap;
+    }
+    perf_cond_t *c = &perf->conds[perf->n_conds++];
+    c->condition = condition;
+    c->trials = 0;
+    c->correct = 0;
+    return c;
+}
+
+/* Page-Hinkley test on this segment; restarts after a detection */
+static int changepoint(perf_state_t *perf, int x) {
+    perf->seg_trials++;
+    perf->seg_mean += (x - perf->seg_mean) / perf->seg_trials;
+
+    perf->ph_up += x - perf->seg_mean - PERF_PH_DELTA;
+    if (perf->ph_up < perf->ph_up_min) perf->ph_up_min = perf->ph_up;
+    perf->ph_down += x - perf->seg_mean + PERF_PH_DELTA;
+    if (perf->ph_down > perf->ph_down_max) perf->ph_down_max = perf->ph_down;
+
+    int change = 0;
+    if (perf->ph_up - perf->ph_up_min > PERF_PH_LAMBDA) change = 1;
+    else if (perf->ph_down_max - perf->ph_down > PERF_PH_LAMBDA) change = -1;
+
+    if (change) {
+        perf->seg_trials = 0;
+        perf->seg_mean = 0.0;
+        perf->ph_up = perf->ph_up_min = 0.0;
+        perf->ph_down = perf->ph_down_max = 0.0;
+    }
+    return change;
+}
+
+int perf_update(perf_state_t *perf, int condition, int error_code) {
+    int x = (error_code == 0);
+
+    perf_cond_t *c = find_cond(perf, condition);
+    if (!c) return -1;
+    c->trials++;
+    c->correct += x;
+
+    perf->trials++;
+    perf->correct += x;
+
+    /* Sliding window */
+    if (perf->ring_count == PERF_WINDOW) {
+        perf->ring_sum -= perf->ring[perf->ring_pos];
+    } else {
+        perf->ring_count++;
+    }
+    perf->ring[perf->ring_pos] = (uint8_t)x;
+    perf->ring_sum += x;
+    perf->ring_pos = (perf->ring_pos + 1) % PERF_WINDOW;
+
+    perf->window_rate = (double)perf->ring_sum / perf->ring_count;
+    perf->ewma = perf->trials == 1 ? x : perf->ewma + PERF_EWMA_ALPHA * (x - perf->ewma);
+    perf->cond_rate = (double)c->correct / c->trials;
+    perf->change = changepoint(perf, x);
+    return 0;
+}
+
+/************************************************************/
+/* Macro
+ */
+/************************************************************/
+
+#define PERF_MAX_LISTED 64      /* Changepoints listed in the summary */
+
+static int compare_cond(const void *a, const void *b) {
+    int ca = ((const perf_cond_t*)a)->condition;
+    int cb = ((const perf_cond_t*)b)->condition;
+    return (ca > cb) - (ca < cb);
+}
+
+int macro_performance(ml_trial_file_t *file, macro_result_t *result) {
+    if (set_data_fields(file, performance_fields) != 0) {
+        macro_result_set(result, "Out of memory");
+        return 0;
+    }
+
+    perf_state_t perf;
+    perf_init(&perf);
+
+    /* Changepoints for the summary */
+    int changes[PERF_MAX_LISTED];
+    int change_dir[PERF_MAX_LISTED];
+    int n_changes = 0;
+
+    double t0 = 0.0;
+    double last_minutes = 0.0;
+    macro_result_append(result, "Trial\tCond\tError\tMinutes\tWindow\tEWMA\tCondRate\tChange\n");
+
+    while (read_next_trial(file, SELECT_DATA) > 0) {
+        if (perf_update(&perf, trial_condition(file), trial_error(file)) != 0) {
+            macro_result_set(result, "Out of memory");
+            perf_free(&perf);
+            return 0;
+        }
+
+        bhv2_value_t *start = bhv2_struct_get(trial_data(file), "AbsoluteTrialStartTime", 0);
+        double t = start ? bhv2_get_double(start, 0) : 0.0;
+        if (perf.trials == 1) t0 = t;
+        last_minutes = (t - t0) / 60000.0;
+
+        macro_result_append_int(result, trial_number(file));
+        macro_result_append(result, "\t");
+        macro_result_append_int(result, trial_condition(file));
+        macro_result_append(result, "\t");
+        macro_result_append_int(result, trial_error(file));
+        macro_result_append(result, "\t");
+        macro_result_append_fixed(result, last_minutes, 2);
+        double rates[3] = { perf.window_rate, perf.ewma, perf.cond_rate };
+        for (int k = 0; k < 3; k++) {
+            macro_result_append(result, "\t");
+            macro_result_append_fixed(result, rates[k], 3);
+        }
+        macro_result_append(result, perf.change > 0 ? "\tup\n" : (perf.change < 0 ? "\tdown\n" : "\t-\n"));
+
+        if (perf.change && n_changes < PERF_MAX_LISTED) {
+            changes[n_changes] = trial_number(file);
+            change_dir[n_changes] = perf.change;
+            n_changes++;
+        }
+    }
+
+    if (perf.trials == 0) {
+        macro_result_set(result, "No data");
+        perf_free(&perf);
+        return 0;
+    }
+
+    /* Summary */
+    macro_result_appendf(result, "\nTrials: %d\n", perf.trials);
+    macro_result_appendf(result, "Correct: %d (%.1f%%)\n", perf.correct, 100.0 * perf.correct / perf.trials);
+    macro_result_appendf(result, "Minutes: %.1f\n", last_minutes);
+    macro_result_appendf(result, "Final window (%d trials): %.3f\n", PERF_WINDOW, perf.window_rate);
+    macro_result_appendf(result, "Final EWMA: %.3f\n", perf.ewma);
+
+    macro_result_append(result, "Changepoints:");
+    if (n_changes == 0) macro_result_append(result, " none");
+    for (int i = 0; i < n_changes; i++) {
+        macro_result_appendf(result, " %d(%s)", changes[i], change_dir[i] > 0 ? "up" : "down");
+    }
+    macro_result_append(result, "\n");
+
+    macro_result_append(result, "Cond\tTrials\tCorrect\tRate\n");
+    qsort(perf.conds, perf.n_conds, sizeof(perf_cond_t), compare_cond);
+    for (size_t i = 0; i < perf.n_conds; i++) {
+        perf_cond_t *c = &perf.conds[i];
+        macro_result_appendf(result, "%d\t%d\t%d\t%.3f\n", c->condition, c->trials,
+                             c->correct, (double)c->correct / c->trials);
+    }
+
+    perf_free(&perf);
+    return 0;
+}
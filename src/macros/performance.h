@@ -0,0 +1,67 @@
+/************************************************************/
+/* performance.h - Rolling performance over a session
+ *
+ * Shared by the text macro (-o9) and its plot (-g4). Trials are fed in
+ * order; after each perf_update() the state holds that trial's rates.
+ *
+ *   Window:   accuracy over the last PERF_WINDOW trials
+ *   EWMA:     exponentially weighted accuracy (alpha PERF_EWMA_ALPHA)
+ *   CondRate: running accuracy of the trial's condition
+ *   Change:   Page-Hinkley changepoint in accuracy (+1 up, -1 down);
+ *             the test restarts after each detection
+ *
+ * A trial is correct when its error code is 0.
+ */
+/************************************************************/
+
+#ifndef PRESTO_PERFORMANCE_H
+#define PRESTO_PERFORMANCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PERF_WINDOW     20      /* Sliding window (trials) */
+#define PERF_EWMA_ALPHA 0.1     /* Weight of the newest trial */
+#define PERF_PH_DELTA   0.05    /* Change in accuracy ignored by the test */
+#define PERF_PH_LAMBDA  5.0     /* Detection threshold (cumulative, in trials) */
+
+typedef struct {
+    int condition;
+    int trials;
+    int correct;
+} perf_cond_t;
+
+typedef struct {
+    /* Rates after the latest trial */
+    double window_rate;
+    double ewma;
+    double cond_rate;
+    int change;                 /* +1, -1, or 0 */
+
+    /* Totals */
+    int trials;
+    int correct;
+    perf_cond_t *conds;
+    size_t n_conds;
+    size_t cond_capacity;
+
+    /* Sliding window */
+    uint8_t ring[PERF_WINDOW];
+    int ring_count;
+    int ring_pos;
+    int ring_sum;
+
+    /* Page-Hinkley state for the current segment */
+    int seg_trials;
+    double seg_mean;
+    double ph_up, ph_up_min;
+    double ph_down, ph_down_max;
+} perf_state_t;
+
+void perf_init(perf_state_t *perf);
+void perf_free(perf_state_t *perf);
+
+/* Add the next trial. Returns 0 on success, -1 on allocation failure */
+int perf_update(perf_state_t *perf, int condition, int error_code);
+
+#endif /* PRESTO_PERFORMANCE_H */
@@ -4,6 +4,15 @@
  * Generates PDF plots using gnuplot for:
  *   -g1: Analog data plots (eye, mouse, buttons)
  *   -g2: Timeline histogram (trials over time)
+ *   -g3: Gaze heatmap (heatmap.c, rendered in-process)
+ *   -g4: Rolling performance (learning curve, see performance.h)
+ *   -g5: Trial contact sheet (contact.c, rendered in-process)
+ *   -g6: Trial raster (raster.c, rendered in-process)
+ *
+ * Plot data goes to gnuplot as native 32-bit floats, one record (row) of
+ * columns after another, read with `binary record=N format='%float...'`;
+ * -g1 puts every trial in one file and addresses each with `skip=`. The
+ * script itself is written to gnuplot's stdin.
  */
 /************************************************************/
 
@@ -12,20 +21,36 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <dirent.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <libgen.h>
 #include "../bhv2.h"
+#include "../ml_analog.h"
 #include "plot.h"
+#include "performance.h"
 
 /* Initial capacity for trial_data array */
 #define INITIAL_TRIAL_CAPACITY 256
 
+/* Columns of a -g4 data record */
+#define PERF_COLUMNS 8
+
 /* Data structures for plotting */
 
 typedef struct {
-    double *data;
+    double *data;               /* Samples (NULL if kept single) */
+    float *data_single;         /* Samples of single channels (--single) */
     size_t length;
+    char name[48];              /* Column label: "Eye X", "Btn1" */
+    char group_name[32];        /* Top-level AnalogData field: "Eye", "Button" */
+    ml_channel_kind_t kind;
+    uint64_t group;             /* Signals of one subplot share a group */
 } signal_data_t;
 
 typedef struct {
@@ -33,41 +58,64 @@ typedef struct {
     int error_code;
     int condition;
     int block;
-    signal_data_t eye_x, eye_y;
-    signal_data_t mouse_x, mouse_y;
-    signal_data_t *buttons;  /* Array of button signals */
-    int n_buttons;
-    double sample_interval;
+    signal_data_t *signals;     /* One per channel column, in channel-map order */
+    int n_signals;
+    double sample_interval;     /* ms */
     double abs_start_time;  /* For timeline */
-    int has_eye;
-    int has_mouse;
 } trial_analog_data_t;
 
+/* Fields each graphical macro needs (projected read) */
+static const char *analog_plot_fields[] = { "AnalogData", "AbsoluteTrialStartTime", NULL };
+static const char *timeline_plot_fields[] = { "AbsoluteTrialStartTime", NULL };
+
 /* Helper functions */
 
 static void signal_free(signal_data_t *sig) {
-    if (sig && sig->data) {
+    if (sig) {
         free(sig->data);
+        free(sig->data_single);
         sig->data = NULL;
+        sig->data_single = NULL;
         sig->length = 0;
     }
 }
 
 static void trial_analog_free(trial_analog_data_t *tad) {
     if (!tad) return;
-    signal_free(&tad->eye_x);
-    signal_free(&tad->eye_y);
-    signal_free(&tad->mouse_x);
-    signal_free(&tad->mouse_y);
-    if (tad->buttons) {
-        for (int i = 0; i < tad->n_buttons; i++) {
-            signal_free(&tad->buttons[i]);
+    if (tad->signals) {
+        for (int i = 0; i < tad->n_signals; i++) {
+            signal_free(&tad->signals[i]);
         }
-        free(tad->buttons);
-        tad->buttons = NULL;
+        free(tad->signals);
+        tad->signals = NULL;
     }
 }
 
+void plot_options_init(plot_options_t *opts) {
+    opts->width = 11.0;
+    opts->height = 8.5;
+    opts->extent[0] = -20.0;
+    opts->extent[1] = 20.0;
+    opts->extent[2] = -20.0;
+    opts->extent[3] = 20.0;
+    opts->bin = 0.5;
+    opts->raster_value = RASTER_EYE_X;
+    opts->raster_sort = RASTER_SORT_TRIAL;
+    opts->align_code = -1;
+    opts->window[0] = opts->window[1] = 0.0;
+}
+
+void plot_output_stem(const char *input_path, char *stem, size_t size) {
+    char *path_copy = strdup(input_path);
+    const char *base_name = path_copy ? basename(path_copy) : input_path;
+    const char *dot = strrchr(base_name, '.');
+    size_t len = dot ? (size_t)(dot - base_name) : strlen(base_name);
+    if (len >= size) len = size - 1;
+    memcpy(stem, base_name, len);
+    stem[len] = '\0';
+    free(path_copy);
+}
+
 static int check_gnuplot_installed(void) {
     int ret = system("which gnuplot > /dev/null 2>&1");
     if (ret != 0) {
@@ -91,16 +139,77 @@ static char* create_temp_dir(void) {
     return tmpdir;
 }
 
+/* Best-effort: the directory holds only the data files written here */
 static void cleanup_temp_dir(const char *tmpdir) {
     if (!tmpdir) return;
     
-    char cmd[1024];
-    snprintf(cmd, sizeof(cmd), "rm -rf %s", tmpdir);
-    int ret __attribute__((unused)) = system(cmd);  /* Best-effort cleanup */
+    DIR *dir = opendir(tmpdir);
+    if (dir) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+            char path[1024];
+            snprintf(path, sizeof(path), "%s/%s", tmpdir, entry->d_name);
+            unlink(path);
+        }
+        closedir(dir);
+    }
+    rmdir(tmpdir);
+}
+
+/* Data source clause for n_records records of n_cols floats starting
+ * skip bytes into path: 'path' binary skip=.. record=.. format='%float..' */
+static void write_binary_source(FILE *fp, const char *path, size_t skip, size_t n_records, int n_cols) {
+    fprintf(fp, "'%s' binary skip=%zu record=%zu format='", path, skip, n_records);
+    for (int i = 0; i < n_cols; i++) {
+        fputs("%float", fp);
+    }
+    fputc('\'', fp);
+}
+
+/* Feed script to gnuplot on its stdin. Returns gnuplot's exit status
+ * (-1 if it could not be run or stopped reading). */
+static int run_gnuplot(const char *script, size_t len) {
+    FILE *pipe = popen("gnuplot 2>&1", "w");
+    if (!pipe) {
+        perror("popen");
+        return -1;
+    }
+    
+    /* A gnuplot that exits early must fail the write, not kill presto:
+     * hold SIGPIPE for this thread and discard it if it was raised */
+    sigset_t sigpipe, old_mask;
+    sigemptyset(&sigpipe);
+    sigaddset(&sigpipe, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &sigpipe, &old_mask);
+    
+    int write_ok = fwrite(script, 1, len, pipe) == len && fflush(pipe) == 0;
+    int status = pclose(pipe);
+    
+    if (!write_ok) {
+        struct timespec zero = {0, 0};
+        while (sigtimedwait(&sigpipe, NULL, &zero) == SIGPIPE) {}
+    }
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+    return write_ok ? status : -1;
+}
+
+/* Column label for one column of a channel: "Eye X", "Gen1", "Touch 3" */
+static void signal_name(signal_data_t *sig, const ml_analog_channel_t *ch,
+                        uint64_t column, uint64_t n_columns) {
+    if (n_columns == 1) {
+        snprintf(sig->name, sizeof(sig->name), "%s", ch->label);
+    } else if (n_columns == 2) {
+        snprintf(sig->name, sizeof(sig->name), "%s %c", ch->label, column == 0 ? 'X' : 'Y');
+    } else {
+        snprintf(sig->name, sizeof(sig->name), "%s %lu", ch->label, (unsigned long)column + 1);
+    }
 }
 
-/* Extract analog data from a trial using accessor functions and trial data */
-static int extract_trial_analog_data(ml_trial_file_t *file, trial_analog_data_t *out) {
+/* Extract analog data from a trial using accessor functions and the
+ * session's channel map (built on the first trial, reused after) */
+static int extract_trial_analog_data(ml_trial_file_t *file, ml_analog_schema_t **schema,
+                                     trial_analog_data_t *out) {
     memset(out, 0, sizeof(trial_analog_data_t));
     
     /* Get trial metadata from accessor functions */
@@ -123,162 +232,152 @@ static int extract_trial_analog_data(ml_trial_file_t *file, trial_analog_data_t
     
     /* Get AnalogData struct */
     bhv2_value_t *analog_data = bhv2_struct_get(trial_value, "AnalogData", 0);
-    if (!analog_data) {
+    if (!analog_data || ml_analog_schema_update(schema, analog_data) != 0) {
         return 0;  /* No analog data */
     }
+    const ml_analog_schema_t *map = *schema;
     
-    /* Get sample interval */
-    bhv2_value_t *sample_interval = bhv2_struct_get(analog_data, "SampleInterval", 0);
-    if (sample_interval) {
-        out->sample_interval = bhv2_get_double(sample_interval, 0);
-    } else {
-        out->sample_interval = 0.001;  /* Default 1ms */
-    }
+    out->sample_interval = ml_analog_interval_ms(map, analog_data);
     
-    /* Extract Eye data */
-    bhv2_value_t *eye = bhv2_struct_get(analog_data, "Eye", 0);
-    if (eye && eye->dims[0] > 0 && eye->dims[1] >= 2) {
-        size_t n_samples = eye->dims[0];
-        out->eye_x.data = malloc(n_samples * sizeof(double));
-        out->eye_y.data = malloc(n_samples * sizeof(double));
-        out->eye_x.length = n_samples;
-        out->eye_y.length = n_samples;
-        
-        for (size_t i = 0; i < n_samples; i++) {
-            out->eye_x.data[i] = bhv2_get_double(eye, i * eye->dims[1] + 0);
-            out->eye_y.data[i] = bhv2_get_double(eye, i * eye->dims[1] + 1);
-        }
-        out->has_eye = 1;
+    /* Count columns of every non-empty channel */
+    size_t n_signals = 0;
+    for (size_t c = 0; c < map->n_channels; c++) {
+        n_signals += ml_analog_columns(ml_analog_channel(map, analog_data, c));
     }
+    if (n_signals == 0) return 1;
     
-    /* Extract Mouse data */
-    bhv2_value_t *mouse = bhv2_struct_get(analog_data, "Mouse", 0);
-    if (mouse && mouse->dims[0] > 0 && mouse->dims[1] >= 2) {
-        size_t n_samples = mouse->dims[0];
-        out->mouse_x.data = malloc(n_samples * sizeof(double));
-        out->mouse_y.data = malloc(n_samples * sizeof(double));
-        out->mouse_x.length = n_samples;
-        out->mouse_y.length = n_samples;
-        
-        for (size_t i = 0; i < n_samples; i++) {
-            out->mouse_x.data[i] = bhv2_get_double(mouse, i * mouse->dims[1] + 0);
-            out->mouse_y.data[i] = bhv2_get_double(mouse, i * mouse->dims[1] + 1);
-        }
-        out->has_mouse = 1;
-    }
+    out->signals = calloc(n_signals, sizeof(signal_data_t));
+    if (!out->signals) return -1;
     
-    /* Extract Button data */
-    bhv2_value_t *button_struct = bhv2_struct_get(analog_data, "Button", 0);
-    if (button_struct && button_struct->dtype == MATLAB_STRUCT) {
-        /* Count buttons and extract data */
-        out->n_buttons = 0;
-        out->buttons = NULL;
+    /* Copy each column (MATLAB column-major: column j is samples j*n .. j*n+n-1) */
+    for (size_t c = 0; c < map->n_channels; c++) {
+        bhv2_value_t *channel = ml_analog_channel(map, analog_data, c);
+        uint64_t n_samples = ml_analog_samples(channel);
+        uint64_t n_columns = ml_analog_columns(channel);
+        const ml_analog_channel_t *ch = &map->channels[c];
         
-        /* Allocate space for up to 10 buttons */
-        signal_data_t temp_buttons[10];
-        int temp_count = 0;
-        
-        for (int btn = 1; btn <= 10 && temp_count < 10; btn++) {
-            char btn_name[16];
-            snprintf(btn_name, sizeof(btn_name), "Btn%d", btn);
+        for (uint64_t j = 0; j < n_columns; j++) {
+            signal_data_t *sig = &out->signals[out->n_signals];
+            if (channel->dtype == MATLAB_SINGLE) {
+                sig->data_single = malloc(n_samples * sizeof(float));
+                if (!sig->data_single) return -1;
+            } else {
+                sig->data = malloc(n_samples * sizeof(double));
+                if (!sig->data) return -1;
+            }
+            sig->length = n_samples;
+            sig->kind = ch->kind;
+            sig->group = ch->group;
+            snprintf(sig->group_name, sizeof(sig->group_name), "%s",
+                     map->field_names[ch->field]);
+            signal_name(sig, ch, j, n_columns);
             
-            bhv2_value_t *btn_data = bhv2_struct_get(button_struct, btn_name, 0);
-            if (btn_data && btn_data->dims[0] > 0) {
-                size_t n_samples = btn_data->dims[0];
-                temp_buttons[temp_count].data = malloc(n_samples * sizeof(double));
-                temp_buttons[temp_count].length = n_samples;
-                
-                for (size_t i = 0; i < n_samples; i++) {
-                    temp_buttons[temp_count].data[i] = bhv2_get_double(btn_data, i);
+            if (channel->dtype == MATLAB_SINGLE) {
+                memcpy(sig->data_single, channel->data.f + j * n_samples, n_samples * sizeof(float));
+            } else if (channel->dtype == MATLAB_DOUBLE) {
+                memcpy(sig->data, channel->data.d + j * n_samples, n_samples * sizeof(double));
+            } else {
+                for (uint64_t i = 0; i < n_samples; i++) {
+                    sig->data[i] = bhv2_get_double(channel, j * n_samples + i);
                 }
-                temp_count++;
             }
-        }
-        
-        if (temp_count > 0) {
-            out->buttons = malloc(temp_count * sizeof(signal_data_t));
-            memcpy(out->buttons, temp_buttons, temp_count * sizeof(signal_data_t));
-            out->n_buttons = temp_count;
+            out->n_signals++;
         }
     }
     
     return 1;
 }
 
-/* Write data file for a single trial */
-static int write_trial_data_file(trial_analog_data_t *tad, const char *filepath) {
-    FILE *fp = fopen(filepath, "w");
-    if (!fp) {
-        perror("fopen");
-        return -1;
-    }
-    
-    /* Header */
-    fprintf(fp, "# Trial %d: Error %d, Condition %d\n", tad->trial_num, tad->error_code, tad->condition);
-    fprintf(fp, "# Time(ms)");
-    if (tad->has_eye) fprintf(fp, "\tEye_X\tEye_Y");
-    if (tad->has_mouse) fprintf(fp, "\tMouse_X\tMouse_Y");
-    for (int i = 0; i < tad->n_buttons; i++) {
-        fprintf(fp, "\tBtn%d", i + 1);
-    }
-    fprintf(fp, "\n");
-    
+/* Append one trial's records to the -g1 data file: time (ms), then one
+ * column per signal (NaN past a signal's end). Returns the number of
+ * records written, or -1 on error. */
+static long write_trial_data_file(trial_analog_data_t *tad, FILE *fp) {
     /* Determine maximum length */
     size_t max_len = 0;
-    if (tad->has_eye && tad->eye_x.length > max_len) max_len = tad->eye_x.length;
-    if (tad->has_mouse && tad->mouse_x.length > max_len) max_len = tad->mouse_x.length;
-    for (int i = 0; i < tad->n_buttons; i++) {
-        if (tad->buttons[i].length > max_len) max_len = tad->buttons[i].length;
+    for (int i = 0; i < tad->n_signals; i++) {
+        if (tad->signals[i].length > max_len) max_len = tad->signals[i].length;
     }
     
-    /* Write data rows */
+    size_t n_cols = (size_t)tad->n_signals + 1;
+    float *record = malloc(n_cols * sizeof(float));
+    if (!record) return -1;
     for (size_t i = 0; i < max_len; i++) {
-        double time_ms = i * tad->sample_interval * 1000.0;
-        fprintf(fp, "%.3f", time_ms);
-        
-        if (tad->has_eye) {
-            if (i < tad->eye_x.length) {
-                fprintf(fp, "\t%.3f\t%.3f", tad->eye_x.data[i], tad->eye_y.data[i]);
+        record[0] = (float)(i * tad->sample_interval);
+        for (int j = 0; j < tad->n_signals; j++) {
+            signal_data_t *sig = &tad->signals[j];
+            if (i >= sig->length) {
+                record[j + 1] = NAN;
             } else {
-                fprintf(fp, "\tNaN\tNaN");
+                record[j + 1] = sig->data ? (float)sig->data[i] : sig->data_single[i];
             }
         }
-        
-        if (tad->has_mouse) {
-            if (i < tad->mouse_x.length) {
-                fprintf(fp, "\t%.3f\t%.3f", tad->mouse_x.data[i], tad->mouse_y.data[i]);
-            } else {
-                fprintf(fp, "\tNaN\tNaN");
-            }
+        if (fwrite(record, sizeof(float), n_cols, fp) != n_cols) {
+            free(record);
+            return -1;
         }
-        
-        for (int j = 0; j < tad->n_buttons; j++) {
-            if (i < tad->buttons[j].length) {
-                fprintf(fp, "\t%.0f", tad->buttons[j].data[i]);
-            } else {
-                fprintf(fp, "\tNaN");
-            }
-        }
-        
-        fprintf(fp, "\n");
     }
+    free(record);
     
-    fclose(fp);
-    return 0;
+    return (long)max_len;
 }
 
-/* Generate gnuplot script for analog data (-g1) */
+/* Subplot title and y-axis label for a channel group */
+static void group_labels(signal_data_t *first, char *title, size_t title_size,
+                         const char **ylabel) {
+    switch (first->kind) {
+        case ML_CH_EYE:
+            snprintf(title, title_size, "%s Position", first->group_name);
+            *ylabel = "Position (deg)";
+            break;
+        case ML_CH_MOUSE:
+        case ML_CH_TOUCH:
+            snprintf(title, title_size, "%s Position", first->group_name);
+            *ylabel = "Position (px)";
+            break;
+        case ML_CH_JOYSTICK:
+            snprintf(title, title_size, "%s Position", first->group_name);
+            *ylabel = "Position";
+            break;
+        case ML_CH_GENERAL:
+            snprintf(title, title_size, "General Inputs");
+            *ylabel = "Voltage";
+            break;
+        case ML_CH_PHOTODIODE:
+            snprintf(title, title_size, "Photodiode");
+            *ylabel = "Voltage";
+            break;
+        case ML_CH_BUTTON:
+            snprintf(title, title_size, "Button States");
+            *ylabel = "State";
+            break;
+        default:
+            snprintf(title, title_size, "%s", first->group_name);
+            *ylabel = "Value";
+            break;
+    }
+}
+
+/* Line colors for the first two columns of a position channel */
+static const char* group_color(ml_channel_kind_t kind, int index) {
+    if (kind == ML_CH_EYE) return index == 0 ? "#3498db" : "#85c1e9";
+    if (kind == ML_CH_MOUSE) return index == 0 ? "#e74c3c" : "#f1948a";
+    return NULL;
+}
+
+/* Generate gnuplot script for analog data (-g1) into fp; the samples of
+ * every trial go to one data file in tmpdir */
 static int generate_analog_plot_script(trial_analog_data_t *trials, int n_trials, 
                                        const char *tmpdir, const char *output_pdf,
-                                       double width, double height) {
-    char script_path[1024];
-    snprintf(script_path, sizeof(script_path), "%s/plot.gp", tmpdir);
+                                       double width, double height, FILE *fp) {
+    char data_path[1024];
+    snprintf(data_path, sizeof(data_path), "%s/analog.bin", tmpdir);
     
-    FILE *fp = fopen(script_path, "w");
-    if (!fp) {
+    FILE *data_fp = fopen(data_path, "wb");
+    if (!data_fp) {
         perror("fopen");
         return -1;
     }
+    size_t offset = 0;
     
     /* Gnuplot header */
     fprintf(fp, "set terminal pdfcairo enhanced color font 'Sans,10' size %g,%g\n", width, height);
@@ -288,11 +387,11 @@ static int generate_analog_plot_script(trial_analog_data_t *trials, int n_trials
     for (int t = 0; t < n_trials; t++) {
         trial_analog_data_t *tad = &trials[t];
         
-        /* Count number of subplots */
+        /* Count number of subplots (one per channel group) */
         int n_plots = 0;
-        if (tad->has_eye) n_plots++;
-        if (tad->has_mouse) n_plots++;
-        if (tad->n_buttons > 0) n_plots++;
+        for (int s = 0; s < tad->n_signals; s++) {
+            if (s == 0 || tad->signals[s].group != tad->signals[s - 1].group) n_plots++;
+        }
         
         if (n_plots == 0) continue;
         
@@ -300,86 +399,89 @@ static int generate_analog_plot_script(trial_analog_data_t *trials, int n_trials
         fprintf(fp, "set multiplot layout %d,1 title 'Trial %d | Block %d | Condition %d | Error %d'\n\n",
                 n_plots, tad->trial_num, tad->block, tad->condition, tad->error_code);
         
-        char data_file[1024];
-        snprintf(data_file, sizeof(data_file), "%s/trial_%03d.dat", tmpdir, t);
-        
-        int plot_idx = 0;
-        int col = 2;  /* Start at column 2 (column 1 is time) */
-        
-        /* Eye position plot */
-        if (tad->has_eye) {
-            fprintf(fp, "set title 'Eye Position'\n");
-            fprintf(fp, "set xlabel 'Time (ms)'\n");
-            fprintf(fp, "set ylabel 'Position (deg)'\n");
-            fprintf(fp, "set grid\n");
-            fprintf(fp, "plot '%s' using 1:%d with lines lw 2 lc rgb '#3498db' title 'Eye X', \\\n", data_file, col);
-            fprintf(fp, "     '' using 1:%d with lines lw 2 lc rgb '#85c1e9' title 'Eye Y'\n\n", col + 1);
-            col += 2;
-            plot_idx++;
-        }
-        
-        /* Mouse position plot */
-        if (tad->has_mouse) {
-            fprintf(fp, "set title 'Mouse Position'\n");
-            fprintf(fp, "set xlabel 'Time (ms)'\n");
-            fprintf(fp, "set ylabel 'Position (px)'\n");
-            fprintf(fp, "set grid\n");
-            fprintf(fp, "plot '%s' using 1:%d with lines lw 2 lc rgb '#e74c3c' title 'Mouse X', \\\n", data_file, col);
-            fprintf(fp, "     '' using 1:%d with lines lw 2 lc rgb '#f1948a' title 'Mouse Y'\n\n", col + 1);
-            col += 2;
-            plot_idx++;
+        long n_records = write_trial_data_file(tad, data_fp);
+        if (n_records < 0) {
+            fprintf(stderr, "Error: Failed writing %s\n", data_path);
+            fclose(data_fp);
+            return -1;
         }
+        size_t skip = offset;
+        offset += (size_t)n_records * (tad->n_signals + 1) * sizeof(float);
         
-        /* Button states plot */
-        if (tad->n_buttons > 0) {
-            fprintf(fp, "set title 'Button States'\n");
+        /* Column 1 is time; signal s is column s + 2 */
+        int s = 0;
+        while (s < tad->n_signals) {
+            int first = s;
+            while (s < tad->n_signals && tad->signals[s].group == tad->signals[first].group) s++;
+            int n_group = s - first;
+            signal_data_t *head = &tad->signals[first];
+            
+            char title[64];
+            const char *ylabel;
+            group_labels(head, title, sizeof(title), &ylabel);
+            
+            fprintf(fp, "set title '%s'\n", title);
             fprintf(fp, "set xlabel 'Time (ms)'\n");
-            fprintf(fp, "set ylabel 'State'\n");
+            fprintf(fp, "set ylabel '%s'\n", ylabel);
             fprintf(fp, "set grid\n");
-            fprintf(fp, "set yrange [-0.5:%d.5]\n", tad->n_buttons);
-            fprintf(fp, "plot ");
-            for (int b = 0; b < tad->n_buttons; b++) {
-                if (b > 0) fprintf(fp, ",\\\n     ");
-                fprintf(fp, "'%s' using 1:($%d*0.8+%d) with steps lw 2 title 'Button %d'", 
-                        data_file, col + b, b, b + 1);
+            
+            if (head->kind == ML_CH_BUTTON) {
+                fprintf(fp, "set yrange [-0.5:%d.5]\n", n_group);
+                fprintf(fp, "plot ");
+                for (int b = 0; b < n_group; b++) {
+                    if (b > 0) fprintf(fp, ",\\\n     ");
+                    write_binary_source(fp, data_path, skip, (size_t)n_records, tad->n_signals + 1);
+                    fprintf(fp, " using 1:($%d*0.8+%d) with steps lw 2 title '%s'",
+                            first + b + 2, b, tad->signals[first + b].name);
+                }
+                fprintf(fp, "\n");
+                fprintf(fp, "set autoscale y\n\n");
+            } else {
+                fprintf(fp, "plot ");
+                for (int b = 0; b < n_group; b++) {
+                    const char *color = group_color(head->kind, b);
+                    if (b > 0) fprintf(fp, ", \\\n     ");
+                    write_binary_source(fp, data_path, skip, (size_t)n_records, tad->n_signals + 1);
+                    fprintf(fp, " using 1:%d with lines lw 2", first + b + 2);
+                    if (color) fprintf(fp, " lc rgb '%s'", color);
+                    fprintf(fp, " title '%s'", tad->signals[first + b].name);
+                }
+                fprintf(fp, "\n\n");
             }
-            fprintf(fp, "\n\n");
         }
         
         fprintf(fp, "unset multiplot\n\n");
     }
     
-    fclose(fp);
+    if (fclose(data_fp) != 0) {
+        fprintf(stderr, "Error: Failed writing %s\n", data_path);
+        return -1;
+    }
     return 0;
 }
 
-/* Generate gnuplot script for timeline (-g2) */
+/* Generate gnuplot script for timeline (-g2) into fp */
 static int generate_timeline_plot_script(trial_analog_data_t *trials, int n_trials,
                                          const char *tmpdir, const char *output_pdf,
-                                         double width, double height) {
-    char script_path[1024];
+                                         double width, double height, FILE *fp) {
     char data_path[1024];
-    snprintf(script_path, sizeof(script_path), "%s/plot.gp", tmpdir);
-    snprintf(data_path, sizeof(data_path), "%s/timeline.dat", tmpdir);
+    snprintf(data_path, sizeof(data_path), "%s/timeline.bin", tmpdir);
     
-    /* Write timeline data file */
-    FILE *data_fp = fopen(data_path, "w");
+    /* Write timeline data file: time (min), error code */
+    FILE *data_fp = fopen(data_path, "wb");
     if (!data_fp) {
         perror("fopen");
         return -1;
     }
     
-    fprintf(data_fp, "# Time(min)\tError\n");
-    for (int i = 0; i < n_trials; i++) {
-        double time_min = trials[i].abs_start_time / 60000.0;  /* Convert ms to minutes */
-        fprintf(data_fp, "%.3f\t%d\n", time_min, trials[i].error_code);
+    int ok = 1;
+    for (int i = 0; i < n_trials && ok; i++) {
+        float record[2] = { (float)(trials[i].abs_start_time / 60000.0),  /* Convert ms to minutes */
+                            (float)trials[i].error_code };
+        ok = fwrite(record, sizeof(record), 1, data_fp) == 1;
     }
-    fclose(data_fp);
-    
-    /* Write gnuplot script */
-    FILE *fp = fopen(script_path, "w");
-    if (!fp) {
-        perror("fopen");
+    if (fclose(data_fp) != 0 || !ok) {
+        fprintf(stderr, "Error: Failed writing %s\n", data_path);
         return -1;
     }
     
@@ -416,12 +518,16 @@ static int generate_timeline_plot_script(trial_analog_data_t *trials, int n_tria
     fprintf(fp, "set xtics rotate by -45\n\n");
     
     /* Calculate data range for binning */
-    fprintf(fp, "stats '%s' using 1 nooutput\n", data_path);
+    fprintf(fp, "stats ");
+    write_binary_source(fp, data_path, 0, (size_t)n_trials, 2);
+    fprintf(fp, " using 1 nooutput\n");
     fprintf(fp, "bins = 20\n");
     fprintf(fp, "binwidth = (STATS_max - STATS_min) / bins\n");
     fprintf(fp, "bin(x) = binwidth * floor((x - STATS_min)/binwidth) + STATS_min\n\n");
     
-    fprintf(fp, "plot '%s' using (bin($1)):(1.0) smooth freq with boxes \\\n", data_path);
+    fprintf(fp, "plot ");
+    write_binary_source(fp, data_path, 0, (size_t)n_trials, 2);
+    fprintf(fp, " using (bin($1)):(1.0) smooth freq with boxes \\\n");
     fprintf(fp, "     lc rgb '#3498db' title 'All Trials (n=%d)' fillstyle solid 0.5\n", n_trials);
     
     /* Add info text */
@@ -433,14 +539,93 @@ static int generate_timeline_plot_script(trial_analog_data_t *trials, int n_tria
     fprintf(fp, "\nset label 'Total: %d trials over %.1f minutes' at graph 0.02, graph 0.95 front\n",
             n_trials, duration_min);
     
-    fclose(fp);
+    return 0;
+}
+
+/* Generate gnuplot script for rolling performance (-g4) into fp */
+static int generate_performance_plot_script(trial_analog_data_t *trials, int n_trials,
+                                            const char *tmpdir, const char *output_pdf,
+                                            double width, double height, FILE *fp) {
+    char data_path[1024];
+    snprintf(data_path, sizeof(data_path), "%s/performance.bin", tmpdir);
+    
+    FILE *data_fp = fopen(data_path, "wb");
+    if (!data_fp) {
+        perror("fopen");
+        return -1;
+    }
+    
+    perf_state_t perf;
+    perf_init(&perf);
+    int n_changes = 0;
+    
+    /* Index, Trial, Cond, Correct, Window, EWMA, CondRate, Change */
+    int ok = 1;
+    for (int i = 0; i < n_trials && ok; i++) {
+        if (perf_update(&perf, trials[i].condition, trials[i].error_code) != 0) {
+            fclose(data_fp);
+            perf_free(&perf);
+            return -1;
+        }
+        n_changes += perf.change != 0;
+        float record[PERF_COLUMNS] = {
+            (float)(i + 1), (float)trials[i].trial_num, (float)trials[i].condition,
+            (float)(trials[i].error_code == 0),
+            (float)perf.window_rate, (float)perf.ewma, (float)perf.cond_rate, (float)perf.change
+        };
+        ok = fwrite(record, sizeof(record), 1, data_fp) == 1;
+    }
+    double final_rate = perf.trials ? (double)perf.correct / perf.trials : 0.0;
+    perf_free(&perf);
+    if (fclose(data_fp) != 0 || !ok) {
+        fprintf(stderr, "Error: Failed writing %s\n", data_path);
+        return -1;
+    }
+    
+    fprintf(fp, "set terminal pdfcairo enhanced color font 'Sans,12' size %g,%g\n", width, height);
+    fprintf(fp, "set output '%s'\n\n", output_pdf);
+    
+    fprintf(fp, "set title 'Performance (%d trials, %.1f%% correct, %d changepoints)' font 'Sans,14'\n",
+            n_trials, 100.0 * final_rate, n_changes);
+    fprintf(fp, "set xlabel 'Trial (in session order)'\n");
+    fprintf(fp, "set ylabel 'Proportion correct'\n");
+    fprintf(fp, "set yrange [-0.08:1.08]\n");
+    fprintf(fp, "set xrange [0:%d]\n", n_trials + 1);
+    fprintf(fp, "set grid\n");
+    fprintf(fp, "set key outside right top\n\n");
+    
+    /* Changepoints: up green, down red */
+    fprintf(fp, "plot ");
+    write_binary_source(fp, data_path, 0, (size_t)n_trials, PERF_COLUMNS);
+    fprintf(fp, " using 1:($8 != 0 ? 1.08 : 1/0):(0):(-1.16):($8 > 0 ? 0x27ae60 : 0xc0392b) \\\n");
+    fprintf(fp, "         with vectors nohead lc rgb variable dt 2 lw 1.5 notitle, \\\n     ");
+    write_binary_source(fp, data_path, 0, (size_t)n_trials, PERF_COLUMNS);
+    fprintf(fp, " using 1:($4 ? 1.03 : -0.03) with points pt 7 ps 0.25 lc rgb '#7f8c8d' title 'Trial outcome', \\\n     ");
+    write_binary_source(fp, data_path, 0, (size_t)n_trials, PERF_COLUMNS);
+    fprintf(fp, " using 1:7:3 with points pt 7 ps 0.3 lc variable title 'Condition running rate', \\\n     ");
+    write_binary_source(fp, data_path, 0, (size_t)n_trials, PERF_COLUMNS);
+    fprintf(fp, " using 1:5 with lines lw 2 lc rgb '#3498db' title 'Last %d trials', \\\n     ", PERF_WINDOW);
+    write_binary_source(fp, data_path, 0, (size_t)n_trials, PERF_COLUMNS);
+    fprintf(fp, " using 1:6 with lines lw 2 lc rgb '#e67e22' title 'EWMA ({/Symbol a}=%.2f)'\n", PERF_EWMA_ALPHA);
+    
     return 0;
 }
 
 /* Main plotting function - iterates trials using read_next_trial() */
 int run_plot_macro(int macro_id, ml_trial_file_t *file,
                    const char *input_path, const char *output_dir,
-                   double width, double height) {
+                   const plot_options_t *opts) {
+    
+    /* Heatmap, contact sheet and raster are rendered in-process */
+    if (macro_id == 3) {
+        return run_heatmap_macro(file, input_path, output_dir, opts);
+    }
+    if (macro_id == 5) {
+        return run_contact_macro(file, input_path, output_dir, opts);
+    }
+    if (macro_id == 6) {
+        return run_raster_macro(file, input_path, output_dir, opts);
+    }
     
     /* Check gnuplot */
     if (check_gnuplot_installed() != 0) {
@@ -456,6 +641,7 @@ int run_plot_macro(int macro_id, ml_trial_file_t *file,
     /* Iterate trials and build trial_data array dynamically */
     size_t capacity = INITIAL_TRIAL_CAPACITY;
     size_t n_trials = 0;
+    ml_analog_schema_t *schema = NULL;  /* Channel map, built on first trial */
     trial_analog_data_t *trial_data = calloc(capacity, sizeof(trial_analog_data_t));
     if (!trial_data) {
         cleanup_temp_dir(tmpdir);
@@ -463,8 +649,13 @@ int run_plot_macro(int macro_id, ml_trial_file_t *file,
         return -1;
     }
     
+    /* Decode only the fields this plot needs */
+    if (set_data_fields(file, macro_id == 1 ? analog_plot_fields : timeline_plot_fields) != 0) {
+        goto cleanup_error;
+    }
+    
     /* Iterate through all trials (skip filtering happens in read_next_trial) */
-    while (read_next_trial(file, WITH_DATA) > 0) {
+    while (read_next_trial(file, SELECT_DATA) > 0) {
         /* Grow array if needed */
         if (n_trials >= capacity) {
             capacity *= 2;
@@ -479,9 +670,15 @@ int run_plot_macro(int macro_id, ml_trial_file_t *file,
         }
         
         /* Extract analog data from current trial */
-        extract_trial_analog_data(file, &trial_data[n_trials]);
+        if (extract_trial_analog_data(file, &schema, &trial_data[n_trials]) < 0) {
+            fprintf(stderr, "Error: Failed to extract analog data\n");
+            trial_analog_free(&trial_data[n_trials]);
+            goto cleanup_error;
+        }
         n_trials++;
     }
+    ml_analog_schema_free(schema);
+    schema = NULL;
     
     if (n_trials == 0) {
         fprintf(stderr, "Warning: No trials to plot\n");
@@ -490,18 +687,8 @@ int run_plot_macro(int macro_id, ml_trial_file_t *file,
     
     /* Determine output filename */
     char output_pdf[1024];
-    const char *base_name = basename((char*)input_path);
-    char *dot = strrchr(base_name, '.');
     char stem[256];
-    if (dot) {
-        size_t len = dot - base_name;
-        if (len >= sizeof(stem)) len = sizeof(stem) - 1;
-        strncpy(stem, base_name, len);
-        stem[len] = '\0';
-    } else {
-        strncpy(stem, base_name, sizeof(stem) - 1);
-        stem[sizeof(stem) - 1] = '\0';
-    }
+    plot_output_stem(input_path, stem, sizeof(stem));
     
     const char *out_dir = output_dir ? output_dir : ".";
     if (strcmp(out_dir, "-") == 0) {
@@ -512,22 +699,22 @@ int run_plot_macro(int macro_id, ml_trial_file_t *file,
     
     int ret = 0;
     
+    /* The script is built in memory and piped to gnuplot */
+    char *script = NULL;
+    size_t script_len = 0;
+    FILE *script_fp = open_memstream(&script, &script_len);
+    if (!script_fp) {
+        perror("open_memstream");
+        ret = -1;
+        goto cleanup;
+    }
+    
     if (macro_id == 1) {
         /* -g1: Analog data plots */
         snprintf(output_pdf, sizeof(output_pdf), "%s/AnalogData_%s.pdf", out_dir, stem);
         
-        /* Write data files */
-        for (size_t i = 0; i < n_trials; i++) {
-            char data_file[1024];
-            snprintf(data_file, sizeof(data_file), "%s/trial_%03zu.dat", tmpdir, i);
-            if (write_trial_data_file(&trial_data[i], data_file) != 0) {
-                ret = -1;
-                goto cleanup;
-            }
-        }
-        
-        /* Generate gnuplot script */
-        if (generate_analog_plot_script(trial_data, n_trials, tmpdir, output_pdf, width, height) != 0) {
+        /* Generate data file and gnuplot script */
+        if (generate_analog_plot_script(trial_data, n_trials, tmpdir, output_pdf, opts->width, opts->height, script_fp) != 0) {
             ret = -1;
             goto cleanup;
         }
@@ -536,7 +723,16 @@ int run_plot_macro(int macro_id, ml_trial_file_t *file,
         /* -g2: Timeline histogram */
         snprintf(output_pdf, sizeof(output_pdf), "%s/Timeline_%s.pdf", out_dir, stem);
         
-        if (generate_timeline_plot_script(trial_data, n_trials, tmpdir, output_pdf, width, height) != 0) {
+        if (generate_timeline_plot_script(trial_data, n_trials, tmpdir, output_pdf, opts->width, opts->height, script_fp) != 0) {
+            ret = -1;
+            goto cleanup;
+        }
+        
+    } else if (macro_id == 4) {
+        /* -g4: Rolling performance */
+        snprintf(output_pdf, sizeof(output_pdf), "%s/Performance_%s.pdf", out_dir, stem);
+        
+        if (generate_performance_plot_script(trial_data, n_trials, tmpdir, output_pdf, opts->width, opts->height, script_fp) != 0) {
             ret = -1;
             goto cleanup;
         }
@@ -548,12 +744,26 @@ int run_plot_macro(int macro_id, ml_trial_file_t *file,
     }
     
     /* Execute gnuplot */
-    char cmd[2048];
-    snprintf(cmd, sizeof(cmd), "gnuplot %s/plot.gp 2>&1", tmpdir);
-    int gnuplot_ret = system(cmd);
+    if (fclose(script_fp) != 0) {
+        script_fp = NULL;
+        fprintf(stderr, "Error: Out of memory\n");
+        ret = -1;
+        goto cleanup;
+    }
+    script_fp = NULL;
+    int gnuplot_ret = run_gnuplot(script, script_len);
     if (gnuplot_ret != 0) {
         fprintf(stderr, "Error: gnuplot execution failed (exit code %d)\n", gnuplot_ret);
-        fprintf(stderr, "Script location: %s/plot.gp\n", tmpdir);
+        
+        /* Keep the script next to its data for debugging */
+        char script_path[1024];
+        snprintf(script_path, sizeof(script_path), "%s/plot.gp", tmpdir);
+        FILE *fp = fopen(script_path, "w");
+        if (fp) {
+            fwrite(script, 1, script_len, fp);
+            fclose(fp);
+            fprintf(stderr, "Script location: %s\n", script_path);
+        }
         ret = -1;
         goto cleanup;
     }
@@ -562,6 +772,8 @@ int run_plot_macro(int macro_id, ml_trial_file_t *file,
     
 cleanup:
     /* Clean up */
+    if (script_fp) fclose(script_fp);
+    free(script);
     for (size_t i = 0; i < n_trials; i++) {
         trial_analog_free(&trial_data[i]);
     }
@@ -577,6 +789,7 @@ cleanup:
     return ret;
 
 cleanup_error:
+    ml_analog_schema_free(schema);
     for (size_t i = 0; i < n_trials; i++) {
         trial_analog_free(&trial_data[i]);
     }
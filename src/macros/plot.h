@@ -8,21 +8,90 @@
 
 #include "../ml_trial.h"
 
+/************************************************************/
+/* Options for graphical macros
+ */
+/************************************************************/
+
+/* What a trial raster (-g6) colors its time bins by */
+typedef enum {
+    RASTER_EYE_X,               /* Mean eye X, scaled to the extent */
+    RASTER_EYE_Y,               /* Mean eye Y */
+    RASTER_EYE_SPEED,           /* Mean eye speed (deg/s, log scale) */
+    RASTER_BUTTON               /* Fraction of the bin any button is held */
+} raster_value_t;
+
+/* Order of a trial raster's rows (ties keep file order) */
+typedef enum {
+    RASTER_SORT_TRIAL,
+    RASTER_SORT_CONDITION,
+    RASTER_SORT_RT,             /* ReactionTime; trials without one last */
+    RASTER_SORT_ERROR
+} raster_sort_t;
+
+typedef struct {
+    double width;               /* Plot width in inches (gnuplot macros) */
+    double height;              /* Plot height in inches */
+    double extent[4];           /* Heatmap (and contact sheet) x min, x max, y min, y max (deg) */
+    double bin;                 /* Heatmap bin size (deg) */
+    raster_value_t raster_value;
+    raster_sort_t raster_sort;
+    int align_code;             /* Raster rows aligned to this behavioral code, -1: trial start */
+    double window[2];           /* Raster time window (ms from alignment); equal: default */
+} plot_options_t;
+
+/* Defaults: 11x8.5 in, heatmap -20:20 deg on both axes in 0.5 deg bins,
+ * raster of eye X in trial order from trial start */
+void plot_options_init(plot_options_t *opts);
+
 /************************************************************/
 /* Run graphical macro
  * 
- * macro_id: 1 = analog data plots, 2 = timeline histogram
+ * macro_id: 1 = analog data plots, 2 = timeline histogram, 3 = gaze heatmap,
+ *           4 = rolling performance, 5 = trial contact sheet, 6 = trial raster
  * file: BHV2 file handle (with skips already set via bhv2_set_skips)
  * input_path: Original input file path (for naming output)
  * output_dir: Directory for output PDF (or "-" for stdout, NULL for current dir)
- * width: Plot width in inches
- * height: Plot height in inches
+ * opts: Plot size and heatmap grid
  * 
  * Returns: 0 on success, -1 on error
  */
 /************************************************************/
 int run_plot_macro(int macro_id, ml_trial_file_t *file,
                    const char *input_path, const char *output_dir,
-                   double width, double height);
+                   const plot_options_t *opts);
+
+/* Output file stem: "/path/to/session.bhv2" -> "session" */
+void plot_output_stem(const char *input_path, char *stem, size_t size);
+
+/************************************************************/
+/* Gaze heatmap (-g3, heatmap.c)
+ *
+ * Writes GazeHeatmap_<stem>.grid (per-condition bin counts) and one
+ * GazeHeatmap_<stem>_c<N>.ppm image per condition. Does not use gnuplot.
+ */
+/************************************************************/
+int run_heatmap_macro(ml_trial_file_t *file, const char *input_path,
+                      const char *output_dir, const plot_options_t *opts);
+
+/************************************************************/
+/* Trial contact sheet (-g5, contact.c)
+ *
+ * Writes ContactSheet_<stem>.png: one thumbnail per trial (error code,
+ * eye traces within the heatmap extent, buttons). Does not use gnuplot.
+ */
+/************************************************************/
+int run_contact_macro(ml_trial_file_t *file, const char *input_path,
+                      const char *output_dir, const plot_options_t *opts);
+
+/************************************************************/
+/* Trial raster (-g6, raster.c)
+ *
+ * Writes Raster_<stem>.png: one row per trial, one column per time bin
+ * of the window around the alignment code. Does not use gnuplot.
+ */
+/************************************************************/
+int run_raster_macro(ml_trial_file_t *file, const char *input_path,
+                     const char *output_dir, const plot_options_t *opts);
 
 #endif /* PRESTO_PLOT_H */
@@ -0,0 +1,418 @@
+/************************************************************/
+/* raster.c - Graphical macro 6: Trial-by-time raster
+ *
+ * One image row per kept trial, one column per time bin of a window
+ * around an alignment point (trial start, or the first occurrence of a
+ * behavioral code with --align). Bins are colored by mean eye X or Y,
+ * eye speed, or the fraction of the bin a button is held (--raster),
+ * through the heat colormap; bins without samples stay dark. A strip on
+ * the left gives each row's error code. Rows can be sorted by condition,
+ * reaction time or error code (--sort).
+ *
+ * Each trial is reduced to its row of bin means (kernel_mean_bins())
+ * as it streams past, so memory is rows x bins, not the raw samples.
+ * Rendered in-process (no gnuplot).
+ */
+/************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../ml_analog.h"
+#include "../kernels.h"
+#include "../image.h"
+#include "plot.h"
+
+#define RASTER_COLUMNS 400          /* Time bins across the window */
+#define RASTER_COLUMN_PX 2
+#define RASTER_HEIGHT 600           /* Rows are scaled up to about this many pixels */
+#define RASTER_MAX_ROW_PX 8
+#define RASTER_STRIP 8              /* Error code strip, plus a 2 px gap */
+#define RASTER_MAX_SPEED 1000.0     /* deg/s at the top of the colormap */
+
+static const char *raster_fields[] = {
+    "AnalogData.Eye", "AnalogData.Button", "AnalogData.SampleInterval",
+    "BehavioralCodes", "ReactionTime", NULL
+};
+
+static const uint8_t color_empty[3] = { 24, 26, 32 };
+static const uint8_t color_marker[3] = { 255, 255, 255 };
+static const uint8_t color_correct[3] = { 0x2e, 0xcc, 0x71 };   /* As in -g2 */
+static const uint8_t color_error3[3] = { 0xe7, 0x4c, 0x3c };
+static const uint8_t color_error7[3] = { 0x34, 0x98, 0xdb };
+static const uint8_t color_other[3] = { 0x95, 0xa5, 0xa6 };
+
+/* What every trial's row is computed from (the kernel's ctx) */
+typedef struct {
+    raster_value_t value;
+    int align_code;
+    double window[2];       /* ms from the alignment point */
+} raster_spec_t;
+
+typedef struct {
+    size_t order;           /* Position in the file (tie-break when sorting) */
+    int trial_num;
+    int condition;
+    int error_code;
+    double rt;              /* NaN if absent */
+    float bins[RASTER_COLUMNS];
+} raster_row_t;
+
+/* Rows of a run of trials (the per-trial kernel's accumulator) */
+typedef struct {
+    raster_row_t *rows;
+    size_t count;
+    size_t capacity;
+    size_t unaligned;       /* Trials without the alignment code */
+
+    /* Working state */
+    ml_analog_schema_t *schema;
+    double *conv;           /* Channel samples converted to double */
+    size_t conv_len;
+    double *speed;
+    size_t speed_len;
+} raster_t;
+
+/* Time (ms from trial start) of the first occurrence of code: 0 if found,
+ * -1 if not */
+static int code_time(bhv2_value_t *trial, int code, double *time) {
+    bhv2_value_t *codes = bhv2_struct_get(trial, "BehavioralCodes", 0);
+    bhv2_value_t *numbers = codes ? bhv2_struct_get(codes, "CodeNumbers", 0) : NULL;
+    bhv2_value_t *times = codes ? bhv2_struct_get(codes, "CodeTimes", 0) : NULL;
+    if (!numbers || !times) return -1;
+
+    uint64_t n = numbers->total < times->total ? numbers->total : times->total;
+    for (uint64_t i = 0; i < n; i++) {
+        if (bhv2_get_double(numbers, i) == code) {
+            *time = bhv2_get_double(times, i);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Samples of a channel (all columns) as doubles, column-major */
+static const double* channel_samples(bhv2_value_t *channel, double **conv, size_t *conv_len) {
+    if (channel->dtype == MATLAB_DOUBLE && !channel->packed) return channel->data.d;
+    size_t total = (size_t)channel->total;
+    if (*conv_len < total) {
+        double *grown = realloc(*conv, total * sizeof(double));
+        if (!grown) return NULL;
+        *conv = grown;
+        *conv_len = total;
+    }
+    for (size_t i = 0; i < total; i++) {
+        (*conv)[i] = bhv2_get_double(channel, i);
+    }
+    return *conv;
+}
+
+/* Bin means of the chosen quantity over [first, first + RASTER_COLUMNS *
+ * width) in sample positions: 1 if computed, 0 if the trial has no such
+ * data, -1 on error */
+static int trial_bins(raster_t *rs, const raster_spec_t *spec, bhv2_value_t *analog,
+                      double first, double width, double dt_ms, double *means) {
+    bool want_button = spec->value == RASTER_BUTTON;
+    int found = 0;
+    for (size_t c = 0; want_button && c < RASTER_COLUMNS; c++) {
+        means[c] = NAN;
+    }
+
+    for (size_t ch = 0; ch < rs->schema->n_channels; ch++) {
+        const ml_analog_channel_t *info = &rs->schema->channels[ch];
+        bool is_eye = info->kind == ML_CH_EYE && strcmp(info->label, "Eye") == 0;
+        if (want_button ? info->kind != ML_CH_BUTTON : !is_eye) continue;
+
+        bhv2_value_t *channel = ml_analog_channel(rs->schema, analog, ch);
+        size_t n = channel ? ml_analog_samples(channel) : 0;
+        if (n == 0 || ml_analog_columns(channel) < (want_button ? 1u : 2u)) continue;
+
+        const double *x = channel_samples(channel, &rs->conv, &rs->conv_len);
+        if (!x) return -1;
+
+        if (!want_button) {
+            if (spec->value == RASTER_EYE_SPEED) {
+                if (rs->speed_len < n) {
+                    double *grown = realloc(rs->speed, n * sizeof(double));
+                    if (!grown) return -1;
+                    rs->speed = grown;
+                    rs->speed_len = n;
+                }
+                kernel_speed(x, x + n, n, dt_ms / 1000.0, rs->speed);
+                x = rs->speed;
+            } else if (spec->value == RASTER_EYE_Y) {
+                x += n;  /* Column-major: Y follows X */
+            }
+            kernel_mean_bins(x, n, first, width, RASTER_COLUMNS, means);
+            return 1;
+        }
+
+        /* Buttons: the largest held fraction over all buttons */
+        double held[RASTER_COLUMNS];
+        kernel_mean_bins(x, n, first, width, RASTER_COLUMNS, held);
+        for (size_t c = 0; c < RASTER_COLUMNS; c++) {
+            if (isnan(means[c]) || held[c] > means[c]) means[c] = held[c];
+        }
+        found = 1;
+    }
+    return found;
+}
+
+/************************************************************/
+/* Per-trial kernel
+ */
+/************************************************************/
+
+static void* raster_create(void *ctx) {
+    (void)ctx;
+    return calloc(1, sizeof(raster_t));
+}
+
+static void raster_destroy(void *acc) {
+    raster_t *rs = acc;
+    free(rs->rows);
+    free(rs->conv);
+    free(rs->speed);
+    ml_analog_schema_free(rs->schema);
+    free(rs);
+}
+
+static raster_row_t* add_row(raster_t *rs) {
+    if (rs->count >= rs->capacity) {
+        size_t new_cap = rs->capacity == 0 ? 64 : rs->capacity * 2;
+        raster_row_t *grown = realloc(rs->rows, new_cap * sizeof(raster_row_t));
+        if (!grown) return NULL;
+        rs->rows = grown;
+        rs->capacity = new_cap;
+    }
+    return &rs->rows[rs->count++];
+}
+
+static int raster_trial(void *acc, const trial_view_t *trial, void *ctx) {
+    raster_t *rs = acc;
+    const raster_spec_t *spec = ctx;
+
+    double align = 0.0;
+    if (spec->align_code >= 0 && code_time(trial->data, spec->align_code, &align) != 0) {
+        rs->unaligned++;
+        return 0;
+    }
+
+    raster_row_t *row = add_row(rs);
+    if (!row) return -1;
+    row->trial_num = trial->trial_num;
+    row->condition = trial->condition;
+    row->error_code = trial->error_code;
+    bhv2_value_t *rt = bhv2_struct_get(trial->data, "ReactionTime", 0);
+    row->rt = rt && rt->total > 0 ? bhv2_get_double(rt, 0) : NAN;
+    if (!isfinite(row->rt)) row->rt = NAN;
+
+    /* A trial without the data keeps an empty row */
+    double means[RASTER_COLUMNS];
+    int found = 0;
+    bhv2_value_t *analog = bhv2_struct_get(trial->data, "AnalogData", 0);
+    if (analog && ml_analog_schema_update(&rs->schema, analog) == 0) {
+        double dt = ml_analog_interval_ms(rs->schema, analog);
+        double bin_ms = (spec->window[1] - spec->window[0]) / RASTER_COLUMNS;
+        found = trial_bins(rs, spec, analog, (align + spec->window[0]) / dt, bin_ms / dt, dt, means);
+        if (found < 0) return -1;
+    }
+    for (size_t c = 0; c < RASTER_COLUMNS; c++) {
+        row->bins[c] = found ? (float)means[c] : NAN;
+    }
+    return 0;
+}
+
+/* Later trials go after earlier ones */
+static int raster_merge(void *acc, void *later, void *ctx) {
+    (void)ctx;
+    raster_t *rs = acc;
+    const raster_t *more = later;
+    for (size_t i = 0; i < more->count; i++) {
+        raster_row_t *row = add_row(rs);
+        if (!row) return -1;
+        *row = more->rows[i];
+    }
+    rs->unaligned += more->unaligned;
+    return 0;
+}
+
+static const trial_kernel_t raster_kernel = {
+    .read_flag = SELECT_DATA,
+    .create = raster_create,
+    .trial = raster_trial,
+    .merge = raster_merge,
+    .destroy = raster_destroy
+};
+
+/************************************************************/
+/* Sorting
+ */
+/************************************************************/
+
+static int compare_order(const raster_row_t *a, const raster_row_t *b) {
+    return (a->order > b->order) - (a->order < b->order);
+}
+
+static int compare_condition(const void *pa, const void *pb) {
+    const raster_row_t *a = pa, *b = pb;
+    if (a->condition != b->condition) return (a->condition > b->condition) - (a->condition < b->condition);
+    return compare_order(a, b);
+}
+
+static int compare_error(const void *pa, const void *pb) {
+    const raster_row_t *a = pa, *b = pb;
+    if (a->error_code != b->error_code) return (a->error_code > b->error_code) - (a->error_code < b->error_code);
+    return compare_order(a, b);
+}
+
+/* Shortest first, trials without a reaction time last */
+static int compare_rt(const void *pa, const void *pb) {
+    const raster_row_t *a = pa, *b = pb;
+    bool na = isnan(a->rt), nb = isnan(b->rt);
+    if (na != nb) return na ? 1 : -1;
+    if (!na && a->rt != b->rt) return a->rt > b->rt ? 1 : -1;
+    return compare_order(a, b);
+}
+
+static void sort_rows(raster_t *rs, raster_sort_t sort) {
+    for (size_t i = 0; i < rs->count; i++) {
+        rs->rows[i].order = i;
+    }
+    int (*compare)(const void*, const void*) =
+        sort == RASTER_SORT_CONDITION ? compare_condition :
+        sort == RASTER_SORT_ERROR ? compare_error :
+        sort == RASTER_SORT_RT ? compare_rt : NULL;
+    if (compare) qsort(rs->rows, rs->count, sizeof(raster_row_t), compare);
+}
+
+/************************************************************/
+/* Rendering
+ */
+/************************************************************/
+
+static const uint8_t* error_color(int error_code) {
+    if (error_code == 0) return color_correct;
+    if (error_code == 3) return color_error3;
+    if (error_code == 7) return color_error7;
+    return color_other;
+}
+
+/* Position on the colormap of a bin mean */
+static double colormap_position(const plot_options_t *opts, double v) {
+    switch (opts->raster_value) {
+        case RASTER_EYE_X:
+            return (v - opts->extent[0]) / (opts->extent[1] - opts->extent[0]);
+        case RASTER_EYE_Y:
+            return (v - opts->extent[2]) / (opts->extent[3] - opts->extent[2]);
+        case RASTER_EYE_SPEED:
+            return log1p(v > 0.0 ? v : 0.0) / log1p(RASTER_MAX_SPEED);
+        default:
+            return v;
+    }
+}
+
+static image_t* render_raster(const raster_t *rs, const plot_options_t *opts, const double window[2]) {
+    size_t row_px = RASTER_HEIGHT / rs->count;
+    if (row_px < 1) row_px = 1;
+    if (row_px > RASTER_MAX_ROW_PX) row_px = RASTER_MAX_ROW_PX;
+    size_t x0 = RASTER_STRIP + 2;
+
+    image_t *img = image_new(x0 + RASTER_COLUMNS * RASTER_COLUMN_PX, rs->count * row_px);
+    if (!img) return NULL;
+
+    for (size_t r = 0; r < rs->count; r++) {
+        const raster_row_t *row = &rs->rows[r];
+        uint8_t rgb[3];
+        for (size_t dy = 0; dy < row_px; dy++) {
+            size_t y = r * row_px + dy;
+            for (size_t x = 0; x < RASTER_STRIP; x++) {
+                image_set(img, x, y, error_color(row->error_code));
+            }
+        }
+        for (size_t c = 0; c < RASTER_COLUMNS; c++) {
+            const uint8_t *color = color_empty;
+            if (!isnan(row->bins[c])) {
+                image_colormap(colormap_position(opts, row->bins[c]), rgb);
+                color = rgb;
+            }
+            for (size_t dy = 0; dy < row_px; dy++) {
+                for (size_t dx = 0; dx < RASTER_COLUMN_PX; dx++) {
+                    image_set(img, x0 + c * RASTER_COLUMN_PX + dx, r * row_px + dy, color);
+                }
+            }
+        }
+    }
+
+    /* Alignment point, if inside the window */
+    if (window[0] < 0.0 && window[1] > 0.0) {
+        double frac = -window[0] / (window[1] - window[0]);
+        size_t x = x0 + (size_t)(frac * RASTER_COLUMNS * RASTER_COLUMN_PX);
+        for (size_t y = 0; y < img->height; y++) {
+            image_blend(img, x, y, color_marker, 0.6);
+        }
+    }
+    return img;
+}
+
+int run_raster_macro(ml_trial_file_t *file, const char *input_path,
+                     const char *output_dir, const plot_options_t *opts) {
+    const char *out_dir = output_dir ? output_dir : ".";
+    if (strcmp(out_dir, "-") == 0) {
+        fprintf(stderr, "Error: Stdout output (-O -) not supported for rasters\n");
+        return -1;
+    }
+
+    raster_spec_t spec = { .value = opts->raster_value, .align_code = opts->align_code };
+    if (opts->window[1] > opts->window[0]) {
+        spec.window[0] = opts->window[0];
+        spec.window[1] = opts->window[1];
+    } else if (opts->align_code >= 0) {
+        spec.window[0] = -500.0;
+        spec.window[1] = 1500.0;
+    } else {
+        spec.window[0] = 0.0;
+        spec.window[1] = 2000.0;
+    }
+
+    if (set_data_fields(file, raster_fields) != 0) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return -1;
+    }
+
+    raster_t *rs;
+    if (run_trial_kernel(file, &raster_kernel, &spec, (void**)&rs) != 0) return -1;
+    int ret = 0;
+
+    if (rs->unaligned > 0) {
+        fprintf(stderr, "Warning: %zu trials without code %d left out\n", rs->unaligned, spec.align_code);
+    }
+    if (rs->count == 0) {
+        fprintf(stderr, "Warning: No trials to plot\n");
+        ret = -1;
+        goto cleanup;
+    }
+    sort_rows(rs, opts->raster_sort);
+
+    image_t *img = render_raster(rs, opts, spec.window);
+    if (!img) {
+        fprintf(stderr, "Error: Out of memory\n");
+        ret = -1;
+        goto cleanup;
+    }
+
+    char stem[256];
+    char path[1024];
+    plot_output_stem(input_path, stem, sizeof(stem));
+    snprintf(path, sizeof(path), "%s/Raster_%s.png", out_dir, stem);
+    ret = image_write_png(img, path);
+    if (ret == 0) printf("Saved: %s\n", path);
+    image_free(img);
+
+cleanup:
+    raster_destroy(rs);
+    return ret;
+}
@@ -0,0 +1,216 @@
+/************************************************************/
+/* timing.c - Macro 10: Trial timing and inter-trial intervals
+ * Per-trial start, duration (last behavioral code time) and interval to
+ * the next trial, with session pauses and throughput. Reads only
+ * AbsoluteTrialStartTime and BehavioralCodes.CodeTimes, or nothing at
+ * all when a fresh sidecar index exists (see trial_index.h, --index).
+ *
+ * Intervals run between consecutive trials that pass the skip rules.
+ * An interval is a pause when it is longer than TIMING_PAUSE_FACTOR
+ * times the median interval and at least TIMING_PAUSE_MIN_MS.
+ */
+/************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../macros.h"
+#include "../trial_index.h"
+
+#define TIMING_PAUSE_FACTOR 5.0
+#define TIMING_PAUSE_MIN_MS 5000.0
+#define TIMING_MAX_LISTED   64      /* Pauses listed in the summary */
+
+/* Summary of a set of durations (ms) */
+typedef struct {
+    size_t n;
+    double mean, median, p95, max;
+} timing_stats_t;
+
+static int compare_double(const void *a, const void *b) {
+    double da = *(const double*)a, db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+/* Sorts values in place; NaN entries must already be left out */
+static void describe(double *values, size_t n, timing_stats_t *s) {
+    memset(s, 0, sizeof(*s));
+    s->n = n;
+    if (n == 0) return;
+
+    qsort(values, n, sizeof(double), compare_double);
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++) sum += values[i];
+    s->mean = sum / n;
+    s->median = n % 2 ? values[n / 2] : 0.5 * (values[n / 2 - 1] + values[n / 2]);
+    s->p95 = values[(size_t)ceil(0.95 * n) - 1];  /* Nearest rank */
+    s->max = values[n - 1];
+}
+
+static void append_stats(macro_result_t *result, const char *label, const timing_stats_t *s) {
+    if (s->n == 0) {
+        macro_result_appendf(result, "%s\t0\t-\t-\t-\t-\n", label);
+        return;
+    }
+    macro_result_appendf(result, "%s\t%zu\t%.1f\t%.1f\t%.1f\t%.1f\n", label, s->n,
+                         s->mean, s->median, s->p95, s->max);
+}
+
+/* Kept trials, from the sidecar index or from the file */
+static trial_index_t* collect_trials(ml_trial_file_t *file) {
+    trial_index_t *index = trial_index_load(file->bhv2_file->path);
+    if (index) {
+        size_t kept = 0;
+        for (size_t i = 0; i < index->count; i++) {
+            trial_index_entry_t *e = &index->entries[i];
+            trial_info_t info = {
+                .trial_num = e->trial_num,
+                .error_code = e->error_code,
+                .condition = e->condition,
+                .block = e->block
+            };
+            if (file->skips && skip_trial(file->skips, &info)) continue;
+            index->entries[kept++] = *e;
+        }
+        index->count = kept;
+        return index;
+    }
+
+    index = trial_index_new();
+    if (!index || set_data_fields(file, trial_index_fields) != 0) {
+        trial_index_free(index);
+        return NULL;
+    }
+    while (read_next_trial(file, SELECT_DATA) > 0) {
+        if (trial_index_append(index, file) != 0) {
+            trial_index_free(index);
+            return NULL;
+        }
+    }
+    return index;
+}
+
+int macro_timing(ml_trial_file_t *file, macro_result_t *result) {
+    trial_index_t *trials = collect_trials(file);
+    if (!trials) {
+        macro_result_set(result, "Out of memory");
+        return 0;
+    }
+    if (trials->count == 0) {
+        macro_result_set(result, "No data");
+        trial_index_free(trials);
+        return 0;
+    }
+
+    size_t n = trials->count;
+    const trial_index_entry_t *e = trials->entries;
+    double *interval = malloc(n * sizeof(double));     /* End to next start, NaN if unknown */
+    double *scratch = malloc(n * sizeof(double));
+    if (!interval || !scratch) {
+        macro_result_set(result, "Out of memory");
+        free(interval);
+        free(scratch);
+        trial_index_free(trials);
+        return 0;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        interval[i] = i + 1 < n ? e[i + 1].start_time - (e[i].start_time + e[i].end_time) : NAN;
+    }
+
+    /* Pause threshold from the median interval */
+    size_t n_known = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (isfinite(interval[i])) scratch[n_known++] = interval[i];
+    }
+    timing_stats_t iti;
+    describe(scratch, n_known, &iti);
+    double pause_ms = fmax(TIMING_PAUSE_FACTOR * iti.median, TIMING_PAUSE_MIN_MS);
+
+    double t0 = e[0].start_time;
+    int n_pauses = 0;
+    double pause_total = 0.0;
+    int listed[TIMING_MAX_LISTED];
+    double listed_ms[TIMING_MAX_LISTED];
+
+    macro_result_append(result, "Trial\tCond\tError\tStart\tDuration\tITI\tPause\n");
+    for (size_t i = 0; i < n; i++) {
+        macro_result_append_int(result, e[i].trial_num);
+        macro_result_append(result, "\t");
+        macro_result_append_int(result, e[i].condition);
+        macro_result_append(result, "\t");
+        macro_result_append_int(result, e[i].error_code);
+        macro_result_append(result, "\t");
+        if (isfinite(e[i].start_time)) {
+            macro_result_append_fixed(result, (e[i].start_time - t0) / 1000.0, 3);
+            macro_result_append(result, "\t");
+        } else {
+            macro_result_append(result, "-\t");
+        }
+        if (isfinite(e[i].end_time)) {
+            macro_result_append_fixed(result, e[i].end_time, 1);
+            macro_result_append(result, "\t");
+        } else {
+            macro_result_append(result, "-\t");
+        }
+        if (!isfinite(interval[i])) {
+            macro_result_append(result, "-\t-\n");
+            continue;
+        }
+
+        int pause = interval[i] > pause_ms;
+        macro_result_append_fixed(result, interval[i], 1);
+        macro_result_append(result, pause ? "\tpause\n" : "\t-\n");
+        if (pause) {
+            if (n_pauses < TIMING_MAX_LISTED) {
+                listed[n_pauses] = e[i].trial_num;
+                listed_ms[n_pauses] = interval[i];
+            }
+            n_pauses++;
+            pause_total += interval[i];
+        }
+    }
+
+    /* Session span: first start to last end */
+    size_t first = 0, last = n - 1;
+    while (first < n && !isfinite(e[first].start_time)) first++;
+    while (last > first && !(isfinite(e[last].start_time) && isfinite(e[last].end_time))) last--;
+    double span_ms = first < n ? e[last].start_time + (isfinite(e[last].end_time) ? e[last].end_time : 0.0)
+                                 - e[first].start_time : NAN;
+
+    size_t n_durations = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (isfinite(e[i].end_time)) scratch[n_durations++] = e[i].end_time;
+    }
+    timing_stats_t duration;
+    describe(scratch, n_durations, &duration);
+
+    /* Summary */
+    macro_result_appendf(result, "\nTrials: %zu\n", n);
+    if (isfinite(span_ms)) {
+        double active_ms = span_ms - pause_total;
+        macro_result_appendf(result, "Session: %.1f min (%.1f min active)\n",
+                             span_ms / 60000.0, active_ms / 60000.0);
+        if (span_ms > 0.0) {
+            macro_result_appendf(result, "Throughput: %.2f trials/min (%.2f active)\n",
+                                 n / (span_ms / 60000.0),
+                                 active_ms > 0.0 ? n / (active_ms / 60000.0) : 0.0);
+        }
+    }
+
+    macro_result_append(result, "Measure\tN\tMean\tMedian\tP95\tMax\n");
+    append_stats(result, "Duration", &duration);
+    append_stats(result, "ITI", &iti);
+
+    macro_result_appendf(result, "Pauses (ITI > %.1f s): %d", pause_ms / 1000.0, n_pauses);
+    if (n_pauses > 0) macro_result_appendf(result, ", %.1f s total", pause_total / 1000.0);
+    macro_result_append(result, "\n");
+    for (int i = 0; i < n_pauses && i < TIMING_MAX_LISTED; i++) {
+        macro_result_appendf(result, "  after trial %d: %.1f s\n", listed[i], listed_ms[i] / 1000.0);
+    }
+
+    free(interval);
+    free(scratch);
+    trial_index_free(trials);
+    return 0;
+}
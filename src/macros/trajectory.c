@@ -0,0 +1,262 @@
+/************************************************************/
+/* trajectory.c - Macro 8: Mouse/touch trajectories
+ * Per-trial path length, peak speed, movement onset/offset and
+ * curvature of AnalogData.Mouse and AnalogData.Touch, with means per
+ * condition. Only those two channels and SampleInterval are decoded.
+ *
+ * Positions are smoothed with a moving average, speed comes from
+ * central differences. The movement is the run of samples around the
+ * speed peak that stays at or above TRAJ_ONSET_FRACTION of the peak.
+ * Curvature is the largest distance of the path from the straight line
+ * between onset and offset positions, divided by that line's length.
+ */
+/************************************************************/
+
+#define _POSIX_C_SOURCE 200809L  /* For strdup */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../macros.h"
+#include "../ml_analog.h"
+#include "../kernels.h"
+
+#define TRAJ_SMOOTH_MS      10.0    /* Moving-average window */
+#define TRAJ_ONSET_FRACTION 0.1     /* Onset/offset at this share of peak speed */
+
+static const char *trajectory_fields[] = {
+    "AnalogData.Mouse", "AnalogData.Touch", "AnalogData.SampleInterval", NULL
+};
+
+/* One trial's measures for one input */
+typedef struct {
+    double path_length;     /* Position units */
+    double peak_speed;      /* Position units per second */
+    double onset_ms;
+    double offset_ms;
+    double curvature;       /* Max deviation / chord, NaN if chord is 0 */
+    int moved;              /* 0: no finite speed above zero */
+} traj_measures_t;
+
+/* Condition x input sums for the summary */
+typedef struct {
+    int condition;
+    char *input;
+    int trials;
+    int moved;
+    int curved;             /* Trials with a defined curvature */
+    double path_sum;
+    double peak_sum;
+    double onset_sum;
+    double duration_sum;
+    double curvature_sum;
+} traj_group_t;
+
+typedef struct {
+    traj_group_t *items;
+    size_t count;
+    size_t capacity;
+} traj_groups_t;
+
+/* Scratch buffers reused across trials */
+typedef struct {
+    double *conv;           /* Non-double channel converted */
+    double *sx, *sy;        /* Smoothed positions */
+    double *speed;
+    size_t capacity;
+} traj_buffers_t;
+
+static int buffers_reserve(traj_buffers_t *buf, size_t n) {
+    if (n <= buf->capacity) return 0;
+    double *conv = realloc(buf->conv, 2 * n * sizeof(double));
+    if (!conv) return -1;
+    buf->conv = conv;
+    double *sx = realloc(buf->sx, n * sizeof(double));
+    if (!sx) return -1;
+    buf->sx = sx;
+    double *sy = realloc(buf->sy, n * sizeof(double));
+    if (!sy) return -1;
+    buf->sy = sy;
+    double *speed = realloc(buf->speed, n * sizeof(double));
+    if (!speed) return -1;
+    buf->speed = speed;
+    buf->capacity = n;
+    return 0;
+}
+
+static traj_group_t* find_group(traj_groups_t *list, int condition, const char *input) {
+    for (size_t i = 0; i < list->count; i++) {
+        if (list->items[i].condition == condition && strcmp(list->items[i].input, input) == 0) {
+            return &list->items[i];
+        }
+    }
+    if (list->count >= list->capacity) {
+        size_t new_cap = list->capacity == 0 ? 16 : list->capacity * 2;
+        traj_group_t *grown = realloc(list->items, new_cap * sizeof(traj_group_t));
+        if (!grown) return NULL;
+        list->items = grown;
+        list->capacity = new_cap;
+    }
+    traj_group_t *g = &list->items[list->count];
+    memset(g, 0, sizeof(*g));
+    g->condition = condition;
+    g->input = strdup(input);
+    if (!g->input) return NULL;
+    list->count++;
+    return g;
+}
+
+static int compare_group(const void *a, const void *b) {
+    const traj_group_t *ga = a, *gb = b;
+    if (ga->condition != gb->condition) return (ga->condition > gb->condition) - (ga->condition < gb->condition);
+    return strcmp(ga->input, gb->input);
+}
+
+/* Largest distance of (x, y)[from..to] from the onset-offset chord, over its length */
+static double path_curvature(const double *x, const double *y, size_t from, size_t to) {
+    double cx = x[to] - x[from], cy = y[to] - y[from];
+    double chord = sqrt(cx * cx + cy * cy);
+    if (!(chord > 0.0)) return NAN;
+
+    double max_dev = 0.0;
+    for (size_t i = from; i <= to; i++) {
+        double dev = fabs((x[i] - x[from]) * cy - (y[i] - y[from]) * cx);
+        if (dev > max_dev) max_dev = dev;  /* NaN compares false */
+    }
+    return max_dev / chord / chord;
+}
+
+static void measure(const double *x, const double *y, size_t n, double interval_ms,
+                    traj_buffers_t *buf, traj_measures_t *m) {
+    memset(m, 0, sizeof(*m));
+    if (n < 2) return;
+
+    size_t half = (size_t)(TRAJ_SMOOTH_MS / 2.0 / interval_ms + 0.5);
+    kernel_moving_average(x, n, half, buf->sx);
+    kernel_moving_average(y, n, half, buf->sy);
+    kernel_speed(buf->sx, buf->sy, n, interval_ms / 1000.0, buf->speed);
+
+    m->path_length = kernel_path_length(buf->sx, buf->sy, n);
+
+    size_t peak = kernel_argmax(buf->speed, n);
+    if (peak >= n || !(buf->speed[peak] > 0.0)) return;
+
+    double threshold = buf->speed[peak] * TRAJ_ONSET_FRACTION;
+    size_t onset = peak, offset = peak;
+    while (onset > 0 && buf->speed[onset - 1] >= threshold) onset--;
+    while (offset + 1 < n && buf->speed[offset + 1] >= threshold) offset++;
+
+    m->moved = 1;
+    m->peak_speed = buf->speed[peak];
+    m->onset_ms = onset * interval_ms;
+    m->offset_ms = offset * interval_ms;
+    m->curvature = path_curvature(buf->sx, buf->sy, onset, offset);
+}
+
+int macro_trajectory(ml_trial_file_t *file, macro_result_t *result) {
+    if (set_data_fields(file, trajectory_fields) != 0) {
+        macro_result_set(result, "Out of memory");
+        return 0;
+    }
+
+    ml_analog_schema_t *schema = NULL;
+    traj_groups_t groups = {0};
+    traj_buffers_t buf = {0};
+    int n_trials = 0;
+
+    macro_result_append(result, "Trial\tCond\tError\tInput\tPathLen\tPeakSpeed\tOnset\tOffset\tCurvature\n");
+
+    while (read_next_trial(file, SELECT_DATA) > 0) {
+        n_trials++;
+        bhv2_value_t *analog = bhv2_struct_get(trial_data(file), "AnalogData", 0);
+        if (!analog || ml_analog_schema_update(&schema, analog) != 0) continue;
+
+        double interval_ms = ml_analog_interval_ms(schema, analog);
+
+        for (size_t c = 0; c < schema->n_channels; c++) {
+            const ml_analog_channel_t *ch = &schema->channels[c];
+            if (ch->kind != ML_CH_MOUSE && ch->kind != ML_CH_TOUCH) continue;
+            bhv2_value_t *value = ml_analog_channel(schema, analog, c);
+            if (!value || ml_analog_columns(value) < 2) continue;
+
+            size_t n = ml_analog_samples(value);
+            if (buffers_reserve(&buf, n) != 0) continue;
+
+            /* First two columns are X and Y (column-major) */
+            const double *x = value->data.d;
+            if (value->dtype != MATLAB_DOUBLE) {
+                for (size_t i = 0; i < 2 * n; i++) {
+                    buf.conv[i] = bhv2_get_double(value, i);
+                }
+                x = buf.conv;
+            }
+
+            traj_measures_t m;
+            measure(x, x + n, n, interval_ms, &buf, &m);
+
+            traj_group_t *g = find_group(&groups, trial_condition(file), ch->label);
+            if (g) g->trials++;
+
+            if (!m.moved) {
+                macro_result_appendf(result, "%d\t%d\t%d\t%s\t%.2f\t-\t-\t-\t-\n",
+                                     trial_number(file), trial_condition(file), trial_error(file),
+                                     ch->label, m.path_length);
+                if (g) g->path_sum += m.path_length;
+                continue;
+            }
+
+            macro_result_appendf(result, "%d\t%d\t%d\t%s\t%.2f\t%.2f\t%.1f\t%.1f\t",
+                                 trial_number(file), trial_condition(file), trial_error(file),
+                                 ch->label, m.path_length, m.peak_speed, m.onset_ms, m.offset_ms);
+            if (isnan(m.curvature)) {
+                macro_result_append(result, "-\n");
+            } else {
+                macro_result_appendf(result, "%.3f\n", m.curvature);
+            }
+
+            if (g) {
+                g->moved++;
+                g->path_sum += m.path_length;
+                g->peak_sum += m.peak_speed;
+                g->onset_sum += m.onset_ms;
+                g->duration_sum += m.offset_ms - m.onset_ms;
+                if (!isnan(m.curvature)) {
+                    g->curved++;
+                    g->curvature_sum += m.curvature;
+                }
+            }
+        }
+    }
+
+    /* Means per condition and input */
+    macro_result_appendf(result, "\nTrials: %d\n", n_trials);
+    if (groups.count > 0) {
+        qsort(groups.items, groups.count, sizeof(traj_group_t), compare_group);
+        macro_result_append(result, "Cond\tInput\tTrials\tMoved\tPathLen\tPeakSpeed\tOnset\tDuration\tCurvature\n");
+    }
+    for (size_t i = 0; i < groups.count; i++) {
+        traj_group_t *g = &groups.items[i];
+        macro_result_appendf(result, "%d\t%s\t%d\t%d\t%.2f", g->condition, g->input,
+                             g->trials, g->moved, g->trials ? g->path_sum / g->trials : 0.0);
+        if (g->moved > 0) {
+            macro_result_appendf(result, "\t%.2f\t%.1f\t%.1f", g->peak_sum / g->moved,
+                                 g->onset_sum / g->moved, g->duration_sum / g->moved);
+        } else {
+            macro_result_append(result, "\t-\t-\t-");
+        }
+        if (g->curved > 0) {
+            macro_result_appendf(result, "\t%.3f\n", g->curvature_sum / g->curved);
+        } else {
+            macro_result_append(result, "\t-\n");
+        }
+        free(g->input);
+    }
+
+    free(groups.items);
+    free(buf.conv);
+    free(buf.sx);
+    free(buf.sy);
+    free(buf.speed);
+    ml_analog_schema_free(schema);
+    return 0;
+}
@@ -0,0 +1,117 @@
+/************************************************************/
+/* uservars.c - Macro 12: UserVars table
+ * One row per trial, one typed column per UserVars name seen in any
+ * trial (see ml_uservars.h for the schema rules). Only UserVars is
+ * decoded. String columns hold dictionary ids; the schema and the
+ * dictionaries follow the table.
+ */
+/************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "../macros.h"
+#include "../ml_uservars.h"
+
+static const char *uservars_fields[] = { "UserVars", NULL };
+
+static void append_cell(macro_result_t *result, const ml_uv_column_t *col, size_t row) {
+    switch (col->kind[row]) {
+        case ML_UV_BOOL:
+        case ML_UV_INT:
+            macro_result_append(result, "\t");
+            macro_result_append_fixed(result, col->num[row], 0);
+            break;
+        case ML_UV_DOUBLE:
+            macro_result_appendf(result, "\t%.10g", col->num[row]);
+            break;
+        case ML_UV_STRING:
+            macro_result_append(result, "\t");
+            macro_result_append_int(result, col->id[row]);
+            break;
+        default:
+            macro_result_append(result, "\t-");
+            break;
+    }
+}
+
+/* Dictionary text on one line: tabs and line breaks become spaces */
+static void append_text(macro_result_t *result, const char *text) {
+    size_t len = strlen(text);
+    char *line = malloc(len + 1);
+    if (!line) return;
+    for (size_t i = 0; i <= len; i++) {
+        line[i] = (text[i] == '\t' || text[i] == '\n' || text[i] == '\r') ? ' ' : text[i];
+    }
+    macro_result_append(result, line);
+    free(line);
+}
+
+int macro_uservars(ml_trial_file_t *file, macro_result_t *result) {
+    ml_uv_table_t *table = ml_uv_table_new();
+    if (!table || set_data_fields(file, uservars_fields) != 0) {
+        macro_result_set(result, "Out of memory");
+        ml_uv_table_free(table);
+        return 0;
+    }
+
+    while (read_next_trial(file, SELECT_DATA) > 0) {
+        bhv2_value_t *uservars = bhv2_struct_get(trial_data(file), "UserVars", 0);
+        if (ml_uv_table_add(table, trial_number(file), trial_condition(file), trial_error(file),
+                            trial_block(file), uservars) != 0) {
+            macro_result_set(result, "Out of memory");
+            ml_uv_table_free(table);
+            return 0;
+        }
+    }
+    if (ml_uv_table_finish(table) != 0) {
+        macro_result_set(result, "Out of memory");
+        ml_uv_table_free(table);
+        return 0;
+    }
+
+    /* Table */
+    macro_result_append(result, "Trial\tCond\tError\tBlock");
+    for (size_t c = 0; c < table->n_columns; c++) {
+        macro_result_appendf(result, "\t%s", table->columns[c].name);
+    }
+    macro_result_append(result, "\n");
+    for (size_t row = 0; row < table->n_rows; row++) {
+        int meta[4] = { table->trial[row], table->condition[row], table->error[row], table->block[row] };
+        for (int k = 0; k < 4; k++) {
+            if (k) macro_result_append(result, "\t");
+            macro_result_append_int(result, meta[k]);
+        }
+        for (size_t c = 0; c < table->n_columns; c++) {
+            append_cell(result, &table->columns[c], row);
+        }
+        macro_result_append(result, "\n");
+    }
+
+    /* Schema */
+    macro_result_appendf(result, "\nTrials: %zu\n", table->n_rows);
+    macro_result_append(result, "Column\tType\tPresent\tDistinct\n");
+    for (size_t c = 0; c < table->n_columns; c++) {
+        const ml_uv_column_t *col = &table->columns[c];
+        macro_result_appendf(result, "%s\t%s\t%zu\t", col->name, ml_uv_type_name(col->type), col->present);
+        if (col->type == ML_UV_STRING) {
+            macro_result_appendf(result, "%u\n", col->n_dict);
+        } else {
+            macro_result_append(result, "-\n");
+        }
+    }
+
+    /* Dictionaries */
+    for (size_t c = 0; c < table->n_columns; c++) {
+        const ml_uv_column_t *col = &table->columns[c];
+        if (col->type != ML_UV_STRING) continue;
+        macro_result_appendf(result, "\nColumn %s\nId\tValue\n", col->name);
+        for (uint32_t id = 0; id < col->n_dict; id++) {
+            macro_result_appendf(result, "%u\t", id);
+            append_text(result, col->dict[id]);
+            macro_result_append(result, "\n");
+        }
+    }
+
+    ml_uv_table_free(table);
+    return 0;
+}
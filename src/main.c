@@ -17,6 +17,21 @@
  *   -x<N:M>     Exclude trials N through M
  *   -o<N>       Text output macro N (default: 0 = count)
  *   -g<N>       Graphical output macro N
+ *   -e <fmt>    Export trials (mat, jsonl)
+ *   --fields <paths>  Fields to export, comma-separated dotted paths
+ *   --extent <spec>  Heatmap extent in deg (N or X0:X1,Y0:Y1)
+ *   --bin <deg>      Heatmap bin size in deg
+ *   --raster <value> Raster (-g6) colors: eyex, eyey, speed, button
+ *   --sort <key>     Raster row order: trial, condition, rt, error
+ *   --align <code>   Align raster rows to a behavioral code
+ *   --window <A:B>   Raster time window in ms from the alignment
+ *   --filter <spec>  Analog filter, e.g. eye:lp=30 (repeatable)
+ *   --resample <Hz>  Resample all analog channels to a common rate
+ *   --index     Write/refresh the sidecar trial index (<file>.pidx)
+ *   --plugins <dir>  Load plugin macros (*.so) from dir
+ *   -j <N>      Worker threads (default 1, 0 for one per CPU)
+ *   --single    Keep AnalogData channels in single precision
+ *   --journal <file>  Skip files a previous run finished, resume the rest
  *   -O <dir>    Output directory (default: current dir, "-" for stdout)
  *   -f          Force overwrite existing files
  *   -l          List available macros
@@ -29,13 +44,21 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include <libgen.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #include "ml_trial.h"
+#include "sched.h"
 #include "skip.h"
 #include "macros.h"
 #include "macros/plot.h"
+#include "trial_index.h"
+#include "export.h"
+#include "plugin.h"
+#include "journal.h"
+#include "kernels.h"
 
 #define PRESTO_VERSION "0.1.0"
+#define JOURNAL_CHECKPOINT_SECONDS 30.0   /* Between kernel checkpoints */
 
 /************************************************************/
 /* Macro registry
@@ -56,6 +79,13 @@ static macro_info_t macros[] = {
     {3, "scenes", "Scene structure", false},
     {4, "analog", "Analog data info", false},
     {5, "errorcounts", "Error counts per condition", false},
+    {6, "analogqc", "Analog data quality (all trials)", false},
+    {7, "buttons", "Button press events (all trials)", false},
+    {8, "trajectory", "Mouse/touch trajectories (all trials)", false},
+    {9, "performance", "Rolling performance / learning curve (all trials)", false},
+    {10, "timing", "Trial durations, ITIs, pauses, throughput", false},
+    {11, "objects", "Object status per scene and condition (all trials)", false},
+    {12, "uservars", "UserVars as typed columns (all trials)", false},
     {-1, NULL, NULL, false}  /* Sentinel */
 };
 
@@ -74,8 +104,33 @@ static void print_usage(const char *prog) {
     fprintf(stderr, "\nOutput:\n");
     fprintf(stderr, "  -o<N>       Text output macro (default: 0)\n");
     fprintf(stderr, "  -g<N>       Graphical output macro\n");
+    fprintf(stderr, "  -e <fmt>    Export trials: mat (MATLAB v5), jsonl (JSON Lines)\n");
+    fprintf(stderr, "  --fields <paths>  Fields to export (e.g., AnalogData.Eye,UserVars; repeatable)\n");
     fprintf(stderr, "  -O <dir>    Output directory ('-' for stdout)\n");
     fprintf(stderr, "  -s <WxH>    Plot size in inches (default: 11x8.5, e.g., -s 8x6)\n");
+    fprintf(stderr, "  --extent <spec>  Heatmap and contact sheet extent in deg: N (-N:N) or X0:X1,Y0:Y1 (default: 20)\n");
+    fprintf(stderr, "  --bin <deg>      Heatmap bin size in deg (default: 0.5)\n");
+    fprintf(stderr, "  --raster <value> Raster (-g6) colors: eyex, eyey, speed, button (default: eyex)\n");
+    fprintf(stderr, "  --sort <key>     Raster rows by: trial, condition, rt, error (default: trial)\n");
+    fprintf(stderr, "  --align <code>   Align raster rows to the first occurrence of a behavioral code\n");
+    fprintf(stderr, "  --window <A:B>   Raster window in ms from alignment (default: -500:1500, unaligned 0:2000)\n");
+    fprintf(stderr, "\nAnalog filtering:\n");
+    fprintf(stderr, "  --filter <channel>:<op>=<v>[,<op>=<v>...]   (repeatable, applied in order)\n");
+    fprintf(stderr, "              lp=<Hz>   zero-phase Butterworth low-pass\n");
+    fprintf(stderr, "              sg=<ms>   Savitzky-Golay smoothing\n");
+    fprintf(stderr, "              sgd=<ms>  Savitzky-Golay derivative (units/s)\n");
+    fprintf(stderr, "              med=<ms>  median filter (despiking)\n");
+    fprintf(stderr, "              e.g. --filter eye:lp=30 --filter general:med=5\n");
+    fprintf(stderr, "  --resample <Hz>   Resample all analog channels (before filters)\n");
+    fprintf(stderr, "\nIndexing:\n");
+    fprintf(stderr, "  --index     Write/refresh <file>.pidx (trial metadata and offsets, used by -o10)\n");
+    fprintf(stderr, "\nPlugins:\n");
+    fprintf(stderr, "  --plugins <dir>   Load plugin macros from dir/*.so (default: $PRESTO_PLUGIN_DIR)\n");
+    fprintf(stderr, "\nPerformance:\n");
+    fprintf(stderr, "  -j <N>      Worker threads for decoding and multiple files (default: 1, 0: one per CPU)\n");
+    fprintf(stderr, "  --single    Decode AnalogData channels as single precision\n");
+    fprintf(stderr, "  --journal <file>  Record finished files in file; a rerun skips them and resumes\n");
+    fprintf(stderr, "                    checkpointed ones (-o5, -g3) where they stopped\n");
     fprintf(stderr, "\nInfo:\n");
     fprintf(stderr, "  -M          List available macros\n");
     fprintf(stderr, "  -h          Show this help\n");
@@ -93,6 +148,19 @@ static void print_macros(void) {
     printf("\nGraphical macros:\n");
     printf("  -g1  Plot analog data (PDF)\n");
     printf("  -g2  Plot timeline (PDF)\n");
+    printf("  -g3  Gaze heatmap per condition (PPM + grid)\n");
+    printf("  -g4  Rolling performance (PDF)\n");
+    printf("  -g5  Trial contact sheet (PNG)\n");
+    printf("  -g6  Trial-by-time raster (PNG)\n");
+    if (plugin_count() > 0) {
+        printf("\nPlugin macros:\n");
+        for (int i = 0; i < plugin_count(); i++) {
+            int id;
+            const char *name, *description;
+            plugin_info(i, &id, &name, &description);
+            printf("  -o%d  %s: %s\n", id, name, description);
+        }
+    }
 }
 
 /************************************************************/
@@ -166,7 +234,8 @@ static char* make_output_filename(const char *input_path, int macro_id) {
 }
 
 /************************************************************/
-/* Write text result to file
+/* Write text result to file (written aside and renamed into
+ * place, so the file is whole or absent)
  * Returns 0 on success, -1 on error
  */
 /************************************************************/
@@ -174,13 +243,20 @@ static int write_result_to_file(const char *dir, const char *filename, const cha
     /* Build full path */
     size_t path_len = strlen(dir) + 1 + strlen(filename) + 1;
     char *path = malloc(path_len);
-    if (!path) return -1;
+    char *tmp = malloc(path_len + 4);
+    if (!path || !tmp) {
+        free(path);
+        free(tmp);
+        return -1;
+    }
     snprintf(path, path_len, "%s/%s", dir, filename);
+    snprintf(tmp, path_len + 4, "%s.tmp", path);
     
-    FILE *fp = fopen(path, "w");
+    FILE *fp = fopen(tmp, "w");
     if (!fp) {
-        fprintf(stderr, "Error: Cannot write to %s: ", path);
+        fprintf(stderr, "Error: Cannot write to %s: ", tmp);
         perror(NULL);
+        free(tmp);
         free(path);
         return -1;
     }
@@ -194,8 +270,16 @@ static int write_result_to_file(const char *dir, const char *filename, const cha
         }
     }
     
-    fclose(fp);
+    if (fclose(fp) != 0 || rename(tmp, path) != 0) {
+        fprintf(stderr, "Error: Cannot write to %s: ", path);
+        perror(NULL);
+        remove(tmp);
+        free(tmp);
+        free(path);
+        return -1;
+    }
     printf("Saved: %s\n", path);
+    free(tmp);
     free(path);
     return 0;
 }
@@ -216,8 +300,16 @@ typedef struct {
     bool show_help;
     bool show_version;
     int first_file_idx;
-    double plot_width;   /* Plot width in inches */
-    double plot_height;  /* Plot height in inches */
+    plot_options_t plot;  /* Plot size, heatmap grid */
+    filter_chain_t *filters;  /* --filter rules, --resample (NULL if neither) */
+    bool write_index;     /* --index: keep <file>.pidx up to date */
+    char *export_format;  /* -e (NULL for none) */
+    char **export_fields; /* --fields, NULL-terminated (NULL for none) */
+    size_t n_export_fields;
+    char *plugin_dir;     /* --plugins (NULL for $PRESTO_PLUGIN_DIR) */
+    int jobs;             /* -j: worker threads (1: none, 0: one per CPU) */
+    char *journal_path;   /* --journal (NULL for none) */
+    bool single;          /* --single: decode AnalogData channels as single */
 } presto_args_t;
 
 static void args_init(presto_args_t *args) {
@@ -230,15 +322,85 @@ static void args_init(presto_args_t *args) {
     args->show_help = false;
     args->show_version = false;
     args->first_file_idx = -1;
-    args->plot_width = 11.0;   /* Default: 11 inches wide */
-    args->plot_height = 8.5;   /* Default: 8.5 inches tall */
+    plot_options_init(&args->plot);
+    args->filters = NULL;
+    args->write_index = false;
+    args->export_format = NULL;
+    args->export_fields = NULL;
+    args->n_export_fields = 0;
+    args->plugin_dir = NULL;
+    args->jobs = 1;
+    args->journal_path = NULL;
+    args->single = false;
 }
 
 static void args_free(presto_args_t *args) {
     skip_set_free(args->skips);
     free(args->output_dir);
+    filter_chain_free(args->filters);
+    free(args->export_format);
+    for (size_t i = 0; i < args->n_export_fields; i++) {
+        free(args->export_fields[i]);
+    }
+    free(args->export_fields);
+    free(args->plugin_dir);
+    free(args->journal_path);
+}
+
+/* Append "a,b.c,..." to the export field list */
+static int parse_fields(presto_args_t *args, const char *spec) {
+    char *copy = strdup(spec);
+    if (!copy) return -1;
+    
+    int status = 0;
+    char *save;
+    for (char *tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char **grown = realloc(args->export_fields, (args->n_export_fields + 2) * sizeof(char*));
+        if (!grown) {
+            status = -1;
+            break;
+        }
+        args->export_fields = grown;
+        args->export_fields[args->n_export_fields] = strdup(tok);
+        if (!args->export_fields[args->n_export_fields]) {
+            status = -1;
+            break;
+        }
+        args->export_fields[++args->n_export_fields] = NULL;
+    }
+    free(copy);
+    return args->n_export_fields > 0 ? status : -1;
 }
 
+/* Heatmap extent: "N" is -N:N on both axes, "X0:X1,Y0:Y1" sets each axis */
+static int parse_extent(const char *spec, double extent[4]) {
+    double v[4];
+    char tail;
+    if (sscanf(spec, "%lf:%lf,%lf:%lf%c", &v[0], &v[1], &v[2], &v[3], &tail) == 4) {
+        if (v[1] <= v[0] || v[3] <= v[2]) return -1;
+        memcpy(extent, v, sizeof(v));
+        return 0;
+    }
+    if (sscanf(spec, "%lf%c", &v[0], &tail) == 1 && v[0] > 0) {
+        extent[0] = extent[2] = -v[0];
+        extent[1] = extent[3] = v[0];
+        return 0;
+    }
+    return -1;
+}
+
+/* Index of name in a NULL-terminated list, -1 if absent */
+static int parse_keyword(const char *name, const char *const *names) {
+    for (int i = 0; names[i]; i++) {
+        if (strcmp(name, names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+/* Raster keywords, in raster_value_t / raster_sort_t order */
+static const char *const raster_value_names[] = { "eyex", "eyey", "speed", "button", NULL };
+static const char *const raster_sort_names[] = { "trial", "condition", "rt", "error", NULL };
+
 static int parse_args(int argc, char **argv, presto_args_t *args) {
     args_init(args);
     
@@ -302,15 +464,228 @@ static int parse_args(int argc, char **argv, presto_args_t *args) {
                 fprintf(stderr, "Error: Invalid size format '%s' (use WxH, e.g., 11x8.5)\n", size_str);
                 return -1;
             }
-            *x_pos = '\0';  /* Split at 'x' */
-            args->plot_width = atof(size_str);
-            args->plot_height = atof(x_pos + 1);
+            args->plot.width = atof(size_str);  /* Stops at the 'x'; argv is left intact for the journal */
+            args->plot.height = atof(x_pos + 1);
             
-            if (args->plot_width <= 0 || args->plot_height <= 0) {
+            if (args->plot.width <= 0 || args->plot.height <= 0) {
                 fprintf(stderr, "Error: Invalid plot dimensions: %gx%g (must be positive)\n",
-                        args->plot_width, args->plot_height);
+                        args->plot.width, args->plot.height);
+                return -1;
+            }
+            i++;
+            continue;
+        }
+        
+        if (strcmp(arg, "--extent") == 0) {
+            /* Heatmap extent - next arg: N or X0:X1,Y0:Y1 */
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --extent requires an argument (e.g., --extent 15)\n");
+                return -1;
+            }
+            i++;
+            if (parse_extent(argv[i], args->plot.extent) != 0) {
+                fprintf(stderr, "Error: Invalid extent '%s' (use N or X0:X1,Y0:Y1)\n", argv[i]);
+                return -1;
+            }
+            i++;
+            continue;
+        }
+        
+        if (strcmp(arg, "--filter") == 0) {
+            /* Analog filter rule - next arg */
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --filter requires a spec (e.g., --filter eye:lp=30)\n");
+                return -1;
+            }
+            i++;
+            if (!args->filters) args->filters = filter_chain_new();
+            if (!args->filters || filter_chain_parse(args->filters, argv[i]) != 0) {
+                fprintf(stderr, "Error: Invalid filter spec '%s' (use <channel>:<op>=<value>, ops lp, sg, sgd, med)\n",
+                        argv[i]);
+                return -1;
+            }
+            i++;
+            continue;
+        }
+        
+        if (strcmp(arg, "--resample") == 0) {
+            /* Analog sample rate - next arg */
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --resample requires a rate in Hz (e.g., --resample 500)\n");
+                return -1;
+            }
+            i++;
+            if (!args->filters) args->filters = filter_chain_new();
+            if (!args->filters || filter_chain_set_resample(args->filters, atof(argv[i])) != 0) {
+                fprintf(stderr, "Error: Invalid resample rate: %s (must be positive)\n", argv[i]);
+                return -1;
+            }
+            i++;
+            continue;
+        }
+        
+        if (strcmp(arg, "-e") == 0) {
+            /* Export format - next arg */
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: -e requires a format (mat, jsonl)\n");
+                return -1;
+            }
+            i++;
+            if (!export_format_known(argv[i])) {
+                fprintf(stderr, "Error: Unknown export format '%s' (use mat or jsonl)\n", argv[i]);
+                return -1;
+            }
+            free(args->export_format);
+            args->export_format = strdup(argv[i]);
+            i++;
+            continue;
+        }
+        
+        if (strcmp(arg, "--fields") == 0) {
+            /* Export fields - next arg */
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --fields requires a list (e.g., --fields AnalogData.Eye,UserVars)\n");
+                return -1;
+            }
+            i++;
+            if (parse_fields(args, argv[i]) != 0) {
+                fprintf(stderr, "Error: Invalid field list '%s'\n", argv[i]);
+                return -1;
+            }
+            i++;
+            continue;
+        }
+        
+        if (strcmp(arg, "--index") == 0) {
+            args->write_index = true;
+            i++;
+            continue;
+        }
+        
+        if (strcmp(arg, "--plugins") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --plugins requires a directory\n");
+                return -1;
+            }
+            i++;
+            free(args->plugin_dir);
+            args->plugin_dir = strdup(argv[i]);
+            i++;
+            continue;
+        }
+        
+        if (strcmp(arg, "--single") == 0) {
+            args->single = true;
+            i++;
+            continue;
+        }
+        
+        if (strcmp(arg, "--journal") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --journal requires a file\n");
+                return -1;
+            }
+            i++;
+            free(args->journal_path);
+            args->journal_path = strdup(argv[i]);
+            i++;
+            continue;
+        }
+        
+        if (strncmp(arg, "-j", 2) == 0) {
+            /* Worker threads: -j N or -jN */
+            const char *value = arg + 2;
+            if (*value == '\0') {
+                if (i + 1 >= argc) {
+                    fprintf(stderr, "Error: -j requires a thread count (e.g., -j 4)\n");
+                    return -1;
+                }
+                value = argv[++i];
+            }
+            char *end;
+            long jobs = strtol(value, &end, 10);
+            if (*value == '\0' || *end != '\0' || jobs < 0 || jobs > 256) {
+                fprintf(stderr, "Error: Invalid thread count: %s (0-256)\n", value);
+                return -1;
+            }
+            args->jobs = (int)jobs;
+            i++;
+            continue;
+        }
+        
+        if (strcmp(arg, "--bin") == 0) {
+            /* Heatmap bin size - next arg */
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --bin requires a size in degrees\n");
+                return -1;
+            }
+            i++;
+            args->plot.bin = atof(argv[i]);
+            if (args->plot.bin <= 0) {
+                fprintf(stderr, "Error: Invalid bin size: %s (must be positive)\n", argv[i]);
+                return -1;
+            }
+            i++;
+            continue;
+        }
+        
+        if (strcmp(arg, "--raster") == 0 || strcmp(arg, "--sort") == 0) {
+            /* Raster colors or row order - next arg: keyword */
+            bool is_value = strcmp(arg, "--raster") == 0;
+            const char *const *names = is_value ? raster_value_names : raster_sort_names;
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: %s requires an argument (e.g., %s %s)\n", arg, arg, names[1]);
+                return -1;
+            }
+            i++;
+            int k = parse_keyword(argv[i], names);
+            if (k < 0) {
+                fprintf(stderr, "Error: Invalid %s '%s' (use %s, %s, %s or %s)\n",
+                        arg, argv[i], names[0], names[1], names[2], names[3]);
+                return -1;
+            }
+            if (is_value) {
+                args->plot.raster_value = (raster_value_t)k;
+            } else {
+                args->plot.raster_sort = (raster_sort_t)k;
+            }
+            i++;
+            continue;
+        }
+        
+        if (strcmp(arg, "--align") == 0) {
+            /* Raster alignment - next arg: behavioral code number */
+            char *end;
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --align requires a behavioral code (e.g., --align 30)\n");
+                return -1;
+            }
+            i++;
+            long code = strtol(argv[i], &end, 10);
+            if (end == argv[i] || *end != '\0' || code < 0 || code > 65535) {
+                fprintf(stderr, "Error: Invalid behavioral code: %s\n", argv[i]);
+                return -1;
+            }
+            args->plot.align_code = (int)code;
+            i++;
+            continue;
+        }
+        
+        if (strcmp(arg, "--window") == 0) {
+            /* Raster window - next arg: ms0:ms1 */
+            double w[2];
+            char tail;
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --window requires a range in ms (e.g., --window -200:800)\n");
+                return -1;
+            }
+            i++;
+            if (sscanf(argv[i], "%lf:%lf%c", &w[0], &w[1], &tail) != 2 || !(w[1] > w[0])) {
+                fprintf(stderr, "Error: Invalid window '%s' (use A:B in ms, A < B)\n", argv[i]);
                 return -1;
             }
+            args->plot.window[0] = w[0];
+            args->plot.window[1] = w[1];
             i++;
             continue;
         }
@@ -357,6 +732,274 @@ static int parse_args(int argc, char **argv, presto_args_t *args) {
     return 0;
 }
 
+/************************************************************/
+/* Per-file work
+ *
+ * With -j, files are scheduler tasks and run concurrently; their text
+ * results are kept and printed by main() in input order, so the output
+ * matches a serial run.
+ */
+/************************************************************/
+
+typedef struct {
+    const presto_args_t *args;
+    const char *path;           /* File to read */
+    const char *display_name;   /* Name to show in output */
+    bool from_stdin;            /* path is the buffered stdin */
+    filter_chain_t *filters;    /* This file's analog filters */
+    sched_t *sched;             /* Decode trials on (NULL for none) */
+    uint64_t size;              /* File size, the task's cost */
+    bool skipped;               /* The journal lists it as done */
+    uint64_t journal_key;       /* Its journal key (when checkpoint is set) */
+    char *checkpoint;           /* Kernel checkpoint path (NULL if not journaled) */
+
+    /* Filled by process_file() */
+    int status;
+    bool has_result;
+    bool unknown_macro;
+    macro_result_t result;
+
+    /* Set once the task finished (guarded by file_jobs_lock) */
+    bool done;
+} file_job_t;
+
+static pthread_mutex_t file_jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t file_jobs_done = PTHREAD_COND_INITIALIZER;
+
+/* Open one file and run the index, export, plot or text macro on it */
+static void process_file(file_job_t *job) {
+    const presto_args_t *args = job->args;
+    if (job->skipped) return;
+    
+    /* Open BHV2 file with streaming API */
+    ml_trial_file_t *file = open_input_file(job->path);
+    if (!file) {
+        fprintf(stderr, "Error: Failed to open %s: %s\n", job->display_name, bhv2_error_detail);
+        job->status = 1;
+        return;
+    }
+    
+    /* Set skip rules - macros will iterate trials themselves */
+    set_skips(file, args->skips);
+    set_filters(file, job->filters);
+    set_scheduler(file, job->sched);
+    if (args->single) set_decode_flags(file, BHV2_DECODE_SINGLE);
+    if (job->checkpoint && set_checkpoint(file, job->checkpoint, JOURNAL_CHECKPOINT_SECONDS) != 0) {
+        fprintf(stderr, "Error: Out of memory\n");
+        job->status = 1;
+        close_input_file(file);
+        return;
+    }
+    
+    /* Sidecar index, rebuilt only when missing or stale */
+    if (args->write_index && !job->from_stdin) {
+        trial_index_t *index = trial_index_load(job->path);
+        if (!index) {
+            index = trial_index_build(file);
+            if (!index || trial_index_save(index, job->path) != 0) {
+                fprintf(stderr, "Error: Failed to index %s\n", job->display_name);
+                job->status = 1;
+            }
+        }
+        trial_index_free(index);
+    }
+    
+    /* Run the appropriate macro */
+    if (args->export_format) {
+        /* Export */
+        if (run_export(args->export_format, file, job->path, args->to_stdout ? "-" : args->output_dir,
+                       (const char**)args->export_fields) != 0) {
+            job->status = 1;
+        }
+    } else if (args->graph_macro >= 0) {
+        /* Graphical output */
+        const char *output_path = args->output_dir ? args->output_dir : ".";
+        int plot_status = run_plot_macro(args->graph_macro, file, job->path, output_path,
+                                        &args->plot);
+        if (plot_status != 0) {
+            fprintf(stderr, "Error: Plot generation failed\n");
+            job->status = 1;
+        }
+    } else {
+        /* Text output, printed by emit_result() */
+        if (run_macro(args->output_macro, file, &job->result) != 0) {
+            macro_result_free(&job->result);
+            job->unknown_macro = true;
+            job->status = 1;
+        } else {
+            job->has_result = true;
+        }
+    }
+    
+    close_input_file(file);
+}
+
+/* Print or save the text result of a processed file */
+static void emit_result(file_job_t *job, int n_files, const char *prog) {
+    const presto_args_t *args = job->args;
+    
+    if (job->unknown_macro) {
+        fprintf(stderr, "Error: Unknown macro -o%d\n\n", args->output_macro);
+        fprintf(stderr, "Available text macros:\n");
+        for (int j = 0; macros[j].name != NULL; j++) {
+            fprintf(stderr, "  -o%d  %s\n", macros[j].id, macros[j].description);
+        }
+        fprintf(stderr, "\nUse '%s -M' to list all macros.\n", prog);
+        return;
+    }
+    if (!job->has_result) return;
+    
+    macro_result_t *result = &job->result;
+    if (args->to_stdout || args->output_dir == NULL) {
+        /* Print to stdout */
+        if (n_files > 1) {
+            /* Multiple files - use header separator */
+            printf("==> %s <==\n", job->display_name);
+            printf("%s\n", result->text ? result->text : "");
+        } else {
+            printf("%s\n", result->text ? result->text : "");
+        }
+    } else {
+        /* Write to file */
+        char *outfile = make_output_filename(job->display_name, args->output_macro);
+        if (outfile) {
+            if (write_result_to_file(args->output_dir, outfile, result->text) != 0) {
+                job->status = 1;
+            }
+            free(outfile);
+        } else {
+            fprintf(stderr, "Error: Failed to create output filename\n");
+            job->status = 1;
+        }
+    }
+    
+    macro_result_free(result);
+    job->has_result = false;
+}
+
+/* Emit the result and record the job in the journal (NULL for none) once
+ * its output is in place */
+static void finish_job(file_job_t *job, int n_files, const char *prog, journal_t *journal) {
+    emit_result(job, n_files, prog);
+    if (journal && job->checkpoint && job->status == 0
+        && journal_record(journal, job->journal_key, job->path) != 0) {
+        job->status = 1;
+    }
+}
+
+static void file_task(void *arg) {
+    file_job_t *job = arg;
+    process_file(job);
+    
+    pthread_mutex_lock(&file_jobs_lock);
+    job->done = true;
+    pthread_cond_broadcast(&file_jobs_done);
+    pthread_mutex_unlock(&file_jobs_lock);
+}
+
+/* Wait for a file task, decoding queued trial chunks meanwhile */
+static void wait_file_job(sched_t *sched, file_job_t *job) {
+    pthread_mutex_lock(&file_jobs_lock);
+    while (!job->done) {
+        pthread_mutex_unlock(&file_jobs_lock);
+        int helped = sched_help(sched);
+        pthread_mutex_lock(&file_jobs_lock);
+        if (!helped && !job->done) {
+            pthread_cond_wait(&file_jobs_done, &file_jobs_lock);
+        }
+    }
+    pthread_mutex_unlock(&file_jobs_lock);
+}
+
+/* Largest file first, so the long tasks start early */
+static int compare_job_size(const void *a, const void *b) {
+    const file_job_t *ja = *(file_job_t* const*)a;
+    const file_job_t *jb = *(file_job_t* const*)b;
+    return (ja->size < jb->size) - (ja->size > jb->size);
+}
+
+/* Run every job on sched and emit the results in input order */
+static void run_file_jobs(sched_t *sched, file_job_t *jobs, int n_jobs, const char *prog,
+                          journal_t *journal) {
+    file_job_t **order = malloc(n_jobs * sizeof(file_job_t*));
+    for (int i = 0; i < n_jobs; i++) {
+        struct stat st;
+        jobs[i].size = stat(jobs[i].path, &st) == 0 ? (uint64_t)st.st_size : 0;
+        if (order) order[i] = &jobs[i];
+    }
+    if (order) qsort(order, n_jobs, sizeof(file_job_t*), compare_job_size);
+    
+    for (int i = 0; i < n_jobs; i++) {
+        file_job_t *job = order ? order[i] : &jobs[i];
+        if (sched_submit(sched, file_task, job, job->size, false) != 0) {
+            file_task(job);  /* Queue full of memory: run it here */
+        }
+    }
+    free(order);
+    
+    for (int i = 0; i < n_jobs; i++) {
+        wait_file_job(sched, &jobs[i]);
+        finish_job(&jobs[i], n_jobs, prog, journal);
+    }
+}
+
+/************************************************************/
+/* Job journal
+ */
+/************************************************************/
+
+/* The options that shape the output, i.e. all but -j and --journal, one
+ * per line (caller frees) */
+static char* journal_signature(int argc, char **argv, int first_file_idx) {
+    size_t len = 1;
+    for (int i = 1; i < first_file_idx && i < argc; i++) len += strlen(argv[i]) + 1;
+    char *signature = malloc(len);
+    if (!signature) return NULL;
+    
+    char *end = signature;
+    for (int i = 1; i < first_file_idx && i < argc; i++) {
+        if (strcmp(argv[i], "--journal") == 0 || strcmp(argv[i], "-j") == 0) {
+            i++;
+            continue;
+        }
+        if (strncmp(argv[i], "-j", 2) == 0) continue;
+        end += sprintf(end, "%s\n", argv[i]);
+    }
+    *end = '\0';
+    return signature;
+}
+
+/* Open the journal and mark the jobs it lists as skipped (the rest
+ * checkpoint next to it). Returns NULL on failure. */
+static journal_t* open_journal(const presto_args_t *args, int argc, char **argv,
+                               file_job_t *jobs, int n_files) {
+    char *signature = journal_signature(argc, argv, args->first_file_idx);
+    journal_t *journal = signature ? journal_open(args->journal_path, signature) : NULL;
+    free(signature);
+    if (!journal) {
+        fprintf(stderr, "Error: Cannot open journal %s\n", args->journal_path);
+        return NULL;
+    }
+    
+    int n_skipped = 0;
+    for (int i = 0; i < n_files; i++) {
+        file_job_t *job = &jobs[i];
+        if (job->from_stdin || journal_key(journal, job->path, &job->journal_key) != 0) continue;
+        if (journal_done(journal, job->journal_key)) {
+            job->skipped = true;
+            n_skipped++;
+        } else if (!(job->checkpoint = journal_checkpoint_path(journal, job->journal_key))) {
+            fprintf(stderr, "Error: Out of memory\n");
+            journal_close(journal);
+            return NULL;
+        }
+    }
+    if (n_skipped > 0) {
+        fprintf(stderr, "Journal: %d of %d files already done\n", n_skipped, n_files);
+    }
+    return journal;
+}
+
 /************************************************************/
 /* Main
  */
@@ -383,12 +1026,22 @@ int main(int argc, char **argv) {
     
     if (args.show_version) {
         printf("presto %s\n", PRESTO_VERSION);
+        printf("Kernels: %s (supported: %s)\n", kernel_isa_name(kernel_isa()),
+               kernel_isa_name(kernel_isa_supported()));
         args_free(&args);
         return 0;
     }
     
+    /* Plugin macros */
+    const char *plugin_dir = args.plugin_dir ? args.plugin_dir : getenv("PRESTO_PLUGIN_DIR");
+    if (plugin_dir && *plugin_dir && plugin_load_dir(plugin_dir) < 0 && args.plugin_dir) {
+        args_free(&args);
+        return 1;
+    }
+    
     if (args.list_macros) {
         print_macros();
+        plugin_unload_all();
         args_free(&args);
         return 0;
     }
@@ -396,6 +1049,7 @@ int main(int argc, char **argv) {
     if (args.first_file_idx < 0 || args.first_file_idx >= argc) {
         fprintf(stderr, "Error: No input files specified\n");
         print_usage(argv[0]);
+        plugin_unload_all();
         args_free(&args);
         return 1;
     }
@@ -405,22 +1059,40 @@ int main(int argc, char **argv) {
         struct stat st;
         if (stat(args.output_dir, &st) != 0 || !S_ISDIR(st.st_mode)) {
             fprintf(stderr, "Error: Output directory does not exist: %s\n", args.output_dir);
+            plugin_unload_all();
             args_free(&args);
             return 1;
         }
     }
     
+    /* The journal only vouches for output files */
+    if (args.journal_path && (args.to_stdout
+                              || (!args.export_format && args.graph_macro < 0 && !args.output_dir))) {
+        fprintf(stderr, "Error: --journal requires output files (-O <dir>)\n");
+        plugin_unload_all();
+        args_free(&args);
+        return 1;
+    }
+    
     /* Process each file */
     int status = 0;
     int n_files = argc - args.first_file_idx;
     char *stdin_tmpfile = NULL;  /* Track stdin temp file for cleanup */
     
-    for (int i = args.first_file_idx; i < argc; i++) {
-        const char *filepath = argv[i];
-        const char *display_name = filepath;  /* Name to show in output */
+    file_job_t *jobs = calloc(n_files, sizeof(file_job_t));
+    if (!jobs) {
+        fprintf(stderr, "Error: Out of memory\n");
+        plugin_unload_all();
+        args_free(&args);
+        return 1;
+    }
+    for (int i = 0; i < n_files && status == 0; i++) {
+        jobs[i].args = &args;
+        jobs[i].path = jobs[i].display_name = argv[args.first_file_idx + i];
+        jobs[i].filters = args.filters;
         
         /* Handle stdin with explicit '-' */
-        if (strcmp(filepath, "-") == 0) {
+        if (strcmp(jobs[i].path, "-") == 0) {
             if (n_files > 1) {
                 fprintf(stderr, "Error: stdin (-) cannot be combined with other files\n");
                 status = 1;
@@ -432,75 +1104,53 @@ int main(int argc, char **argv) {
                 status = 1;
                 break;
             }
-            filepath = stdin_tmpfile;
-            display_name = "(stdin)";
-        }
-        
-        /* Open BHV2 file with streaming API */
-        ml_trial_file_t *file = open_input_file(filepath);
-        if (!file) {
-            fprintf(stderr, "Error: Failed to open %s: %s\n", display_name, bhv2_error_detail);
-            status = 1;
-            continue;
+            jobs[i].path = stdin_tmpfile;
+            jobs[i].display_name = "(stdin)";
+            jobs[i].from_stdin = true;
         }
-        
-        /* Set skip rules - macros will iterate trials themselves */
-        set_skips(file, args.skips);
-        
-        /* Run the appropriate macro */
-        if (args.graph_macro >= 0) {
-            /* Graphical output */
-            const char *output_path = args.output_dir ? args.output_dir : ".";
-            int plot_status = run_plot_macro(args.graph_macro, file, filepath, output_path,
-                                            args.plot_width, args.plot_height);
-            if (plot_status != 0) {
-                fprintf(stderr, "Error: Plot generation failed\n");
-                status = 1;
-            }
-        } else {
-            /* Text output */
-            macro_result_t result;
-            int macro_status = run_macro(args.output_macro, file, &result);
-            
-            if (macro_status != 0) {
-                fprintf(stderr, "Error: Unknown macro -o%d\n\n", args.output_macro);
-                fprintf(stderr, "Available text macros:\n");
-                for (int j = 0; macros[j].name != NULL; j++) {
-                    fprintf(stderr, "  -o%d  %s\n", macros[j].id, macros[j].description);
-                }
-                fprintf(stderr, "\nUse '%s -M' to list all macros.\n", argv[0]);
+    }
+    
+    journal_t *journal = NULL;
+    if (status == 0 && args.journal_path) {
+        journal = open_journal(&args, argc, argv, jobs, n_files);
+        if (!journal) status = 1;
+    }
+    
+    /* Worker threads decode each file's trials and, unless the export
+     * shares stdout, process several files at once */
+    sched_t *sched = NULL;
+    if (status == 0 && args.jobs != 1) {
+        sched = sched_new(args.jobs);
+        if (!sched) fprintf(stderr, "Warning: Cannot start worker threads, running serially\n");
+    }
+    bool parallel_files = sched && n_files > 1 && !(args.export_format && args.to_stdout);
+    
+    if (status == 0 && parallel_files) {
+        /* Filters keep per-file working state */
+        for (int i = 0; i < n_files; i++) {
+            jobs[i].sched = sched;
+            if (args.filters && !(jobs[i].filters = filter_chain_copy(args.filters))) {
+                fprintf(stderr, "Error: Out of memory\n");
                 status = 1;
-            } else {
-                /* Output result */
-                if (args.to_stdout || args.output_dir == NULL) {
-                    /* Print to stdout */
-                    if (n_files > 1) {
-                        /* Multiple files - use header separator */
-                        printf("==> %s <==\n", display_name);
-                        printf("%s\n", result.text ? result.text : "");
-                    } else {
-                        printf("%s\n", result.text ? result.text : "");
-                    }
-                } else {
-                    /* Write to file */
-                    char *outfile = make_output_filename(display_name, args.output_macro);
-                    if (outfile) {
-                        if (write_result_to_file(args.output_dir, outfile, result.text) != 0) {
-                            status = 1;
-                        }
-                        free(outfile);
-                    } else {
-                        fprintf(stderr, "Error: Failed to create output filename\n");
-                        status = 1;
-                    }
-                }
-                
-                macro_result_free(&result);
             }
         }
-        
-        close_input_file(file);
+        if (status == 0) run_file_jobs(sched, jobs, n_files, argv[0], journal);
+    } else if (status == 0) {
+        for (int i = 0; i < n_files; i++) {
+            jobs[i].sched = sched;
+            process_file(&jobs[i]);
+            finish_job(&jobs[i], n_files, argv[0], journal);
+        }
+    }
+    
+    for (int i = 0; i < n_files; i++) {
+        if (jobs[i].status != 0) status = 1;
+        if (jobs[i].filters != args.filters) filter_chain_free(jobs[i].filters);
+        free(jobs[i].checkpoint);
     }
+    free(jobs);
+    sched_free(sched);
+    journal_close(journal);
     
     /* Clean up stdin temp file if used */
     if (stdin_tmpfile) {
@@ -508,6 +1158,7 @@ int main(int argc, char **argv) {
         free(stdin_tmpfile);
     }
     
+    plugin_unload_all();
     args_free(&args);
     return status;
 }
@@ -0,0 +1,392 @@
+/*
+ * matfile.c - MATLAB Level 5 MAT-file writer
+ *
+ * Every data element is an 8-byte tag (type, byte count) followed by its
+ * data padded to 8 bytes. A variable is one miMATRIX element holding array
+ * flags, dimensions, name and then the data, or for structs and cells
+ * one nested miMATRIX per element.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "matfile.h"
+
+#define MAT_BUFFER_SIZE (1 << 20)
+#define MAT_NAME_MAX 63             /* Longest field name MATLAB accepts */
+#define MAT_CHUNK 4096              /* Elements converted per write */
+
+/* Data types */
+enum {
+    MI_INT8 = 1, MI_UINT8 = 2, MI_INT16 = 3, MI_UINT16 = 4, MI_INT32 = 5, MI_UINT32 = 6,
+    MI_SINGLE = 7, MI_DOUBLE = 9, MI_INT64 = 12, MI_UINT64 = 13, MI_MATRIX = 14
+};
+
+/* Array classes */
+enum {
+    MX_CELL = 1, MX_STRUCT = 2, MX_CHAR = 4, MX_DOUBLE = 6, MX_SINGLE = 7,
+    MX_INT8 = 8, MX_UINT8 = 9, MX_INT16 = 10, MX_UINT16 = 11, MX_INT32 = 12,
+    MX_UINT32 = 13, MX_INT64 = 14, MX_UINT64 = 15
+};
+
+#define MX_LOGICAL_FLAG 0x0200
+
+/************************************************************/
+/* Low-level output
+ */
+/************************************************************/
+
+static uint64_t pad8(uint64_t n) {
+    return (n + 7) & ~(uint64_t)7;
+}
+
+static void put(mat_file_t *mat, const void *data, size_t n) {
+    if (n > 0 && fwrite(data, 1, n, mat->fp) != n) mat->failed = true;
+}
+
+static void put_u32(mat_file_t *mat, uint32_t v) {
+    put(mat, &v, sizeof(v));
+}
+
+static void put_tag(mat_file_t *mat, uint32_t type, uint64_t bytes) {
+    if (bytes > UINT32_MAX) {
+        if (!mat->failed) fprintf(stderr, "Error: MAT v5 element over 4 GB; export fewer fields\n");
+        mat->failed = true;
+    }
+    put_u32(mat, type);
+    put_u32(mat, (uint32_t)bytes);
+}
+
+static void put_padding(mat_file_t *mat, uint64_t n) {
+    static const char zeros[8] = {0};
+    put(mat, zeros, pad8(n) - n);
+}
+
+/************************************************************/
+/* Array layout
+ */
+/************************************************************/
+
+typedef struct {
+    uint8_t mx;
+    uint32_t mi;
+    size_t size;            /* Bytes per element in the file */
+} mat_class_t;
+
+/* Class of a numeric, logical or char value; 0 for anything else */
+static int array_class(matlab_dtype_t dtype, mat_class_t *c) {
+    switch (dtype) {
+        case MATLAB_DOUBLE:  *c = (mat_class_t){ MX_DOUBLE, MI_DOUBLE, 8 }; return 1;
+        case MATLAB_SINGLE:  *c = (mat_class_t){ MX_SINGLE, MI_SINGLE, 4 }; return 1;
+        case MATLAB_INT8:    *c = (mat_class_t){ MX_INT8,   MI_INT8,   1 }; return 1;
+        case MATLAB_UINT8:   *c = (mat_class_t){ MX_UINT8,  MI_UINT8,  1 }; return 1;
+        case MATLAB_INT16:   *c = (mat_class_t){ MX_INT16,  MI_INT16,  2 }; return 1;
+        case MATLAB_UINT16:  *c = (mat_class_t){ MX_UINT16, MI_UINT16, 2 }; return 1;
+        case MATLAB_INT32:   *c = (mat_class_t){ MX_INT32,  MI_INT32,  4 }; return 1;
+        case MATLAB_UINT32:  *c = (mat_class_t){ MX_UINT32, MI_UINT32, 4 }; return 1;
+        case MATLAB_INT64:   *c = (mat_class_t){ MX_INT64,  MI_INT64,  8 }; return 1;
+        case MATLAB_UINT64:  *c = (mat_class_t){ MX_UINT64, MI_UINT64, 8 }; return 1;
+        case MATLAB_LOGICAL: *c = (mat_class_t){ MX_UINT8,  MI_UINT8,  1 }; return 1;
+        case MATLAB_CHAR:    *c = (mat_class_t){ MX_CHAR,   MI_UINT16, 2 }; return 1;
+        default: return 0;
+    }
+}
+
+/* Written as [] when missing or of a type MAT cannot hold */
+static bool is_empty(bhv2_value_t *value) {
+    mat_class_t c;
+    return !value || (value->dtype != MATLAB_STRUCT && value->dtype != MATLAB_CELL
+                      && !array_class(value->dtype, &c));
+}
+
+/* MAT arrays have at least two dimensions */
+static uint64_t n_dims(bhv2_value_t *value) {
+    return value->ndims < 2 ? 2 : value->ndims;
+}
+
+static uint64_t dim(bhv2_value_t *value, uint64_t d) {
+    if (d < value->ndims) return value->dims[d];
+    return value->ndims == 0 && d == 0 ? value->total : 1;
+}
+
+/* Named fields of a struct (selective reads leave the others unnamed) */
+static size_t named_fields(bhv2_value_t *value, size_t *name_len) {
+    size_t n = 0, longest = 0;
+    if (value->total > 0) {
+        for (uint64_t f = 0; f < value->data.struct_array.n_fields; f++) {
+            const char *name = value->data.struct_array.fields[f].name;
+            if (!name) continue;
+            size_t len = strlen(name);
+            if (len > longest) longest = len;
+            n++;
+        }
+    }
+    *name_len = (longest > MAT_NAME_MAX ? MAT_NAME_MAX : longest) + 1;
+    return n;
+}
+
+static uint64_t header_size(uint64_t ndims, size_t name_len) {
+    return 16 + 8 + pad8(4 * ndims) + 8 + pad8(name_len);
+}
+
+/* Bytes of a miMATRIX element after its tag */
+static uint64_t matrix_size(bhv2_value_t *value, size_t name_len) {
+    if (is_empty(value)) return header_size(2, name_len) + 8;
+
+    uint64_t size = header_size(n_dims(value), name_len);
+    mat_class_t c;
+    if (array_class(value->dtype, &c)) return size + 8 + pad8(value->total * c.size);
+
+    if (value->dtype == MATLAB_STRUCT) {
+        size_t field_len;
+        size_t n = named_fields(value, &field_len);
+        size += 16 + 8 + pad8(n * field_len);
+        uint64_t n_fields = value->data.struct_array.n_fields;
+        for (uint64_t i = 0; i < value->total * n_fields; i++) {
+            bhv2_struct_field_t *field = &value->data.struct_array.fields[i];
+            if (field->name) size += 8 + matrix_size(field->value, 0);
+        }
+        return size;
+    }
+
+    for (uint64_t i = 0; i < value->total; i++) {
+        size += 8 + matrix_size(value->data.cell_array[i], 0);
+    }
+    return size;
+}
+
+/************************************************************/
+/* Array output
+ */
+/************************************************************/
+
+static void put_header(mat_file_t *mat, uint32_t flags, bhv2_value_t *dims_of, uint64_t rows,
+                       const char *name) {
+    put_tag(mat, MI_UINT32, 8);
+    put_u32(mat, flags);
+    put_u32(mat, 0);
+
+    uint64_t nd = dims_of ? n_dims(dims_of) : 2;
+    put_tag(mat, MI_INT32, 4 * nd);
+    for (uint64_t d = 0; d < nd; d++) {
+        uint64_t n = dims_of ? dim(dims_of, d) : (d == 0 ? rows : (rows ? 1 : 0));
+        put_u32(mat, (uint32_t)n);
+    }
+    put_padding(mat, 4 * nd);
+
+    size_t len = name ? strlen(name) : 0;
+    put_tag(mat, MI_INT8, len);
+    put(mat, name, len);
+    put_padding(mat, len);
+}
+
+static void put_field_names(mat_file_t *mat, const char **names, size_t n, size_t field_len) {
+    put_tag(mat, MI_INT32, 4);
+    put_u32(mat, (uint32_t)field_len);
+    put_u32(mat, 0);
+
+    put_tag(mat, MI_INT8, n * field_len);
+    char padded[MAT_NAME_MAX + 1];
+    for (size_t f = 0; f < n; f++) {
+        memset(padded, 0, sizeof(padded));
+        strncpy(padded, names[f], field_len - 1);
+        put(mat, padded, field_len);
+    }
+    put_padding(mat, n * field_len);
+}
+
+/* Element data of a numeric, logical or char value */
+static void put_array_data(mat_file_t *mat, bhv2_value_t *value, const mat_class_t *c) {
+    uint64_t bytes = value->total * c->size;
+    put_tag(mat, c->mi, bytes);
+
+    if (value->dtype == MATLAB_CHAR) {
+        uint16_t chunk[MAT_CHUNK];
+        for (uint64_t i = 0; i < value->total; i += MAT_CHUNK) {
+            uint64_t n = value->total - i < MAT_CHUNK ? value->total - i : MAT_CHUNK;
+            for (uint64_t k = 0; k < n; k++) chunk[k] = (unsigned char)value->data.string[i + k];
+            put(mat, chunk, n * sizeof(uint16_t));
+        }
+    } else if (value->dtype == MATLAB_LOGICAL) {
+        uint8_t chunk[MAT_CHUNK];
+        for (uint64_t i = 0; i < value->total; i += MAT_CHUNK) {
+            uint64_t n = value->total - i < MAT_CHUNK ? value->total - i : MAT_CHUNK;
+            for (uint64_t k = 0; k < n; k++) chunk[k] = bhv2_get_double(value, i + k) != 0.0;
+            put(mat, chunk, n);
+        }
+    } else {
+        put(mat, value->data.d, bytes);  /* Any numeric member: same pointer */
+    }
+    put_padding(mat, bytes);
+}
+
+static void put_matrix(mat_file_t *mat, bhv2_value_t *value, const char *name) {
+    size_t name_len = name ? strlen(name) : 0;
+    put_tag(mat, MI_MATRIX, matrix_size(value, name_len));
+
+    if (is_empty(value)) {
+        put_header(mat, MX_DOUBLE, NULL, 0, name);
+        put_tag(mat, MI_DOUBLE, 0);
+        return;
+    }
+
+    mat_class_t c;
+    if (array_class(value->dtype, &c)) {
+        uint32_t flags = c.mx | (value->dtype == MATLAB_LOGICAL ? MX_LOGICAL_FLAG : 0);
+        put_header(mat, flags, value, 0, name);
+        put_array_data(mat, value, &c);
+        return;
+    }
+
+    if (value->dtype == MATLAB_STRUCT) {
+        put_header(mat, MX_STRUCT, value, 0, name);
+        size_t field_len;
+        size_t n = named_fields(value, &field_len);
+        uint64_t n_fields = value->data.struct_array.n_fields;
+
+        const char **names = malloc((n ? n : 1) * sizeof(char*));
+        if (!names) {
+            mat->failed = true;
+            return;
+        }
+        size_t k = 0;
+        for (uint64_t f = 0; f < n_fields && value->total > 0; f++) {
+            const char *field = value->data.struct_array.fields[f].name;
+            if (field) names[k++] = field;
+        }
+        put_field_names(mat, names, n, field_len);
+        free(names);
+
+        for (uint64_t i = 0; i < value->total * n_fields; i++) {
+            bhv2_struct_field_t *field = &value->data.struct_array.fields[i];
+            if (field->name) put_matrix(mat, field->value, NULL);
+        }
+        return;
+    }
+
+    put_header(mat, MX_CELL, value, 0, name);
+    for (uint64_t i = 0; i < value->total; i++) {
+        put_matrix(mat, value->data.cell_array[i], NULL);
+    }
+}
+
+/************************************************************/
+/* Public API
+ */
+/************************************************************/
+
+mat_file_t* mat_create(const char *path) {
+    mat_file_t *mat = calloc(1, sizeof(mat_file_t));
+    if (!mat) return NULL;
+
+    mat->fp = fopen(path, "wb");
+    mat->buffer = malloc(MAT_BUFFER_SIZE);
+    if (!mat->fp || !mat->buffer) {
+        if (mat->fp) fclose(mat->fp);
+        free(mat->buffer);
+        free(mat);
+        return NULL;
+    }
+    setvbuf(mat->fp, mat->buffer, _IOFBF, MAT_BUFFER_SIZE);
+
+    /* 116-byte text, 8-byte subsystem offset, version, endian indicator */
+    char text[116];
+    time_t now = time(NULL);
+    struct tm local;
+    char date[64];
+    strftime(date, sizeof(date), "%a %b %d %H:%M:%S %Y", localtime_r(&now, &local));
+    memset(text, ' ', sizeof(text));
+    int len = snprintf(text, sizeof(text), "MATLAB 5.0 MAT-file, Platform: presto, Created on: %s", date);
+    if (len >= 0 && (size_t)len < sizeof(text)) text[len] = ' ';
+    put(mat, text, sizeof(text));
+
+    static const char subsys[8] = {0};
+    uint16_t version = 0x0100;
+    put(mat, subsys, sizeof(subsys));
+    put(mat, &version, sizeof(version));
+    put(mat, "IM", 2);
+    return mat;
+}
+
+int mat_close(mat_file_t *mat) {
+    if (!mat) return -1;
+    if (mat->streaming) mat->failed = true;  /* Struct array never finished */
+    if (fclose(mat->fp) != 0) mat->failed = true;
+    int status = mat->failed ? -1 : 0;
+    free(mat->buffer);
+    free(mat);
+    return status;
+}
+
+int mat_write_doubles(mat_file_t *mat, const char *name, const double *values, size_t n) {
+    if (mat->streaming) return -1;
+    size_t name_len = strlen(name);
+    put_tag(mat, MI_MATRIX, header_size(2, name_len) + 8 + pad8(n * sizeof(double)));
+    put_header(mat, MX_DOUBLE, NULL, n, name);
+    put_tag(mat, MI_DOUBLE, n * sizeof(double));
+    put(mat, values, n * sizeof(double));
+    return mat->failed ? -1 : 0;
+}
+
+int mat_write_value(mat_file_t *mat, const char *name, bhv2_value_t *value) {
+    if (mat->streaming) return -1;
+    put_matrix(mat, value, name);
+    return mat->failed ? -1 : 0;
+}
+
+int mat_begin_struct_array(mat_file_t *mat, const char *name, const char **fields, size_t n_fields) {
+    if (mat->streaming || n_fields == 0) return -1;
+
+    size_t field_len = 0;
+    for (size_t f = 0; f < n_fields; f++) {
+        size_t len = strlen(fields[f]);
+        if (len > field_len) field_len = len;
+    }
+    field_len = (field_len > MAT_NAME_MAX ? MAT_NAME_MAX : field_len) + 1;
+
+    mat->tag_pos = ftell(mat->fp);
+    put_tag(mat, MI_MATRIX, 0);                 /* Size patched at the end */
+    mat->dims_pos = ftell(mat->fp) + 16;        /* After the array flags */
+    put_header(mat, MX_STRUCT, NULL, 0, name);  /* 0 x 1, patched too */
+    put_field_names(mat, fields, n_fields, field_len);
+
+    mat->bytes = (uint64_t)(ftell(mat->fp) - mat->tag_pos) - 8;
+    mat->n_fields = n_fields;
+    mat->field = 0;
+    mat->n_elements = 0;
+    mat->streaming = true;
+    return mat->failed || mat->tag_pos < 0 ? -1 : 0;
+}
+
+int mat_write_field(mat_file_t *mat, bhv2_value_t *value) {
+    if (!mat->streaming) return -1;
+    put_matrix(mat, value, NULL);
+    mat->bytes += 8 + matrix_size(value, 0);
+    if (++mat->field == mat->n_fields) {
+        mat->field = 0;
+        mat->n_elements++;
+    }
+    return mat->failed ? -1 : 0;
+}
+
+int mat_end_struct_array(mat_file_t *mat) {
+    if (!mat->streaming || mat->field != 0) return -1;
+    mat->streaming = false;
+
+    if (mat->bytes > UINT32_MAX || mat->n_elements > INT32_MAX) {
+        fprintf(stderr, "Error: MAT v5 variable over 4 GB; export fewer fields or trials\n");
+        mat->failed = true;
+        return -1;
+    }
+
+    /* Element count (rows) and size, then back to the end */
+    uint32_t dims[2] = { (uint32_t)mat->n_elements, 1 };
+    if (fseek(mat->fp, mat->dims_pos + 8, SEEK_SET) != 0) mat->failed = true;
+    put(mat, dims, sizeof(dims));
+    if (fseek(mat->fp, mat->tag_pos + 4, SEEK_SET) != 0) mat->failed = true;
+    put_u32(mat, (uint32_t)mat->bytes);
+    if (fseek(mat->fp, 0, SEEK_END) != 0) mat->failed = true;
+    return mat->failed ? -1 : 0;
+}
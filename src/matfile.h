@@ -0,0 +1,59 @@
+/*
+ * matfile.h - MATLAB Level 5 MAT-file writer
+ *
+ * Writes uncompressed v5 MAT files that MATLAB's load() reads directly.
+ * BHV2 values are already MATLAB arrays (same classes, column-major), so
+ * any bhv2_value_t is written as the matching MAT array, structs and
+ * cells included.
+ *
+ * A struct array can be streamed: open it with mat_begin_struct_array(),
+ * write each element's field values in order, then mat_end_struct_array()
+ * patches its size and element count. Output goes through a large stdio
+ * buffer. A v5 variable is limited to 4 GB.
+ */
+
+#ifndef MATFILE_H
+#define MATFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "bhv2.h"
+
+typedef struct {
+    FILE *fp;
+    char *buffer;
+    bool failed;                /* A write failed or a variable outgrew v5 */
+
+    /* Struct array being streamed */
+    bool streaming;
+    long tag_pos;               /* Its miMATRIX tag */
+    long dims_pos;              /* Its dimensions */
+    uint64_t bytes;             /* Its size after the tag */
+    size_t n_fields;
+    size_t field;               /* Next field of the current element */
+    uint64_t n_elements;
+} mat_file_t;
+
+/* Create path and write the file header (NULL on failure) */
+mat_file_t* mat_create(const char *path);
+
+/* Flush and close. Returns 0 if everything was written, -1 otherwise. */
+int mat_close(mat_file_t *mat);
+
+/* Write a double column vector variable */
+int mat_write_doubles(mat_file_t *mat, const char *name, const double *values, size_t n);
+
+/* Write a value as a variable (NULL writes []) */
+int mat_write_value(mat_file_t *mat, const char *name, bhv2_value_t *value);
+
+/* Start an N x 1 struct array variable with the given field names */
+int mat_begin_struct_array(mat_file_t *mat, const char *name, const char **fields, size_t n_fields);
+
+/* Write the next field value of the current element (NULL writes []) */
+int mat_write_field(mat_file_t *mat, bhv2_value_t *value);
+
+/* Finish the struct array (every element must have all its fields) */
+int mat_end_struct_array(mat_file_t *mat);
+
+#endif /* MATFILE_H */
@@ -0,0 +1,208 @@
+/*
+ * ml_analog.c - MonkeyLogic AnalogData channel map
+ */
+
+#define _POSIX_C_SOURCE 200809L  /* For strdup */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ml_analog.h"
+
+/************************************************************/
+/* Helpers
+ */
+/************************************************************/
+
+static ml_channel_kind_t kind_from_name(const char *field) {
+    if (strcmp(field, "Eye") == 0 || strcmp(field, "Eye2") == 0) return ML_CH_EYE;
+    if (strncmp(field, "Joystick", 8) == 0) return ML_CH_JOYSTICK;
+    if (strcmp(field, "Touch") == 0)      return ML_CH_TOUCH;
+    if (strcmp(field, "Mouse") == 0)      return ML_CH_MOUSE;
+    if (strcmp(field, "General") == 0)    return ML_CH_GENERAL;
+    if (strcmp(field, "PhotoDiode") == 0) return ML_CH_PHOTODIODE;
+    if (strcmp(field, "Button") == 0)     return ML_CH_BUTTON;
+    return ML_CH_OTHER;
+}
+
+static bool is_numeric(bhv2_value_t *value) {
+    return value && matlab_dtype_size(value->dtype) > 0 && value->dtype != MATLAB_CHAR;
+}
+
+static int add_channel(ml_analog_schema_t *schema, size_t *capacity, const char *parent,
+                       const char *field, uint64_t field_idx, int64_t subfield_idx) {
+    if (schema->n_channels >= *capacity) {
+        size_t new_cap = *capacity == 0 ? 16 : *capacity * 2;
+        ml_analog_channel_t *grown = realloc(schema->channels, new_cap * sizeof(ml_analog_channel_t));
+        if (!grown) return -1;
+        schema->channels = grown;
+        *capacity = new_cap;
+    }
+
+    ml_analog_channel_t *ch = &schema->channels[schema->n_channels];
+    size_t len = strlen(field) + (parent ? strlen(parent) + 1 : 0) + 1;
+    ch->name = malloc(len);
+    if (!ch->name) return -1;
+
+    if (parent) {
+        snprintf(ch->name, len, "%s.%s", parent, field);
+        ch->label = ch->name + strlen(parent) + 1;
+    } else {
+        snprintf(ch->name, len, "%s", field);
+        ch->label = ch->name;
+    }
+    ch->kind = kind_from_name(parent ? parent : field);
+    ch->field = field_idx;
+    ch->subfield = subfield_idx;
+    ch->group = field_idx;
+
+    schema->n_channels++;
+    return 0;
+}
+
+/************************************************************/
+/* Schema discovery
+ */
+/************************************************************/
+
+ml_analog_schema_t* ml_analog_schema_new(bhv2_value_t *analog) {
+    if (!analog || analog->dtype != MATLAB_STRUCT || analog->total < 1) return NULL;
+
+    ml_analog_schema_t *schema = calloc(1, sizeof(ml_analog_schema_t));
+    if (!schema) return NULL;
+
+    uint64_t n_fields = analog->data.struct_array.n_fields;
+    schema->n_fields = n_fields;
+    schema->interval_field = -1;
+    schema->field_names = calloc(n_fields ? n_fields : 1, sizeof(char*));
+    if (!schema->field_names) {
+        free(schema);
+        return NULL;
+    }
+
+    size_t capacity = 0;
+    bhv2_struct_field_t *fields = analog->data.struct_array.fields;
+
+    for (uint64_t f = 0; f < n_fields; f++) {
+        const char *name = fields[f].name;
+        bhv2_value_t *value = fields[f].value;
+        if (!name) continue;  /* Not decoded (selective read) */
+
+        schema->field_names[f] = strdup(name);
+        if (!schema->field_names[f]) goto fail;
+
+        if (strcmp(name, "SampleInterval") == 0) {
+            schema->interval_field = (int64_t)f;
+            continue;
+        }
+
+        if (value && value->dtype == MATLAB_STRUCT && value->total == 1) {
+            /* Numbered inputs: General.Gen1, Button.Btn1, ... */
+            for (uint64_t s = 0; s < value->data.struct_array.n_fields; s++) {
+                bhv2_struct_field_t *sub = &value->data.struct_array.fields[s];
+                if (!sub->name || !is_numeric(sub->value)) continue;
+                if (add_channel(schema, &capacity, name, sub->name, f, (int64_t)s) != 0) goto fail;
+            }
+        } else if (is_numeric(value)) {
+            if (add_channel(schema, &capacity, NULL, name, f, -1) != 0) goto fail;
+        }
+    }
+
+    return schema;
+
+fail:
+    ml_analog_schema_free(schema);
+    return NULL;
+}
+
+void ml_analog_schema_free(ml_analog_schema_t *schema) {
+    if (!schema) return;
+    for (uint64_t f = 0; f < schema->n_fields; f++) {
+        free(schema->field_names[f]);
+    }
+    free(schema->field_names);
+    for (size_t c = 0; c < schema->n_channels; c++) {
+        free(schema->channels[c].name);
+    }
+    free(schema->channels);
+    free(schema);
+}
+
+bool ml_analog_schema_matches(const ml_analog_schema_t *schema, bhv2_value_t *analog) {
+    if (!schema || !analog || analog->dtype != MATLAB_STRUCT || analog->total < 1) return false;
+    if (analog->data.struct_array.n_fields != schema->n_fields) return false;
+
+    bhv2_struct_field_t *fields = analog->data.struct_array.fields;
+    for (uint64_t f = 0; f < schema->n_fields; f++) {
+        const char *expected = schema->field_names[f];
+        const char *actual = fields[f].name;
+        if (!expected || !actual) {
+            if (expected != actual) return false;
+            continue;
+        }
+        if (strcmp(expected, actual) != 0) return false;
+    }
+
+    /* Nested channels: the numbered input must still sit at the same slot */
+    for (size_t c = 0; c < schema->n_channels; c++) {
+        const ml_analog_channel_t *ch = &schema->channels[c];
+        if (ch->subfield < 0) continue;
+        bhv2_value_t *parent = fields[ch->field].value;
+        if (!parent || parent->dtype != MATLAB_STRUCT || parent->total < 1) return false;
+        if ((uint64_t)ch->subfield >= parent->data.struct_array.n_fields) return false;
+        const char *actual = parent->data.struct_array.fields[ch->subfield].name;
+        if (!actual || strcmp(actual, ch->label) != 0) return false;
+    }
+
+    return true;
+}
+
+int ml_analog_schema_update(ml_analog_schema_t **schema, bhv2_value_t *analog) {
+    if (*schema && ml_analog_schema_matches(*schema, analog)) return 0;
+
+    ml_analog_schema_t *fresh = ml_analog_schema_new(analog);
+    if (!fresh) return -1;
+
+    ml_analog_schema_free(*schema);
+    *schema = fresh;
+    return 0;
+}
+
+/************************************************************/
+/* Channel access
+ */
+/************************************************************/
+
+bhv2_value_t* ml_analog_channel(const ml_analog_schema_t *schema, bhv2_value_t *analog, size_t channel) {
+    if (!schema || channel >= schema->n_channels) return NULL;
+
+    const ml_analog_channel_t *ch = &schema->channels[channel];
+    bhv2_value_t *value = analog->data.struct_array.fields[ch->field].value;
+    if (ch->subfield >= 0) {
+        if (!value || value->dtype != MATLAB_STRUCT) return NULL;
+        value = value->data.struct_array.fields[ch->subfield].value;
+    }
+
+    if (!is_numeric(value) || value->total == 0 || value->ndims < 1 || value->dims[0] == 0) {
+        return NULL;
+    }
+    return value;
+}
+
+uint64_t ml_analog_samples(bhv2_value_t *channel) {
+    return (channel && channel->ndims >= 1) ? channel->dims[0] : 0;
+}
+
+uint64_t ml_analog_columns(bhv2_value_t *channel) {
+    uint64_t n = ml_analog_samples(channel);
+    return n > 0 ? channel->total / n : 0;
+}
+
+double ml_analog_interval_ms(const ml_analog_schema_t *schema, bhv2_value_t *analog) {
+    double v = 0.0;
+    if (schema && schema->interval_field >= 0) {
+        v = bhv2_get_double(analog->data.struct_array.fields[schema->interval_field].value, 0);
+    }
+    if (v <= 0.0) return 1.0;
+    return v < 0.05 ? v * 1000.0 : v;
+}
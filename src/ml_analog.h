@@ -0,0 +1,88 @@
+/*
+ * ml_analog.h - MonkeyLogic AnalogData channel map
+ *
+ * AnalogData holds one field per input (Eye, Eye2, Joystick, Touch, Mouse,
+ * PhotoDiode, ...) plus nested structs for numbered inputs (General.Gen1,
+ * Button.Btn1, ...). Which channels exist depends on the rig, but the
+ * layout is the same for every trial of a session.
+ *
+ * The schema is discovered once from a trial's AnalogData and records the
+ * struct position of every channel, so later trials are indexed directly
+ * instead of being searched by name.
+ */
+
+#ifndef ML_ANALOG_H
+#define ML_ANALOG_H
+
+#include <stdbool.h>
+#include "bhv2.h"
+
+/************************************************************/
+/* Channel kinds (decide plot grouping and labels)
+ */
+/************************************************************/
+
+typedef enum {
+    ML_CH_EYE,          /* Eye, Eye2 */
+    ML_CH_JOYSTICK,     /* Joystick, Joystick2 */
+    ML_CH_TOUCH,        /* Touch */
+    ML_CH_MOUSE,        /* Mouse */
+    ML_CH_GENERAL,      /* General.Gen<N> */
+    ML_CH_PHOTODIODE,   /* PhotoDiode */
+    ML_CH_BUTTON,       /* Button.Btn<N> */
+    ML_CH_OTHER         /* Anything else numeric (EyeExtra, KeyInput, ...) */
+} ml_channel_kind_t;
+
+/************************************************************/
+/* Channel map
+ */
+/************************************************************/
+
+typedef struct {
+    char *name;                 /* "Eye", "General.Gen1" */
+    const char *label;          /* Short label: "Eye", "Gen1" (points into name) */
+    ml_channel_kind_t kind;
+    uint64_t field;             /* Index into AnalogData fields */
+    int64_t subfield;           /* Index into nested struct, -1 if top-level */
+    uint64_t group;             /* Channels sharing a top-level field share a group */
+} ml_analog_channel_t;
+
+typedef struct {
+    char **field_names;         /* AnalogData field names the map was built from */
+    uint64_t n_fields;
+    int64_t interval_field;     /* SampleInterval index, -1 if absent */
+    ml_analog_channel_t *channels;
+    size_t n_channels;
+} ml_analog_schema_t;
+
+/* Build the channel map from a trial's AnalogData struct (NULL on error) */
+ml_analog_schema_t* ml_analog_schema_new(bhv2_value_t *analog);
+
+/* Free a channel map */
+void ml_analog_schema_free(ml_analog_schema_t *schema);
+
+/* True if analog has the layout the map was built from */
+bool ml_analog_schema_matches(const ml_analog_schema_t *schema, bhv2_value_t *analog);
+
+/* Build *schema on first use, rebuild it if the layout changed.
+ * Returns 0 on success, -1 if analog is not a struct or on error.
+ */
+int ml_analog_schema_update(ml_analog_schema_t **schema, bhv2_value_t *analog);
+
+/************************************************************/
+/* Channel access (analog must match the schema)
+ */
+/************************************************************/
+
+/* Channel value for this trial (NULL if empty or not numeric) */
+bhv2_value_t* ml_analog_channel(const ml_analog_schema_t *schema, bhv2_value_t *analog, size_t channel);
+
+/* Samples (rows) and columns of a channel value */
+uint64_t ml_analog_samples(bhv2_value_t *channel);
+uint64_t ml_analog_columns(bhv2_value_t *channel);
+
+/* Sample interval in ms. MonkeyLogic stores milliseconds; values below
+ * 0.05 can only be seconds and are converted. Defaults to 1 ms. */
+double ml_analog_interval_ms(const ml_analog_schema_t *schema, bhv2_value_t *analog);
+
+#endif /* ML_ANALOG_H */
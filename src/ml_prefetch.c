@@ -0,0 +1,460 @@
+/*
+ * ml_prefetch.c - Decoding trials ahead on a scheduler
+ */
+
+#define _POSIX_C_SOURCE 200809L  /* For strdup */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "ml_prefetch.h"
+
+#define PREFETCH_CHUNKS_PER_WORKER 8      /* Chunks per worker over the whole file */
+#define PREFETCH_MIN_CHUNK (256 * 1024)   /* Bytes; smaller chunks cost more than they balance */
+#define PREFETCH_WINDOW_PER_WORKER 2      /* Chunks in flight per worker */
+
+typedef enum {
+    CHUNK_IDLE,             /* Not submitted yet */
+    CHUNK_QUEUED,           /* Submitted, not finished */
+    CHUNK_DONE,
+    CHUNK_SHORT,            /* A trial failed to decode; data or acc holds those before it */
+    CHUNK_FAILED
+} chunk_status_t;
+
+typedef struct {
+    ml_prefetch_t *owner;
+    size_t first;           /* First trial, index into kept */
+    size_t count;
+    uint64_t bytes;
+    bhv2_value_t **data;    /* Decoded trials, once done */
+    void *acc;              /* Kernel mode: accumulator over the chunk, once done */
+    size_t n_done;          /* Trials decoded (kernel mode: trials acc has seen) */
+    chunk_status_t status;
+} prefetch_chunk_t;
+
+struct ml_prefetch {
+    sched_t *sched;
+    char *path;
+    char **fields;          /* NULL-terminated (NULL for whole trials) */
+    unsigned decode_flags;
+    off_t file_size;
+    const trial_index_t *index;
+
+    /* Kernel mode (kernel NULL: hand decoded trials to the consumer) */
+    const trial_kernel_t *kernel;
+    void *ctx;
+    bool metadata_only;     /* SKIP_DATA kernel: decode to check, pass no data */
+    filter_chain_t *filters;            /* Copied for each concurrent chunk */
+    filter_chain_t **spare_filters;     /* Copies not in use (guarded by lock) */
+    size_t n_spare;
+    size_t spare_capacity;
+
+    const trial_index_entry_t **kept;   /* Trials the skips keep, in file order */
+    size_t n_kept;
+    prefetch_chunk_t *chunks;
+    size_t n_chunks;
+    size_t window;          /* Chunks submitted ahead of the consumer */
+
+    /* Consumer side */
+    size_t next_chunk;
+    size_t next_trial;      /* Within chunks[next_chunk] */
+    size_t n_submitted;
+    const trial_index_entry_t *last;    /* Last trial returned */
+
+    pthread_mutex_t lock;   /* Guards chunk status, running, cancelled, spare filters */
+    pthread_cond_t ready;   /* A chunk finished */
+    size_t running;         /* Submitted chunks not finished */
+    bool cancelled;
+};
+
+/************************************************************/
+/* Decoding (worker side)
+ */
+/************************************************************/
+
+static bool is_cancelled(ml_prefetch_t *p) {
+    pthread_mutex_lock(&p->lock);
+    bool cancelled = p->cancelled;
+    pthread_mutex_unlock(&p->lock);
+    return cancelled;
+}
+
+static bhv2_value_t* decode_trial(bhv2_file_t *bhv2, uint64_t offset, const char **fields) {
+    char *name;
+    if (bhv2_seek(bhv2, (off_t)offset) != 0 || bhv2_read_next_variable_name(bhv2, &name) != 0) {
+        return NULL;
+    }
+    free(name);
+    return fields ? bhv2_read_variable_data_selective(bhv2, fields) : bhv2_read_variable_data(bhv2);
+}
+
+static void free_values(bhv2_value_t **data, size_t count) {
+    if (!data) return;
+    for (size_t i = 0; i < count; i++) {
+        bhv2_value_free(data[i]);
+    }
+    free(data);
+}
+
+/* Decode the chunk's trials for the consumer. A trial that fails to
+ * decode ends the chunk there; the trials before it are kept. */
+static chunk_status_t decode_trials(ml_prefetch_t *p, prefetch_chunk_t *chunk) {
+    bhv2_value_t **data = calloc(chunk->count, sizeof(bhv2_value_t*));
+    bhv2_file_t *bhv2 = data && !is_cancelled(p) ? bhv2_open_stream(p->path) : NULL;
+    if (!bhv2) {
+        free(data);
+        return CHUNK_FAILED;
+    }
+
+    bhv2_set_decode_flags(bhv2, p->decode_flags);
+    chunk_status_t status = CHUNK_DONE;
+    while (chunk->n_done < chunk->count) {
+        if (is_cancelled(p)) {
+            status = CHUNK_FAILED;
+            break;
+        }
+        size_t i = chunk->n_done;
+        data[i] = decode_trial(bhv2, p->kept[chunk->first + i]->offset, (const char**)p->fields);
+        if (!data[i]) {
+            status = CHUNK_SHORT;  /* Ends the run, as a read loop would */
+            break;
+        }
+        chunk->n_done++;
+    }
+    bhv2_file_free(bhv2);
+
+    if (status == CHUNK_FAILED) {
+        free_values(data, chunk->count);
+        return CHUNK_FAILED;
+    }
+    chunk->data = data;
+    return status;
+}
+
+/* A filter chain no other chunk is using (NULL on allocation failure) */
+static filter_chain_t* take_filters(ml_prefetch_t *p) {
+    filter_chain_t *chain = NULL;
+    pthread_mutex_lock(&p->lock);
+    if (p->n_spare > 0) chain = p->spare_filters[--p->n_spare];
+    pthread_mutex_unlock(&p->lock);
+    return chain ? chain : filter_chain_copy(p->filters);
+}
+
+static void give_filters(ml_prefetch_t *p, filter_chain_t *chain) {
+    if (!chain) return;
+    pthread_mutex_lock(&p->lock);
+    if (p->n_spare == p->spare_capacity) {
+        size_t capacity = p->spare_capacity ? p->spare_capacity * 2 : 8;
+        filter_chain_t **grown = realloc(p->spare_filters, capacity * sizeof(filter_chain_t*));
+        if (grown) {
+            p->spare_filters = grown;
+            p->spare_capacity = capacity;
+        }
+    }
+    if (p->n_spare < p->spare_capacity) {
+        p->spare_filters[p->n_spare++] = chain;
+        chain = NULL;
+    }
+    pthread_mutex_unlock(&p->lock);
+    filter_chain_free(chain);
+}
+
+/* Run the kernel over the chunk's trials, each freed once it has seen it */
+static chunk_status_t run_kernel(ml_prefetch_t *p, prefetch_chunk_t *chunk) {
+    const trial_kernel_t *kernel = p->kernel;
+    void *acc = is_cancelled(p) ? NULL : kernel->create(p->ctx);
+    if (!acc) return CHUNK_FAILED;
+
+    chunk_status_t status = CHUNK_DONE;
+    bhv2_file_t *bhv2 = bhv2_open_stream(p->path);
+    filter_chain_t *filters = p->filters ? take_filters(p) : NULL;
+    if (!bhv2 || (p->filters && !filters)) status = CHUNK_FAILED;
+    else bhv2_set_decode_flags(bhv2, p->decode_flags);
+
+    for (size_t i = 0; status == CHUNK_DONE && i < chunk->count; i++) {
+        if (is_cancelled(p)) {
+            status = CHUNK_FAILED;
+            break;
+        }
+        const trial_index_entry_t *e = p->kept[chunk->first + i];
+        trial_view_t view = {
+            .trial_num = e->trial_num,
+            .error_code = e->error_code,
+            .condition = e->condition,
+            .block = e->block,
+            .data = NULL
+        };
+        /* SKIP_DATA kernels still decode the metadata, as a read loop
+         * does, so a trial the index lists but that no longer decodes
+         * ends the run at the same place */
+        view.data = decode_trial(bhv2, e->offset, (const char**)p->fields);
+        if (!view.data) {
+            status = CHUNK_SHORT;  /* Ends the run, as a read loop would */
+            break;
+        }
+        if (p->metadata_only) {
+            bhv2_value_free(view.data);
+            view.data = NULL;
+        } else if (filter_chain_apply(filters, view.data) != 0) {
+            status = CHUNK_FAILED;
+        }
+        if (status == CHUNK_DONE && kernel->trial(acc, &view, p->ctx) != 0) status = CHUNK_FAILED;
+        bhv2_value_free(view.data);
+        chunk->n_done++;
+    }
+
+    give_filters(p, filters);
+    bhv2_file_free(bhv2);
+    if (status == CHUNK_FAILED) {
+        kernel->destroy(acc);
+        return CHUNK_FAILED;
+    }
+    chunk->acc = acc;
+    return status;
+}
+
+/* Task: decode one chunk on its own descriptor */
+static void decode_chunk(void *arg) {
+    prefetch_chunk_t *chunk = arg;
+    ml_prefetch_t *p = chunk->owner;
+    chunk_status_t status = p->kernel ? run_kernel(p, chunk) : decode_trials(p, chunk);
+
+    /* p may be freed as soon as the lock is released */
+    pthread_mutex_lock(&p->lock);
+    chunk->status = status;
+    p->running--;
+    pthread_cond_broadcast(&p->ready);
+    pthread_mutex_unlock(&p->lock);
+}
+
+/************************************************************/
+/* Setup
+ */
+/************************************************************/
+
+/* Bytes from an entry to the next trial (or the end of the file) */
+static uint64_t trial_bytes(const ml_prefetch_t *p, const trial_index_entry_t *e) {
+    size_t k = (size_t)(e - p->index->entries);
+    uint64_t end = k + 1 < p->index->count ? p->index->entries[k + 1].offset : (uint64_t)p->file_size;
+    return end > e->offset ? end - e->offset : 0;
+}
+
+static int select_trials(ml_prefetch_t *p, skip_set_t *skips) {
+    p->kept = malloc((p->index->count ? p->index->count : 1) * sizeof(trial_index_entry_t*));
+    if (!p->kept) return -1;
+
+    for (size_t i = 0; i < p->index->count; i++) {
+        const trial_index_entry_t *e = &p->index->entries[i];
+        trial_info_t info = {
+            .trial_num = e->trial_num,
+            .error_code = e->error_code,
+            .condition = e->condition,
+            .block = e->block
+        };
+        if (skips && skip_trial(skips, &info)) continue;
+        p->kept[p->n_kept++] = e;
+    }
+    return 0;
+}
+
+/* Cut the kept trials into runs of about target bytes each */
+static int make_chunks(ml_prefetch_t *p) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < p->n_kept; i++) {
+        total += trial_bytes(p, p->kept[i]);
+    }
+    uint64_t target = total / ((uint64_t)sched_workers(p->sched) * PREFETCH_CHUNKS_PER_WORKER);
+    if (target < PREFETCH_MIN_CHUNK) target = PREFETCH_MIN_CHUNK;
+
+    p->chunks = calloc(p->n_kept ? p->n_kept : 1, sizeof(prefetch_chunk_t));
+    if (!p->chunks) return -1;
+
+    prefetch_chunk_t *chunk = NULL;
+    for (size_t i = 0; i < p->n_kept; i++) {
+        if (!chunk || chunk->bytes >= target) {
+            chunk = &p->chunks[p->n_chunks++];
+            chunk->owner = p;
+            chunk->first = i;
+        }
+        chunk->count++;
+        chunk->bytes += trial_bytes(p, p->kept[i]);
+    }
+    return 0;
+}
+
+static int copy_fields(ml_prefetch_t *p, const char **fields) {
+    if (!fields) return 0;
+
+    size_t n = 0;
+    while (fields[n]) n++;
+    p->fields = calloc(n + 1, sizeof(char*));
+    if (!p->fields) return -1;
+    for (size_t i = 0; i < n; i++) {
+        p->fields[i] = strdup(fields[i]);
+        if (!p->fields[i]) return -1;
+    }
+    return 0;
+}
+
+ml_prefetch_t* ml_prefetch_start(sched_t *sched, const char *path, off_t file_size,
+                                 const trial_index_t *index, skip_set_t *skips,
+                                 const char **fields, unsigned decode_flags,
+                                 const trial_kernel_t *kernel, void *ctx, filter_chain_t *filters) {
+    if (!sched || !path || !index) return NULL;
+
+    ml_prefetch_t *p = calloc(1, sizeof(ml_prefetch_t));
+    if (!p) return NULL;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->ready, NULL);
+    p->sched = sched;
+    p->file_size = file_size;
+    p->index = index;
+    p->decode_flags = decode_flags;
+    p->kernel = kernel;
+    p->ctx = ctx;
+    p->metadata_only = kernel && kernel->read_flag == SKIP_DATA;
+    p->filters = kernel && !p->metadata_only ? filters : NULL;
+    p->window = (size_t)sched_workers(sched) * PREFETCH_WINDOW_PER_WORKER;
+
+    p->path = strdup(path);
+    if (!p->path || copy_fields(p, fields) != 0 || select_trials(p, skips) != 0 || make_chunks(p) != 0) {
+        ml_prefetch_free(p);
+        return NULL;
+    }
+    return p;
+}
+
+/************************************************************/
+/* Consumer side
+ */
+/************************************************************/
+
+/* Keep the window of chunks ahead of the consumer in flight */
+static void submit_chunks(ml_prefetch_t *p) {
+    while (p->n_submitted < p->n_chunks && p->n_submitted < p->next_chunk + p->window) {
+        prefetch_chunk_t *chunk = &p->chunks[p->n_submitted++];
+        pthread_mutex_lock(&p->lock);
+        chunk->status = CHUNK_QUEUED;
+        p->running++;
+        pthread_mutex_unlock(&p->lock);
+
+        if (sched_submit(p->sched, decode_chunk, chunk, chunk->bytes, true) != 0) {
+            decode_chunk(chunk);  /* Out of memory for the queue: decode here */
+        }
+    }
+}
+
+/* Wait until *done holds, decoding queued chunks meanwhile. Called with
+ * p->lock held; returns with it held. */
+static void help_until(ml_prefetch_t *p, bool (*done)(ml_prefetch_t*, void*), void *arg) {
+    while (!done(p, arg)) {
+        pthread_mutex_unlock(&p->lock);
+        int helped = sched_help(p->sched);
+        pthread_mutex_lock(&p->lock);
+        if (!helped && !done(p, arg)) {
+            /* Nothing queued anywhere: what we wait for is running */
+            pthread_cond_wait(&p->ready, &p->lock);
+        }
+    }
+}
+
+static bool chunk_finished(ml_prefetch_t *p, void *arg) {
+    (void)p;
+    return ((prefetch_chunk_t*)arg)->status != CHUNK_QUEUED;
+}
+
+static bool none_running(ml_prefetch_t *p, void *arg) {
+    (void)arg;
+    return p->running == 0;
+}
+
+int ml_prefetch_next(ml_prefetch_t *p, const trial_index_entry_t **entry, bhv2_value_t **data) {
+    if (!p) return -1;
+    if (p->next_chunk >= p->n_chunks) return 0;
+
+    submit_chunks(p);
+    prefetch_chunk_t *chunk = &p->chunks[p->next_chunk];
+    pthread_mutex_lock(&p->lock);
+    help_until(p, chunk_finished, chunk);
+    pthread_mutex_unlock(&p->lock);
+    if (chunk->status == CHUNK_FAILED) return -1;
+    if (chunk->status == CHUNK_SHORT && p->next_trial == chunk->n_done) {
+        /* The trials before the one that failed went out first */
+        p->next_chunk = p->n_chunks;
+        return -1;
+    }
+
+    *entry = p->kept[chunk->first + p->next_trial];
+    *data = chunk->data[p->next_trial];
+    chunk->data[p->next_trial] = NULL;
+    p->last = *entry;
+
+    if (++p->next_trial == chunk->count) {
+        free(chunk->data);
+        chunk->data = NULL;
+        p->next_chunk++;
+        p->next_trial = 0;
+    }
+    return 1;
+}
+
+int ml_prefetch_merge(ml_prefetch_t *p, void **acc) {
+    if (!p || !p->kernel) return -1;
+    if (p->next_chunk >= p->n_chunks) return 0;
+    const trial_kernel_t *kernel = p->kernel;
+
+    submit_chunks(p);
+    prefetch_chunk_t *chunk = &p->chunks[p->next_chunk++];
+    pthread_mutex_lock(&p->lock);
+    help_until(p, chunk_finished, chunk);
+    pthread_mutex_unlock(&p->lock);
+    if (chunk->status == CHUNK_FAILED) return -1;
+
+    void *later = chunk->acc;
+    chunk->acc = NULL;
+    int status = 1;
+    if (!*acc) {
+        *acc = later;
+    } else {
+        if (kernel->merge(*acc, later, p->ctx) != 0) status = -1;
+        kernel->destroy(later);
+    }
+    if (chunk->n_done > 0) p->last = p->kept[chunk->first + chunk->n_done - 1];
+    if (chunk->status == CHUNK_SHORT) p->next_chunk = p->n_chunks;
+    return status;
+}
+
+off_t ml_prefetch_resume_offset(const ml_prefetch_t *p) {
+    if (!p || !p->last) return 0;
+    size_t k = (size_t)(p->last - p->index->entries);
+    return k + 1 < p->index->count ? (off_t)p->index->entries[k + 1].offset : p->file_size;
+}
+
+void ml_prefetch_free(ml_prefetch_t *p) {
+    if (!p) return;
+
+    /* Queued chunks still run, but return at once */
+    pthread_mutex_lock(&p->lock);
+    p->cancelled = true;
+    help_until(p, none_running, NULL);
+    pthread_mutex_unlock(&p->lock);
+
+    for (size_t i = 0; p->chunks && i < p->n_chunks; i++) {
+        free_values(p->chunks[i].data, p->chunks[i].count);
+        if (p->chunks[i].acc) p->kernel->destroy(p->chunks[i].acc);
+    }
+    for (size_t i = 0; i < p->n_spare; i++) {
+        filter_chain_free(p->spare_filters[i]);
+    }
+    free(p->spare_filters);
+    free(p->chunks);
+    free(p->kept);
+    if (p->fields) {
+        for (size_t i = 0; p->fields[i]; i++) free(p->fields[i]);
+        free(p->fields);
+    }
+    free(p->path);
+    pthread_cond_destroy(&p->ready);
+    pthread_mutex_destroy(&p->lock);
+    free(p);
+}
@@ -0,0 +1,73 @@
+/*
+ * ml_prefetch.h - Decoding trials ahead on a scheduler
+ *
+ * The trial index gives every trial's file offset, so trials need not be
+ * decoded one after another. A prefetch drops the trials the skip rules
+ * reject (their metadata is in the index), cuts the rest into chunks of
+ * roughly equal byte size, and queues each chunk as a leaf task: the
+ * task opens its own descriptor on the file and decodes its trials
+ * straight from their offsets. A bounded window of chunks is in flight
+ * at a time, so memory stays proportional to the worker count, not to
+ * the file.
+ *
+ * The consumer takes trials back in file order with ml_prefetch_next();
+ * while the next chunk is not ready it decodes queued chunks itself
+ * (sched_help()) instead of sleeping.
+ *
+ * In kernel mode (see run_trial_kernel()) the trials never reach the
+ * consumer: each chunk task also filters them and runs the kernel into an
+ * accumulator of its own, and ml_prefetch_merge() folds the chunks'
+ * accumulators together in file order. A SKIP_DATA kernel gets no data,
+ * but its trials' metadata is still decoded, so a trial that does not
+ * decode ends the run where a read_next_trial() loop would stop.
+ */
+
+#ifndef ML_PREFETCH_H
+#define ML_PREFETCH_H
+
+#include <sys/types.h>
+#include "bhv2.h"
+#include "sched.h"
+#include "skip.h"
+#include "trial_index.h"
+
+typedef struct ml_prefetch ml_prefetch_t;
+
+/* Start decoding the trials of index that skips keep (skips may be NULL).
+ * path: the data file index describes; file_size: its size
+ * index: not owned, must outlive the prefetch
+ * fields: projection for bhv2_read_variable_data_selective() (copied),
+ *         NULL to decode whole trials
+ * decode_flags: BHV2_DECODE_* options
+ * kernel, ctx: kernel mode (NULL kernel to return trials with
+ *              ml_prefetch_next()); filters are applied to the decoded
+ *              trials in kernel mode only (NULL for none, not owned)
+ * Returns NULL on allocation failure.
+ */
+ml_prefetch_t* ml_prefetch_start(sched_t *sched, const char *path, off_t file_size,
+                                 const trial_index_t *index, skip_set_t *skips,
+                                 const char **fields, unsigned decode_flags,
+                                 const trial_kernel_t *kernel, void *ctx, filter_chain_t *filters);
+
+/* Next kept trial in file order: sets *entry and *data (caller frees data).
+ * Returns 1 on success, 0 after the last trial, -1 if a trial failed to decode.
+ */
+int ml_prefetch_next(ml_prefetch_t *prefetch, const trial_index_entry_t **entry,
+                     bhv2_value_t **data);
+
+/* Kernel mode: wait for the next chunk and fold its accumulator into *acc
+ * (which may start NULL; caller destroys). A trial that fails to decode
+ * ends the run there, as it ends a read_next_trial() loop. Returns 1 when
+ * a chunk was merged, 0 when there are no more, -1 on a kernel or
+ * allocation error.
+ */
+int ml_prefetch_merge(ml_prefetch_t *prefetch, void **acc);
+
+/* File offset just past the last trial returned (or merged), where
+ * sequential reading would continue (0 if none was yet) */
+off_t ml_prefetch_resume_offset(const ml_prefetch_t *prefetch);
+
+/* Cancel outstanding chunks, wait for running ones and free everything */
+void ml_prefetch_free(ml_prefetch_t *prefetch);
+
+#endif /* ML_PREFETCH_H */
@@ -5,17 +5,31 @@
  * This is the domain-specific layer that interprets BHV2 variables as trials.
  */
 
+#define _POSIX_C_SOURCE 200809L  /* For strdup, fsync, clock_gettime */
+
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <time.h>
 #include <unistd.h>
 #include "ml_trial.h"
+#include "ml_prefetch.h"
+#include "trial_index.h"
 
 /* Fields needed for trial metadata (filtering and accessors) */
+#define N_METADATA_FIELDS 3
 static const char *trial_metadata_fields[] = {
     "TrialError", "Condition", "Block", NULL
 };
 
+/* Kernel checkpoint header: magic, version, offset of the next trial */
+#define CHECKPOINT_MAGIC "PRCK"
+#define CHECKPOINT_VERSION 1
+
+/* Added to projections that select part of AnalogData */
+static const char *analog_interval_field = "AnalogData.SampleInterval";
+
 /************************************************************/
 /* Helper functions
  */
@@ -38,6 +52,18 @@ static void extract_trial_info(ml_trial_file_t *file, bhv2_value_t *trial_value)
     file->current_block = block_val ? (int)bhv2_get_double(block_val, 0) : -1;
 }
 
+/* Free the SELECT_DATA projection list */
+static void free_selected_fields(ml_trial_file_t *file) {
+    if (!file->selected_fields) return;
+    
+    /* Metadata names are static; only caller-supplied names were copied */
+    for (size_t i = N_METADATA_FIELDS; file->selected_fields[i]; i++) {
+        free((char*)file->selected_fields[i]);
+    }
+    free(file->selected_fields);
+    file->selected_fields = NULL;
+}
+
 /* Clear current trial state */
 static void clear_trial_state(ml_trial_file_t *file) {
     if (!file) return;
@@ -51,9 +77,82 @@ static void clear_trial_state(ml_trial_file_t *file) {
     file->current_error_code = -1;
     file->current_condition = -1;
     file->current_block = -1;
+    file->current_offset = 0;
     file->has_current = false;
 }
 
+/************************************************************/
+/* Decoding ahead
+ */
+/************************************************************/
+
+/* End the prefetch pass, leaving the file where sequential reading would
+ * continue after the last trial it returned */
+static void stop_prefetch(ml_trial_file_t *file) {
+    if (!file->prefetch) return;
+    
+    off_t resume = ml_prefetch_resume_offset(file->prefetch);
+    ml_prefetch_free(file->prefetch);
+    file->prefetch = NULL;
+    bhv2_seek(file->bhv2_file, resume);
+}
+
+/* Sidecar index if fresh, else one built from the file (kept for later passes) */
+static trial_index_t* prefetch_index(ml_trial_file_t *file) {
+    if (file->index) return file->index;
+    
+    file->index = trial_index_load(file->bhv2_file->path);
+    if (file->index) return file->index;
+    
+    /* Building reads the file with its own projection and in place */
+    const char **selected = file->selected_fields;
+    sched_t *sched = file->sched;
+    file->selected_fields = NULL;
+    file->sched = NULL;
+    file->index = trial_index_build(file);
+    free_selected_fields(file);
+    file->selected_fields = selected;
+    file->sched = sched;
+    return file->index;
+}
+
+/* Start a prefetch pass at the beginning of the file (no-op if the file
+ * has no trials or something fails: the pass then reads in place) */
+static void start_prefetch(ml_trial_file_t *file, int skip_data_flag) {
+    trial_index_t *index = prefetch_index(file);
+    if (!index || index->count == 0) return;
+    
+    const char **fields = NULL;
+    if (skip_data_flag == SELECT_DATA) {
+        fields = file->selected_fields ? file->selected_fields : trial_metadata_fields;
+    }
+    bhv2_file_t *bhv2 = file->bhv2_file;
+    file->prefetch = ml_prefetch_start(file->sched, bhv2->path, bhv2->file_size, index,
+                                       file->skips, fields, bhv2->decode_flags, NULL, NULL, NULL);
+    file->prefetch_flag = skip_data_flag;
+}
+
+/* Next trial of the prefetch pass (same returns as read_next_trial()) */
+static int read_prefetched_trial(ml_trial_file_t *file) {
+    const trial_index_entry_t *entry;
+    bhv2_value_t *trial_data;
+    int status = ml_prefetch_next(file->prefetch, &entry, &trial_data);
+    if (status <= 0) {
+        /* At the end, or stopped at the trial that failed to decode */
+        stop_prefetch(file);
+        if (status == 0) bhv2_seek(file->bhv2_file, file->bhv2_file->file_size);
+        return status;
+    }
+    
+    file->current_trial_num = entry->trial_num;
+    file->current_offset = (off_t)entry->offset;
+    extract_trial_info(file, trial_data);
+    file->has_current = true;
+    file->current_data = trial_data;
+    if (filter_chain_apply(file->filters, trial_data) != 0) return -1;
+    return entry->trial_num;
+}
+
 /************************************************************/
 /* Public API
  */
@@ -78,6 +177,10 @@ void close_input_file(ml_trial_file_t *file) {
     if (!file) return;
     
     clear_trial_state(file);
+    ml_prefetch_free(file->prefetch);
+    trial_index_free(file->index);
+    free_selected_fields(file);
+    free(file->checkpoint_path);
     bhv2_file_free(file->bhv2_file);
     free(file);
 }
@@ -88,6 +191,8 @@ void rewind_input_file(ml_trial_file_t *file) {
     
     /* Clear current trial state */
     clear_trial_state(file);
+    ml_prefetch_free(file->prefetch);
+    file->prefetch = NULL;
     
     /* Rewind the underlying BHV2 file */
     bhv2_file_t *bhv2 = file->bhv2_file;
@@ -99,10 +204,92 @@ void rewind_input_file(ml_trial_file_t *file) {
 /* Set skip rules for trial filtering */
 void set_skips(ml_trial_file_t *file, skip_set_t *skips) {
     if (file) {
+        stop_prefetch(file);
         file->skips = skips;
     }
 }
 
+/* Set analog filters for subsequent trial reads */
+void set_filters(ml_trial_file_t *file, filter_chain_t *filters) {
+    if (file) {
+        file->filters = filters;
+    }
+}
+
+/* Set BHV2 decode options for subsequent trial reads */
+void set_decode_flags(ml_trial_file_t *file, unsigned flags) {
+    if (file) {
+        stop_prefetch(file);
+        bhv2_set_decode_flags(file->bhv2_file, flags);
+    }
+}
+
+/* Decode trials ahead on a scheduler */
+void set_scheduler(ml_trial_file_t *file, sched_t *sched) {
+    if (file) {
+        stop_prefetch(file);
+        file->sched = sched;
+    }
+}
+
+/* Checkpoint kernel runs */
+int set_checkpoint(ml_trial_file_t *file, const char *path, double interval) {
+    if (!file) return -1;
+    
+    char *copy = path ? strdup(path) : NULL;
+    if (path && !copy) return -1;
+    free(file->checkpoint_path);
+    file->checkpoint_path = copy;
+    file->checkpoint_interval = interval;
+    return 0;
+}
+
+/* Choose fields decoded by read_next_trial(SELECT_DATA) */
+int set_data_fields(ml_trial_file_t *file, const char **fields) {
+    if (!file) return -1;
+    
+    stop_prefetch(file);
+    free_selected_fields(file);
+    
+    size_t n_extra = 0;
+    bool analog_path = false, has_interval = false;
+    while (fields && fields[n_extra]) {
+        analog_path |= strncmp(fields[n_extra], "AnalogData.", 11) == 0;
+        has_interval |= strcmp(fields[n_extra], analog_interval_field) == 0;
+        n_extra++;
+    }
+    
+    /* Channels are meaningless without their sample interval (and filters
+     * and resampling need it), so bring it along with any AnalogData path */
+    bool add_interval = analog_path && !has_interval;
+    
+    const char **list = calloc(N_METADATA_FIELDS + n_extra + add_interval + 1, sizeof(char*));
+    if (!list) return -1;
+    
+    for (size_t i = 0; i < N_METADATA_FIELDS; i++) {
+        list[i] = trial_metadata_fields[i];
+    }
+    for (size_t i = 0; i < n_extra; i++) {
+        list[N_METADATA_FIELDS + i] = strdup(fields[i]);
+        if (!list[N_METADATA_FIELDS + i]) {
+            file->selected_fields = list;
+            free_selected_fields(file);
+            return -1;
+        }
+    }
+    if (add_interval) {
+        list[N_METADATA_FIELDS + n_extra] = strdup(analog_interval_field);
+        if (!list[N_METADATA_FIELDS + n_extra]) {
+            file->selected_fields = list;
+            free_selected_fields(file);
+            return -1;
+        }
+    }
+    
+    file->selected_fields = list;
+    return 0;
+}
+
 /* Read next trial */
 int read_next_trial(ml_trial_file_t *file, int skip_data_flag) {
     if (!file) return -1;
@@ -110,19 +297,36 @@ int read_next_trial(ml_trial_file_t *file, int skip_data_flag) {
     /* Clear previous trial */
     clear_trial_state(file);
     
+    /* Decode ahead when a pass starts with a scheduler set */
+    if (file->prefetch && file->prefetch_flag != skip_data_flag) {
+        stop_prefetch(file);
+    }
+    if (!file->prefetch && file->sched && skip_data_flag != SKIP_DATA
+        && file->bhv2_file->current_pos == 0) {
+        start_prefetch(file, skip_data_flag);
+    }
+    if (file->prefetch) {
+        return read_prefetched_trial(file);
+    }
+    
     /* Iterate through BHV2 variables looking for trials */
     char *name;
+    off_t offset = file->bhv2_file->current_pos;
     while (bhv2_read_next_variable_name(file->bhv2_file, &name) == 0) {
         /* Check if this is a Trial variable: "Trial1", "Trial2", etc. */
         if (strncmp(name, "Trial", 5) == 0 && isdigit(name[5])) {
             int trial_num = atoi(name + 5);
             free(name);
             
-            /* Read trial data - selectively for SKIP_DATA, fully for WITH_DATA */
+            /* Read trial data - selectively for SKIP_DATA/SELECT_DATA, fully for WITH_DATA */
             bhv2_value_t *trial_data;
             if (skip_data_flag == SKIP_DATA) {
                 /* Only read metadata fields, skip bulk data */
                 trial_data = bhv2_read_variable_data_selective(file->bhv2_file, trial_metadata_fields);
+            } else if (skip_data_flag == SELECT_DATA) {
+                /* Metadata plus the fields chosen with set_data_fields() */
+                const char **fields = file->selected_fields ? file->selected_fields : trial_metadata_fields;
+                trial_data = bhv2_read_variable_data_selective(file->bhv2_file, fields);
             } else {
                 /* Read everything */
                 trial_data = bhv2_read_variable_data(file->bhv2_file);
@@ -131,6 +335,7 @@ int read_next_trial(ml_trial_file_t *file, int skip_data_flag) {
             
             /* Extract trial info */
             file->current_trial_num = trial_num;
+            file->current_offset = offset;
             extract_trial_info(file, trial_data);
             
             /* Check if trial should be skipped */
@@ -145,6 +350,7 @@ int read_next_trial(ml_trial_file_t *file, int skip_data_flag) {
                     /* Skip this trial - free data and continue */
                     bhv2_value_free(trial_data);
                     clear_trial_state(file);
+                    offset = file->bhv2_file->current_pos;
                     continue;
                 }
             }
@@ -156,8 +362,9 @@ int read_next_trial(ml_trial_file_t *file, int skip_data_flag) {
                 /* Caller doesn't need data - free it */
                 bhv2_value_free(trial_data);
             } else {
-                /* WITH_DATA: Keep the data */
+                /* WITH_DATA/SELECT_DATA: Keep the data */
                 file->current_data = trial_data;
+                if (filter_chain_apply(file->filters, trial_data) != 0) return -1;
             }
             
             return trial_num;
@@ -165,6 +372,7 @@ int read_next_trial(ml_trial_file_t *file, int skip_data_flag) {
             /* Not a trial - skip it */
             free(name);
             bhv2_skip_variable_data(file->bhv2_file);
+            offset = file->bhv2_file->current_pos;
         }
     }
     
@@ -172,6 +380,146 @@ int read_next_trial(ml_trial_file_t *file, int skip_data_flag) {
     return 0;
 }
 
+/************************************************************/
+/* Kernel checkpoints
+ */
+/************************************************************/
+
+typedef struct {
+    ml_trial_file_t *file;
+    const trial_kernel_t *kernel;
+    void *ctx;
+    struct timespec last_save;
+} checkpoint_t;
+
+static double seconds_since(const struct timespec *then) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - then->tv_sec) + (now.tv_nsec - then->tv_nsec) / 1e9;
+}
+
+/* Load the checkpoint, if the kernel can and there is a readable one:
+ * sets *acc and *offset (left alone otherwise) */
+static void load_checkpoint(checkpoint_t *ck, void **acc, off_t *offset) {
+    ml_trial_file_t *file = ck->file;
+    if (!file->checkpoint_path || !ck->kernel->load) return;
+    
+    FILE *fp = fopen(file->checkpoint_path, "rb");
+    if (!fp) return;
+    
+    char magic[4];
+    uint32_t version;
+    uint64_t next;
+    if (fread(magic, 1, 4, fp) == 4 && memcmp(magic, CHECKPOINT_MAGIC, 4) == 0
+        && fread(&version, sizeof(version), 1, fp) == 1 && version == CHECKPOINT_VERSION
+        && fread(&next, sizeof(next), 1, fp) == 1 && next <= (uint64_t)file->bhv2_file->file_size) {
+        void *loaded = ck->kernel->load(fp, ck->ctx);
+        if (loaded) {
+            *acc = loaded;
+            *offset = (off_t)next;
+        }
+    }
+    fclose(fp);
+}
+
+/* Save acc with the offset of the next trial, if a save is due (a failed
+ * save is only a lost checkpoint) */
+static void save_checkpoint(checkpoint_t *ck, const void *acc, off_t next) {
+    ml_trial_file_t *file = ck->file;
+    if (!file->checkpoint_path || !ck->kernel->save) return;
+    if (seconds_since(&ck->last_save) < file->checkpoint_interval) return;
+    
+    size_t len = strlen(file->checkpoint_path) + sizeof(".tmp");
+    char *tmp = malloc(len);
+    if (!tmp) return;
+    snprintf(tmp, len, "%s.tmp", file->checkpoint_path);
+    
+    FILE *fp = fopen(tmp, "wb");
+    uint32_t version = CHECKPOINT_VERSION;
+    uint64_t offset = (uint64_t)next;
+    bool ok = fp
+        && fwrite(CHECKPOINT_MAGIC, 1, 4, fp) == 4
+        && fwrite(&version, sizeof(version), 1, fp) == 1
+        && fwrite(&offset, sizeof(offset), 1, fp) == 1
+        && ck->kernel->save(acc, fp, ck->ctx) == 0
+        && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    if (fp && fclose(fp) != 0) ok = false;
+    if (ok) ok = rename(tmp, file->checkpoint_path) == 0;
+    if (!ok) remove(tmp);
+    free(tmp);
+    clock_gettime(CLOCK_MONOTONIC, &ck->last_save);
+}
+
+/* Run a per-trial kernel over the kept trials */
+int run_trial_kernel(ml_trial_file_t *file, const trial_kernel_t *kernel, void *ctx,
+                     void **acc_out) {
+    if (!file || !kernel || !acc_out) return -1;
+    
+    rewind_input_file(file);
+    bhv2_file_t *bhv2 = file->bhv2_file;
+    
+    /* Carry on from the checkpoint, if any */
+    checkpoint_t ck = { .file = file, .kernel = kernel, .ctx = ctx };
+    clock_gettime(CLOCK_MONOTONIC, &ck.last_save);
+    void *acc = NULL;
+    off_t start = 0;
+    load_checkpoint(&ck, &acc, &start);
+    
+    /* On the workers, next to decoding */
+    trial_index_t *index = file->sched ? prefetch_index(file) : NULL;
+    size_t first = 0;
+    while (index && first < index->count && index->entries[first].offset < (uint64_t)start) first++;
+    if (index && first < index->count) {
+        const char **fields = NULL;
+        if (kernel->read_flag == SELECT_DATA) {
+            fields = file->selected_fields ? file->selected_fields : trial_metadata_fields;
+        } else if (kernel->read_flag == SKIP_DATA) {
+            fields = trial_metadata_fields;
+        }
+        trial_index_t rest = { .entries = index->entries + first, .count = index->count - first };
+        ml_prefetch_t *prefetch = ml_prefetch_start(file->sched, bhv2->path, bhv2->file_size, &rest,
+                                                    file->skips, fields, bhv2->decode_flags,
+                                                    kernel, ctx, file->filters);
+        if (prefetch) {
+            int status;
+            while ((status = ml_prefetch_merge(prefetch, &acc)) > 0) {
+                off_t next = ml_prefetch_resume_offset(prefetch);
+                if (next > 0) save_checkpoint(&ck, acc, next);
+            }
+            ml_prefetch_free(prefetch);
+            bhv2_seek(bhv2, bhv2->file_size);
+            if (status == 0 && !acc) acc = kernel->create(ctx);
+            if (status != 0 || !acc) {
+                if (acc) kernel->destroy(acc);
+                return -1;
+            }
+            *acc_out = acc;
+            return 0;
+        }
+    }
+    
+    /* In place, one accumulator */
+    if (!acc) acc = kernel->create(ctx);
+    if (!acc) return -1;
+    if (start > 0) bhv2_seek(bhv2, start);
+    while (read_next_trial(file, kernel->read_flag) > 0) {
+        trial_view_t view = {
+            .trial_num = file->current_trial_num,
+            .error_code = file->current_error_code,
+            .condition = file->current_condition,
+            .block = file->current_block,
+            .data = file->current_data
+        };
+        if (kernel->trial(acc, &view, ctx) != 0) {
+            kernel->destroy(acc);
+            return -1;
+        }
+        save_checkpoint(&ck, acc, bhv2->current_pos);
+    }
+    *acc_out = acc;
+    return 0;
+}
+
 /* Trial accessor functions */
 int trial_number(ml_trial_file_t *file) {
     return file ? file->current_trial_num : 0;
@@ -16,8 +16,11 @@
 #define ML_TRIAL_H
 
 #include <stdbool.h>
+#include <stdio.h>
 #include "bhv2.h"
 #include "skip.h"
+#include "filter.h"
+#include "sched.h"
 
 /************************************************************/
 /* MonkeyLogic trial file handle
@@ -27,14 +30,29 @@
 typedef struct {
     bhv2_file_t *bhv2_file;          /* Generic BHV2 format parser */
     skip_set_t *skips;               /* Trial filtering rules */
+    filter_chain_t *filters;         /* Analog conditioning (NULL for none) */
     
     /* Current trial state (populated by read_next_trial) */
     int current_trial_num;           /* Trial number (1-based, from "Trial123") */
     int current_error_code;          /* TrialError field value */
     int current_condition;           /* Condition field value */
     int current_block;               /* Block field value */
+    off_t current_offset;            /* File position of the trial variable */
     bhv2_value_t *current_data;      /* Full trial struct (NULL if SKIP_DATA) */
     bool has_current;                /* True if current trial is valid */
+    
+    /* Projection for SELECT_DATA: metadata fields + caller's fields */
+    const char **selected_fields;    /* NULL-terminated, owned by file */
+    
+    /* Decoding ahead (see set_scheduler()) */
+    sched_t *sched;                  /* NULL: decode in the calling thread */
+    struct trial_index *index;       /* Trial offsets, loaded or built on first use */
+    struct ml_prefetch *prefetch;    /* Pass in progress (NULL if none) */
+    int prefetch_flag;               /* Its WITH_DATA or SELECT_DATA */
+    
+    /* Kernel checkpoints (see set_checkpoint()) */
+    char *checkpoint_path;           /* NULL: none */
+    double checkpoint_interval;      /* Seconds between saves */
 } ml_trial_file_t;
 
 /************************************************************/
@@ -42,8 +60,43 @@ typedef struct {
  */
 /************************************************************/
 
-#define WITH_DATA 0
-#define SKIP_DATA 1
+#define WITH_DATA   0
+#define SKIP_DATA   1
+#define SELECT_DATA 2   /* Read only fields chosen with set_data_fields() */
+
+/************************************************************/
+/* Per-trial kernels (see run_trial_kernel())
+ */
+/************************************************************/
+
+/* One kept trial as a kernel sees it */
+typedef struct {
+    int trial_num;
+    int error_code;
+    int condition;
+    int block;
+    bhv2_value_t *data;     /* Decoded (and filtered) fields, NULL for SKIP_DATA */
+} trial_view_t;
+
+/* A macro split into an accumulator it builds per trial and a merge.
+ * Accumulators are built over runs of consecutive trials, possibly on
+ * several threads at once, and merged in file order: merge(a, b) folds
+ * the trials of b, all later than a's, into a. ctx is shared by every
+ * call and must only be read.
+ *
+ * save and load are optional: a kernel that has them can checkpoint its
+ * accumulator and resume from it (see set_checkpoint()). load reads back
+ * what save wrote, on the same machine and build.
+ */
+typedef struct {
+    int read_flag;                                  /* SKIP_DATA, SELECT_DATA or WITH_DATA */
+    void* (*create)(void *ctx);                     /* Empty accumulator (NULL on failure) */
+    int (*trial)(void *acc, const trial_view_t *trial, void *ctx);  /* Nonzero: error */
+    int (*merge)(void *acc, void *later, void *ctx);                /* Nonzero: error */
+    void (*destroy)(void *acc);
+    int (*save)(const void *acc, FILE *fp, void *ctx);             /* Nonzero: error */
+    void* (*load)(FILE *fp, void *ctx);                             /* NULL on failure */
+} trial_kernel_t;
 
 /************************************************************/
 /* Grab-style API
@@ -62,12 +115,60 @@ void rewind_input_file(ml_trial_file_t *file);
 /* Set skip rules for trial filtering */
 void set_skips(ml_trial_file_t *file, skip_set_t *skips);
 
+/* Set analog filters applied to each trial's data after it is read
+ * (not owned; NULL for none) */
+void set_filters(ml_trial_file_t *file, filter_chain_t *filters);
+
+/* Set BHV2 decode options (BHV2_DECODE_*) for subsequent trial reads */
+void set_decode_flags(ml_trial_file_t *file, unsigned flags);
+
+/* Decode trials ahead on sched's workers (not owned; NULL to decode in
+ * the calling thread). A WITH_DATA or SELECT_DATA pass from the start of
+ * the file then reads the trial index (the sidecar if fresh, else built
+ * in memory), hands the kept trials to the workers in byte-balanced
+ * chunks and returns them in file order. Analog filters still run in the
+ * caller. Changing the mode, fields, skips or decode flags mid-pass falls
+ * back to reading in place after the last trial returned.
+ */
+void set_scheduler(ml_trial_file_t *file, sched_t *sched);
+
+/* Checkpoint kernel runs to path (copied; NULL for none), at most every
+ * interval seconds. run_trial_kernel() then saves the accumulator and the
+ * offset of the next trial there as it goes (kernels with save/load only),
+ * and a later run with the same path starts from what was saved. The
+ * checkpoint is written to a temporary file and renamed into place, so it
+ * is always whole; the caller removes it once the result is safe.
+ * Returns 0 on success, -1 on allocation failure.
+ */
+int set_checkpoint(ml_trial_file_t *file, const char *path, double interval);
+
+/* Run kernel over every kept trial (SELECT_DATA reads the fields chosen
+ * with set_data_fields()). Without a scheduler the trials are read in
+ * place into one accumulator; with one, each chunk of trials is decoded,
+ * filtered and passed to the kernel on a worker, and the chunks'
+ * accumulators are merged in file order. The file is left at its end.
+ * Returns the accumulator (caller destroys) in *acc_out and 0, or -1 on
+ * a read, allocation or kernel error.
+ */
+int run_trial_kernel(ml_trial_file_t *file, const trial_kernel_t *kernel, void *ctx,
+                     void **acc_out);
+
+/* Choose the top-level trial fields decoded by read_next_trial(SELECT_DATA)
+ * fields: NULL-terminated list (e.g. {"AnalogData", NULL}); copied.
+ *         Dotted paths ("AnalogData.Eye") select part of a nested struct;
+ *         AnalogData.SampleInterval is added to any AnalogData path.
+ * Metadata fields (TrialError, Condition, Block) are always included.
+ * Returns 0 on success, -1 on allocation failure.
+ */
+int set_data_fields(ml_trial_file_t *file, const char **fields);
+
 /* Read next trial (returns trial number, 0 on EOF, negative on error)
- * skip_data_flag: WITH_DATA or SKIP_DATA
+ * skip_data_flag: WITH_DATA, SKIP_DATA or SELECT_DATA
  * 
  * Iterates through BHV2 variables looking for "Trial1", "Trial2", etc.
  * Extracts MonkeyLogic metadata (TrialError, Condition, Block).
- * Applies skip filters if configured.
+ * Applies skip filters if configured, then analog filters (set_filters())
+ * to the data of kept trials.
  * Populates current trial state accessible via trial_*() functions.
  */
 int read_next_trial(ml_trial_file_t *file, int skip_data_flag);
@@ -79,6 +180,6 @@ int trial_number(ml_trial_file_t *file);
 int trial_error(ml_trial_file_t *file);
 int trial_condition(ml_trial_file_t *file);
 int trial_block(ml_trial_file_t *file);
-bhv2_value_t* trial_data(ml_trial_file_t *file);
+bhv2_value_t* trial_data(ml_trial_file_t *file);  /* NULL if SKIP_DATA */
 
 #endif /* ML_TRIAL_H */
@@ -0,0 +1,287 @@
+/*
+ * ml_uservars.c - MonkeyLogic UserVars as a typed column table
+ */
+
+#define _POSIX_C_SOURCE 200809L  /* For strdup */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ml_uservars.h"
+
+#define UV_TEXT_MAX 256         /* Longest text made from a non-scalar value */
+#define UV_VECTOR_MAX 16        /* Longer vectors are shown by size only */
+
+/************************************************************/
+/* Dictionary
+ */
+/************************************************************/
+
+static uint32_t hash_text(const char *text) {
+    uint32_t h = 2166136261u;  /* FNV-1a */
+    for (const unsigned char *p = (const unsigned char*)text; *p; p++) {
+        h = (h ^ *p) * 16777619u;
+    }
+    return h;
+}
+
+static int rehash(ml_uv_column_t *col, uint32_t n_slots) {
+    uint32_t *slots = calloc(n_slots, sizeof(uint32_t));
+    if (!slots) return -1;
+    for (uint32_t id = 0; id < col->n_dict; id++) {
+        uint32_t s = hash_text(col->dict[id]) & (n_slots - 1);
+        while (slots[s]) s = (s + 1) & (n_slots - 1);
+        slots[s] = id + 1;
+    }
+    free(col->slots);
+    col->slots = slots;
+    col->n_slots = n_slots;
+    return 0;
+}
+
+/* Id of text in the column's dictionary, added if new. Returns -1 on allocation failure. */
+static int64_t intern(ml_uv_column_t *col, const char *text) {
+    if (col->n_slots == 0 && rehash(col, 64) != 0) return -1;
+
+    uint32_t s = hash_text(text) & (col->n_slots - 1);
+    while (col->slots[s]) {
+        uint32_t id = col->slots[s] - 1;
+        if (strcmp(col->dict[id], text) == 0) return id;
+        s = (s + 1) & (col->n_slots - 1);
+    }
+
+    if (col->n_dict >= col->dict_cap) {
+        uint32_t new_cap = col->dict_cap == 0 ? 16 : col->dict_cap * 2;
+        char **grown = realloc(col->dict, new_cap * sizeof(char*));
+        if (!grown) return -1;
+        col->dict = grown;
+        col->dict_cap = new_cap;
+    }
+    char *copy = strdup(text);
+    if (!copy) return -1;
+    uint32_t id = col->n_dict++;
+    col->dict[id] = copy;
+    col->slots[s] = id + 1;
+
+    /* Keep the table at most half full */
+    if (2 * col->n_dict > col->n_slots && rehash(col, col->n_slots * 2) != 0) return -1;
+    return id;
+}
+
+/************************************************************/
+/* Values
+ */
+/************************************************************/
+
+static bool is_integer_class(matlab_dtype_t dtype) {
+    return dtype >= MATLAB_UINT8 && dtype <= MATLAB_INT64;
+}
+
+/* Text for a value that is not a scalar or a string */
+static void value_text(bhv2_value_t *value, char *buf, size_t size) {
+    bool numeric = matlab_dtype_size(value->dtype) > 0 && value->dtype != MATLAB_CHAR;
+    if (numeric && value->total <= UV_VECTOR_MAX) {
+        size_t len = snprintf(buf, size, "[");
+        for (uint64_t i = 0; i < value->total && len < size; i++) {
+            len += snprintf(buf + len, size - len, i ? " %.15g" : "%.15g", bhv2_get_double(value, i));
+        }
+        if (len < size) {
+            snprintf(buf + len, size - len, "]");
+            return;
+        }
+    }
+
+    size_t len = snprintf(buf, size, "<");
+    for (uint64_t d = 0; d < value->ndims && len < size; d++) {
+        len += snprintf(buf + len, size - len, d ? "x%lu" : "%lu", (unsigned long)value->dims[d]);
+    }
+    if (len < size) snprintf(buf + len, size - len, " %s>", matlab_dtype_to_string(value->dtype));
+}
+
+/* Type of a cell and its number or text; ML_UV_NONE for empty values */
+static ml_uv_type_t classify(bhv2_value_t *value, double *num, const char **text, char *buf, size_t size) {
+    if (!value || value->total == 0) return ML_UV_NONE;
+
+    if (value->dtype == MATLAB_CHAR) {
+        *text = value->data.string ? value->data.string : "";
+        return ML_UV_STRING;
+    }
+    if (value->total == 1 && value->dtype == MATLAB_LOGICAL) {
+        *num = bhv2_get_double(value, 0);
+        return ML_UV_BOOL;
+    }
+    if (value->total == 1 && is_integer_class(value->dtype)) {
+        *num = bhv2_get_double(value, 0);
+        return ML_UV_INT;
+    }
+    if (value->total == 1 && (value->dtype == MATLAB_DOUBLE || value->dtype == MATLAB_SINGLE)) {
+        *num = bhv2_get_double(value, 0);
+        return ML_UV_DOUBLE;
+    }
+
+    value_text(value, buf, size);
+    *text = buf;
+    return ML_UV_STRING;
+}
+
+/************************************************************/
+/* Table
+ */
+/************************************************************/
+
+ml_uv_table_t* ml_uv_table_new(void) {
+    return calloc(1, sizeof(ml_uv_table_t));
+}
+
+static void column_free(ml_uv_column_t *col) {
+    free(col->name);
+    free(col->kind);
+    free(col->num);
+    free(col->id);
+    for (uint32_t i = 0; i < col->n_dict; i++) free(col->dict[i]);
+    free(col->dict);
+    free(col->slots);
+}
+
+void ml_uv_table_free(ml_uv_table_t *table) {
+    if (!table) return;
+    for (size_t c = 0; c < table->n_columns; c++) column_free(&table->columns[c]);
+    free(table->columns);
+    free(table->trial);
+    free(table->condition);
+    free(table->error);
+    free(table->block);
+    free(table);
+}
+
+/* Room for one more row in every column (new columns get row_cap cells) */
+static int reserve_row(ml_uv_table_t *table) {
+    if (table->n_rows < table->row_cap) return 0;
+    size_t cap = table->row_cap == 0 ? 256 : table->row_cap * 2;
+
+    int **meta[4] = { &table->trial, &table->condition, &table->error, &table->block };
+    for (int m = 0; m < 4; m++) {
+        int *grown = realloc(*meta[m], cap * sizeof(int));
+        if (!grown) return -1;
+        *meta[m] = grown;
+    }
+    for (size_t c = 0; c < table->n_columns; c++) {
+        ml_uv_column_t *col = &table->columns[c];
+        uint8_t *kind = realloc(col->kind, cap * sizeof(uint8_t));
+        if (!kind) return -1;
+        col->kind = kind;
+        double *num = realloc(col->num, cap * sizeof(double));
+        if (!num) return -1;
+        col->num = num;
+        uint32_t *id = realloc(col->id, cap * sizeof(uint32_t));
+        if (!id) return -1;
+        col->id = id;
+    }
+    table->row_cap = cap;
+    return 0;
+}
+
+static ml_uv_column_t* find_column(ml_uv_table_t *table, const char *name) {
+    for (size_t c = 0; c < table->n_columns; c++) {
+        if (strcmp(table->columns[c].name, name) == 0) return &table->columns[c];
+    }
+
+    if (table->n_columns >= table->column_cap) {
+        size_t new_cap = table->column_cap == 0 ? 16 : table->column_cap * 2;
+        ml_uv_column_t *grown = realloc(table->columns, new_cap * sizeof(ml_uv_column_t));
+        if (!grown) return NULL;
+        table->columns = grown;
+        table->column_cap = new_cap;
+    }
+
+    ml_uv_column_t *col = &table->columns[table->n_columns];
+    memset(col, 0, sizeof(*col));
+    col->name = strdup(name);
+    col->kind = calloc(table->row_cap, sizeof(uint8_t));  /* Earlier rows: missing */
+    col->num = calloc(table->row_cap, sizeof(double));
+    col->id = calloc(table->row_cap, sizeof(uint32_t));
+    if (!col->name || !col->kind || !col->num || !col->id) {
+        column_free(col);
+        return NULL;
+    }
+    table->n_columns++;
+    return col;
+}
+
+int ml_uv_table_add(ml_uv_table_t *table, int trial, int condition, int error, int block,
+                    bhv2_value_t *uservars) {
+    if (reserve_row(table) != 0) return -1;
+
+    size_t row = table->n_rows;
+    table->trial[row] = trial;
+    table->condition[row] = condition;
+    table->error[row] = error;
+    table->block[row] = block;
+    for (size_t c = 0; c < table->n_columns; c++) {
+        table->columns[c].kind[row] = ML_UV_NONE;
+        table->columns[c].num[row] = 0.0;
+        table->columns[c].id[row] = 0;
+    }
+    table->n_rows++;
+
+    if (!uservars || uservars->dtype != MATLAB_STRUCT || uservars->total == 0) return 0;
+
+    char buf[UV_TEXT_MAX];
+    uint64_t n_fields = uservars->data.struct_array.n_fields;
+    for (uint64_t f = 0; f < n_fields; f++) {
+        bhv2_struct_field_t *field = &uservars->data.struct_array.fields[f];
+        if (!field->name) continue;
+
+        double num = 0.0;
+        const char *text = NULL;
+        ml_uv_type_t type = classify(field->value, &num, &text, buf, sizeof(buf));
+        if (type == ML_UV_NONE) continue;
+
+        ml_uv_column_t *col = find_column(table, field->name);
+        if (!col) return -1;
+
+        col->kind[row] = (uint8_t)type;
+        if (type == ML_UV_STRING) {
+            int64_t id = intern(col, text);
+            if (id < 0) return -1;
+            col->id[row] = (uint32_t)id;
+        } else {
+            col->num[row] = num;
+        }
+        if (type > col->type) col->type = type;
+        col->present++;
+    }
+    return 0;
+}
+
+int ml_uv_table_finish(ml_uv_table_t *table) {
+    char buf[64];
+    for (size_t c = 0; c < table->n_columns; c++) {
+        ml_uv_column_t *col = &table->columns[c];
+        for (size_t row = 0; row < table->n_rows; row++) {
+            if (col->kind[row] == ML_UV_NONE || col->kind[row] == col->type) continue;
+            if (col->type == ML_UV_STRING) {
+                if (col->kind[row] == ML_UV_BOOL) {
+                    snprintf(buf, sizeof(buf), "%s", col->num[row] != 0.0 ? "true" : "false");
+                } else {
+                    snprintf(buf, sizeof(buf), "%.15g", col->num[row]);
+                }
+                int64_t id = intern(col, buf);
+                if (id < 0) return -1;
+                col->id[row] = (uint32_t)id;
+            }
+            col->kind[row] = (uint8_t)col->type;
+        }
+    }
+    return 0;
+}
+
+const char* ml_uv_type_name(ml_uv_type_t type) {
+    switch (type) {
+        case ML_UV_BOOL:   return "bool";
+        case ML_UV_INT:    return "int";
+        case ML_UV_DOUBLE: return "double";
+        case ML_UV_STRING: return "string";
+        default:           return "none";
+    }
+}
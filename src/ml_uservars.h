@@ -0,0 +1,87 @@
+/*
+ * ml_uservars.h - MonkeyLogic UserVars as a typed column table
+ *
+ * Tasks store their own per-trial scalars in the trial's UserVars struct
+ * (bhv.UserVars in MATLAB). Which variables exist, and their types, can
+ * change from trial to trial, so the table's schema is the union of every
+ * trial's names, in order of first appearance, with each column's type
+ * widened over all of its values:
+ *
+ *   bool < int < double < string
+ *
+ * Logical scalars are bool, integer-class scalars int, double/single
+ * scalars double, char arrays string. Anything else (vectors, structs,
+ * cells) is stored as its text ("[1 2 3]", "<1x2 cell>") and makes the
+ * column string; in a string column, numbers become their text too.
+ * Empty values and variables a trial did not set are missing.
+ *
+ * String columns are dictionary-encoded: each cell holds the id of its
+ * text in the column's dictionary, ids in order of first appearance.
+ */
+
+#ifndef ML_USERVARS_H
+#define ML_USERVARS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "bhv2.h"
+
+typedef enum {
+    ML_UV_NONE,         /* Never set (column of missing values only) */
+    ML_UV_BOOL,
+    ML_UV_INT,
+    ML_UV_DOUBLE,
+    ML_UV_STRING
+} ml_uv_type_t;
+
+typedef struct {
+    char *name;
+    ml_uv_type_t type;          /* Widest type seen so far */
+    uint8_t *kind;              /* [n_rows] type of each cell, ML_UV_NONE if missing */
+    double *num;                /* [n_rows] bool/int/double cells */
+    uint32_t *id;               /* [n_rows] string cells: dictionary id */
+    size_t present;             /* Cells not missing */
+
+    /* Dictionary: text by id, hashed for lookup */
+    char **dict;
+    uint32_t n_dict;
+    uint32_t dict_cap;
+    uint32_t *slots;            /* Open addressing, id + 1 (0 empty) */
+    uint32_t n_slots;
+} ml_uv_column_t;
+
+typedef struct {
+    size_t n_rows;
+    size_t row_cap;
+    int *trial;                 /* [n_rows] trial number, condition, error, block */
+    int *condition;
+    int *error;
+    int *block;
+
+    ml_uv_column_t *columns;
+    size_t n_columns;
+    size_t column_cap;
+} ml_uv_table_t;
+
+/* Empty table (NULL on allocation failure) */
+ml_uv_table_t* ml_uv_table_new(void);
+
+/* Free a table */
+void ml_uv_table_free(ml_uv_table_t *table);
+
+/* Append a row from a trial's UserVars struct (NULL or empty for a row of
+ * missing values). Returns 0 on success, -1 on allocation failure.
+ */
+int ml_uv_table_add(ml_uv_table_t *table, int trial, int condition, int error, int block,
+                    bhv2_value_t *uservars);
+
+/* Settle every column on its widest type: numbers in string columns are
+ * added to the dictionary, cell kinds become the column type.
+ * Returns 0 on success, -1 on allocation failure.
+ */
+int ml_uv_table_finish(ml_uv_table_t *table);
+
+/* "bool", "int", "double", "string" ("none" for ML_UV_NONE) */
+const char* ml_uv_type_name(ml_uv_type_t type);
+
+#endif /* ML_USERVARS_H */
@@ -0,0 +1,177 @@
+/*
+ * plugin.c - Loading plugin macros
+ */
+
+#define _POSIX_C_SOURCE 200809L  /* For scandir, strdup */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include "plugin.h"
+#include "presto_plugin.h"
+
+static const presto_api_t plugin_api = {
+    .abi = PRESTO_PLUGIN_ABI,
+    .struct_get = bhv2_struct_get,
+    .cell_get = bhv2_cell_get,
+    .get_double = bhv2_get_double,
+    .get_string = bhv2_get_string,
+    .append = macro_result_append,
+    .appendf = macro_result_appendf,
+    .append_fixed = macro_result_append_fixed,
+    .append_int = macro_result_append_int,
+};
+
+/* Loaded macros, numbered from PRESTO_PLUGIN_FIRST_ID in load order */
+static const presto_macro_t **plugin_macros = NULL;
+static int n_plugin_macros = 0;
+
+static void **plugin_handles = NULL;
+static int n_plugin_handles = 0;
+
+/************************************************************/
+/* Loading
+ */
+/************************************************************/
+
+static int is_shared_object(const struct dirent *entry) {
+    size_t len = strlen(entry->d_name);
+    return entry->d_name[0] != '.' && len > 3 && strcmp(entry->d_name + len - 3, ".so") == 0;
+}
+
+/* Load one plugin; returns the number of macros it added or -1 */
+static int load_plugin(const char *path) {
+    void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        fprintf(stderr, "Warning: Cannot load plugin %s: %s\n", path, dlerror());
+        return -1;
+    }
+
+    presto_plugin_macros_fn get_macros = (presto_plugin_macros_fn)dlsym(handle, "presto_plugin_macros");
+    const presto_macro_t *list = get_macros ? get_macros(PRESTO_PLUGIN_ABI) : NULL;
+    if (!list) {
+        fprintf(stderr, "Warning: %s is not a presto plugin for ABI %d\n", path, PRESTO_PLUGIN_ABI);
+        dlclose(handle);
+        return -1;
+    }
+
+    int n = 0;
+    while (list[n].name) {
+        if (!list[n].begin || !list[n].trial || !list[n].end) {
+            fprintf(stderr, "Warning: Plugin macro %s in %s lacks begin(), trial() or end()\n", list[n].name, path);
+            dlclose(handle);
+            return -1;
+        }
+        n++;
+    }
+
+    const presto_macro_t **grown_macros = realloc(plugin_macros, (n_plugin_macros + n) * sizeof(*plugin_macros));
+    if (grown_macros) plugin_macros = grown_macros;
+    void **grown_handles = realloc(plugin_handles, (n_plugin_handles + 1) * sizeof(*plugin_handles));
+    if (grown_handles) plugin_handles = grown_handles;
+    if (!grown_macros || !grown_handles) {
+        dlclose(handle);
+        return -1;
+    }
+
+    plugin_handles[n_plugin_handles++] = handle;
+    for (int i = 0; i < n; i++) {
+        plugin_macros[n_plugin_macros++] = &list[i];
+    }
+    return n;
+}
+
+int plugin_load_dir(const char *dir) {
+    struct dirent **entries;
+    int n_entries = scandir(dir, &entries, is_shared_object, alphasort);
+    if (n_entries < 0) {
+        fprintf(stderr, "Error: Cannot read plugin directory %s\n", dir);
+        return -1;
+    }
+
+    int added = 0;
+    for (int i = 0; i < n_entries; i++) {
+        size_t len = strlen(dir) + 1 + strlen(entries[i]->d_name) + 1;
+        char *path = malloc(len);
+        if (path) {
+            snprintf(path, len, "%s/%s", dir, entries[i]->d_name);
+            int n = load_plugin(path);
+            if (n > 0) added += n;
+            free(path);
+        }
+        free(entries[i]);
+    }
+    free(entries);
+    return added;
+}
+
+void plugin_unload_all(void) {
+    for (int i = 0; i < n_plugin_handles; i++) {
+        dlclose(plugin_handles[i]);
+    }
+    free(plugin_handles);
+    free(plugin_macros);
+    plugin_handles = NULL;
+    plugin_macros = NULL;
+    n_plugin_handles = 0;
+    n_plugin_macros = 0;
+}
+
+/************************************************************/
+/* Queries and running
+ */
+/************************************************************/
+
+int plugin_count(void) {
+    return n_plugin_macros;
+}
+
+int plugin_info(int i, int *id, const char **name, const char **description) {
+    if (i < 0 || i >= n_plugin_macros) return -1;
+    *id = PRESTO_PLUGIN_FIRST_ID + i;
+    *name = plugin_macros[i]->name;
+    *description = plugin_macros[i]->description ? plugin_macros[i]->description : "";
+    return 0;
+}
+
+int run_plugin_macro(int macro_id, ml_trial_file_t *file, macro_result_t *result) {
+    int i = macro_id - PRESTO_PLUGIN_FIRST_ID;
+    if (i < 0 || i >= n_plugin_macros) return -1;
+    const presto_macro_t *macro = plugin_macros[i];
+
+    void *state = NULL;
+    if (macro->begin(&state, &plugin_api) != 0) {
+        macro_result_appendf(result, "Plugin macro %s failed to start", macro->name);
+        return 0;
+    }
+    if (set_data_fields(file, macro->fields) != 0) {
+        macro->end(state, result);
+        macro_result_set(result, "Out of memory");
+        return 0;
+    }
+
+    int status;
+    int failed = 0;
+    while ((status = read_next_trial(file, SELECT_DATA)) > 0) {
+        presto_trial_t trial = {
+            .trial = trial_number(file),
+            .condition = trial_condition(file),
+            .error = trial_error(file),
+            .block = trial_block(file),
+            .data = trial_data(file),
+        };
+        if (macro->trial(state, &trial) != 0) {
+            failed = 1;
+            break;
+        }
+    }
+
+    /* end() frees the state, so it runs even when the output is dropped */
+    macro->end(state, result);
+    if (failed || status < 0) {
+        macro_result_set(result, "Error reading or processing trials");
+    }
+    return 0;
+}
@@ -0,0 +1,28 @@
+/*
+ * plugin.h - Loading plugin macros (see presto_plugin.h for the ABI)
+ */
+
+#ifndef PLUGIN_H
+#define PLUGIN_H
+
+#include "macros.h"
+
+/* Load every *.so in dir, in name order. A plugin that fails to load is
+ * reported and skipped. Returns the number of macros added, -1 if dir
+ * cannot be read. */
+int plugin_load_dir(const char *dir);
+
+/* Unload all plugins */
+void plugin_unload_all(void);
+
+/* Number of plugin macros loaded */
+int plugin_count(void);
+
+/* Macro id, name and description of the i-th plugin macro (0 on
+ * success, -1 if out of range) */
+int plugin_info(int i, int *id, const char **name, const char **description);
+
+/* Run plugin macro macro_id. Returns -1 if no plugin has that id. */
+int run_plugin_macro(int macro_id, ml_trial_file_t *file, macro_result_t *result);
+
+#endif /* PLUGIN_H */
@@ -0,0 +1,84 @@
+/*
+ * presto_plugin.h - Plugin ABI for text macros
+ *
+ * A plugin is a shared object that adds text macros without rebuilding
+ * presto. presto loads every *.so in the plugin directory (--plugins <dir>
+ * or $PRESTO_PLUGIN_DIR) and numbers plugin macros from -o100 up, in file
+ * name order; presto -M lists them.
+ *
+ * A plugin exports one function:
+ *
+ *   const presto_macro_t* presto_plugin_macros(int abi);
+ *
+ * returning its macros as an array ended by an entry with a NULL name, or
+ * NULL if it was not built for this abi (PRESTO_PLUGIN_ABI). Each macro
+ * declares the trial fields it needs as projection paths, the same dotted
+ * paths as set_data_fields(); presto decodes only those, once per trial,
+ * and calls the macro's trial() with them. Plugins call presto through the
+ * presto_api_t table, so they link against nothing:
+ *
+ *   gcc -shared -fPIC -Ipath/to/presto/src -o my_macros.so my_macros.c
+ *
+ * See tests/plugin_example.c.
+ */
+
+#ifndef PRESTO_PLUGIN_H
+#define PRESTO_PLUGIN_H
+
+#include <stdint.h>
+#include "bhv2.h"
+#include "macros.h"
+
+#define PRESTO_PLUGIN_ABI 1
+
+/* First macro number given to plugin macros */
+#define PRESTO_PLUGIN_FIRST_ID 100
+
+/* One kept trial */
+typedef struct {
+    int trial;
+    int condition;
+    int error;
+    int block;
+    bhv2_value_t *data;     /* Trial struct holding the declared fields (may be NULL) */
+} presto_trial_t;
+
+/* presto functions available to plugins */
+typedef struct {
+    int abi;
+
+    /* Values (see bhv2.h) */
+    bhv2_value_t* (*struct_get)(bhv2_value_t *value, const char *field, uint64_t index);
+    bhv2_value_t* (*cell_get)(bhv2_value_t *value, uint64_t index);
+    double (*get_double)(bhv2_value_t *value, uint64_t index);
+    const char* (*get_string)(bhv2_value_t *value);
+
+    /* Output (see macros.h) */
+    void (*append)(macro_result_t *result, const char *text);
+    void (*appendf)(macro_result_t *result, const char *fmt, ...);
+    void (*append_fixed)(macro_result_t *result, double value, int decimals);
+    void (*append_int)(macro_result_t *result, int64_t value);
+} presto_api_t;
+
+typedef struct {
+    const char *name;
+    const char *description;
+    const char **fields;    /* NULL-terminated projection paths (NULL for metadata only) */
+
+    /* Start a file: set *state (may stay NULL). Required: api is only
+     * handed out here, so keep it in the state for trial() and end().
+     * Nonzero aborts the macro. */
+    int (*begin)(void **state, const presto_api_t *api);
+
+    /* Each kept trial in file order. Nonzero is an error: reading stops,
+     * and after end() the output is replaced by an error message. */
+    int (*trial)(void *state, const presto_trial_t *trial);
+
+    /* Write the output and free the state. Called once begin() succeeded. */
+    void (*end)(void *state, macro_result_t *result);
+} presto_macro_t;
+
+/* The function a plugin exports */
+typedef const presto_macro_t* (*presto_plugin_macros_fn)(int abi);
+
+#endif /* PRESTO_PLUGIN_H */
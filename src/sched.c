@@ -0,0 +1,349 @@
+/*
+ * sched.c - Work-stealing task scheduler
+ *
+ * Each deque is a ring buffer under its own mutex: tasks are few (files,
+ * trial chunks of a few hundred kilobytes) and each runs for milliseconds,
+ * so a lock per push/pop costs nothing next to the work and keeps the
+ * stealing logic plain. The scheduler lock only guards the task counters
+ * and the idle workers' sleep.
+ */
+
+#define _POSIX_C_SOURCE 200809L  /* For sysconf(_SC_NPROCESSORS_ONLN) */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "sched.h"
+
+#define SCHED_MAX_WORKERS 256
+#define SCHED_INITIAL_DEQUE 16
+
+typedef struct {
+    sched_fn_t fn;
+    void *arg;
+    uint64_t cost;
+    bool leaf;
+} task_t;
+
+/* Tasks from top (oldest, stolen) to bottom (newest, run by the owner) */
+typedef struct {
+    pthread_mutex_t lock;
+    task_t *tasks;
+    size_t head;            /* Ring index of the top task */
+    size_t count;
+    size_t capacity;
+    uint64_t cost;          /* Sum of queued task costs */
+} deque_t;
+
+typedef struct {
+    sched_t *sched;
+    int id;
+} worker_t;
+
+struct sched {
+    int n_workers;
+    pthread_t *threads;
+    worker_t *workers;
+    deque_t *deques;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work;    /* Task queued, or stopping */
+    pthread_cond_t idle;    /* Task finished */
+    size_t queued;          /* Tasks in deques */
+    size_t unfinished;      /* Tasks queued or running */
+    bool stopping;
+};
+
+/* Worker running on this thread (-1 outside any pool) */
+static _Thread_local const sched_t *current_sched = NULL;
+static _Thread_local int current_worker = -1;
+
+/************************************************************/
+/* Deques
+ */
+/************************************************************/
+
+static task_t* deque_at(deque_t *d, size_t i) {
+    return &d->tasks[(d->head + i) % d->capacity];
+}
+
+/* Push to the bottom. Returns 0 on success, -1 on allocation failure. */
+static int deque_push(deque_t *d, const task_t *task) {
+    pthread_mutex_lock(&d->lock);
+    if (d->count == d->capacity) {
+        size_t capacity = d->capacity ? d->capacity * 2 : SCHED_INITIAL_DEQUE;
+        task_t *tasks = malloc(capacity * sizeof(task_t));
+        if (!tasks) {
+            pthread_mutex_unlock(&d->lock);
+            return -1;
+        }
+        for (size_t i = 0; i < d->count; i++) {
+            tasks[i] = *deque_at(d, i);
+        }
+        free(d->tasks);
+        d->tasks = tasks;
+        d->capacity = capacity;
+        d->head = 0;
+    }
+    *deque_at(d, d->count) = *task;
+    d->count++;
+    d->cost += task->cost;
+    pthread_mutex_unlock(&d->lock);
+    return 0;
+}
+
+/* Remove the i-th task from the top, closing the gap */
+static void deque_remove(deque_t *d, size_t i, task_t *task) {
+    *task = *deque_at(d, i);
+    if (i == 0) {
+        d->head = (d->head + 1) % d->capacity;
+    } else {
+        for (size_t j = i; j + 1 < d->count; j++) {
+            *deque_at(d, j) = *deque_at(d, j + 1);
+        }
+    }
+    d->count--;
+    d->cost -= task->cost;
+}
+
+/* Owner's end: the newest task (the newest leaf if leaf_only).
+ * Returns 1 with *task filled, 0 if there is none. */
+static int deque_pop(deque_t *d, bool leaf_only, task_t *task) {
+    int found = 0;
+    pthread_mutex_lock(&d->lock);
+    for (size_t i = d->count; i-- > 0;) {
+        if (!leaf_only || deque_at(d, i)->leaf) {
+            deque_remove(d, i, task);
+            found = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&d->lock);
+    return found;
+}
+
+/* Thief's end: the oldest task (the oldest leaf if leaf_only) */
+static int deque_steal(deque_t *d, bool leaf_only, task_t *task) {
+    int found = 0;
+    pthread_mutex_lock(&d->lock);
+    for (size_t i = 0; i < d->count; i++) {
+        if (!leaf_only || deque_at(d, i)->leaf) {
+            deque_remove(d, i, task);
+            found = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&d->lock);
+    return found;
+}
+
+static uint64_t deque_cost(deque_t *d) {
+    pthread_mutex_lock(&d->lock);
+    uint64_t cost = d->count ? d->cost + 1 : 0;  /* Zero-cost tasks still count */
+    pthread_mutex_unlock(&d->lock);
+    return cost;
+}
+
+/************************************************************/
+/* Taking and running tasks
+ */
+/************************************************************/
+
+/* Own deque first, then steal from the most loaded other deque */
+static int take_task(sched_t *sched, int self, bool leaf_only, task_t *task) {
+    if (self >= 0 && deque_pop(&sched->deques[self], leaf_only, task)) goto taken;
+
+    for (;;) {
+        int victim = -1;
+        uint64_t most = 0;
+        for (int i = 0; i < sched->n_workers; i++) {
+            if (i == self) continue;
+            uint64_t cost = deque_cost(&sched->deques[i]);
+            if (cost > most) {
+                most = cost;
+                victim = i;
+            }
+        }
+        if (victim < 0) return 0;
+        if (deque_steal(&sched->deques[victim], leaf_only, task)) goto taken;
+        if (leaf_only) {
+            /* Victim holds only waiting tasks; look for leaves anywhere */
+            for (int i = 0; i < sched->n_workers; i++) {
+                if (i != self && deque_steal(&sched->deques[i], true, task)) goto taken;
+            }
+            return 0;
+        }
+        /* Emptied under us; look again */
+    }
+
+taken:
+    pthread_mutex_lock(&sched->lock);
+    sched->queued--;
+    pthread_mutex_unlock(&sched->lock);
+    return 1;
+}
+
+static void run_task(sched_t *sched, const task_t *task) {
+    task->fn(task->arg);
+    pthread_mutex_lock(&sched->lock);
+    if (--sched->unfinished == 0) pthread_cond_broadcast(&sched->idle);
+    pthread_mutex_unlock(&sched->lock);
+}
+
+static void* worker_main(void *arg) {
+    worker_t *worker = arg;
+    sched_t *sched = worker->sched;
+    current_sched = sched;
+    current_worker = worker->id;
+
+    for (;;) {
+        task_t task;
+        if (take_task(sched, worker->id, false, &task)) {
+            run_task(sched, &task);
+            continue;
+        }
+
+        pthread_mutex_lock(&sched->lock);
+        while (sched->queued == 0 && !sched->stopping) {
+            pthread_cond_wait(&sched->work, &sched->lock);
+        }
+        bool done = sched->queued == 0 && sched->stopping;
+        pthread_mutex_unlock(&sched->lock);
+        if (done) break;
+    }
+    return NULL;
+}
+
+/************************************************************/
+/* Public API
+ */
+/************************************************************/
+
+/* Stop and join the first n_started workers, free everything */
+static void sched_destroy(sched_t *sched, int n_started) {
+    pthread_mutex_lock(&sched->lock);
+    sched->stopping = true;
+    pthread_cond_broadcast(&sched->work);
+    pthread_mutex_unlock(&sched->lock);
+
+    for (int i = 0; i < n_started; i++) {
+        pthread_join(sched->threads[i], NULL);
+    }
+    for (int i = 0; i < sched->n_workers; i++) {
+        free(sched->deques[i].tasks);
+        pthread_mutex_destroy(&sched->deques[i].lock);
+    }
+    pthread_cond_destroy(&sched->idle);
+    pthread_cond_destroy(&sched->work);
+    pthread_mutex_destroy(&sched->lock);
+    free(sched->threads);
+    free(sched->workers);
+    free(sched->deques);
+    free(sched);
+}
+
+sched_t* sched_new(int n_workers) {
+    if (n_workers < 1) {
+        long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_workers = n_cpus > 0 ? (int)n_cpus : 1;
+    }
+    if (n_workers > SCHED_MAX_WORKERS) n_workers = SCHED_MAX_WORKERS;
+
+    sched_t *sched = calloc(1, sizeof(sched_t));
+    if (!sched) return NULL;
+    sched->threads = calloc(n_workers, sizeof(pthread_t));
+    sched->workers = calloc(n_workers, sizeof(worker_t));
+    sched->deques = calloc(n_workers, sizeof(deque_t));
+    if (!sched->threads || !sched->workers || !sched->deques) {
+        free(sched->threads);
+        free(sched->workers);
+        free(sched->deques);
+        free(sched);
+        return NULL;
+    }
+
+    sched->n_workers = n_workers;
+    pthread_mutex_init(&sched->lock, NULL);
+    pthread_cond_init(&sched->work, NULL);
+    pthread_cond_init(&sched->idle, NULL);
+    for (int i = 0; i < n_workers; i++) {
+        pthread_mutex_init(&sched->deques[i].lock, NULL);
+    }
+
+    for (int i = 0; i < n_workers; i++) {
+        sched->workers[i].sched = sched;
+        sched->workers[i].id = i;
+        if (pthread_create(&sched->threads[i], NULL, worker_main, &sched->workers[i]) != 0) {
+            sched_destroy(sched, i);
+            return NULL;
+        }
+    }
+    return sched;
+}
+
+void sched_free(sched_t *sched) {
+    if (!sched) return;
+    sched_wait(sched);
+    sched_destroy(sched, sched->n_workers);
+}
+
+int sched_workers(const sched_t *sched) {
+    return sched ? sched->n_workers : 0;
+}
+
+int sched_submit(sched_t *sched, sched_fn_t fn, void *arg, uint64_t cost, bool leaf) {
+    if (!sched || !fn) return -1;
+
+    int target = current_sched == sched ? current_worker : -1;
+    if (target < 0) {
+        uint64_t least = UINT64_MAX;
+        for (int i = 0; i < sched->n_workers; i++) {
+            uint64_t queued = deque_cost(&sched->deques[i]);
+            if (queued < least) {
+                least = queued;
+                target = i;
+            }
+        }
+    }
+
+    /* Count the task before it can be taken, so queued never underflows */
+    pthread_mutex_lock(&sched->lock);
+    sched->queued++;
+    sched->unfinished++;
+    pthread_mutex_unlock(&sched->lock);
+
+    task_t task = { fn, arg, cost, leaf };
+    if (deque_push(&sched->deques[target], &task) != 0) {
+        pthread_mutex_lock(&sched->lock);
+        sched->queued--;
+        if (--sched->unfinished == 0) pthread_cond_broadcast(&sched->idle);
+        pthread_mutex_unlock(&sched->lock);
+        return -1;
+    }
+
+    pthread_mutex_lock(&sched->lock);
+    pthread_cond_signal(&sched->work);
+    pthread_mutex_unlock(&sched->lock);
+    return 0;
+}
+
+int sched_help(sched_t *sched) {
+    if (!sched) return 0;
+
+    int self = current_sched == sched ? current_worker : -1;
+    task_t task;
+    if (!take_task(sched, self, true, &task)) return 0;
+    run_task(sched, &task);
+    return 1;
+}
+
+void sched_wait(sched_t *sched) {
+    if (!sched) return;
+
+    pthread_mutex_lock(&sched->lock);
+    while (sched->unfinished > 0) {
+        pthread_cond_wait(&sched->idle, &sched->lock);
+    }
+    pthread_mutex_unlock(&sched->lock);
+}
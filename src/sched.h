@@ -0,0 +1,48 @@
+/*
+ * sched.h - Work-stealing task scheduler
+ *
+ * A fixed pool of worker threads, each with its own deque of tasks. A
+ * worker runs tasks from the bottom of its own deque (newest first) and,
+ * when that is empty, steals from the top (oldest) of the deque holding
+ * the most queued work. Every task carries a cost estimate (bytes to
+ * decode, for instance): tasks submitted from outside the pool go to the
+ * least loaded deque, tasks submitted by a worker go to its own.
+ *
+ * Tasks that wait on other tasks must not block a worker idle, or a pool
+ * whose workers all wait would stop. Such tasks call sched_help() while
+ * waiting: it runs one queued leaf task (a task that never waits), so a
+ * file's trial chunks keep being decoded by whoever waits for them.
+ */
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct sched sched_t;
+
+typedef void (*sched_fn_t)(void *arg);
+
+/* Start n_workers threads (n_workers < 1: one per online CPU).
+ * Returns NULL on failure. */
+sched_t* sched_new(int n_workers);
+
+/* Wait for all tasks, stop the workers and free the scheduler */
+void sched_free(sched_t *sched);
+
+/* Number of worker threads */
+int sched_workers(const sched_t *sched);
+
+/* Queue fn(arg). leaf: fn never waits for other tasks (see sched_help()).
+ * Returns 0 on success, -1 on allocation failure (fn is not run). */
+int sched_submit(sched_t *sched, sched_fn_t fn, void *arg, uint64_t cost, bool leaf);
+
+/* Run one queued leaf task on the calling thread.
+ * Returns 1 if one ran, 0 if there was none. */
+int sched_help(sched_t *sched);
+
+/* Block until every submitted task has finished */
+void sched_wait(sched_t *sched);
+
+#endif /* SCHED_H */
@@ -0,0 +1,506 @@
+/*
+ * stats.c - Mergeable streaming statistics
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "stats.h"
+
+static int compare_double(const void *a, const void *b) {
+    double da = *(const double*)a, db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+/************************************************************/
+/* Moments
+ */
+/************************************************************/
+
+void stats_moments_add(stats_moments_t *m, double x) {
+    if (!isfinite(x)) return;
+    m->n++;
+    if (m->n == 1) {
+        m->mean = x;
+        m->m2 = 0.0;
+        m->min = m->max = x;
+        return;
+    }
+    double d = x - m->mean;
+    m->mean += d / (double)m->n;
+    m->m2 += d * (x - m->mean);
+    if (x < m->min) m->min = x;
+    if (x > m->max) m->max = x;
+}
+
+void stats_moments_merge(stats_moments_t *m, const stats_moments_t *later) {
+    if (later->n == 0) return;
+    if (m->n == 0) {
+        *m = *later;
+        return;
+    }
+    double na = (double)m->n, nb = (double)later->n, n = na + nb;
+    double d = later->mean - m->mean;
+    m->mean += d * nb / n;
+    m->m2 += later->m2 + d * d * na * nb / n;
+    m->n += later->n;
+    if (later->min < m->min) m->min = later->min;
+    if (later->max > m->max) m->max = later->max;
+}
+
+double stats_moments_variance(const stats_moments_t *m) {
+    return m->n > 1 ? m->m2 / (double)(m->n - 1) : NAN;
+}
+
+double stats_moments_sd(const stats_moments_t *m) {
+    return sqrt(stats_moments_variance(m));
+}
+
+int stats_moments_save(const stats_moments_t *m, FILE *fp) {
+    return fwrite(m, sizeof(*m), 1, fp) == 1 ? 0 : -1;
+}
+
+int stats_moments_load(stats_moments_t *m, FILE *fp) {
+    return fread(m, sizeof(*m), 1, fp) == 1 ? 0 : -1;
+}
+
+/************************************************************/
+/* Fixed-width histogram
+ */
+/************************************************************/
+
+stats_hist_t* stats_hist_new(double lo, double hi, size_t n_bins) {
+    if (!(isfinite(lo) && isfinite(hi) && hi > lo) || n_bins == 0) return NULL;
+    stats_hist_t *h = calloc(1, sizeof(stats_hist_t));
+    if (!h) return NULL;
+    h->counts = calloc(n_bins, sizeof(uint64_t));
+    if (!h->counts) {
+        free(h);
+        return NULL;
+    }
+    h->lo = lo;
+    h->hi = hi;
+    h->n_bins = n_bins;
+    return h;
+}
+
+void stats_hist_free(stats_hist_t *h) {
+    if (!h) return;
+    free(h->counts);
+    free(h);
+}
+
+void stats_hist_add(stats_hist_t *h, double x) {
+    if (!isfinite(x)) {
+        h->nonfinite++;
+    } else if (x < h->lo) {
+        h->below++;
+    } else if (x >= h->hi) {
+        h->above++;
+    } else {
+        /* Multiply first so integer bin edges land exactly */
+        size_t b = (size_t)((x - h->lo) * (double)h->n_bins / (h->hi - h->lo));
+        h->counts[b < h->n_bins ? b : h->n_bins - 1]++;
+    }
+}
+
+int stats_hist_merge(stats_hist_t *h, const stats_hist_t *later) {
+    if (h->lo != later->lo || h->hi != later->hi || h->n_bins != later->n_bins) return -1;
+    for (size_t b = 0; b < h->n_bins; b++) h->counts[b] += later->counts[b];
+    h->below += later->below;
+    h->above += later->above;
+    h->nonfinite += later->nonfinite;
+    return 0;
+}
+
+uint64_t stats_hist_total(const stats_hist_t *h) {
+    uint64_t total = h->below + h->above + h->nonfinite;
+    for (size_t b = 0; b < h->n_bins; b++) total += h->counts[b];
+    return total;
+}
+
+int stats_hist_save(const stats_hist_t *h, FILE *fp) {
+    double range[2] = { h->lo, h->hi };
+    uint64_t header[4] = { h->n_bins, h->below, h->above, h->nonfinite };
+    if (fwrite(range, sizeof(range), 1, fp) != 1 || fwrite(header, sizeof(header), 1, fp) != 1
+        || fwrite(h->counts, sizeof(uint64_t), h->n_bins, fp) != h->n_bins) {
+        return -1;
+    }
+    return 0;
+}
+
+stats_hist_t* stats_hist_load(FILE *fp) {
+    double range[2];
+    uint64_t header[4];
+    if (fread(range, sizeof(range), 1, fp) != 1 || fread(header, sizeof(header), 1, fp) != 1
+        || header[0] > SIZE_MAX / sizeof(uint64_t)) {
+        return NULL;
+    }
+    stats_hist_t *h = stats_hist_new(range[0], range[1], (size_t)header[0]);
+    if (!h) return NULL;
+    if (fread(h->counts, sizeof(uint64_t), h->n_bins, fp) != h->n_bins) {
+        stats_hist_free(h);
+        return NULL;
+    }
+    h->below = header[1];
+    h->above = header[2];
+    h->nonfinite = header[3];
+    return h;
+}
+
+/************************************************************/
+/* Log-bucketed histogram
+ */
+/************************************************************/
+
+#define LOGHIST_MAX_BUCKETS ((size_t)1 << 24)   /* Load sanity limit */
+
+static int64_t floor_div(int64_t a, int64_t b) {
+    int64_t q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+/* Bucket of a finite x > 0 */
+static int64_t loghist_index(int sub, double x) {
+    int e;
+    double m = frexp(x, &e);    /* m in [0.5, 1) */
+    int s = (int)((2.0 * m - 1.0) * sub);
+    if (s >= sub) s = sub - 1;
+    return (int64_t)e * sub + s;
+}
+
+/* Middle of bucket i */
+static double loghist_middle(int sub, int64_t i) {
+    int64_t e = floor_div(i, sub);
+    double s = (double)(i - e * sub);
+    double lo = ldexp(1.0 + s / sub, (int)(e - 1));
+    double hi = ldexp(1.0 + (s + 1.0) / sub, (int)(e - 1));
+    return lo + 0.5 * (hi - lo);
+}
+
+stats_loghist_t* stats_loghist_new(int sub) {
+    if (sub < 0) return NULL;
+    stats_loghist_t *h = calloc(1, sizeof(stats_loghist_t));
+    if (h) h->sub = sub > 0 ? sub : STATS_LOGHIST_DEFAULT_SUB;
+    return h;
+}
+
+void stats_loghist_free(stats_loghist_t *h) {
+    if (!h) return;
+    free(h->counts);
+    free(h);
+}
+
+/* Make counts cover buckets lo..hi, with room to spare on the side that
+ * grows so a drifting range does not copy every time */
+static int loghist_cover(stats_loghist_t *h, int64_t lo, int64_t hi) {
+    if (h->n_buckets > 0) {
+        int64_t last = h->first + (int64_t)h->n_buckets - 1;
+        if (lo >= h->first && hi <= last) return 0;
+        int64_t slack = (int64_t)(h->n_buckets / 2);
+        lo = lo < h->first ? lo - slack : h->first;
+        hi = hi > last ? hi + slack : last;
+    }
+    size_t n = (size_t)(hi - lo + 1);
+    uint64_t *counts = calloc(n, sizeof(uint64_t));
+    if (!counts) return -1;
+    if (h->n_buckets > 0) {
+        memcpy(counts + (h->first - lo), h->counts, h->n_buckets * sizeof(uint64_t));
+    }
+    free(h->counts);
+    h->counts = counts;
+    h->first = lo;
+    h->n_buckets = n;
+    return 0;
+}
+
+int stats_loghist_add(stats_loghist_t *h, double x) {
+    if (!isfinite(x)) {
+        h->nonfinite++;
+        return 0;
+    }
+    if (x <= 0.0) {
+        h->nonpositive++;
+    } else {
+        int64_t i = loghist_index(h->sub, x);
+        if (loghist_cover(h, i, i) != 0) return -1;
+        h->counts[i - h->first]++;
+    }
+    h->n++;
+    return 0;
+}
+
+int stats_loghist_merge(stats_loghist_t *h, const stats_loghist_t *later) {
+    if (h->sub != later->sub) return -1;
+    if (later->n_buckets > 0) {
+        if (loghist_cover(h, later->first, later->first + (int64_t)later->n_buckets - 1) != 0) return -1;
+        uint64_t *dst = h->counts + (later->first - h->first);
+        for (size_t i = 0; i < later->n_buckets; i++) dst[i] += later->counts[i];
+    }
+    h->nonpositive += later->nonpositive;
+    h->nonfinite += later->nonfinite;
+    h->n += later->n;
+    return 0;
+}
+
+double stats_loghist_quantile(const stats_loghist_t *h, double q) {
+    if (h->n == 0) return NAN;
+    q = q < 0.0 ? 0.0 : q > 1.0 ? 1.0 : q;
+    uint64_t rank = (uint64_t)llround(q * (double)(h->n - 1));
+    if (rank < h->nonpositive) return 0.0;
+    uint64_t seen = h->nonpositive;
+    for (size_t i = 0; i < h->n_buckets; i++) {
+        seen += h->counts[i];
+        if (rank < seen) return loghist_middle(h->sub, h->first + (int64_t)i);
+    }
+    return NAN;     /* Unreachable while counts add up to n */
+}
+
+int stats_loghist_save(const stats_loghist_t *h, FILE *fp) {
+    int64_t header[6] = { h->sub, h->first, (int64_t)h->n_buckets,
+                          (int64_t)h->nonpositive, (int64_t)h->nonfinite, (int64_t)h->n };
+    if (fwrite(header, sizeof(header), 1, fp) != 1
+        || (h->n_buckets > 0 && fwrite(h->counts, sizeof(uint64_t), h->n_buckets, fp) != h->n_buckets)) {
+        return -1;
+    }
+    return 0;
+}
+
+stats_loghist_t* stats_loghist_load(FILE *fp) {
+    int64_t header[6];
+    if (fread(header, sizeof(header), 1, fp) != 1 || header[0] <= 0 || header[0] > INT32_MAX
+        || header[2] < 0 || (uint64_t)header[2] > LOGHIST_MAX_BUCKETS) {
+        return NULL;
+    }
+    stats_loghist_t *h = stats_loghist_new((int)header[0]);
+    if (!h) return NULL;
+    if (header[2] > 0) {
+        if (loghist_cover(h, header[1], header[1] + header[2] - 1) != 0
+            || fread(h->counts, sizeof(uint64_t), h->n_buckets, fp) != h->n_buckets) {
+            stats_loghist_free(h);
+            return NULL;
+        }
+    }
+    h->nonpositive = (uint64_t)header[3];
+    h->nonfinite = (uint64_t)header[4];
+    h->n = (uint64_t)header[5];
+    return h;
+}
+
+/************************************************************/
+/* Quantile sketch (Karnin, Lang and Liberty, 2016)
+ */
+/************************************************************/
+
+#define KLL_MIN_CAPACITY 8      /* Smallest level, however deep */
+#define KLL_MAX_LEVELS 64       /* Weights are 2^level */
+
+typedef struct {
+    double *items;
+    size_t count;
+    size_t capacity;
+} kll_level_t;
+
+struct stats_quantiles {
+    size_t k;
+    uint64_t n;
+    double min, max;
+    kll_level_t *levels;    /* Level h items stand for 2^h values each */
+    size_t n_levels;
+    unsigned flip;          /* Alternates which half of a level survives */
+};
+
+/* Levels shrink by 2/3 going down from the top one, which holds k */
+static size_t level_capacity(const stats_quantiles_t *qs, size_t h) {
+    double cap = (double)qs->k;
+    for (size_t d = h + 1; d < qs->n_levels; d++) cap *= 2.0 / 3.0;
+    return cap < KLL_MIN_CAPACITY ? KLL_MIN_CAPACITY : (size_t)cap;
+}
+
+static int level_push(kll_level_t *level, double x) {
+    if (level->count == level->capacity) {
+        size_t capacity = level->capacity ? level->capacity * 2 : 16;
+        double *items = realloc(level->items, capacity * sizeof(double));
+        if (!items) return -1;
+        level->items = items;
+        level->capacity = capacity;
+    }
+    level->items[level->count++] = x;
+    return 0;
+}
+
+static int add_level(stats_quantiles_t *qs) {
+    if (qs->n_levels == KLL_MAX_LEVELS) return -1;
+    kll_level_t *levels = realloc(qs->levels, (qs->n_levels + 1) * sizeof(kll_level_t));
+    if (!levels) return -1;
+    memset(&levels[qs->n_levels], 0, sizeof(kll_level_t));
+    qs->levels = levels;
+    qs->n_levels++;
+    return 0;
+}
+
+/* Halve the lowest full level into the next one until the sketch fits */
+static int compress(stats_quantiles_t *qs) {
+    for (;;) {
+        size_t retained = 0, capacity = 0, h = qs->n_levels;
+        for (size_t i = 0; i < qs->n_levels; i++) {
+            size_t cap = level_capacity(qs, i);
+            retained += qs->levels[i].count;
+            capacity += cap;
+            if (h == qs->n_levels && qs->levels[i].count >= cap) h = i;
+        }
+        if (retained <= capacity) return 0;
+
+        if (h + 1 == qs->n_levels && add_level(qs) != 0) return -1;
+        kll_level_t *level = &qs->levels[h];
+        qsort(level->items, level->count, sizeof(double), compare_double);
+
+        /* An odd level keeps its smallest item; of each following pair
+         * one survives, the same side across the whole level */
+        size_t keep = level->count % 2;
+        qs->flip ^= 1;
+        for (size_t i = keep + qs->flip; i < level->count; i += 2) {
+            if (level_push(&qs->levels[h + 1], level->items[i]) != 0) return -1;
+        }
+        level->count = keep;
+    }
+}
+
+stats_quantiles_t* stats_quantiles_new(size_t k) {
+    stats_quantiles_t *qs = calloc(1, sizeof(stats_quantiles_t));
+    if (!qs) return NULL;
+    qs->k = k > 0 ? k : STATS_QUANTILES_DEFAULT_K;
+    if (qs->k < KLL_MIN_CAPACITY) qs->k = KLL_MIN_CAPACITY;
+    if (add_level(qs) != 0) {
+        free(qs);
+        return NULL;
+    }
+    return qs;
+}
+
+void stats_quantiles_free(stats_quantiles_t *qs) {
+    if (!qs) return;
+    for (size_t i = 0; i < qs->n_levels; i++) free(qs->levels[i].items);
+    free(qs->levels);
+    free(qs);
+}
+
+int stats_quantiles_add(stats_quantiles_t *qs, double x) {
+    if (!isfinite(x)) return 0;
+    if (level_push(&qs->levels[0], x) != 0) return -1;
+    if (qs->n == 0 || x < qs->min) qs->min = x;
+    if (qs->n == 0 || x > qs->max) qs->max = x;
+    qs->n++;
+    return compress(qs);
+}
+
+int stats_quantiles_merge(stats_quantiles_t *qs, const stats_quantiles_t *later) {
+    if (qs->k != later->k) return -1;
+    if (later->n == 0) return 0;
+    for (size_t h = 0; h < later->n_levels; h++) {
+        if (h == qs->n_levels && add_level(qs) != 0) return -1;
+        const kll_level_t *from = &later->levels[h];
+        for (size_t i = 0; i < from->count; i++) {
+            if (level_push(&qs->levels[h], from->items[i]) != 0) return -1;
+        }
+    }
+    if (qs->n == 0 || later->min < qs->min) qs->min = later->min;
+    if (qs->n == 0 || later->max > qs->max) qs->max = later->max;
+    qs->n += later->n;
+    return compress(qs);
+}
+
+uint64_t stats_quantiles_count(const stats_quantiles_t *qs) {
+    return qs->n;
+}
+
+typedef struct {
+    double value;
+    uint64_t weight;
+} weighted_t;
+
+static int compare_weighted(const void *a, const void *b) {
+    return compare_double(&((const weighted_t*)a)->value, &((const weighted_t*)b)->value);
+}
+
+double stats_quantiles_get(const stats_quantiles_t *qs, double q) {
+    if (qs->n == 0) return NAN;
+    if (q <= 0.0) return qs->min;
+    if (q >= 1.0) return qs->max;
+
+    size_t m = 0;
+    for (size_t h = 0; h < qs->n_levels; h++) m += qs->levels[h].count;
+    weighted_t *items = malloc(m * sizeof(weighted_t));
+    if (!items) return NAN;
+    size_t j = 0;
+    uint64_t total = 0;
+    for (size_t h = 0; h < qs->n_levels; h++) {
+        for (size_t i = 0; i < qs->levels[h].count; i++) {
+            items[j].value = qs->levels[h].items[i];
+            items[j++].weight = (uint64_t)1 << h;
+        }
+        total += qs->levels[h].count << h;
+    }
+    qsort(items, m, sizeof(weighted_t), compare_weighted);
+
+    /* Order statistics at ranks floor(p) and floor(p) + 1 */
+    double p = q * (double)(total - 1);
+    uint64_t r = (uint64_t)p;
+    double frac = p - (double)r;
+    double a = NAN, b = NAN;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < m && isnan(b); i++) {
+        seen += items[i].weight;
+        if (isnan(a) && r < seen) a = items[i].value;
+        if (r + 1 < seen) b = items[i].value;
+    }
+    free(items);
+    if (isnan(b)) b = a;    /* r was the last rank */
+    return a + frac * (b - a);
+}
+
+int stats_quantiles_save(const stats_quantiles_t *qs, FILE *fp) {
+    uint64_t header[4] = { qs->k, qs->n, qs->n_levels, qs->flip };
+    double range[2] = { qs->min, qs->max };
+    if (fwrite(header, sizeof(header), 1, fp) != 1 || fwrite(range, sizeof(range), 1, fp) != 1) return -1;
+    for (size_t h = 0; h < qs->n_levels; h++) {
+        uint64_t count = qs->levels[h].count;
+        if (fwrite(&count, sizeof(count), 1, fp) != 1
+            || (count > 0 && fwrite(qs->levels[h].items, sizeof(double), count, fp) != count)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+stats_quantiles_t* stats_quantiles_load(FILE *fp) {
+    uint64_t header[4];
+    double range[2];
+    if (fread(header, sizeof(header), 1, fp) != 1 || fread(range, sizeof(range), 1, fp) != 1
+        || header[0] == 0 || header[0] > SIZE_MAX / 8 || header[2] == 0 || header[2] > KLL_MAX_LEVELS) {
+        return NULL;
+    }
+    stats_quantiles_t *qs = stats_quantiles_new((size_t)header[0]);
+    if (!qs) return NULL;
+    qs->n = header[1];
+    qs->flip = (unsigned)(header[3] & 1);
+    qs->min = range[0];
+    qs->max = range[1];
+    for (uint64_t h = 0; h < header[2]; h++) {
+        uint64_t count;
+        if ((h > 0 && add_level(qs) != 0) || fread(&count, sizeof(count), 1, fp) != 1
+            || count > 4 * qs->k + KLL_MAX_LEVELS * KLL_MIN_CAPACITY) {
+            stats_quantiles_free(qs);
+            return NULL;
+        }
+        kll_level_t *level = &qs->levels[h];
+        level->items = malloc((count > 0 ? count : 1) * sizeof(double));
+        if (!level->items || fread(level->items, sizeof(double), count, fp) != count) {
+            stats_quantiles_free(qs);
+            return NULL;
+        }
+        level->capacity = count > 0 ? count : 1;
+        level->count = count;
+    }
+    return qs;
+}
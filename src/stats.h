@@ -0,0 +1,151 @@
+/*
+ * stats.h - Mergeable streaming statistics
+ *
+ * Estimators a macro can feed one value at a time and keep per trial
+ * kernel accumulator (see trial_kernel_t): each has a merge that folds in
+ * an estimator built over later trials, and save/load for checkpoints
+ * (raw fields, read back on the same machine and build). Memory does not
+ * grow with the number of values except in the quantile sketch, which
+ * stays bounded.
+ *
+ * NaN/Inf values are not part of any estimate; histograms count them
+ * separately. Floating-point merges are not associative, so means and
+ * variances can differ in the last bits with the -j chunking.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/************************************************************/
+/* Moments: count, mean, variance, min, max
+ */
+/************************************************************/
+
+/* Zero-initialized is empty */
+typedef struct {
+    uint64_t n;
+    double mean;
+    double m2;              /* Sum of squared deviations from the mean */
+    double min, max;
+} stats_moments_t;
+
+/* Add a value (Welford's update) */
+void stats_moments_add(stats_moments_t *m, double x);
+
+/* Fold in the moments of other values (Chan et al.'s pairwise update) */
+void stats_moments_merge(stats_moments_t *m, const stats_moments_t *later);
+
+/* Sample variance (n - 1 denominator) and standard deviation, NaN for
+ * fewer than two values */
+double stats_moments_variance(const stats_moments_t *m);
+double stats_moments_sd(const stats_moments_t *m);
+
+int stats_moments_save(const stats_moments_t *m, FILE *fp);
+int stats_moments_load(stats_moments_t *m, FILE *fp);
+
+/************************************************************/
+/* Fixed-width histogram
+ */
+/************************************************************/
+
+/* n_bins equal bins over [lo, hi), plus counts below and above */
+typedef struct {
+    double lo, hi;
+    size_t n_bins;
+    uint64_t *counts;
+    uint64_t below, above;
+    uint64_t nonfinite;
+} stats_hist_t;
+
+/* NULL on error or an empty range */
+stats_hist_t* stats_hist_new(double lo, double hi, size_t n_bins);
+void stats_hist_free(stats_hist_t *h);
+
+void stats_hist_add(stats_hist_t *h, double x);
+
+/* Returns -1 if the bins differ */
+int stats_hist_merge(stats_hist_t *h, const stats_hist_t *later);
+
+/* Values added, including those outside the bins and NaN/Inf */
+uint64_t stats_hist_total(const stats_hist_t *h);
+
+int stats_hist_save(const stats_hist_t *h, FILE *fp);
+stats_hist_t* stats_hist_load(FILE *fp);
+
+/************************************************************/
+/* Log-bucketed histogram
+ */
+/************************************************************/
+
+/* Each power of two split into sub equal buckets, so a bucket's width is
+ * at most 1 / sub of its values: relative resolution over any range.
+ * Buckets are allocated as values arrive. */
+typedef struct {
+    int sub;
+    int64_t first;          /* Index of counts[0] */
+    size_t n_buckets;
+    uint64_t *counts;
+    uint64_t nonpositive;   /* Values <= 0 */
+    uint64_t nonfinite;
+    uint64_t n;             /* Finite values */
+} stats_loghist_t;
+
+#define STATS_LOGHIST_DEFAULT_SUB 16    /* About 6% resolution */
+
+/* sub of 0 takes the default; NULL on error */
+stats_loghist_t* stats_loghist_new(int sub);
+void stats_loghist_free(stats_loghist_t *h);
+
+/* Returns -1 if out of memory (the value is not counted) */
+int stats_loghist_add(stats_loghist_t *h, double x);
+
+/* Returns -1 if the buckets differ or out of memory */
+int stats_loghist_merge(stats_loghist_t *h, const stats_loghist_t *later);
+
+/* Value at quantile q in [0, 1]: the middle of the bucket holding that
+ * rank (0 for a rank among values <= 0), NaN if empty */
+double stats_loghist_quantile(const stats_loghist_t *h, double q);
+
+int stats_loghist_save(const stats_loghist_t *h, FILE *fp);
+stats_loghist_t* stats_loghist_load(FILE *fp);
+
+/************************************************************/
+/* Quantile sketch
+ */
+/************************************************************/
+
+/* KLL sketch: values are kept exactly up to k of them, then sorted
+ * levels are halved into the level above (each survivor standing for
+ * twice as many values). Rank error is about 1.7 / k of the count for
+ * any quantile, in O(k) memory. */
+typedef struct stats_quantiles stats_quantiles_t;
+
+#define STATS_QUANTILES_DEFAULT_K 2048  /* Exact for up to 2048 values */
+
+/* k of 0 takes the default; NULL on error */
+stats_quantiles_t* stats_quantiles_new(size_t k);
+void stats_quantiles_free(stats_quantiles_t *qs);
+
+/* Returns -1 if out of memory */
+int stats_quantiles_add(stats_quantiles_t *qs, double x);
+
+/* Returns -1 if k differs or out of memory */
+int stats_quantiles_merge(stats_quantiles_t *qs, const stats_quantiles_t *later);
+
+/* Finite values added */
+uint64_t stats_quantiles_count(const stats_quantiles_t *qs);
+
+/* Value at quantile q in [0, 1], interpolated between order statistics
+ * like numpy's default (so q = 0.5 of an even count is the mean of the
+ * middle two). Exact while no level has been halved. NaN if empty or out
+ * of memory. */
+double stats_quantiles_get(const stats_quantiles_t *qs, double q);
+
+int stats_quantiles_save(const stats_quantiles_t *qs, FILE *fp);
+stats_quantiles_t* stats_quantiles_load(FILE *fp);
+
+#endif /* STATS_H */
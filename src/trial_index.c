@@ -0,0 +1,229 @@
+/*
+ * trial_index.c - Sidecar trial index for BHV2 files
+ */
+
+#define _POSIX_C_SOURCE 200809L  /* For strdup, st_mtim */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+#include "trial_index.h"
+
+#define TRIAL_INDEX_VERSION 1
+#define TRIAL_INDEX_SUFFIX ".pidx"
+
+const char *trial_index_fields[] = {
+    "AbsoluteTrialStartTime", "BehavioralCodes.CodeTimes", NULL
+};
+
+/* What the index remembers about its data file */
+typedef struct {
+    uint64_t size;
+    int64_t mtime[2];       /* Seconds, nanoseconds */
+} source_stamp_t;
+
+static int source_stamp(const char *data_path, source_stamp_t *stamp) {
+    struct stat st;
+    if (stat(data_path, &st) != 0) return -1;
+    stamp->size = (uint64_t)st.st_size;
+    stamp->mtime[0] = (int64_t)st.st_mtim.tv_sec;
+    stamp->mtime[1] = (int64_t)st.st_mtim.tv_nsec;
+    return 0;
+}
+
+/************************************************************/
+/* Building
+ */
+/************************************************************/
+
+char* trial_index_path(const char *data_path) {
+    size_t len = strlen(data_path);
+    char *path = malloc(len + sizeof(TRIAL_INDEX_SUFFIX));
+    if (!path) return NULL;
+    memcpy(path, data_path, len);
+    memcpy(path + len, TRIAL_INDEX_SUFFIX, sizeof(TRIAL_INDEX_SUFFIX));
+    return path;
+}
+
+trial_index_t* trial_index_new(void) {
+    return calloc(1, sizeof(trial_index_t));
+}
+
+void trial_index_free(trial_index_t *index) {
+    if (!index) return;
+    free(index->entries);
+    free(index);
+}
+
+static int reserve(trial_index_t *index, size_t n) {
+    if (n <= index->capacity) return 0;
+    size_t new_cap = index->capacity == 0 ? 256 : index->capacity;
+    while (new_cap < n) new_cap *= 2;
+    trial_index_entry_t *grown = realloc(index->entries, new_cap * sizeof(trial_index_entry_t));
+    if (!grown) return -1;
+    index->entries = grown;
+    index->capacity = new_cap;
+    return 0;
+}
+
+int trial_index_append(trial_index_t *index, ml_trial_file_t *file) {
+    if (reserve(index, index->count + 1) != 0) return -1;
+
+    trial_index_entry_t *e = &index->entries[index->count++];
+    e->trial_num = trial_number(file);
+    e->error_code = trial_error(file);
+    e->condition = trial_condition(file);
+    e->block = trial_block(file);
+    e->offset = (uint64_t)file->current_offset;
+
+    bhv2_value_t *data = trial_data(file);
+    bhv2_value_t *start = bhv2_struct_get(data, "AbsoluteTrialStartTime", 0);
+    e->start_time = start && start->total > 0 ? bhv2_get_double(start, 0) : NAN;
+
+    bhv2_value_t *codes = bhv2_struct_get(data, "BehavioralCodes", 0);
+    bhv2_value_t *times = codes ? bhv2_struct_get(codes, "CodeTimes", 0) : NULL;
+    e->end_time = times && times->total > 0 ? bhv2_get_double(times, times->total - 1) : NAN;
+    return 0;
+}
+
+trial_index_t* trial_index_build(ml_trial_file_t *file) {
+    if (!file) return NULL;
+
+    trial_index_t *index = trial_index_new();
+    if (!index || set_data_fields(file, trial_index_fields) != 0) {
+        trial_index_free(index);
+        return NULL;
+    }
+
+    /* Every trial goes in, whatever the caller filters on */
+    skip_set_t *skips = file->skips;
+    filter_chain_t *filters = file->filters;
+    file->skips = NULL;
+    file->filters = NULL;
+
+    rewind_input_file(file);
+    int status;
+    while ((status = read_next_trial(file, SELECT_DATA)) > 0) {
+        if (trial_index_append(index, file) != 0) {
+            status = -1;
+            break;
+        }
+    }
+    rewind_input_file(file);
+
+    file->skips = skips;
+    file->filters = filters;
+    set_data_fields(file, NULL);
+
+    if (status < 0) {
+        trial_index_free(index);
+        return NULL;
+    }
+    return index;
+}
+
+/************************************************************/
+/* Sidecar file
+ */
+/************************************************************/
+
+static int write_entry(FILE *fp, const trial_index_entry_t *e) {
+    int32_t ints[4] = { e->trial_num, e->error_code, e->condition, e->block };
+    return fwrite(ints, sizeof(ints), 1, fp) == 1
+        && fwrite(&e->offset, sizeof(e->offset), 1, fp) == 1
+        && fwrite(&e->start_time, sizeof(e->start_time), 1, fp) == 1
+        && fwrite(&e->end_time, sizeof(e->end_time), 1, fp) == 1;
+}
+
+static int read_entry(FILE *fp, trial_index_entry_t *e) {
+    int32_t ints[4];
+    if (fread(ints, sizeof(ints), 1, fp) != 1
+        || fread(&e->offset, sizeof(e->offset), 1, fp) != 1
+        || fread(&e->start_time, sizeof(e->start_time), 1, fp) != 1
+        || fread(&e->end_time, sizeof(e->end_time), 1, fp) != 1) {
+        return 0;
+    }
+    e->trial_num = ints[0];
+    e->error_code = ints[1];
+    e->condition = ints[2];
+    e->block = ints[3];
+    return 1;
+}
+
+int trial_index_save(const trial_index_t *index, const char *data_path) {
+    source_stamp_t stamp;
+    if (!index || source_stamp(data_path, &stamp) != 0) return -1;
+
+    char *path = trial_index_path(data_path);
+    if (!path) return -1;
+
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        fprintf(stderr, "Error: Cannot write %s\n", path);
+        free(path);
+        return -1;
+    }
+
+    uint32_t version = TRIAL_INDEX_VERSION;
+    uint64_t count = index->count;
+    int ok = fwrite("PRTI", 1, 4, fp) == 4
+          && fwrite(&version, sizeof(version), 1, fp) == 1
+          && fwrite(&stamp.size, sizeof(stamp.size), 1, fp) == 1
+          && fwrite(stamp.mtime, sizeof(stamp.mtime), 1, fp) == 1
+          && fwrite(&count, sizeof(count), 1, fp) == 1;
+    for (size_t i = 0; ok && i < index->count; i++) {
+        ok = write_entry(fp, &index->entries[i]);
+    }
+
+    if (fclose(fp) != 0) ok = 0;
+    if (!ok) {
+        fprintf(stderr, "Error: Failed writing %s\n", path);
+        remove(path);
+    }
+    free(path);
+    return ok ? 0 : -1;
+}
+
+trial_index_t* trial_index_load(const char *data_path) {
+    source_stamp_t stamp;
+    if (source_stamp(data_path, &stamp) != 0) return NULL;
+
+    char *path = trial_index_path(data_path);
+    if (!path) return NULL;
+    FILE *fp = fopen(path, "rb");
+    free(path);
+    if (!fp) return NULL;
+
+    char magic[4];
+    uint32_t version;
+    source_stamp_t saved;
+    uint64_t count;
+    int ok = fread(magic, 1, 4, fp) == 4 && memcmp(magic, "PRTI", 4) == 0
+          && fread(&version, sizeof(version), 1, fp) == 1 && version == TRIAL_INDEX_VERSION
+          && fread(&saved.size, sizeof(saved.size), 1, fp) == 1
+          && fread(saved.mtime, sizeof(saved.mtime), 1, fp) == 1
+          && fread(&count, sizeof(count), 1, fp) == 1;
+
+    /* Stale: the data file was rewritten or appended to */
+    ok = ok && saved.size == stamp.size && count <= saved.size
+            && saved.mtime[0] == stamp.mtime[0] && saved.mtime[1] == stamp.mtime[1];
+
+    trial_index_t *index = ok ? trial_index_new() : NULL;
+    if (index && reserve(index, count > 0 ? count : 1) != 0) {
+        trial_index_free(index);
+        index = NULL;
+    }
+    for (uint64_t i = 0; index && i < count; i++) {
+        if (!read_entry(fp, &index->entries[i])) {
+            trial_index_free(index);
+            index = NULL;
+            break;
+        }
+        index->count++;
+    }
+
+    fclose(fp);
+    return index;
+}
@@ -0,0 +1,75 @@
+/*
+ * trial_index.h - Sidecar trial index for BHV2 files
+ *
+ * Answering "when did each trial start, how long did it run, how did it
+ * end" normally means walking the whole file. The sidecar index keeps
+ * that per-trial metadata, plus each trial's file offset, next to the
+ * data file as "<file>.pidx":
+ *
+ *   char[4]  "PRTI"
+ *   uint32   version (1)
+ *   uint64   source file size
+ *   int64    source mtime (seconds, nanoseconds)
+ *   uint64   n_trials
+ *   Then per trial, in file order:
+ *     int32    trial number, TrialError, Condition, Block
+ *     uint64   offset of the "Trial<N>" variable
+ *     double   AbsoluteTrialStartTime (ms)
+ *     double   last BehavioralCodes.CodeTimes entry (ms, NaN if no codes)
+ *
+ * An index is only used while the data file's size and mtime still match.
+ */
+
+#ifndef TRIAL_INDEX_H
+#define TRIAL_INDEX_H
+
+#include <stdint.h>
+#include "ml_trial.h"
+
+typedef struct {
+    int32_t trial_num;
+    int32_t error_code;
+    int32_t condition;
+    int32_t block;
+    uint64_t offset;        /* File position of the trial variable */
+    double start_time;      /* AbsoluteTrialStartTime (ms) */
+    double end_time;        /* Last code time, ms from trial start (NaN if none) */
+} trial_index_entry_t;
+
+typedef struct trial_index {
+    trial_index_entry_t *entries;
+    size_t count;
+    size_t capacity;
+} trial_index_t;
+
+/* Trial fields an entry is built from (for set_data_fields()) */
+extern const char *trial_index_fields[];
+
+/* Sidecar path for a data file (caller frees) */
+char* trial_index_path(const char *data_path);
+
+/* Empty index (NULL on allocation failure) */
+trial_index_t* trial_index_new(void);
+
+/* Free an index */
+void trial_index_free(trial_index_t *index);
+
+/* Append the current trial of file, read with at least trial_index_fields.
+ * Returns 0 on success, -1 on allocation failure.
+ */
+int trial_index_append(trial_index_t *index, ml_trial_file_t *file);
+
+/* Index every trial of file, ignoring its skips and filters; the file is
+ * rewound before and after. Returns NULL on read or allocation failure.
+ */
+trial_index_t* trial_index_build(ml_trial_file_t *file);
+
+/* Load the sidecar of data_path. Returns NULL if there is none, it is
+ * unreadable, or the data file changed since it was written.
+ */
+trial_index_t* trial_index_load(const char *data_path);
+
+/* Write the sidecar of data_path. Returns 0 on success, -1 on failure. */
+int trial_index_save(const trial_index_t *index, const char *data_path);
+
+#endif /* TRIAL_INDEX_H */
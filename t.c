@@ -0,0 +1,20 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "stats.h"
+static int cmp(const void*a,const void*b){double x=*(double*)a,y=*(double*)b;return (x>y)-(x<y);}
+int main(void){
+  int Ns[]={5,2048,2049,100000,1000000};
+  for(int t=0;t<5;t++){int N=Ns[t];
+    stats_quantiles_t *q=stats_quantiles_new(0), *a=stats_quantiles_new(0), *b=stats_quantiles_new(0);
+    double *v=malloc(N*sizeof(double)); srand(1);
+    for(int i=0;i<N;i++){v[i]=rand()/(double)RAND_MAX*1000; stats_quantiles_add(q,v[i]); stats_quantiles_add(i<N/3?a:b,v[i]);}
+    stats_quantiles_merge(a,b);
+    qsort(v,N,sizeof(double),cmp);
+    double qs[]={0.05,0.5,0.95};
+    for(int k=0;k<3;k++){double p=qs[k]*(N-1);int r=(int)p;double ex=v[r]+(p-r)*((r+1<N?v[r+1]:v[r])-v[r]);
+      printf("N=%d q=%.2f exact=%.4f sketch=%.4f merged=%.4f\n",N,qs[k],ex,stats_quantiles_get(q,qs[k]),stats_quantiles_get(a,qs[k]));}
+    FILE*f=tmpfile(); stats_quantiles_save(q,f); rewind(f); stats_quantiles_t*l=stats_quantiles_load(f);
+    printf("  load %s %.4f\n", l?"ok":"FAIL", l?stats_quantiles_get(l,0.5):0);
+  }
+}
@@ -0,0 +1,72 @@
+/*
+ * plugin_example.c - Example presto plugin (see src/presto_plugin.h)
+ *
+ * Build and run:
+ *   mkdir -p plugins
+ *   gcc -shared -fPIC -Isrc -o plugins/example.so tests/plugin_example.c
+ *   ./bin/presto --plugins plugins -M
+ *   ./bin/presto --plugins plugins -o100 data.bhv2
+ */
+
+#include <stdlib.h>
+#include "../src/presto_plugin.h"
+
+#define MAX_CONDITIONS 256
+
+typedef struct {
+    const presto_api_t *api;
+    int trials[MAX_CONDITIONS];
+    int correct[MAX_CONDITIONS];
+    double duration_sum[MAX_CONDITIONS];    /* Last code time, correct trials */
+} duration_state_t;
+
+static const char *duration_fields[] = { "BehavioralCodes.CodeTimes", NULL };
+
+static int duration_begin(void **state, const presto_api_t *api) {
+    duration_state_t *s = calloc(1, sizeof(duration_state_t));
+    if (!s) return -1;
+    s->api = api;
+    *state = s;
+    return 0;
+}
+
+static int duration_trial(void *state, const presto_trial_t *trial) {
+    duration_state_t *s = state;
+    if (trial->condition < 0 || trial->condition >= MAX_CONDITIONS) return 0;
+    s->trials[trial->condition]++;
+    if (trial->error != 0) return 0;
+
+    bhv2_value_t *codes = s->api->struct_get(trial->data, "BehavioralCodes", 0);
+    bhv2_value_t *times = s->api->struct_get(codes, "CodeTimes", 0);
+    if (times && times->total > 0) {
+        s->correct[trial->condition]++;
+        s->duration_sum[trial->condition] += s->api->get_double(times, times->total - 1);
+    }
+    return 0;
+}
+
+static void duration_end(void *state, macro_result_t *result) {
+    duration_state_t *s = state;
+    s->api->append(result, "Cond\tTrials\tCorrect\tMeanDuration(ms)\n");
+    for (int c = 0; c < MAX_CONDITIONS; c++) {
+        if (s->trials[c] == 0) continue;
+        s->api->appendf(result, "%d\t%d\t%d\t", c, s->trials[c], s->correct[c]);
+        if (s->correct[c] > 0) {
+            s->api->append_fixed(result, s->duration_sum[c] / s->correct[c], 1);
+        } else {
+            s->api->append(result, "-");
+        }
+        s->api->append(result, "\n");
+    }
+    free(s);
+}
+
+static const presto_macro_t example_macros[] = {
+    { "duration", "Correct-trial duration per condition (example plugin)", duration_fields,
+      duration_begin, duration_trial, duration_end },
+    { NULL, NULL, NULL, NULL, NULL, NULL }
+};
+
+const presto_macro_t* presto_plugin_macros(int abi) {
+    return abi == PRESTO_PLUGIN_ABI ? example_macros : NULL;
+}
@@ -0,0 +1,162 @@
+/*
+ * test_kernels.c - Check every supported SIMD kernel variant against scalar
+ *
+ * Runs the dispatched kernels under each variant up to kernel_isa_supported()
+ * over lengths that cover every remainder, unaligned starts and NaN/Inf/-0
+ * samples, and compares with the scalar results bit for bit (a min of 0
+ * and one of -0 differ). The filters and the moving average run over
+ * several window widths, resampling over several ratios, and the motion
+ * kernels treat x and y as a position trace. Exits 1 on a mismatch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../src/kernels.h"
+
+#define MAX_LEN 80
+#define PAD 8
+#define GRID 7
+#define N_PATTERNS 5
+
+/* FIR half-widths, and resampling ratios with their filter half-widths */
+static const size_t fir_halves[] = { 0, 1, 4, 9 };
+static const size_t ratios[][3] = { { 1, 1, 3 }, { 2, 1, 6 }, { 1, 3, 8 }, { 3, 2, 10 }, { 2, 3, 7 }, { 5, 4, 12 } };
+#define N_FIR (sizeof(fir_halves) / sizeof(fir_halves[0]))
+#define N_RATIOS (sizeof(ratios) / sizeof(ratios[0]))
+#define MAX_UP 5
+#define MAX_TAPS 25
+
+static int failures = 0;
+
+/* Same bits (so -0 and 0 differ), or both NaN */
+static int same(double a, double b) {
+    return memcmp(&a, &b, sizeof(a)) == 0 || (a != a && b != b);
+}
+
+static int same_all(const double *a, const double *b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (!same(a[i], b[i])) return 0;
+    }
+    return 1;
+}
+
+static void check(int ok, kernel_isa_t isa, const char *what, size_t n, size_t off, int pattern) {
+    if (ok) return;
+    if (failures++ < 20) {
+        fprintf(stderr, "%s: %s differs (n=%zu, offset=%zu, pattern=%d)\n",
+                kernel_isa_name(isa), what, n, off, pattern);
+    }
+}
+
+/* Fill x with pattern p: plain values, sprinkled specials, all specials,
+ * repeats, and zeros of both signs that tie for the min or the max */
+static void fill(double *x, size_t n, int p, unsigned seed) {
+    static const double specials[] = { NAN, INFINITY, -INFINITY, 0.0, -0.0 };
+    srand(seed);
+    double other = seed % 2 ? 0.5 : -0.5;
+    for (size_t i = 0; i < n; i++) {
+        x[i] = (rand() % 2001 - 1000) / 64.0;
+        if (p == 1 && rand() % 4 == 0) x[i] = specials[rand() % 5];
+        if (p == 2) x[i] = specials[rand() % 3];
+        if (p == 3) x[i] = (rand() % 3) * 0.5;   /* Many repeats for count_equal */
+        if (p == 4) x[i] = rand() % 4 == 0 ? other : specials[3 + rand() % 2];
+    }
+}
+
+typedef struct {
+    size_t nonfinite;
+    size_t equal;
+    double min, max;
+    uint32_t counts[GRID * GRID];
+    size_t added;
+    float single[MAX_LEN];
+    double fir[N_FIR][MAX_LEN];
+    double smoothed[N_FIR][MAX_LEN];
+    double speed[MAX_LEN];
+    double path;
+    size_t peak;
+    double resampled[N_RATIOS][MAX_LEN * MAX_UP];
+} results_t;
+
+static void run(const double *x, const double *y, size_t n, results_t *r) {
+    /* Conversion inputs that round, overflow and go subnormal in single */
+    static const double scales[] = { 1.0 / 3.0, 1e39, 3e-41, 1.0 };
+    double z[MAX_LEN];
+    for (size_t i = 0; i < n; i++) z[i] = x[i] * scales[i % 4];
+
+    double h[MAX_TAPS];
+    for (size_t k = 0; k < MAX_TAPS; k++) h[k] = 1.0 / (double)(k + 3) - 0.1;
+
+    r->nonfinite = kernel_count_nonfinite(x, n);
+    r->equal = kernel_count_equal(x, n, 0.5);
+    kernel_minmax(x, n, &r->min, &r->max);
+    memset(r->counts, 0, sizeof(r->counts));
+    r->added = kernel_hist2d(x, y, n, -12.0, -12.0, 0.3, GRID, GRID, r->counts);
+    kernel_double_to_single(z, n, r->single);
+    for (size_t f = 0; f < N_FIR; f++) {
+        kernel_fir_centered(x, n, h, fir_halves[f], r->fir[f]);
+        kernel_moving_average(x, n, fir_halves[f], r->smoothed[f]);
+    }
+    kernel_speed(x, y, n, 0.004, r->speed);
+    r->path = kernel_path_length(x, y, n);
+    r->peak = kernel_argmax(x, n);
+    for (size_t f = 0; f < N_RATIOS; f++) {
+        kernel_resample_poly(x, n, h, ratios[f][2], ratios[f][0], ratios[f][1], r->resampled[f]);
+    }
+}
+
+int main(void) {
+    double xbuf[MAX_LEN + PAD], ybuf[MAX_LEN + PAD];
+    kernel_isa_t best = kernel_isa_supported();
+
+    printf("Supported: %s\n", kernel_isa_name(best));
+
+    for (int isa = KERNEL_ISA_SSE2; isa <= (int)best; isa++) {
+        int before = failures;
+        for (int p = 0; p < N_PATTERNS; p++) {
+            for (size_t off = 0; off < PAD; off++) {
+                for (size_t n = 0; n <= MAX_LEN; n++) {
+                    double *x = xbuf + off, *y = ybuf + off;
+                    results_t want, got;
+                    fill(x, n, p, (unsigned)(n * 131 + off * 7 + p));
+                    fill(y, n, p, (unsigned)(n * 17 + off + p + 1));
+
+                    kernel_set_isa(KERNEL_ISA_SCALAR);
+                    run(x, y, n, &want);
+                    kernel_set_isa((kernel_isa_t)isa);
+                    run(x, y, n, &got);
+
+                    check(got.nonfinite == want.nonfinite, isa, "count_nonfinite", n, off, p);
+                    check(got.equal == want.equal, isa, "count_equal", n, off, p);
+                    check(same(got.min, want.min) && same(got.max, want.max), isa, "minmax", n, off, p);
+                    check(got.added == want.added
+                          && memcmp(got.counts, want.counts, sizeof(got.counts)) == 0,
+                          isa, "hist2d", n, off, p);
+                    check(memcmp(got.single, want.single, n * sizeof(float)) == 0,
+                          isa, "double_to_single", n, off, p);
+                    for (size_t f = 0; f < N_FIR; f++) {
+                        check(same_all(got.fir[f], want.fir[f], n), isa, "fir_centered", n, off, p);
+                        check(same_all(got.smoothed[f], want.smoothed[f], n), isa, "moving_average", n, off, p);
+                    }
+                    check(same_all(got.speed, want.speed, n), isa, "speed", n, off, p);
+                    check(same(got.path, want.path), isa, "path_length", n, off, p);
+                    check(got.peak == want.peak, isa, "argmax", n, off, p);
+                    for (size_t f = 0; f < N_RATIOS; f++) {
+                        size_t len = kernel_resample_length(n, ratios[f][0], ratios[f][1]);
+                        check(same_all(got.resampled[f], want.resampled[f], len),
+                              isa, "resample_poly", n, off, p);
+                    }
+                }
+            }
+        }
+        printf("%s: %s\n", kernel_isa_name((kernel_isa_t)isa), failures > before ? "FAIL" : "ok");
+    }
+
+    if (failures) {
+        fprintf(stderr, "%d mismatches\n", failures);
+        return 1;
+    }
+    return 0;
+}
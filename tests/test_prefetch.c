@@ -0,0 +1,184 @@
+/*
+ * test_prefetch.c - Decoding ahead must return what a serial read returns
+ *
+ * Copies a BHV2 file, writes a fresh sidecar index for the copy, then
+ * breaks the trial in the middle (its type name) while keeping the file's
+ * size and mtime, so the index still counts as fresh and the prefetch
+ * workers run into the bad trial. Reads the copy in place and with 4
+ * workers and compares the trials returned and the final status: both
+ * must hand out every trial before the broken one and then fail. A
+ * SKIP_DATA kernel, which needs only what the index holds, must see the
+ * same trials either way: those before the broken one.
+ */
+
+#define _POSIX_C_SOURCE 200809L  /* For utimensat */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../src/ml_trial.h"
+#include "../src/trial_index.h"
+
+#define MAX_TRIALS 100000
+
+typedef struct {
+    int trial_num[MAX_TRIALS];
+    int condition[MAX_TRIALS];
+    uint64_t total[MAX_TRIALS];     /* Elements in the trial's first field */
+    size_t count;
+    int status;                     /* Last read_next_trial() return */
+} pass_t;
+
+static int copy_file(const char *from, const char *to) {
+    FILE *in = fopen(from, "rb");
+    FILE *out = in ? fopen(to, "wb") : NULL;
+    char buf[1 << 16];
+    size_t n;
+    int ok = in && out;
+    while (ok && (n = fread(buf, 1, sizeof(buf), in)) > 0) ok = fwrite(buf, 1, n, out) == n;
+    if (in) fclose(in);
+    if (out && fclose(out) != 0) ok = 0;
+    return ok ? 0 : -1;
+}
+
+/* Index the copy, then break the type name of the middle trial */
+static int corrupt_middle_trial(const char *path, int *broken) {
+    ml_trial_file_t *file = open_input_file(path);
+    trial_index_t *index = file ? trial_index_build(file) : NULL;
+    if (file) close_input_file(file);
+    if (!index || index->count < 3 || trial_index_save(index, path) != 0) {
+        trial_index_free(index);
+        return -1;
+    }
+    const trial_index_entry_t *e = &index->entries[index->count / 2];
+    *broken = e->trial_num;
+
+    /* Variable: uint64 name length, name, uint64 type length, type */
+    struct stat st;
+    FILE *fp = fopen(path, "r+b");
+    uint64_t name_len;
+    int ok = fp && stat(path, &st) == 0
+        && fseek(fp, (long)e->offset, SEEK_SET) == 0
+        && fread(&name_len, sizeof(name_len), 1, fp) == 1
+        && fseek(fp, (long)(name_len + sizeof(uint64_t)), SEEK_CUR) == 0
+        && fputc('?', fp) != EOF;
+    if (fp && fclose(fp) != 0) ok = 0;
+    trial_index_free(index);
+
+    struct timespec times[2] = { st.st_atim, st.st_mtim };
+    return ok && utimensat(AT_FDCWD, path, times, 0) == 0 ? 0 : -1;
+}
+
+/* SKIP_DATA kernel counting the trials it sees */
+static void* count_create(void *ctx) {
+    (void)ctx;
+    return calloc(1, sizeof(size_t));
+}
+
+static int count_trial(void *acc, const trial_view_t *trial, void *ctx) {
+    (void)trial;
+    (void)ctx;
+    (*(size_t*)acc)++;
+    return 0;
+}
+
+static int count_merge(void *acc, void *later, void *ctx) {
+    (void)ctx;
+    *(size_t*)acc += *(size_t*)later;
+    return 0;
+}
+
+static const trial_kernel_t count_kernel = {
+    .read_flag = SKIP_DATA,
+    .create = count_create,
+    .trial = count_trial,
+    .merge = count_merge,
+    .destroy = free
+};
+
+/* Trials the kernel saw, or -1 if the run failed */
+static long kernel_pass(const char *path, sched_t *sched) {
+    ml_trial_file_t *file = open_input_file(path);
+    if (!file) return -2;
+    set_scheduler(file, sched);
+    void *acc;
+    long seen = run_trial_kernel(file, &count_kernel, NULL, &acc) == 0 ? (long)*(size_t*)acc : -1;
+    if (seen >= 0) free(acc);
+    close_input_file(file);
+    return seen;
+}
+
+static int read_pass(const char *path, sched_t *sched, pass_t *pass) {
+    ml_trial_file_t *file = open_input_file(path);
+    if (!file) return -1;
+    set_scheduler(file, sched);
+    pass->count = 0;
+    while ((pass->status = read_next_trial(file, WITH_DATA)) > 0 && pass->count < MAX_TRIALS) {
+        bhv2_value_t *data = trial_data(file);
+        bhv2_value_t *first = data && data->dtype == MATLAB_STRUCT && data->data.struct_array.n_fields > 0
+                              ? data->data.struct_array.fields[0].value : NULL;
+        pass->trial_num[pass->count] = trial_number(file);
+        pass->condition[pass->count] = trial_condition(file);
+        pass->total[pass->count] = first ? first->total : 0;
+        pass->count++;
+    }
+    close_input_file(file);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <file.bhv2>\n", argv[0]);
+        return 1;
+    }
+
+    char path[] = "/tmp/test_prefetch_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+
+    int broken = 0;
+    if (copy_file(argv[1], path) != 0 || corrupt_middle_trial(path, &broken) != 0) {
+        fprintf(stderr, "Cannot prepare a corrupted copy of %s\n", argv[1]);
+        remove(path);
+        return 1;
+    }
+    printf("Broke trial %d\n", broken);
+
+    static pass_t serial, parallel;
+    sched_t *sched = sched_new(4);
+    int failed = !sched || read_pass(path, NULL, &serial) != 0 || read_pass(path, sched, &parallel) != 0;
+    long kernel_serial = failed ? -2 : kernel_pass(path, NULL);
+    long kernel_parallel = failed ? -2 : kernel_pass(path, sched);
+    sched_free(sched);
+
+    char *index_path = trial_index_path(path);
+    if (index_path) remove(index_path);
+    free(index_path);
+    remove(path);
+    if (failed) {
+        fprintf(stderr, "Cannot read the copy\n");
+        return 1;
+    }
+
+    printf("Serial: %zu trials, status %d\n", serial.count, serial.status);
+    printf("4 workers: %zu trials, status %d\n", parallel.count, parallel.status);
+    printf("SKIP_DATA kernel: %ld trials serial, %ld with 4 workers\n", kernel_serial, kernel_parallel);
+
+    int ok = serial.count == parallel.count && serial.status == parallel.status && serial.status < 0
+          && serial.count > 0 && serial.trial_num[serial.count - 1] == broken - 1;
+    /* The kernel stops at the broken trial whichever way it is read */
+    ok = ok && kernel_serial == (long)serial.count && kernel_parallel == (long)serial.count;
+    for (size_t i = 0; ok && i < serial.count; i++) {
+        ok = serial.trial_num[i] == parallel.trial_num[i] && serial.condition[i] == parallel.condition[i]
+          && serial.total[i] == parallel.total[i];
+    }
+    printf("%s\n", ok ? "ok" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,393 @@
+/*
+ * test_stats.c - Check the streaming estimators against direct computation
+ *
+ * Feeds each estimator in stats.h a known sample and compares with the
+ * sorted sample: quantiles exact up to k values and within the rank error
+ * bound past it, estimators built over two halves and merged against one
+ * pass, save/load round trips, and log-histogram quantiles over values
+ * <= 0 and over many powers of two. Exits 1 on a mismatch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../src/stats.h"
+
+#define N_BIG 100000
+#define K_SMALL 200
+
+static const double qs_checked[] = { 0.0, 0.01, 0.05, 0.25, 0.5, 0.75, 0.9, 0.95, 0.99, 1.0 };
+#define N_Q (sizeof(qs_checked) / sizeof(qs_checked[0]))
+
+static int failures = 0;
+
+static void check(int ok, const char *what, size_t n, double q) {
+    if (ok) return;
+    if (failures++ < 20) {
+        fprintf(stderr, "%s differs (n=%zu, q=%g)\n", what, n, q);
+    }
+}
+
+static int compare_double(const void *a, const void *b) {
+    double da = *(const double*)a, db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+/* Quantile of sorted[0..n) interpolated like numpy's default */
+static double exact_quantile(const double *sorted, size_t n, double q) {
+    double p = q * (double)(n - 1);
+    size_t r = (size_t)p;
+    double frac = p - (double)r;
+    double a = sorted[r], b = r + 1 < n ? sorted[r + 1] : a;
+    return a + frac * (b - a);
+}
+
+/* Values with repeats and both signs */
+static void fill(double *x, size_t n, unsigned seed) {
+    srand(seed);
+    for (size_t i = 0; i < n; i++) {
+        x[i] = (rand() % 4001 - 2000) / 8.0;
+    }
+}
+
+/* 0..n-1 in random order, so a value is its own rank */
+static void fill_ranks(double *x, size_t n, unsigned seed) {
+    srand(seed);
+    for (size_t i = 0; i < n; i++) x[i] = (double)i;
+    for (size_t i = n - 1; i > 0; i--) {
+        size_t j = (size_t)rand() % (i + 1);
+        double t = x[i];
+        x[i] = x[j];
+        x[j] = t;
+    }
+}
+
+/************************************************************/
+/* Quantile sketch
+ */
+/************************************************************/
+
+static stats_quantiles_t* sketch(const double *x, size_t n, size_t k) {
+    stats_quantiles_t *qs = stats_quantiles_new(k);
+    for (size_t i = 0; qs && i < n; i++) {
+        if (stats_quantiles_add(qs, x[i]) != 0) {
+            stats_quantiles_free(qs);
+            return NULL;
+        }
+    }
+    return qs;
+}
+
+/* Up to k values every quantile is exact, split and merged or not */
+static void test_quantiles_exact(void) {
+    static double x[STATS_QUANTILES_DEFAULT_K], sorted[STATS_QUANTILES_DEFAULT_K];
+    static const size_t sizes[] = { 1, 2, 3, 10, 101, 1000, STATS_QUANTILES_DEFAULT_K };
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t n = sizes[s];
+        fill(x, n, (unsigned)n);
+        memcpy(sorted, x, n * sizeof(double));
+        qsort(sorted, n, sizeof(double), compare_double);
+
+        stats_quantiles_t *one = sketch(x, n, 0);
+        stats_quantiles_t *first = sketch(x, n / 3, 0);
+        stats_quantiles_t *second = sketch(x + n / 3, n - n / 3, 0);
+        if (!one || !first || !second || stats_quantiles_merge(first, second) != 0) {
+            check(0, "quantiles (allocation)", n, 0.0);
+        } else {
+            check(stats_quantiles_count(one) == n && stats_quantiles_count(first) == n, "quantile count", n, 0.0);
+            for (size_t i = 0; i < N_Q; i++) {
+                double want = exact_quantile(sorted, n, qs_checked[i]);
+                check(stats_quantiles_get(one, qs_checked[i]) == want, "exact quantile", n, qs_checked[i]);
+                check(stats_quantiles_get(first, qs_checked[i]) == want, "merged exact quantile", n, qs_checked[i]);
+            }
+        }
+        stats_quantiles_free(one);
+        stats_quantiles_free(first);
+        stats_quantiles_free(second);
+    }
+
+    /* NaN/Inf are left out; an empty sketch gives NaN */
+    stats_quantiles_t *qs = stats_quantiles_new(0);
+    if (qs) {
+        check(isnan(stats_quantiles_get(qs, 0.5)), "empty quantile", 0, 0.5);
+        stats_quantiles_add(qs, NAN);
+        stats_quantiles_add(qs, INFINITY);
+        stats_quantiles_add(qs, 2.0);
+        check(stats_quantiles_count(qs) == 1 && stats_quantiles_get(qs, 0.5) == 2.0, "quantile of finite", 1, 0.5);
+    }
+    stats_quantiles_free(qs);
+}
+
+/* Past k, the value returned for q has rank within the documented
+ * 1.7 / k of the count of q * (n - 1), in one pass or merged from chunks */
+static void test_quantiles_bound(void) {
+    static double x[N_BIG];
+    double bound = 1.7 / K_SMALL * N_BIG;
+
+    for (unsigned seed = 1; seed <= 5; seed++) {
+        fill_ranks(x, N_BIG, seed);
+        stats_quantiles_t *one = sketch(x, N_BIG, K_SMALL);
+
+        /* Uneven chunks, merged in order like the -j kernels do */
+        static const size_t cuts[] = { 0, 7, 1000, 33333, 60000, 99999, N_BIG };
+        stats_quantiles_t *merged = stats_quantiles_new(K_SMALL);
+        for (size_t c = 0; merged && c + 1 < sizeof(cuts) / sizeof(cuts[0]); c++) {
+            stats_quantiles_t *part = sketch(x + cuts[c], cuts[c + 1] - cuts[c], K_SMALL);
+            if (!part || stats_quantiles_merge(merged, part) != 0) {
+                stats_quantiles_free(merged);
+                merged = NULL;
+            }
+            stats_quantiles_free(part);
+        }
+
+        if (!one || !merged) {
+            check(0, "quantile bound (allocation)", N_BIG, 0.0);
+        } else {
+            check(stats_quantiles_count(merged) == N_BIG, "merged quantile count", N_BIG, 0.0);
+            for (size_t i = 0; i < N_Q; i++) {
+                double want = qs_checked[i] * (N_BIG - 1);
+                check(fabs(stats_quantiles_get(one, qs_checked[i]) - want) <= bound,
+                      "quantile rank error", N_BIG, qs_checked[i]);
+                check(fabs(stats_quantiles_get(merged, qs_checked[i]) - want) <= bound,
+                      "merged quantile rank error", N_BIG, qs_checked[i]);
+            }
+            /* The ends are kept exactly */
+            check(stats_quantiles_get(one, 0.0) == 0.0 && stats_quantiles_get(one, 1.0) == N_BIG - 1,
+                  "quantile min/max", N_BIG, 0.0);
+        }
+        stats_quantiles_free(one);
+        stats_quantiles_free(merged);
+    }
+}
+
+/* A loaded sketch answers like the saved one, and goes on like it */
+static void test_quantiles_save(void) {
+    static double x[N_BIG];
+    static const size_t sizes[] = { 0, 1, 500, N_BIG / 2 };
+    fill_ranks(x, N_BIG, 9);
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t n = sizes[s];
+        stats_quantiles_t *qs = sketch(x, n, K_SMALL), *loaded = NULL;
+        FILE *fp = tmpfile();
+        if (qs && fp && stats_quantiles_save(qs, fp) == 0) {
+            rewind(fp);
+            loaded = stats_quantiles_load(fp);
+        }
+        if (fp) fclose(fp);
+
+        int ok = qs && loaded && stats_quantiles_count(loaded) == n;
+        for (size_t i = n; ok && i < N_BIG; i++) {
+            ok = stats_quantiles_add(qs, x[i]) == 0 && stats_quantiles_add(loaded, x[i]) == 0;
+        }
+        check(ok, "quantile save/load", n, 0.0);
+        for (size_t i = 0; ok && i < N_Q; i++) {
+            check(stats_quantiles_get(loaded, qs_checked[i]) == stats_quantiles_get(qs, qs_checked[i]),
+                  "loaded quantile", n, qs_checked[i]);
+        }
+        stats_quantiles_free(qs);
+        stats_quantiles_free(loaded);
+    }
+}
+
+/************************************************************/
+/* Moments and histograms
+ */
+/************************************************************/
+
+static int close_to(double a, double b) {
+    return fabs(a - b) <= 1e-12 * fmax(1.0, fabs(b));
+}
+
+static void test_moments(void) {
+    static double x[N_BIG];
+    fill(x, N_BIG, 3);
+    x[10] = NAN;
+    x[20] = -INFINITY;
+
+    /* Two-pass reference over the finite values */
+    double sum = 0.0, lo = INFINITY, hi = -INFINITY;
+    size_t n = 0;
+    for (size_t i = 0; i < N_BIG; i++) {
+        if (!isfinite(x[i])) continue;
+        sum += x[i];
+        lo = fmin(lo, x[i]);
+        hi = fmax(hi, x[i]);
+        n++;
+    }
+    double mean = sum / (double)n, ss = 0.0;
+    for (size_t i = 0; i < N_BIG; i++) {
+        if (isfinite(x[i])) ss += (x[i] - mean) * (x[i] - mean);
+    }
+    double variance = ss / (double)(n - 1);
+
+    stats_moments_t one = {0}, first = {0}, second = {0}, loaded = {0};
+    for (size_t i = 0; i < N_BIG; i++) stats_moments_add(&one, x[i]);
+    for (size_t i = 0; i < N_BIG / 4; i++) stats_moments_add(&first, x[i]);
+    for (size_t i = N_BIG / 4; i < N_BIG; i++) stats_moments_add(&second, x[i]);
+    stats_moments_merge(&first, &second);
+
+    const stats_moments_t *all[] = { &one, &first };
+    for (int m = 0; m < 2; m++) {
+        check(all[m]->n == n && all[m]->min == lo && all[m]->max == hi, "moments count/range", n, 0.0);
+        check(close_to(all[m]->mean, mean), "moments mean", n, 0.0);
+        check(close_to(stats_moments_variance(all[m]), variance), "moments variance", n, 0.0);
+        check(close_to(stats_moments_sd(all[m]), sqrt(variance)), "moments sd", n, 0.0);
+    }
+
+    FILE *fp = tmpfile();
+    int ok = fp && stats_moments_save(&one, fp) == 0;
+    if (ok) rewind(fp);
+    ok = ok && stats_moments_load(&loaded, fp) == 0;
+    if (fp) fclose(fp);
+    check(ok && memcmp(&one, &loaded, sizeof(one)) == 0, "moments save/load", n, 0.0);
+
+    stats_moments_t single = {0};
+    stats_moments_add(&single, 4.0);
+    check(isnan(stats_moments_variance(&single)), "variance of one value", 1, 0.0);
+}
+
+static void test_hist(void) {
+    static double x[N_BIG];
+    fill(x, N_BIG, 4);
+    x[5] = NAN;
+
+    stats_hist_t *one = stats_hist_new(-100.0, 100.0, 40);
+    stats_hist_t *first = stats_hist_new(-100.0, 100.0, 40);
+    stats_hist_t *second = stats_hist_new(-100.0, 100.0, 40);
+    stats_hist_t *other = stats_hist_new(-100.0, 100.0, 41);
+    stats_hist_t *loaded = NULL;
+    if (!one || !first || !second || !other) {
+        check(0, "hist (allocation)", 0, 0.0);
+    } else {
+        uint64_t below = 0, above = 0, bin7 = 0;
+        for (size_t i = 0; i < N_BIG; i++) {
+            stats_hist_add(one, x[i]);
+            stats_hist_add(i % 3 ? first : second, x[i]);
+            below += x[i] < -100.0;
+            above += x[i] >= 100.0;
+            bin7 += x[i] >= -65.0 && x[i] < -60.0;
+        }
+        check(stats_hist_merge(first, second) == 0 && stats_hist_merge(first, other) == -1, "hist merge", N_BIG, 0.0);
+        check(one->below == below && one->above == above && one->nonfinite == 1 && one->counts[7] == bin7
+              && stats_hist_total(one) == N_BIG, "hist counts", N_BIG, 0.0);
+        check(memcmp(one->counts, first->counts, 40 * sizeof(uint64_t)) == 0 && first->below == below
+              && first->above == above && stats_hist_total(first) == N_BIG, "merged hist", N_BIG, 0.0);
+
+        FILE *fp = tmpfile();
+        if (fp && stats_hist_save(one, fp) == 0) {
+            rewind(fp);
+            loaded = stats_hist_load(fp);
+        }
+        if (fp) fclose(fp);
+        check(loaded && loaded->lo == one->lo && loaded->hi == one->hi && loaded->n_bins == one->n_bins
+              && memcmp(loaded->counts, one->counts, 40 * sizeof(uint64_t)) == 0
+              && stats_hist_total(loaded) == N_BIG && loaded->below == below, "hist save/load", N_BIG, 0.0);
+    }
+    stats_hist_free(one);
+    stats_hist_free(first);
+    stats_hist_free(second);
+    stats_hist_free(other);
+    stats_hist_free(loaded);
+}
+
+/************************************************************/
+/* Log-bucketed histogram
+ */
+/************************************************************/
+
+/* The quantile is the middle of the bucket holding the value at rank
+ * round(q * (n - 1)): within half a bucket (value / (2 sub)) of it, and 0
+ * for a value <= 0 */
+static int loghist_ok(const stats_loghist_t *h, const double *sorted, size_t n, double q) {
+    double want = sorted[(size_t)llround(q * (double)(n - 1))];
+    double got = stats_loghist_quantile(h, q);
+    if (want <= 0.0) return got == 0.0;
+    return fabs(got - want) <= want / (2.0 * h->sub) * (1.0 + 1e-12);
+}
+
+static void test_loghist(void) {
+    /* From 2^-30 to 2^30, zeros and negatives, and exact powers of two */
+    enum { N = 20000 };
+    static double x[N], sorted[N];
+    srand(5);
+    for (size_t i = 0; i < N; i++) {
+        switch (i % 8) {
+            case 0: x[i] = -(double)(rand() % 1000); break;
+            case 1: x[i] = 0.0; break;
+            case 2: x[i] = ldexp(1.0, rand() % 61 - 30); break;
+            default: x[i] = ldexp(1.0 + rand() / (RAND_MAX + 1.0), rand() % 61 - 30); break;
+        }
+    }
+    memcpy(sorted, x, sizeof(x));
+    qsort(sorted, N, sizeof(double), compare_double);
+
+    static const int subs[] = { 0, 1, 3, 16, 100 };
+    for (size_t s = 0; s < sizeof(subs) / sizeof(subs[0]); s++) {
+        stats_loghist_t *one = stats_loghist_new(subs[s]);
+        stats_loghist_t *first = stats_loghist_new(subs[s]);
+        stats_loghist_t *second = stats_loghist_new(subs[s]);
+        stats_loghist_t *loaded = NULL;
+        int ok = one && first && second && stats_loghist_add(one, NAN) == 0;
+        /* The halves cover different ranges, so the merge has to grow */
+        for (size_t i = 0; ok && i < N; i++) {
+            ok = stats_loghist_add(one, x[i]) == 0
+              && stats_loghist_add(x[i] < 1.0 ? first : second, x[i]) == 0;
+        }
+        ok = ok && stats_loghist_merge(first, second) == 0;
+        check(ok, "loghist (allocation)", N, 0.0);
+
+        FILE *fp = ok ? tmpfile() : NULL;
+        if (fp && stats_loghist_save(one, fp) == 0) {
+            rewind(fp);
+            loaded = stats_loghist_load(fp);
+        }
+        if (fp) fclose(fp);
+        check(!ok || loaded, "loghist save/load", N, 0.0);
+
+        for (size_t i = 0; ok && loaded && i < N_Q; i++) {
+            double q = qs_checked[i];
+            check(loghist_ok(one, sorted, N, q), "loghist quantile", N, q);
+            check(stats_loghist_quantile(first, q) == stats_loghist_quantile(one, q), "merged loghist quantile", N, q);
+            check(stats_loghist_quantile(loaded, q) == stats_loghist_quantile(one, q), "loaded loghist quantile", N, q);
+        }
+        /* Ranks across the whole sample, so most buckets' middles are checked */
+        for (size_t r = 0; ok && r < N; r += 7) {
+            double q = (double)r / (N - 1);
+            check(loghist_ok(one, sorted, N, q), "loghist quantile", N, q);
+        }
+        check(!ok || (one->n == N && one->nonfinite == 1 && first->n == N && loaded->n == N),
+              "loghist counts", N, 0.0);
+
+        stats_loghist_free(one);
+        stats_loghist_free(first);
+        stats_loghist_free(second);
+        stats_loghist_free(loaded);
+    }
+
+    stats_loghist_t *a = stats_loghist_new(4), *b = stats_loghist_new(8);
+    if (a && b) {
+        check(isnan(stats_loghist_quantile(a, 0.5)), "empty loghist", 0, 0.5);
+        check(stats_loghist_merge(a, b) == -1, "loghist merge of different buckets", 0, 0.0);
+    }
+    stats_loghist_free(a);
+    stats_loghist_free(b);
+}
+
+int main(void) {
+    test_quantiles_exact();
+    test_quantiles_bound();
+    test_quantiles_save();
+    test_moments();
+    test_hist();
+    test_loghist();
+
+    if (failures) {
+        fprintf(stderr, "%d mismatches\n", failures);
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}